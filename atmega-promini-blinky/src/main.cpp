@@ -1,4 +1,6 @@
 #include <Arduino.h>
+#include <FastPin.h>
+#include <Probe.h>
 
 #define PIN_LED LED_BUILTIN
 
@@ -11,11 +13,11 @@
 static uint8_t ledState = LOW;
 
 void initLed() {
-  pinMode(PIN_LED, OUTPUT);
+  FastPin<PIN_LED>::output();
 }
 
 void updateLedState() {
-  digitalWrite(PIN_LED, ledState);
+  FastPin<PIN_LED>::write(ledState);
 }
 
 void toggleLedState() {
@@ -29,8 +31,10 @@ void setup() {
 }
 
 void loop() {
+  PROBE_BEGIN(PROBE_LOOP);
   updateLedState();
   toggleLedState();
+  PROBE_END(PROBE_LOOP);
 
   delay(BLINK_PERIOD);
 }
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Polar distance map filled by sweeping the sonar on the servo.
+//
+// 0..180 degrees is cut into BINS slices, one byte of range (cm) each, so
+// 32 bins take 32 bytes. The sweep goes back and forth: bin() says where
+// to point the sensor, update() stores the range measured there and steps
+// to the next bin, one bin per echo cycle. A pass ends at either end, the
+// next one comes back over the others, BINS - 1 cycles each.
+//
+// The nearest obstacle is kept as the map changes, so nearest() and
+// nearestBin() are a read. update() only looks at the other bins when the
+// nearest one itself got farther, BINS compares then.
+//
+// Ranges are 1..254cm, SCAN_NONE is no echo (out of range) or not
+// measured yet. A second sensor facing another way would feed its own
+// bins with set().
+
+#define SCAN_NONE 0xff
+#define SCAN_NO_BIN 0xff
+
+template <uint8_t BINS>
+class ScanMap {
+  static_assert(BINS >= 2 && BINS < SCAN_NO_BIN, "ScanMap: 2..254 bins");
+
+public:
+  static const uint8_t bins = BINS;
+
+  ScanMap() {
+    memset(cm, SCAN_NONE, sizeof(cm));
+  }
+
+  // servo angle of the middle of a bin (degrees)
+  static uint8_t angle(const uint8_t bin) {
+    return (uint16_t)(2 * bin + 1) * 90 / BINS;
+  }
+
+  // bin to measure next
+  uint8_t bin() const {
+    return current;
+  }
+
+  // range measured at bin(), then on to the next bin, true at the end of a pass
+  bool update(const uint32_t now, const uint8_t range) {
+    set(current, range);
+
+    bool end = up ? current == BINS - 1 : current == 0;
+    if (end) {
+      up = !up;
+      if (passes) {
+        passTime = now - passTs;
+      }
+      passTs = now;
+      passes++;
+    }
+    current += up ? 1 : -1;
+    return end;
+  }
+
+  void set(const uint8_t bin, const uint8_t range) {
+    uint8_t last = cm[bin];
+    cm[bin] = range == 0 ? 1 : range;
+
+    if (nearBin == SCAN_NO_BIN || cm[bin] < cm[nearBin]) {
+      if (cm[bin] != SCAN_NONE) {
+        nearBin = bin;
+      }
+    } else if (bin == nearBin && cm[bin] > last) {
+      findNearest();
+    }
+  }
+
+  uint8_t range(const uint8_t bin) const {
+    return cm[bin];
+  }
+
+  const uint8_t *ranges() const {
+    return cm;
+  }
+
+  // closest range in the map (cm), SCAN_NONE if nothing in range
+  uint8_t nearest() const {
+    return nearBin == SCAN_NO_BIN ? SCAN_NONE : cm[nearBin];
+  }
+
+  // bin of it, SCAN_NO_BIN if none
+  uint8_t nearestBin() const {
+    return nearBin;
+  }
+
+  // counters since start
+  uint16_t passes = 0;
+  // time of the last full pass (us)
+  uint32_t passTime = 0;
+
+private:
+  uint8_t cm[BINS];
+  uint8_t current = 0;
+  bool up = true;
+  uint8_t nearBin = SCAN_NO_BIN;
+  uint32_t passTs = 0;
+
+  void findNearest() {
+    nearBin = SCAN_NO_BIN;
+    uint8_t best = SCAN_NONE;
+    for (uint8_t i = 0; i < BINS; i++) {
+      if (cm[i] < best) {
+        best = cm[i];
+        nearBin = i;
+      }
+    }
+  }
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastPin.h>
+
+// HC-SR04 ranging state machine.
+//
+// trigger() fires a probe and returns right away, the echo pin interrupt
+// calls handleEdge() which completes the measurement, loop() collects it with
+// poll(). A probe that gets no echo in time counts as a miss so the next
+// one can go out. Nothing here waits for the sensor.
+//
+// The isr only writes echoWidth before moving to DONE and nothing touches it
+// again until poll() takes it back to IDLE, so it can't be read torn. Echo
+// times are 16 bit, the timeout keeps widths well below the 65ms wrap.
+
+// max echo we wait for (us), ~5m range, sensor gives up at ~38ms
+#define SONAR_TIMEOUT 30000UL
+
+template <uint8_t TRIGGER_PIN>
+class Sonar {
+public:
+  enum state_t {
+    IDLE,      // ready for a probe
+    TRIGGERED, // probe sent, waiting for echo start
+    ECHO,      // echo started, waiting for end
+    DONE       // measurement ready for poll()
+  };
+
+  // send a probe unless one is still in flight, returns true if sent
+  bool trigger(const uint32_t now) {
+    if (state != IDLE) {
+      return false;
+    }
+
+    triggerTs = now;
+    state = TRIGGERED;
+
+    FastPin<TRIGGER_PIN>::high();
+    delayMicroseconds(10);
+    FastPin<TRIGGER_PIN>::low();
+
+    return true;
+  }
+
+  // call from echo pin change interrupt, now is micros() truncated
+  void handleEdge(const uint8_t echoState, const uint16_t now) {
+    if (echoState == 1) {
+      if (state == TRIGGERED) {
+        echoStart = now;
+        state = ECHO;
+      }
+    } else if (state == ECHO) {
+      echoWidth = now - echoStart;
+      state = DONE;
+    }
+  }
+
+  // returns true once per completed measurement, times out lost probes
+  bool poll(const uint32_t now, uint16_t &width) {
+    uint8_t curState = state;
+
+    if (curState == DONE) {
+      width = echoWidth;
+      state = IDLE;
+      measurements++;
+      return true;
+    }
+
+    if (curState != IDLE && now - triggerTs > SONAR_TIMEOUT) {
+      // interrupts off so a late edge can't complete it meanwhile
+      noInterrupts();
+      if (state != DONE) {
+        state = IDLE;
+        misses++;
+      }
+      interrupts();
+    }
+
+    return false;
+  }
+
+  // counters since start
+  uint16_t measurements = 0;
+  uint16_t misses = 0;
+
+private:
+  volatile uint8_t state = IDLE;
+  volatile uint16_t echoStart = 0;
+  volatile uint16_t echoWidth = 0;
+  uint32_t triggerTs = 0;
+};
@@ -1,147 +1,283 @@
 #include <Arduino.h>
 #include <EnableInterrupt.h>
-#include <Servo.h>
+#include <FastPin.h>
+#include <Filters.h>
+#include <Probe.h>
+#include <Scheduler.h>
+#include <ServoDriver.h>
+#include <Sonar.h>
 
 //#define DEBUG
+//#define SERVO_SWEEP
+// servo sweeps the sonar over a distance map, sent as telemetry
+//#define SONAR_SCAN
+
+#ifdef SONAR_SCAN
+#include <ScanMap.h>
+#include <Telemetry.h>
+#define SERIAL_BAUD 115200
+#else
+#define SERIAL_BAUD 9600
+#endif
 
 #define SONIC_TRIGGER 7
 #define SONIC_ECHO 8
 
-#define SERVO 9
+#define SERVO 9 // OC1A, pulses from Timer1
 #define LED_1 10
 #define LED_2 11
 
 //
 
-Servo servo;
+static TimerServo<SERVO> servo;
 
-volatile uint32_t sonicEchoStart = 0;
-volatile uint32_t sonicEchoStop = 0;
-volatile uint32_t sonicPulseWidth = 0;
+// power up sweep, then to the start angle
+static const uint8_t servoSweep[] PROGMEM = {0, 180, 90};
+// pulse change per output task, 1 degree per 5ms as the old sweep loop
+#define SERVO_SWEEP_STEP 41
+
+static Sonar<SONIC_TRIGGER> sonar;
 
 void sonicInterrupt() {
-  uint32_t now = micros();
-
-  uint8_t echoPin = digitalRead(SONIC_ECHO);
-  if (echoPin == 1) {
-    sonicEchoStart = now;
-    //sonicWidth = 0;
-  } else {
-    sonicEchoStop = now;
-    if (sonicEchoStart != 0) {
-      sonicPulseWidth = sonicEchoStop - sonicEchoStart;
-    }
-  }
+  PROBE_BEGIN(PROBE_ISR_1);
+  uint16_t now = micros();
+
+  uint8_t echoPin = FastPin<SONIC_ECHO>::read();
+  sonar.handleEdge(echoPin, now);
+  PROBE_END(PROBE_ISR_1);
 }
 
 //
 
 static uint8_t servoAngle = 180;
-static uint32_t sonicDistance = 255;
+static uint16_t sonicDistance = 255; // mm
 
-void setup() {
-#ifdef DEBUG
-  Serial.begin(9600);
-  Serial.println("Initializing...");
-#endif
+// averaging window, one new sample per sonic cycle: 240ms. The old 16 were
+// loop passes ~5ms apart re-reading the last echo, 1-2 real samples
+#define SONIC_PULSE_BUFFER_SIZE 4
+// sum of 4 distances in mm fits 16 bits (max range ~6.5m)
+static MovingAverage<uint16_t, uint16_t, SONIC_PULSE_BUFFER_SIZE> sonicPulseFilter;
 
-  pinMode(LED_BUILTIN, OUTPUT);
+// when last probe got no echo
+static uint32_t sonicMissTs = 0;
 
-  pinMode(SERVO, OUTPUT);
-  pinMode(LED_1, OUTPUT);
-  pinMode(LED_2, OUTPUT);
+// sensor wants ~60ms between probes so echoes of the last one die out
+#define SONIC_CYCLE 60000UL
 
-  // 
+// average lags the input by half its window
+#define SONIC_FILTER_LATENCY ((SONIC_PULSE_BUFFER_SIZE - 1) * SONIC_CYCLE / 2)
 
-  servo.attach(SERVO);
-  // sweep at init
-#if 0
-  for (int i = 90; i >= 0; i--) {
-    servo.write(i);
-    delay(5);
-  }
-  for (int i = 0; i <= 180; i++) {
-    servo.write(i);
-    delay(5);
-  }
-  for (int i = 180; i > 90; i--) {
-    servo.write(i);
-    delay(5);
-  }
-#endif
-  servo.write(servoAngle);
+// task rates (Hz)
+#define SONIC_POLL_RATE 200
+#define OUTPUT_TASK_RATE 50 // servo frame rate
+#define STATS_TASK_RATE 1
 
-  //
+static Scheduler<4> scheduler;
 
-  pinMode(SONIC_TRIGGER, OUTPUT);
-  pinMode(SONIC_ECHO, INPUT);
+#ifdef SONAR_SCAN
+// one bin per echo cycle, a pass over 180 degrees every ~2s
+#define SCAN_BINS TELEMETRY_SCAN_BINS
+// new pulse starts within a frame, then ~10ms to move one bin (5.6 deg)
+#define SCAN_SETTLE_TIME 25000UL
 
-  enableInterrupt(SONIC_ECHO, sonicInterrupt, CHANGE);
+static ScanMap<SCAN_BINS> scanMap;
+static Telemetry<64> telemetry;
+static uint32_t servoMoveTs = 0;
 
-#ifdef DEBUG
-  Serial.println("Interrupts set, ready to roll");
-#endif
+// stores the range of the bin just measured, points the servo at the next
+// one and sends the map at the end of each pass
+void scanStep(const uint32_t now, const uint8_t cm) {
+  bool passDone = scanMap.update(now, cm);
+
+  servo.write(ScanMap<SCAN_BINS>::angle(scanMap.bin()));
+  // now rather than at the next output task
+  servo.update();
+  servoMoveTs = now;
+
+  uint8_t nearest = scanMap.nearest();
+  sonicDistance = nearest == SCAN_NONE ? 255 : nearest * 10;
+
+  if (passDone) {
+    telemetryScan_t rec;
+    rec.ts = now;
+    rec.passTime = scanMap.passTime / 1000;
+    rec.nearestBin = scanMap.nearestBin();
+    rec.nearest = nearest;
+    memcpy(rec.cm, scanMap.ranges(), sizeof(rec.cm));
+    telemetry.send(TELEMETRY_SCAN, &rec, sizeof(rec));
+  }
 }
+#endif
 
-#define SONIC_PULSE_BUFFER_SIZE 16
-static uint8_t sonicPulsePos = 0;
-static uint32_t sonicPulseBuffer[SONIC_PULSE_BUFFER_SIZE];
-static uint8_t loopCounter = 0;
+void sonicTriggerTask(const uint32_t now) {
+#ifdef SONAR_SCAN
+  // runs at the poll rate: probe on the poll nearest a cycle after the
+  // last one, once the servo had time to get to the bin
+  static uint32_t triggerTs = 0;
+  if (now - triggerTs + TASK_HZ(SONIC_POLL_RATE) / 2 < SONIC_CYCLE || now - servoMoveTs < SCAN_SETTLE_TIME) {
+    return;
+  }
+  if (sonar.trigger(now)) {
+    triggerTs = now;
+  }
+#else
+  sonar.trigger(now);
+#endif
+}
 
-void loop() {
-  loopCounter++;
+void sonicTask(const uint32_t now) {
+  static uint16_t lastMisses = 0;
 
-  // Sonic sensor probe
-  digitalWrite(SONIC_TRIGGER, 1);
-  delayMicroseconds(10);
-  digitalWrite(SONIC_TRIGGER, 0);
+  uint16_t sonicPulseWidth;
+  if (!sonar.poll(now, sonicPulseWidth)) {
+    if (sonar.misses != lastMisses) {
+      lastMisses = sonar.misses;
+      sonicMissTs = now;
+#ifdef SONAR_SCAN
+      scanStep(now, SCAN_NONE);
+#endif
+    }
+    return;
+  }
 
   // Sonic sensor monitor output
-  if (sonicPulseWidth != 0) {
-    uint32_t curSonicDistance = sonicPulseWidth * 340 / 2000;
-    sonicPulseBuffer[sonicPulsePos] = curSonicDistance;
-    sonicPulsePos = (sonicPulsePos + 1) % SONIC_PULSE_BUFFER_SIZE;
-
-    uint32_t curAvgSonicDistance = 0;
-    for (uint8_t i = 0; i < SONIC_PULSE_BUFFER_SIZE; i++) {
-      curAvgSonicDistance += sonicPulseBuffer[i];
-    }
-    curAvgSonicDistance /= SONIC_PULSE_BUFFER_SIZE;
+  if (sonicPulseWidth > SONAR_TIMEOUT) {
+    sonicPulseWidth = SONAR_TIMEOUT;
+  }
+  uint16_t curSonicDistance = (uint32_t)sonicPulseWidth * 340 / 2000;
+  uint16_t curAvgSonicDistance = sonicPulseFilter.update(curSonicDistance);
 #ifdef DEBUG
-    Serial.print("Sonic pulse ");
-    Serial.print(sonicPulseWidth);
-    Serial.print("us ");
-    Serial.print(curSonicDistance);
-    Serial.print("mm avg ");
-    Serial.print(curAvgSonicDistance);
-    Serial.println("mm");
+  Serial.print("Sonic pulse ");
+  Serial.print(sonicPulseWidth);
+  Serial.print("us ");
+  Serial.print(curSonicDistance);
+  Serial.print("mm avg ");
+  Serial.print(curAvgSonicDistance);
+  Serial.println("mm");
 #endif
-    sonicDistance = curAvgSonicDistance;
-
-    uint32_t newServoAngle = sonicDistance / 1;
-    if (newServoAngle > 180) {
-      newServoAngle = 180;
-    }
-    servoAngle = newServoAngle;
+#ifdef SONAR_SCAN
+  // one sample per bin, the filter would mix in the bins next to it
+  (void)curAvgSonicDistance;
+  scanStep(now, curSonicDistance / 10 < SCAN_NONE ? curSonicDistance / 10 : SCAN_NONE);
+  return;
+#endif
+  sonicDistance = curAvgSonicDistance;
 
-  } else {
-    digitalWrite(LED_BUILTIN, 1);
-    delay(50);
-    digitalWrite(LED_BUILTIN, 0);
+  uint16_t newServoAngle = sonicDistance / 1;
+  if (newServoAngle > 180) {
+    newServoAngle = 180;
   }
+  servoAngle = newServoAngle;
+}
 
+void outputTask(const uint32_t now) {
   uint8_t proximityAlert = 0;
   if (sonicDistance < 40) {
     proximityAlert = 1;
   }
 
-  servo.write(servoAngle);
-  digitalWrite(LED_1, (loopCounter % 64) > 32 ? proximityAlert : 0);
-  analogWrite(LED_2, sonicDistance <= 255 ? sonicDistance : 255);
+#ifdef SONAR_SCAN
+  servo.update();
+  telemetry.flush();
+#else
+  if (!servo.playing()) {
+    servo.write(servoAngle);
+  }
+  servo.update();
+#endif
+  // blink about 4 times a second
+  FastPin<LED_1>::write(((now >> 12) % 64) > 32 ? proximityAlert : 0);
+  // timer2, the servo owns timer1
+  PwmPin<LED_2>::write( sonicDistance <= 255 ? sonicDistance : 255);
+
+  // flash builtin led when there was no echo
+  FastPin<LED_BUILTIN>::write(sonicMissTs != 0 && now - sonicMissTs < 50000U);
+}
 
+void statsTask(const uint32_t) {
 #ifdef DEBUG
-  delay(10);
+  static uint16_t lastMeasurements = 0;
+
+  Serial.print("Sonic ");
+  Serial.print((uint16_t)(sonar.measurements - lastMeasurements) * STATS_TASK_RATE);
+  Serial.print(" measurements/s, ");
+  Serial.print(sonar.misses);
+  Serial.print(" misses, filter latency ");
+  Serial.print(SONIC_FILTER_LATENCY / 1000);
+  Serial.print("ms, servo ");
+  Serial.print(servo.read());
+  Serial.print("us ");
+  Serial.print(servo.writes);
+  Serial.println(" writes");
+#ifdef SONAR_SCAN
+  Serial.print("Scan nearest ");
+  Serial.print(scanMap.nearest());
+  Serial.print("cm at ");
+  Serial.print(scanMap.nearestBin() == SCAN_NO_BIN ? 0 : ScanMap<SCAN_BINS>::angle(scanMap.nearestBin()));
+  Serial.print(" deg, ");
+  Serial.print(scanMap.passes);
+  Serial.print(" passes, last ");
+  Serial.print(scanMap.passTime / 1000);
+  Serial.println("ms");
+#endif
+
+  lastMeasurements = sonar.measurements;
+#endif
+}
+
+//
+
+void setup() {
+#if defined(DEBUG) || defined(SONAR_SCAN)
+  Serial.begin(SERIAL_BAUD);
+#endif
+#ifdef DEBUG
+  Serial.println("Initializing...");
+#endif
+
+  pinMode(LED_BUILTIN, OUTPUT);
+
+  pinMode(LED_1, OUTPUT);
+  pinMode(LED_2, OUTPUT);
+
+  //
+
+  servoTimerBegin();
+#if defined(SONAR_SCAN)
+  servo.begin(ScanMap<SCAN_BINS>::angle(scanMap.bin()));
+  servoMoveTs = micros();
+#elif defined(SERVO_SWEEP)
+  servo.begin(90);
+  // played by outputTask, the sonar takes over when done
+  servo.play(servoSweep, sizeof(servoSweep), SERVO_SWEEP_STEP);
 #else
-  delay(5);
+  servo.begin(servoAngle);
 #endif
+
+  //
+
+  FastPin<SONIC_TRIGGER>::output();
+  FastPin<SONIC_ECHO>::input();
+
+  enableInterrupt(SONIC_ECHO, sonicInterrupt, CHANGE);
+
+#ifdef SONAR_SCAN
+  scheduler.add(sonicTriggerTask, TASK_HZ(SONIC_POLL_RATE));
+#else
+  scheduler.add(sonicTriggerTask, SONIC_CYCLE);
+#endif
+  scheduler.add(sonicTask, TASK_HZ(SONIC_POLL_RATE));
+  scheduler.add(outputTask, TASK_HZ(OUTPUT_TASK_RATE));
+  scheduler.add(statsTask, TASK_HZ(STATS_TASK_RATE));
+  scheduler.begin();
+
+#ifdef DEBUG
+  Serial.println("Interrupts set, ready to roll");
+#endif
+}
+
+void loop() {
+  PROBE_BEGIN(PROBE_LOOP);
+  scheduler.run();
+  PROBE_END(PROBE_LOOP);
 }
@@ -0,0 +1,218 @@
+// Sonar echo widths timed by the echo pin isr with a servo running, the
+// servo pulses from the Servo library's Timer1 compare isr or from the
+// compare outputs (TimerServo). On an 8MHz board counted in cpu cycles.
+//
+// The echo isr reads micros(), 8us steps, after 0..3 cycles finishing the
+// current instruction and after any isr running when the edge comes: the
+// timer0 overflow one, and with the Servo library its compare isr at the
+// start of each frame and at the end of each servo's pulse, which makes two
+// digitalWrite() calls. Both isr lengths are estimates from their code, not
+// measured, so the figures show the difference rather than exact errors.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <Sonar.h>
+
+#define SONIC_TRIGGER 7
+
+#define CYCLES_PER_US 8
+#define T0_OVERFLOW_CYCLES 16384UL
+#define T0_ISR_CYCLES 80
+#define SERVO_ISR_CYCLES 120
+#define SERVO_FRAME_CYCLES (20000UL * CYCLES_PER_US)
+#define MAX_SERVOS 4
+// the sketch's echo cycle
+#define ECHO_CYCLE_CYCLES (60000UL * CYCLES_PER_US)
+#define ECHOES 3000
+
+static uint32_t seed;
+
+static uint16_t rnd(uint32_t &state, const uint16_t range) {
+  state = state * 1103515245UL + 12345UL;
+  return (state >> 8) % range;
+}
+
+// servo isr start cycles of the frame being looked at
+struct servoIsrs_t {
+  uint8_t servos;
+  uint32_t seed;
+  uint32_t frameStart;
+  uint32_t at[MAX_SERVOS + 1];
+  uint8_t count;
+};
+
+// the Servo library's isrs in the frame from start: one at the start,
+// setting the first pin, then one per pulse end, setting the next
+static void servoFrame(servoIsrs_t &s, const uint32_t start) {
+  s.frameStart = start;
+  s.count = 0;
+  if (!s.servos) {
+    return;
+  }
+  uint32_t t = start;
+  s.at[s.count++] = t;
+  for (uint8_t i = 0; i < s.servos; i++) {
+    // sweeping, a new width every frame
+    t += (uint32_t)(544 + rnd(s.seed, 2400 - 544 + 1)) * CYCLES_PER_US;
+    s.at[s.count++] = t;
+  }
+}
+
+// the cycle the echo isr reads micros() at for an edge at cycle, after
+// finishing an instruction and any isr running; the servo frames are
+// moved along as time passes
+static uint32_t isrEntry(servoIsrs_t &s, const uint32_t cycle, const uint8_t finish, bool &servoHit) {
+  while (cycle >= s.frameStart + SERVO_FRAME_CYCLES) {
+    servoFrame(s, s.frameStart + SERVO_FRAME_CYCLES);
+  }
+  uint32_t t = cycle + finish;
+  bool moved = true;
+  while (moved) {
+    moved = false;
+    uint32_t inT0 = t % T0_OVERFLOW_CYCLES;
+    if (inT0 < T0_ISR_CYCLES) {
+      t += T0_ISR_CYCLES - inT0;
+      moved = true;
+    }
+    for (uint8_t i = 0; i < s.count; i++) {
+      if (t >= s.at[i] && t < s.at[i] + SERVO_ISR_CYCLES) {
+        t = s.at[i] + SERVO_ISR_CYCLES;
+        servoHit = true;
+        moved = true;
+      }
+    }
+  }
+  return t;
+}
+
+static uint16_t microsAt(const uint32_t cycle) {
+  return (uint16_t)((cycle / 64) * 8);
+}
+
+struct result_t {
+  uint32_t worst;   // cycles
+  uint32_t hitSum;  // cycles, over the echoes held up
+  uint16_t hits;    // echoes with an edge held up by a servo isr
+};
+
+// one way of driving the servos timing the echoes
+struct bench_t {
+  Sonar<SONIC_TRIGGER> sonar;
+  servoIsrs_t isrs;
+  uint32_t error; // cycles, of the last echo
+  bool hit;
+};
+
+static void benchBegin(bench_t &b, const uint8_t servos) {
+  b.isrs.servos = servos;
+  b.isrs.seed = 7;
+  servoFrame(b.isrs, 0);
+}
+
+static void benchEcho(bench_t &b, const uint32_t trigger, const uint32_t rise, const uint32_t fall,
+                      const uint8_t finishRise, const uint8_t finishFall) {
+  TEST_ASSERT_TRUE(b.sonar.trigger(trigger / CYCLES_PER_US));
+  b.hit = false;
+  b.sonar.handleEdge(1, microsAt(isrEntry(b.isrs, rise, finishRise, b.hit)));
+  b.sonar.handleEdge(0, microsAt(isrEntry(b.isrs, fall, finishFall, b.hit)));
+  uint16_t width = 0;
+  TEST_ASSERT_TRUE(b.sonar.poll(fall / CYCLES_PER_US, width));
+  int32_t error = (int32_t)width * CYCLES_PER_US - (int32_t)(fall - rise);
+  b.error = error < 0 ? -error : error;
+}
+
+static void account(result_t &r, const bench_t &b, const bool hit) {
+  r.worst = b.error > r.worst ? b.error : r.worst;
+  if (hit) {
+    r.hitSum += b.error;
+    r.hits++;
+  }
+}
+
+// ECHOES echoes of 5..400cm, each timed with the pulses from Timer1's
+// compare outputs (TimerServo) and with servos isrs driving them
+static void echoes(const uint8_t servos, result_t &timer, result_t &isr) {
+  bench_t byTimer;
+  bench_t byIsr;
+  benchBegin(byTimer, 0);
+  benchBegin(byIsr, servos);
+  timer = result_t();
+  isr = result_t();
+  seed = 1;
+  uint32_t cycle = 1000;
+  for (uint16_t i = 0; i < ECHOES; i++) {
+    // the echo task runs within a ms of its period, the sensor answers
+    // ~450us after the trigger
+    uint32_t trigger = cycle + rnd(seed, 1000 * CYCLES_PER_US);
+    uint32_t rise = trigger + 450 * CYCLES_PER_US;
+    uint32_t fall = rise + (uint32_t)(5 + rnd(seed, 396)) * 58 * CYCLES_PER_US + rnd(seed, 58 * CYCLES_PER_US);
+    uint8_t finishRise = rnd(seed, 4);
+    uint8_t finishFall = rnd(seed, 4);
+    cycle += ECHO_CYCLE_CYCLES;
+
+    benchEcho(byTimer, trigger, rise, fall, finishRise, finishFall);
+    benchEcho(byIsr, trigger, rise, fall, finishRise, finishFall);
+    TEST_ASSERT_FALSE(byTimer.hit);
+    // the same echoes, those the isrs held up
+    account(timer, byTimer, byIsr.hit);
+    account(isr, byIsr, byIsr.hit);
+  }
+}
+
+// mean error of the held up echoes (us)
+static float hitMean(const result_t &r) {
+  return r.hits ? (float)r.hitSum / r.hits / CYCLES_PER_US : 0;
+}
+
+void setUp() {
+  halReset();
+}
+
+void tearDown() {
+}
+
+void test_timer_servo_leaves_the_echo_to_micros() {
+  // no servo isr at all, the error is the micros() step and the timer0
+  // isr whatever the servos do
+  result_t timer;
+  result_t isr;
+  echoes(0, timer, isr);
+  TEST_ASSERT_EQUAL_UINT16(0, isr.hits);
+  TEST_ASSERT_TRUE(timer.worst < 8 * CYCLES_PER_US + T0_ISR_CYCLES + 4);
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "TimerServo: worst %luus over %u echoes", (unsigned long)(timer.worst / CYCLES_PER_US),
+           ECHOES);
+  TEST_MESSAGE(msg);
+}
+
+void test_servo_isr_adds_to_the_echo_error() {
+  uint16_t lastHits = 0;
+  for (uint8_t servos = 1; servos <= MAX_SERVOS; servos *= 2) {
+    result_t timer;
+    result_t isr;
+    echoes(servos, timer, isr);
+    char msg[128];
+    snprintf(msg, sizeof(msg), "Servo library, %u servos: %u echoes held up, off by %.1fus (TimerServo %.1fus)",
+             servos, isr.hits, hitMean(isr), hitMean(timer));
+    TEST_MESSAGE(msg);
+    snprintf(msg, sizeof(msg), "Servo library, %u servos: worst %luus", servos,
+             (unsigned long)(isr.worst / CYCLES_PER_US));
+    TEST_MESSAGE(msg);
+    // more echoes held up the more servos, those further off than the
+    // same echoes timed with TimerServo, by up to a servo isr
+    TEST_ASSERT_TRUE(isr.hits > lastHits);
+    TEST_ASSERT_TRUE(isr.hitSum > timer.hitSum);
+    TEST_ASSERT_TRUE(isr.worst >= timer.worst);
+    TEST_ASSERT_TRUE(isr.worst <= timer.worst + SERVO_ISR_CYCLES + 8 * CYCLES_PER_US);
+    lastHits = isr.hits;
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_timer_servo_leaves_the_echo_to_micros);
+  RUN_TEST(test_servo_isr_adds_to_the_echo_error);
+  return UNITY_END();
+}
@@ -0,0 +1,263 @@
+// ScanMap swept over synthetic rooms: the sensor at the origin facing +y,
+// 0 degrees to the right (+x), each bin's range ray-cast at its angle once
+// per 60ms echo cycle like the sketch. Bins checked against the geometry,
+// nearest against a search of the map, and how stale bins get.
+
+#include <unity.h>
+
+#include <math.h>
+
+#include <HalNative.h>
+#include <ScanMap.h>
+
+// the sketch's
+#define BINS 32
+#define CYCLE_US 60000UL
+
+typedef ScanMap<BINS> scanMap_t;
+
+// walls at x = -halfWidth, +halfWidth and y = depth, an optional post (cm)
+struct room_t {
+  float halfWidth;
+  float depth;
+  float postX;
+  float postY;
+  float postR; // 0 = no post
+};
+
+static const room_t box = {100, 150, 0, 0, 0};
+static const room_t boxPost = {100, 150, 30, 60, 10};
+// open ahead, past range
+static const room_t corridor = {40, 1000, 0, 0, 0};
+
+// distance along the ray at angle (degrees), cm
+static float cast(const room_t &room, const float angle) {
+  float dx = cosf(angle * (float)M_PI / 180);
+  float dy = sinf(angle * (float)M_PI / 180);
+  float t = 1e9;
+  if (dx > 1e-6f) {
+    t = fminf(t, room.halfWidth / dx);
+  } else if (dx < -1e-6f) {
+    t = fminf(t, -room.halfWidth / dx);
+  }
+  if (dy > 1e-6f) {
+    t = fminf(t, room.depth / dy);
+  }
+  if (room.postR > 0) {
+    // |t d - p| = r
+    float b = dx * room.postX + dy * room.postY;
+    float c = room.postX * room.postX + room.postY * room.postY - room.postR * room.postR;
+    float disc = b * b - c;
+    if (disc >= 0 && b - sqrtf(disc) > 0) {
+      t = fminf(t, b - sqrtf(disc));
+    }
+  }
+  return t;
+}
+
+// what the sketch stores for it
+static uint8_t measure(const room_t &room, const uint8_t bin) {
+  float t = cast(room, scanMap_t::angle(bin));
+  return t < SCAN_NONE ? (uint8_t)t : SCAN_NONE;
+}
+
+static scanMap_t *map;
+static uint32_t now;
+// cycle each bin was last measured at
+static uint32_t measuredAt[BINS];
+static uint32_t cycles;
+
+static bool cycle(const room_t &room) {
+  uint8_t bin = map->bin();
+  bool end = map->update(now, measure(room, bin));
+  measuredAt[bin] = cycles++;
+  now += CYCLE_US;
+  return end;
+}
+
+static void checkNearest() {
+  uint8_t best = SCAN_NONE;
+  for (uint8_t i = 0; i < BINS; i++) {
+    best = map->range(i) < best ? map->range(i) : best;
+  }
+  TEST_ASSERT_EQUAL_UINT8(best, map->nearest());
+  if (best != SCAN_NONE) {
+    TEST_ASSERT_EQUAL_UINT8(best, map->range(map->nearestBin()));
+  } else {
+    TEST_ASSERT_EQUAL_UINT8(SCAN_NO_BIN, map->nearestBin());
+  }
+}
+
+static void checkRoom(const room_t &room) {
+  for (uint8_t i = 0; i < BINS; i++) {
+    TEST_ASSERT_EQUAL_UINT8(measure(room, i), map->range(i));
+  }
+}
+
+void setUp() {
+  halReset();
+  map = new scanMap_t();
+  now = 0;
+  cycles = 0;
+  memset(measuredAt, 0, sizeof(measuredAt));
+}
+
+void tearDown() {
+  delete map;
+}
+
+void test_bins_span_the_half_turn() {
+  TEST_ASSERT_EQUAL_UINT8(2, scanMap_t::angle(0));
+  TEST_ASSERT_EQUAL_UINT8(90 - 3, scanMap_t::angle(BINS / 2 - 1));
+  TEST_ASSERT_EQUAL_UINT8(92, scanMap_t::angle(BINS / 2));
+  TEST_ASSERT_EQUAL_UINT8(177, scanMap_t::angle(BINS - 1));
+}
+
+void test_first_pass_fills_every_bin() {
+  for (uint8_t i = 0; i < BINS; i++) {
+    TEST_ASSERT_EQUAL_UINT8(SCAN_NONE, map->range(i));
+  }
+  TEST_ASSERT_EQUAL_UINT8(SCAN_NONE, map->nearest());
+
+  uint8_t n = 0;
+  while (!cycle(box)) {
+    n++;
+    checkNearest();
+  }
+  TEST_ASSERT_EQUAL_UINT8(BINS - 1, n);
+  TEST_ASSERT_EQUAL_UINT16(1, map->passes);
+  checkRoom(box);
+  // the side walls straight across, 100cm out
+  TEST_ASSERT_EQUAL_UINT8(100, map->range(0));
+  TEST_ASSERT_EQUAL_UINT8(100, map->range(BINS - 1));
+  TEST_ASSERT_EQUAL_UINT8(150, map->range(BINS / 2));
+}
+
+void test_nearest_finds_the_post() {
+  for (uint16_t i = 0; i < 4 * BINS; i++) {
+    cycle(boxPost);
+    checkNearest();
+  }
+  checkRoom(boxPost);
+  // 63 degrees, 57cm to its near side
+  float bearing = atan2f(boxPost.postY, boxPost.postX) * 180 / (float)M_PI;
+  TEST_ASSERT_TRUE(fabsf(scanMap_t::angle(map->nearestBin()) - bearing) <= 90.0f / BINS);
+  TEST_ASSERT_UINT_WITHIN(3, 57, map->nearest());
+}
+
+void test_out_of_range_bins_stay_none() {
+  while (!cycle(corridor)) {
+  }
+  uint8_t none = 0;
+  for (uint8_t i = 0; i < BINS; i++) {
+    if (cast(corridor, scanMap_t::angle(i)) >= SCAN_NONE) {
+      TEST_ASSERT_EQUAL_UINT8(SCAN_NONE, map->range(i));
+      none++;
+    }
+  }
+  // ahead, down the corridor
+  TEST_ASSERT_TRUE(none >= 4);
+  TEST_ASSERT_EQUAL_UINT8(SCAN_NONE, map->range(BINS / 2));
+  TEST_ASSERT_EQUAL_UINT8(40, map->nearest());
+  checkNearest();
+}
+
+void test_staleness_is_bounded_by_a_round_trip() {
+  while (!cycle(box)) {
+  }
+  // age of each bin (cycles since measured) just before it is measured again
+  uint32_t maxAge[BINS] = {};
+  uint32_t sumAge = 0;
+  uint32_t samples = 0;
+  for (uint16_t i = 0; i < 10 * BINS; i++) {
+    uint8_t bin = map->bin();
+    uint32_t age = cycles - measuredAt[bin];
+    maxAge[bin] = age > maxAge[bin] ? age : maxAge[bin];
+    cycle(box);
+    // and the map as a whole, sampled each cycle
+    for (uint8_t b = 0; b < BINS; b++) {
+      sumAge += cycles - measuredAt[b];
+      samples++;
+    }
+  }
+
+  // the ends once per round trip, the others twice but unevenly
+  TEST_ASSERT_EQUAL_UINT32(2 * (BINS - 1), maxAge[0]);
+  TEST_ASSERT_EQUAL_UINT32(2 * (BINS - 1), maxAge[BINS - 1]);
+  for (uint8_t b = 1; b < BINS - 1; b++) {
+    TEST_ASSERT_TRUE(maxAge[b] <= 2 * (BINS - 1) - 2);
+  }
+  TEST_ASSERT_EQUAL_UINT32((BINS - 1) * CYCLE_US, map->passTime);
+
+  char msg[96];
+  snprintf(msg, sizeof(msg), "bin age max %lums, mean %lums, pass %lums",
+           (unsigned long)(2 * (BINS - 1) * CYCLE_US / 1000),
+           (unsigned long)(sumAge * (CYCLE_US / 1000) / samples), (unsigned long)(map->passTime / 1000));
+  TEST_MESSAGE(msg);
+}
+
+void test_room_changes_caught_within_a_round_trip() {
+  for (uint16_t i = 0; i < 2 * BINS; i++) {
+    cycle(boxPost);
+  }
+  uint8_t postRange = map->nearest();
+
+  // the post goes away: the nearest moves back to the walls once its bins
+  // are measured again, the map is the new room within a round trip
+  uint32_t changed = cycles;
+  uint32_t caught = 0;
+  for (uint16_t i = 0; i < 2 * (BINS - 1); i++) {
+    cycle(box);
+    checkNearest();
+    if (!caught && map->nearest() != postRange) {
+      caught = cycles - changed;
+    }
+  }
+  checkRoom(box);
+  TEST_ASSERT_EQUAL_UINT8(100, map->nearest());
+  TEST_ASSERT_TRUE(caught > 0);
+
+  // and back: a nearer range is taken the cycle its bin is measured
+  uint8_t postBin = SCAN_NO_BIN;
+  for (uint8_t i = 0; i < BINS; i++) {
+    if (measure(boxPost, i) < 100 && (postBin == SCAN_NO_BIN || measure(boxPost, i) < measure(boxPost, postBin))) {
+      postBin = i;
+    }
+  }
+  while (map->bin() != postBin) {
+    cycle(boxPost);
+  }
+  cycle(boxPost);
+  TEST_ASSERT_EQUAL_UINT8(postBin, map->nearestBin());
+  TEST_ASSERT_EQUAL_UINT8(postRange, map->nearest());
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "post removed, nearest updated after %lums", (unsigned long)(caught * CYCLE_US / 1000));
+  TEST_MESSAGE(msg);
+}
+
+void test_misses_blank_their_bin() {
+  while (!cycle(box)) {
+  }
+  // no echo at the bin now measured: it reads none until the next visit
+  uint8_t bin = map->bin();
+  map->update(now, SCAN_NONE);
+  TEST_ASSERT_EQUAL_UINT8(SCAN_NONE, map->range(bin));
+  checkNearest();
+  // a 0 reading is 1cm, not no echo
+  map->set(3, 0);
+  TEST_ASSERT_EQUAL_UINT8(1, map->range(3));
+  TEST_ASSERT_EQUAL_UINT8(3, map->nearestBin());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_bins_span_the_half_turn);
+  RUN_TEST(test_first_pass_fills_every_bin);
+  RUN_TEST(test_nearest_finds_the_post);
+  RUN_TEST(test_out_of_range_bins_stay_none);
+  RUN_TEST(test_staleness_is_bounded_by_a_round_trip);
+  RUN_TEST(test_room_changes_caught_within_a_round_trip);
+  RUN_TEST(test_misses_blank_their_bin);
+  return UNITY_END();
+}
@@ -0,0 +1,174 @@
+// TimerServo against Timer1 in fast pwm mode 14 as the datasheet has it:
+// the counter runs 0..ICR1, OC1x is set at BOTTOM and cleared on the
+// compare match, OCR1x double buffered and taken at BOTTOM. The pulses
+// are counted in timer ticks off that model.
+//
+// Jitter here is the pulse against the width asked for. The edges come
+// from the compare unit, no isr, so none is possible by construction; the
+// model shows a width written at any time lands whole on the next frame.
+// The Servo library's isr latency can't be measured on the native build.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <ServoDriver.h>
+
+#define SERVO 9
+
+struct timer1_t {
+  uint16_t top;     // ICR1
+  uint16_t ocr;     // OCR1A the compare unit uses
+  uint16_t buffer;  // OCR1A as written
+  uint16_t tcnt;
+  bool pin;
+};
+
+static timer1_t timer;
+
+static void timerBegin(const uint16_t top, const uint16_t ocr) {
+  timer.top = top;
+  timer.ocr = timer.buffer = ocr;
+  timer.tcnt = 0;
+  timer.pin = true;
+}
+
+// one timer clock, true at BOTTOM
+static bool timerTick() {
+  if (timer.tcnt == timer.ocr) {
+    timer.pin = false;
+  }
+  if (timer.tcnt == timer.top) {
+    timer.tcnt = 0;
+    timer.ocr = timer.buffer;
+    timer.pin = true;
+    return true;
+  }
+  timer.tcnt++;
+  return false;
+}
+
+struct frame_t {
+  uint16_t ticks; // frame length
+  uint16_t high;  // pulse
+};
+
+// a frame from BOTTOM, servo.update() called at tick at, -1 never
+static frame_t runFrame(TimerServo<SERVO> &servo, const int32_t at = -1) {
+  frame_t f = {0, 0};
+  do {
+    if (f.ticks == at) {
+      servo.update();
+      timer.buffer = servo.compare();
+    }
+    f.high += timer.pin;
+    f.ticks++;
+  } while (!timerTick());
+  return f;
+}
+
+static uint32_t seed;
+
+static uint16_t rnd(const uint16_t range) {
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 8) % range;
+}
+
+void setUp() {
+  halReset();
+  seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_frame_top_and_endpoints() {
+  // 8MHz, prescaler 8: 1 tick per us
+  TEST_ASSERT_EQUAL_UINT32(1, SERVO_TICKS_PER_US);
+  TEST_ASSERT_EQUAL_UINT16(19999, servoTop());
+  TEST_ASSERT_EQUAL_UINT16(999, servoCompare(1000));
+  TEST_ASSERT_EQUAL_UINT16(1999, servoCompare(2000));
+  // 16MHz boards, 2 ticks per us
+  TEST_ASSERT_EQUAL_UINT16(39999, servoTop(2));
+  TEST_ASSERT_EQUAL_UINT16(1999, servoCompare(1000, 2));
+  TEST_ASSERT_EQUAL_UINT16(3999, servoCompare(2000, 2));
+}
+
+void test_pulses_at_the_endpoints() {
+  static const uint16_t widths[] = {1000, 2000, SERVO_MIN_PULSE, SERVO_MAX_PULSE, 1500};
+  for (uint8_t ticksPerUs = 1; ticksPerUs <= 2; ticksPerUs++) {
+    for (uint8_t i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+      timerBegin(servoTop(ticksPerUs), servoCompare(widths[i], ticksPerUs));
+      uint16_t ticks = 0;
+      uint16_t high = 0;
+      do {
+        high += timer.pin;
+        ticks++;
+      } while (!timerTick());
+      TEST_ASSERT_EQUAL_UINT16(SERVO_FRAME_US * ticksPerUs, ticks);
+      TEST_ASSERT_EQUAL_UINT16(widths[i] * ticksPerUs, high);
+    }
+  }
+}
+
+void test_driver_writes_the_mapping() {
+  TimerServo<SERVO> servo;
+  servo.begin(90);
+  TEST_ASSERT_EQUAL_UINT16(servoCompare(TimerServo<SERVO>::angleToPulse(90)), servo.compare());
+
+  servo.writeMicroseconds(1000);
+  servo.update();
+  TEST_ASSERT_EQUAL_UINT16(999, servo.compare());
+  TEST_ASSERT_EQUAL_INT(1000, halGetPin(SERVO));
+
+  servo.writeMicroseconds(2000);
+  servo.update();
+  TEST_ASSERT_EQUAL_UINT16(1999, servo.compare());
+  TEST_ASSERT_EQUAL_INT(2000, halGetPin(SERVO));
+
+  // clamped to the Servo library's angle range
+  servo.writeMicroseconds(3000);
+  servo.update();
+  TEST_ASSERT_EQUAL_UINT16(servoCompare(SERVO_MAX_PULSE), servo.compare());
+  servo.write(0);
+  servo.update();
+  TEST_ASSERT_EQUAL_UINT16(servoCompare(SERVO_MIN_PULSE), servo.compare());
+
+  // only changes are written
+  uint16_t writes = servo.writes;
+  servo.update();
+  TEST_ASSERT_EQUAL_UINT16(writes, servo.writes);
+}
+
+void test_no_jitter_whenever_written() {
+  TimerServo<SERVO> servo;
+  servo.begin(90);
+  timerBegin(servoTop(), servo.compare());
+
+  // a new width every frame at any point of it, mid pulse included
+  uint16_t before = servo.read();
+  uint16_t maxError = 0;
+  uint16_t frames = 0;
+  for (; frames < 500; frames++) {
+    servo.writeMicroseconds(1000 + rnd(1001));
+    frame_t f = runFrame(servo, rnd(SERVO_FRAME_US));
+    TEST_ASSERT_EQUAL_UINT16(SERVO_FRAME_US, f.ticks);
+    // the width from before the frame, whole
+    uint16_t error = f.high > before ? f.high - before : before - f.high;
+    maxError = error > maxError ? error : maxError;
+    before = servo.read();
+  }
+  TEST_ASSERT_EQUAL_UINT16(0, maxError);
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%u frames, pulse jitter %u ticks (1us)", frames, maxError);
+  TEST_MESSAGE(msg);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_frame_top_and_endpoints);
+  RUN_TEST(test_pulses_at_the_endpoints);
+  RUN_TEST(test_driver_writes_the_mapping);
+  RUN_TEST(test_no_jitter_whenever_written);
+  return UNITY_END();
+}
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastPin.h>
+#include <Tables.h>
+
+#include "Lights.h"
+
+// Plays light outputs from the Timer0 compare A interrupt, so blinking and
+// fades keep their rate whatever loop() is doing:
+//
+//   typedef LightSequencer<PIN_BRAKE, PIN_HAZARD> lightSequencer;
+//   ISR(TIMER0_COMPA_vect) { lightSequencer::tick(); }
+//   lightSequencer::play(OUT_HAZARD, lights.output(now, OUT_HAZARD));
+//
+// Timer0 is the core's millis() timer, compare A matches once per
+// overflow whatever OCR0A holds, so the tick is the overflow rate (2ms on
+// 8MHz boards). begin() sets OCR0A to mid count to place the tick, which
+// makes pin 6 (OC0A) pwm unusable while the sequencer runs: it can't be one
+// of the outputs, and analogWrite(6) would move the tick. Pin 5 (OC0B) is
+// fine. Patterns step every 65ms like before, 32 ticks on 8MHz.
+//
+// play() copies the pattern out of flash, the isr only shifts a bit mask
+// and moves the pwm level by the entry's fade per tick (0 = jump), writing
+// the compare register only when it changes. 9 bytes of RAM per output.
+//
+// On the native build there is no timer, poll(now) runs the ticks due;
+// call it before play() as they would have run by then.
+
+// Timer0 overflow period and pattern step (us)
+#define LIGHTS_TICK_US (64UL * 256UL * 1000000UL / F_CPU)
+#define LIGHTS_STEP_US 65536UL
+#define LIGHTS_TICKS_PER_STEP (LIGHTS_STEP_US / LIGHTS_TICK_US)
+
+template <uint8_t... PINS>
+class LightSequencer {
+public:
+  static const uint8_t count = sizeof...(PINS);
+  static constexpr uint8_t pins[count] = {PINS...};
+
+  static void begin(const lightsPattern_t *patternTable) {
+    static_assert(!hasPin(6), "LightSequencer: pin 6 pwm is OCR0A, which times the tick");
+    patterns = patternTable;
+    beginEach(typename makeIndexSeq<count>::type());
+#ifdef __AVR__
+    OCR0A = 0x80;
+    TIFR0 = _BV(OCF0A);
+    TIMSK0 |= _BV(OCIE0A);
+#endif
+  }
+
+  // what output i plays, the same entry again keeps the pattern running
+  static void play(const uint8_t i, const lightsOutput_t &entry) {
+    lightsPattern_t pattern = {1, 1};
+    if (entry.pattern != LIGHTS_STEADY) {
+      memcpy_P(&pattern, &patterns[entry.pattern], sizeof(pattern));
+    }
+
+    channel_t &c = channels[i];
+    if (c.level == entry.level && c.fade == entry.fade && c.pattern == pattern.steps && c.length == pattern.length) {
+      return;
+    }
+
+    noInterrupts();
+    c.level = entry.level;
+    c.fade = entry.fade;
+    c.pattern = pattern.steps;
+    c.length = pattern.length;
+    c.steps = pattern.steps;
+    c.step = 0;
+    interrupts();
+  }
+
+  // call from ISR(TIMER0_COMPA_vect)
+  static void tick() {
+    bool step = ++ticks == LIGHTS_TICKS_PER_STEP;
+    if (step) {
+      ticks = 0;
+    }
+    tickEach(step, typename makeIndexSeq<count>::type());
+  }
+
+  // native build: run the ticks due by now
+  static void poll(const uint32_t now) {
+#ifndef __AVR__
+    while (now - lastTick >= LIGHTS_TICK_US) {
+      lastTick += LIGHTS_TICK_US;
+      tick();
+    }
+#else
+    (void)now;
+#endif
+  }
+
+  // pwm level written now
+  static uint8_t current(const uint8_t i) {
+    return channels[i].current;
+  }
+
+private:
+  struct channel_t {
+    uint8_t level;
+    uint8_t fade;
+    uint16_t pattern;
+    uint8_t length;
+    uint16_t steps; // pattern shifted down by step
+    uint8_t step;
+    uint8_t current;
+  };
+
+  static constexpr bool hasPin(const uint8_t pin, const uint8_t i = 0) {
+    return i < count && (pins[i] == pin || hasPin(pin, i + 1));
+  }
+
+  static const lightsPattern_t *patterns;
+  static channel_t channels[sizeof...(PINS)];
+  static uint8_t ticks;
+#ifndef __AVR__
+  static uint32_t lastTick;
+#endif
+
+  template <uint16_t... Is>
+  static void beginEach(indexSeq<Is...>) {
+    int unused[] = {0, (FastPin<pins[Is]>::output(), PwmPin<pins[Is]>::write(0), 0)...};
+    (void)unused;
+  }
+
+  template <uint16_t... Is>
+  static void tickEach(const bool step, indexSeq<Is...>) {
+    int unused[] = {0, (tickOne<Is>(step), 0)...};
+    (void)unused;
+  }
+
+  template <uint16_t I>
+  static void tickOne(const bool step) {
+    channel_t &c = channels[I];
+
+    if (step) {
+      if (++c.step == c.length) {
+        c.step = 0;
+        c.steps = c.pattern;
+      } else {
+        c.steps >>= 1;
+      }
+    }
+
+    uint8_t target = (c.steps & 1) ? c.level : 0;
+    uint8_t next = target;
+    if (c.fade && target > c.current) {
+      next = target - c.current > c.fade ? c.current + c.fade : target;
+    } else if (c.fade && target < c.current) {
+      next = c.current - target > c.fade ? c.current - c.fade : target;
+    }
+
+    if (next != c.current) {
+      c.current = next;
+      PwmPin<pins[I]>::write(next);
+    }
+  }
+};
+
+template <uint8_t... PINS>
+constexpr uint8_t LightSequencer<PINS...>::pins[];
+
+template <uint8_t... PINS>
+const lightsPattern_t *LightSequencer<PINS...>::patterns;
+
+template <uint8_t... PINS>
+typename LightSequencer<PINS...>::channel_t LightSequencer<PINS...>::channels[sizeof...(PINS)];
+
+template <uint8_t... PINS>
+uint8_t LightSequencer<PINS...>::ticks;
+
+#ifndef __AVR__
+template <uint8_t... PINS>
+uint32_t LightSequencer<PINS...>::lastTick;
+#endif
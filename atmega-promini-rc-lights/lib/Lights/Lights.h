@@ -0,0 +1,173 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Light engine driven by PROGMEM tables, so the light logic is data.
+//
+// Inputs are groups (throttle, aux switch, signal, ...), each in one state
+// at a time. set() moves a group to a new state and fires the first rule
+// matching (from, to), event() fires the rule of (state, event) and leaves
+// the state alone. A rule turns light bits on and off, can require the old
+// state to be younger than `within` us, can keep what it turned on held
+// for `hold` us, or can refuse the move. A clear of a held bit is lost, the
+// bit stays on past the hold too, unless the rule has LIGHTS_DROP.
+//
+// Outputs are looked up by priority: the first entry of an output whose
+// light bits are on (or that has none) says what it plays, a level, blink
+// pattern and fade. LightSequencer plays them. In a pattern bit i is step
+// i, steps are 65ms.
+//
+// State and event ids are the sketch's, 0 is reserved for LIGHTS_ANY.
+
+#define LIGHTS_ANY 0
+
+// rule flags
+#define LIGHTS_STAY 0x01 // refuse the move, the group keeps its state
+#define LIGHTS_DROP 0x02 // clears held bits too, dropping their holds
+
+// output entry without a pattern
+#define LIGHTS_STEADY 0xff
+
+struct lightsRule_t {
+  uint8_t from;    // state, or LIGHTS_ANY
+  uint8_t to;      // state or event
+  uint8_t flags;
+  uint8_t set;     // light bits turned on
+  uint8_t clear;   // light bits turned off
+  uint32_t within; // only if `from` was entered less than this ago (us), 0 = always
+  uint32_t hold;   // set bits stay on at least this long (us), 0 = no hold
+};
+
+struct lightsOutput_t {
+  uint8_t output;
+  uint8_t lights;  // any of these on, 0 = always
+  uint8_t level;   // pwm
+  uint8_t pattern; // index into the patterns, or LIGHTS_STEADY
+  uint8_t fade;    // pwm change per sequencer tick, 0 = jump
+};
+
+struct lightsPattern_t {
+  uint16_t steps; // bit i = on at step i
+  uint8_t length;
+};
+
+template <uint8_t GROUPS>
+class Lights {
+public:
+  Lights(const lightsRule_t *rules, const uint8_t ruleCount,
+         const lightsOutput_t *outputs, const uint8_t outputCount)
+      : rules(rules), ruleCount(ruleCount), outputs(outputs), outputCount(outputCount) {}
+
+  // enter the first state of a group, fires its LIGHTS_ANY rules
+  void begin(const uint32_t now, const uint8_t group, const uint8_t state) {
+    states[group] = LIGHTS_ANY;
+    set(now, group, state);
+  }
+
+  void set(const uint32_t now, const uint8_t group, const uint8_t state) {
+    if (state == states[group]) {
+      return;
+    }
+    if (fire(now, group, state)) {
+      states[group] = state;
+      since[group] = now;
+      transitions++;
+    }
+  }
+
+  void event(const uint32_t now, const uint8_t group, const uint8_t ev) {
+    fire(now, group, ev);
+    events++;
+  }
+
+  uint8_t state(const uint8_t group) const {
+    return states[group];
+  }
+
+  // light bits on now, holds included
+  uint8_t lights(const uint32_t now) {
+    for (uint8_t i = 0; i < 8; i++) {
+      if ((held & _BV(i)) && (int32_t)(now - holdEnd[i]) >= 0) {
+        held &= ~_BV(i);
+      }
+    }
+    return on | held;
+  }
+
+  // what an output plays now, off if no entry matches
+  lightsOutput_t output(const uint32_t now, const uint8_t output) {
+    uint8_t bits = lights(now);
+    lightsOutput_t entry;
+
+    for (uint8_t i = 0; i < outputCount; i++) {
+      memcpy_P(&entry, &outputs[i], sizeof(entry));
+      if (entry.output == output && (!entry.lights || (entry.lights & bits))) {
+        return entry;
+      }
+    }
+
+    entry.output = output;
+    entry.lights = 0;
+    entry.level = 0;
+    entry.pattern = LIGHTS_STEADY;
+    entry.fade = 0;
+    return entry;
+  }
+
+  // counters since start
+  uint16_t transitions = 0;
+  uint16_t events = 0;
+
+private:
+  const lightsRule_t *rules;
+  const uint8_t ruleCount;
+  const lightsOutput_t *outputs;
+  const uint8_t outputCount;
+
+  uint8_t states[GROUPS] = {};
+  uint32_t since[GROUPS] = {};
+
+  uint8_t on = 0;
+  uint8_t held = 0;
+  uint32_t holdEnd[8] = {};
+
+  // first matching rule wins, false if it refuses the move
+  bool fire(const uint32_t now, const uint8_t group, const uint8_t to) {
+    uint8_t from = states[group];
+
+    for (uint8_t i = 0; i < ruleCount; i++) {
+      lightsRule_t rule;
+      memcpy_P(&rule, &rules[i], sizeof(rule));
+
+      if (rule.to != to || (rule.from != LIGHTS_ANY && rule.from != from)) {
+        continue;
+      }
+      if (rule.within && now - since[group] >= rule.within) {
+        continue;
+      }
+      if (rule.flags & LIGHTS_STAY) {
+        return false;
+      }
+
+      uint8_t clear = rule.clear;
+      if (rule.flags & LIGHTS_DROP) {
+        held &= ~clear;
+      } else {
+        // holds ended by now don't count
+        lights(now);
+        clear &= ~held;
+      }
+      on = (on & ~clear) | rule.set;
+      if (rule.hold) {
+        for (uint8_t b = 0; b < 8; b++) {
+          if (rule.set & _BV(b)) {
+            holdEnd[b] = now + rule.hold;
+          }
+        }
+        held |= rule.set;
+      }
+      break;
+    }
+    return true;
+  }
+};
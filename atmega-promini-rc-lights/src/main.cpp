@@ -1,213 +1,244 @@
 #include <Arduino.h>
-
-// RC channel pins
+#include <Calibration.h>
+#include <Failsafe.h>
+#include <FastPin.h>
+#include <LightSequencer.h>
+#include <Lights.h>
+#include <Probe.h>
+#include <RcChannels.h>
+#include <Scheduler.h>
+
+// RC channel pins (must be INT - not PCINT - capable pins)
 #define PIN_THR 2
 #define PIN_AUX 3
 
 // output pins to lights (pwm capable)
 #define PIN_BRAKE 10
 #define PIN_HAZARD 11
+#define PIN_REVERSE 9
 
 // RC channel data
-struct rcInput_t {
-  uint32_t thrLastPulseStart = 0;
-  uint32_t thrLastPulseWidth = 0;
-  uint32_t auxLastPulseStart = 0;
-  uint32_t auxLastPulseWidth = 0;
-};
+#define CHN_THR 0
+#define CHN_AUX 1
+
+// in channel order
+typedef RcChannels<PIN_THR, PIN_AUX> rcChannels;
+
+static rcPulse_t rcInputs[rcChannels::count];
 
-static rcInput_t rcInputs;
+// lost after 100ms without good pulses, lights go to the error pattern
+static Failsafe<rcChannels::count> failsafe(100000UL, 100000UL, FAILSAFE_ACTION_STOP, 0);
 
-// rc pulse width range (us)
-#define MIN_VALID_PULSE 1000U - 100U
-#define MAX_VALID_PULSE 2000U + 100U
+// throttle endpoints, centre and deadband, full throttle at power up to sweep
+#define CALIBRATION_EEPROM_ADDR 0
+static Calibration<1> calibration(CALIBRATION_EEPROM_ADDR);
+static_assert(CALIBRATION_EEPROM_ADDR + decltype(calibration)::EEPROM_SIZE <= E2END + 1, "calibration ring past the end of the eeprom");
 
-// aux switch thresholds (us)
-#define AUX_CHN_LOW_THRES 1250U
+// aux switch threshold (us), a switch has no centre to calibrate
 #define AUX_CHN_HIGH_THRES 1750U
 
 // brightness values for brake leds
-#define POSITION_LIGHT 31U 
+#define POSITION_LIGHT 31U
 #define BRAKE_LIGHT 255U
 
+// throttle zones, on calibrated pulses (us)
+#define THR_BRAKE_THRES 1450U
+#define THR_ACCEL_THRES 1550U
+
 // when easying off throttle, what decrease should trigger brake
 #define THR_BRAKE_TRIGGER_OFFSET 20U
 
-// how much to keep brake light on when backing off throttle
-#define BRAKE_LIGHT_OFF_DELAY 5U
+// how much to keep brake light on when backing off throttle (us)
+#define BRAKE_LIGHT_OFF_DELAY 50000UL
+
+// braking through a shorter neutral is still braking, longer is reversing (us)
+#define THR_NEUTRAL_BRAKE_TIME 50000UL
+
+// light engine inputs
+#define GROUP_THR 0
+#define GROUP_AUX 1
+#define GROUP_SIGNAL 2
+#define GROUPS 3
+
+enum lightsInput_t {
+  THR_INIT = 1, // throttle not moved yet
+  THR_BRAKE,
+  THR_NEUTRAL,
+  THR_ACCEL,
+  THR_EASE, // events in accel, pulse went down / up
+  THR_PUSH,
+  AUX_OFF,
+  AUX_ON,
+  SIGNAL_OK,
+  SIGNAL_LOST,
+  SIGNAL_CAL // stick sweep
+};
 
-//
+// light bits
+#define LIGHT_WAITING 0x01
+#define LIGHT_BRAKE 0x02
+#define LIGHT_REVERSE 0x04
+#define LIGHT_HAZARD 0x08
+#define LIGHT_ERROR 0x10
+#define LIGHT_CAL 0x20
+
+// outputs, in sequencer order
+#define OUT_BRAKE 0
+#define OUT_HAZARD 1
+#define OUT_REVERSE 2
+
+typedef LightSequencer<PIN_BRAKE, PIN_HAZARD, PIN_REVERSE> lightSequencer;
+
+// first matching rule wins
+static const lightsRule_t lightRules[] PROGMEM = {
+  // from, to, flags, set, clear, within, hold
+  {LIGHTS_ANY, THR_INIT, 0, LIGHT_WAITING, 0, 0, 0},
+  {THR_INIT, THR_NEUTRAL, LIGHTS_STAY, 0, 0, 0, 0},
+  {LIGHTS_ANY, THR_ACCEL, LIGHTS_DROP, 0, LIGHT_WAITING | LIGHT_BRAKE | LIGHT_REVERSE, 0, 0},
+  {LIGHTS_ANY, THR_NEUTRAL, 0, LIGHT_BRAKE, LIGHT_REVERSE, 0, 0},
+  {THR_NEUTRAL, THR_BRAKE, 0, LIGHT_BRAKE, 0, THR_NEUTRAL_BRAKE_TIME, 0},
+  {THR_ACCEL, THR_BRAKE, 0, LIGHT_BRAKE, 0, 0, 0},
+  {LIGHTS_ANY, THR_BRAKE, LIGHTS_DROP, LIGHT_REVERSE, LIGHT_WAITING | LIGHT_BRAKE, 0, 0},
+  {THR_ACCEL, THR_EASE, 0, LIGHT_BRAKE, 0, 0, BRAKE_LIGHT_OFF_DELAY},
+  {THR_ACCEL, THR_PUSH, 0, 0, LIGHT_BRAKE, 0, 0},
+  {LIGHTS_ANY, AUX_ON, 0, LIGHT_HAZARD, 0, 0, 0},
+  {LIGHTS_ANY, AUX_OFF, 0, 0, LIGHT_HAZARD, 0, 0},
+  {LIGHTS_ANY, SIGNAL_LOST, 0, LIGHT_ERROR, LIGHT_CAL, 0, 0},
+  {LIGHTS_ANY, SIGNAL_OK, 0, 0, LIGHT_ERROR | LIGHT_CAL, 0, 0},
+  {LIGHTS_ANY, SIGNAL_CAL, 0, LIGHT_CAL, LIGHT_ERROR, 0, 0},
+};
 
-void setup() {
-  pinMode(LED_BUILTIN, OUTPUT);
-  digitalWrite(LED_BUILTIN, 0);
+#define PATTERN_BLINK 0
+#define PATTERN_ERROR 1
+#define PATTERN_ERROR_INV 2
 
-  pinMode(PIN_THR, INPUT);
-  pinMode(PIN_AUX, INPUT);
+static const lightsPattern_t lightPatterns[] PROGMEM = {
+  {0x0007, 10},
+  {0xff00, 16},
+  {0x00ff, 16},
+};
 
-  pinMode(PIN_BRAKE, OUTPUT);
-  pinMode(PIN_HAZARD, OUTPUT);
-  analogWrite(PIN_BRAKE, 0);
-  analogWrite(PIN_HAZARD, 0);
+// by priority, first entry of an output with a light on wins
+static const lightsOutput_t lightOutputs[] PROGMEM = {
+  // output, lights, level, pattern, fade
+  {OUT_BRAKE, LIGHT_ERROR, 255, PATTERN_ERROR_INV, 0},
+  {OUT_BRAKE, LIGHT_CAL, 255, PATTERN_BLINK, 0},
+  {OUT_BRAKE, LIGHT_WAITING, 127, PATTERN_BLINK, 16},
+  {OUT_BRAKE, LIGHT_BRAKE, BRAKE_LIGHT, LIGHTS_STEADY, 0},
+  {OUT_BRAKE, 0, POSITION_LIGHT, LIGHTS_STEADY, 16},
+  {OUT_HAZARD, LIGHT_ERROR, 255, PATTERN_ERROR, 0},
+  {OUT_HAZARD, LIGHT_CAL, 255, PATTERN_BLINK, 0},
+  {OUT_HAZARD, LIGHT_HAZARD, 255, PATTERN_BLINK, 32},
+  {OUT_REVERSE, LIGHT_ERROR, 0, LIGHTS_STEADY, 0},
+  {OUT_REVERSE, LIGHT_REVERSE, 255, LIGHTS_STEADY, 32},
+};
 
-  // ready
-  digitalWrite(LED_BUILTIN, 1);
-}
+static Lights<GROUPS> lights(lightRules, sizeof(lightRules) / sizeof(lightRules[0]),
+                             lightOutputs, sizeof(lightOutputs) / sizeof(lightOutputs[0]));
 
-enum THR_STATES {
-  ACCEL,
-  NEUTRAL,
-  BRAKE
-};
+// task rates (Hz), rules are timed in us, the rates only set how close the
+// outputs follow
+#define RC_TASK_RATE 1000
+#define LIGHTS_TASK_RATE 1000
 
-// Brake light rules
-// - brake from neutral && neutral short : ON
-// - any to neutral : ON
-// - any to accel: OFF
-// - in accell (optional)
-//   - if higher: OFF
-//   - if lower: ON
-
-void processThr(const uint32_t now, const uint32_t pulseWidth, const bool blinkPulse) {
-  static THR_STATES lastThrState = NEUTRAL;
-  static uint32_t lastThrStateTs = micros();
-  static uint32_t lastThrPulseWidth = 0;
-  static uint32_t lastThrPulseWidthTs = micros();
-  static bool brakeLight = true;
-  static bool throttleMoved = false;
-  static uint32_t brakeLightCountdown = 0;
-
-  THR_STATES thrState = NEUTRAL;
-  if (pulseWidth <= 1450U) {
-    thrState = BRAKE;
-  } else if (pulseWidth >= 1550U) {
-    thrState = ACCEL;
-  }
+static Scheduler<2> scheduler;
 
-  if (thrState != NEUTRAL && !throttleMoved) {
-    throttleMoved = true;
-  }
+#ifdef __AVR__
+ISR(TIMER0_COMPA_vect) {
+  PROBE_BEGIN(PROBE_LIGHTS);
+  lightSequencer::tick();
+  PROBE_END(PROBE_LIGHTS);
+}
+#endif
 
-  if (!throttleMoved) {
-    // blink untill throttle moved
-    analogWrite(PIN_BRAKE, blinkPulse * 127);
-    return;
-  }
+//
 
-  // state transition rules
-  if (thrState != lastThrState) {
-    if (thrState == ACCEL) {
-      // transition to accel; accel variation will be handled later
-      brakeLight = false;
-      brakeLightCountdown = 0;
-
-    } else if (thrState == NEUTRAL) {
-      brakeLight = true;
-
-    } else if (thrState == BRAKE) {
-      if (lastThrState == NEUTRAL && now - lastThrStateTs < 50000U) { // micros
-        brakeLight = true;
-      } else if (lastThrState == ACCEL) {
-        brakeLight = true;
-      } else {
-        brakeLight = false;
-        brakeLightCountdown = 0;
-      }
-    }
-  }
+// throttle zone, plus an ease / push event on pulse changes within accel:
+// not on the pass that enters it, the pulse before was another zone's
+void processThr(const uint32_t now, const uint16_t pulseWidth) {
+  static uint16_t lastThrPulseWidth = 0;
 
-  // pulse variation rules
-  if (pulseWidth != lastThrPulseWidth) {
-    // brake on accell going down
-    if (thrState == ACCEL && lastThrState == ACCEL) {
-      if (pulseWidth < lastThrPulseWidth - THR_BRAKE_TRIGGER_OFFSET) {
-        brakeLight = true;
-        brakeLightCountdown = BRAKE_LIGHT_OFF_DELAY;
-      } else {
-        brakeLight = false;
-      }
-    }
+  uint8_t thrState = THR_NEUTRAL;
+  if (pulseWidth <= THR_BRAKE_THRES) {
+    thrState = THR_BRAKE;
+  } else if (pulseWidth >= THR_ACCEL_THRES) {
+    thrState = THR_ACCEL;
   }
 
-  // after rules are evaluated, update state and pulse width
-  if (thrState != lastThrState) {
-    lastThrStateTs = now;
-    lastThrState = thrState;
-  }
   if (pulseWidth != lastThrPulseWidth) {
-    lastThrPulseWidthTs = now;
+    if (thrState == THR_ACCEL && lights.state(GROUP_THR) == THR_ACCEL) {
+      bool easing = pulseWidth + THR_BRAKE_TRIGGER_OFFSET < lastThrPulseWidth;
+      lights.event(now, GROUP_THR, easing ? THR_EASE : THR_PUSH);
+    }
     lastThrPulseWidth = pulseWidth;
   }
+  lights.set(now, GROUP_THR, thrState);
+}
+
+void processAux2P(const uint32_t now, const uint16_t pulseWidth) {
+  lights.set(now, GROUP_AUX, pulseWidth > AUX_CHN_HIGH_THRES ? AUX_ON : AUX_OFF);
+}
+
+void rcTask(const uint32_t) {
+  rcChannels::readAll(rcInputs);
+
+  // after reading pulses, so they can't be newer than now
+  uint32_t now = micros();
+
+  failsafeState_t signalState = failsafe.update(now, rcInputs);
 
-  // forced brake light on
-  if (brakeLightCountdown > 0) {
-    brakeLight = true;
-    brakeLightCountdown--;
+  if (signalState == FAILSAFE_OK) {
+    calibration.entry(now, rcInputs[CHN_THR].width);
+    calibration.sweep(now, &rcInputs[CHN_THR]);
   }
 
-  // serves as both position and brake
-  uint8_t brakeLightValue = brakeLight ? BRAKE_LIGHT : POSITION_LIGHT;
-  analogWrite(PIN_BRAKE, brakeLightValue);
+  if (signalState == FAILSAFE_STOP) {
+    lights.set(now, GROUP_SIGNAL, SIGNAL_LOST);
+  } else if (calibration.sweeping()) {
+    lights.set(now, GROUP_SIGNAL, SIGNAL_CAL);
+  } else {
+    lights.set(now, GROUP_SIGNAL, SIGNAL_OK);
+    processThr(now, calibration.normalize(0, rcInputs[CHN_THR].width));
+    processAux2P(now, rcInputs[CHN_AUX].width);
+  }
 }
 
-void processAux2P(const uint32_t now, const uint32_t pulseWidth, const bool blinkPulse) {
-  if (pulseWidth > AUX_CHN_HIGH_THRES) {
-    analogWrite(PIN_HAZARD, blinkPulse * 255);
-  } else if (pulseWidth < AUX_CHN_LOW_THRES) {
-    analogWrite(PIN_HAZARD, 0);
-  } else {
-    analogWrite(PIN_HAZARD, 0);
+void lightsTask(const uint32_t now) {
+  // on the avr the ticks due by now ran before this pass, poll first
+  lightSequencer::poll(now);
+  for (uint8_t i = 0; i < lightSequencer::count; i++) {
+    lightSequencer::play(i, lights.output(now, i));
   }
 }
 
-void loop() {
-  static uint8_t badConsecutivePulses = 0;
-  static uint8_t blinkPulse = 0;
-  static uint8_t errorPulse = 0;
-  static bool blinkPattern[] = {1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
-  static bool errorPattern[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1};
+void setup() {
+  pinMode(LED_BUILTIN, OUTPUT);
+  FastPin<LED_BUILTIN>::write(0);
 
-  uint32_t now = micros();
+  rcChannels::begin(INPUT);
 
-  uint32_t thrPulseWidth = pulseIn(PIN_THR, HIGH, 25000);
-  if (thrPulseWidth > 0) {
-    rcInputs.thrLastPulseWidth = thrPulseWidth;
-    rcInputs.thrLastPulseStart = now;
-  }
-  uint32_t auxPulseWidth = pulseIn(PIN_AUX, HIGH, 25000);
-  if (auxPulseWidth > 0) {
-    rcInputs.auxLastPulseWidth = auxPulseWidth;
-    rcInputs.auxLastPulseStart = now;
-  }
+  lightSequencer::begin(lightPatterns);
 
-  bool validAux = rcInputs.auxLastPulseWidth >= 1000U && rcInputs.auxLastPulseWidth <= 2000U;
-  bool freshAux = now - rcInputs.auxLastPulseStart <= 100000U;
-  bool validThr = rcInputs.thrLastPulseWidth >= 1000U && rcInputs.thrLastPulseWidth <= 2000U;
-  bool freshThr = now - rcInputs.thrLastPulseStart <= 100000U;
+  uint32_t now = micros();
+  calibration.begin(now);
 
-  bool validPulse = validAux && validThr;
-  bool freshPulse = freshAux && freshThr;
+  lights.begin(now, GROUP_THR, THR_INIT);
+  lights.begin(now, GROUP_AUX, AUX_OFF);
+  lights.begin(now, GROUP_SIGNAL, SIGNAL_OK);
 
-  if (validPulse && freshPulse) {
-    badConsecutivePulses = 0;
-  } else {
-    if (badConsecutivePulses < 255) {
-      badConsecutivePulses++;
-    }
-  }
+  scheduler.add(rcTask, TASK_HZ(RC_TASK_RATE));
+  scheduler.add(lightsTask, TASK_HZ(LIGHTS_TASK_RATE));
+  scheduler.begin();
 
-  uint32_t pulse = now >> 16;
-  blinkPulse = blinkPattern[pulse % sizeof(blinkPattern)];
-  errorPulse = errorPattern[pulse % sizeof(errorPattern)];
+  // ready
+  FastPin<LED_BUILTIN>::write(1);
+}
 
-  if (freshPulse && badConsecutivePulses < 10) {
-    processThr(now, rcInputs.thrLastPulseWidth, blinkPulse);
-    processAux2P(now, rcInputs.auxLastPulseWidth, blinkPulse);
-  } else {
-    analogWrite(PIN_BRAKE, (1 - errorPulse) * 255);
-    analogWrite(PIN_HAZARD, errorPulse * 255);
-  }
+void loop() {
+  PROBE_BEGIN(PROBE_LOOP);
+
+  scheduler.run();
+  calibration.saveStep();
 
-  // TODO figure out what delay we want (ms)
-  delay(10);
+  PROBE_END(PROBE_LOOP);
 }
@@ -0,0 +1,291 @@
+// Throttle traces through the brake light code before the Lights tables
+// (processThr() as it was, 10ms loop) and through the sketch's tables: the
+// brake output must ask for the same level at every old loop pass.
+//
+// That includes the old countdown forcing brakeLight itself on: a push
+// while it ran was lost and the brake stayed on past the 50ms until the
+// pulse changed again, as a clear of a held light is lost in the tables.
+
+#include <unity.h>
+
+#include "../../src/main.cpp"
+
+#include <HalNative.h>
+#include <new>
+
+// the old rules, pwm writes turned into a returned level
+namespace before {
+
+enum THR_STATES {
+  ACCEL,
+  NEUTRAL,
+  BRAKE
+};
+
+#define BEFORE_BRAKE_LIGHT_OFF_DELAY 5U
+
+static THR_STATES lastThrState;
+static uint32_t lastThrStateTs;
+static uint32_t lastThrPulseWidth;
+static bool brakeLight;
+static bool throttleMoved;
+static uint32_t brakeLightCountdown;
+
+// the statics of the old function, at its first call
+static void reset(const uint32_t now) {
+  lastThrState = NEUTRAL;
+  lastThrStateTs = now;
+  lastThrPulseWidth = 0;
+  brakeLight = true;
+  throttleMoved = false;
+  brakeLightCountdown = 0;
+}
+
+static uint8_t processThr(const uint32_t now, const uint32_t pulseWidth) {
+  static const bool blinkPattern[] = {1, 1, 1, 0, 0, 0, 0, 0, 0, 0};
+  bool blinkPulse = blinkPattern[(now >> 16) % sizeof(blinkPattern)];
+
+  THR_STATES thrState = NEUTRAL;
+  if (pulseWidth <= 1450U) {
+    thrState = BRAKE;
+  } else if (pulseWidth >= 1550U) {
+    thrState = ACCEL;
+  }
+
+  if (thrState != NEUTRAL && !throttleMoved) {
+    throttleMoved = true;
+  }
+
+  if (!throttleMoved) {
+    return blinkPulse * 127;
+  }
+
+  if (thrState != lastThrState) {
+    if (thrState == ACCEL) {
+      brakeLight = false;
+      brakeLightCountdown = 0;
+    } else if (thrState == NEUTRAL) {
+      brakeLight = true;
+    } else if (thrState == BRAKE) {
+      if (lastThrState == NEUTRAL && now - lastThrStateTs < 50000U) {
+        brakeLight = true;
+      } else if (lastThrState == ACCEL) {
+        brakeLight = true;
+      } else {
+        brakeLight = false;
+        brakeLightCountdown = 0;
+      }
+    }
+  }
+
+  if (pulseWidth != lastThrPulseWidth) {
+    if (thrState == ACCEL && lastThrState == ACCEL) {
+      if (pulseWidth < lastThrPulseWidth - THR_BRAKE_TRIGGER_OFFSET) {
+        brakeLight = true;
+        brakeLightCountdown = BEFORE_BRAKE_LIGHT_OFF_DELAY;
+      } else {
+        brakeLight = false;
+      }
+    }
+  }
+
+  if (thrState != lastThrState) {
+    lastThrStateTs = now;
+    lastThrState = thrState;
+  }
+  if (pulseWidth != lastThrPulseWidth) {
+    lastThrPulseWidth = pulseWidth;
+  }
+
+  if (brakeLightCountdown > 0) {
+    brakeLight = true;
+    brakeLightCountdown--;
+  }
+
+  return brakeLight ? BRAKE_LIGHT : POSITION_LIGHT;
+}
+
+} // namespace before
+
+// brake level the tables ask for now, the pattern step taken as the old
+// loop did, fades left to the sequencer
+static uint8_t brakeLevel(const uint32_t now) {
+  lightsOutput_t out = lights.output(now, OUT_BRAKE);
+  if (out.pattern == LIGHTS_STEADY) {
+    return out.level;
+  }
+  lightsPattern_t p;
+  memcpy_P(&p, &lightPatterns[out.pattern], sizeof(p));
+  return (p.steps >> ((now >> 16) % p.length)) & 1 ? out.level : 0;
+}
+
+static uint32_t seed;
+
+static uint16_t rnd(const uint16_t range) {
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 8) % range;
+}
+
+// both fed the same pulse every pass of the old 10ms loop
+static uint32_t passes;
+static uint32_t brakeOn;
+static uint32_t mismatches;
+
+static void feed(const uint16_t width) {
+  uint32_t now = micros();
+  uint8_t old = before::processThr(now, width);
+  processThr(now, width);
+  uint8_t level = brakeLevel(now);
+
+  passes++;
+  brakeOn += level == BRAKE_LIGHT;
+  halAdvance(10000);
+  if (old != level) {
+    mismatches++;
+    char msg[64];
+    snprintf(msg, sizeof(msg), "pass %lu at %lums width %u", (unsigned long)passes, (unsigned long)(now / 1000), width);
+    TEST_MESSAGE(msg);
+  }
+}
+
+static void hold(const uint16_t width, const uint16_t ms) {
+  for (uint16_t t = 0; t < ms; t += 10) {
+    feed(width);
+  }
+}
+
+void setUp() {
+  halReset();
+  halAdvance(20000);
+  seed = 1;
+  passes = 0;
+  brakeOn = 0;
+  mismatches = 0;
+  new (&lights) Lights<GROUPS>(lightRules, sizeof(lightRules) / sizeof(lightRules[0]),
+                               lightOutputs, sizeof(lightOutputs) / sizeof(lightOutputs[0]));
+  uint32_t now = micros();
+  lights.begin(now, GROUP_THR, THR_INIT);
+  before::reset(now);
+}
+
+void tearDown() {
+}
+
+void test_waiting_blink_until_throttle_moves() {
+  hold(1500, 2000);
+  hold(1520, 500);
+  TEST_ASSERT_EQUAL_UINT8(THR_INIT, lights.state(GROUP_THR));
+  hold(1700, 100);
+  TEST_ASSERT_EQUAL_UINT8(THR_ACCEL, lights.state(GROUP_THR));
+  TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+}
+
+void test_scripted_drive() {
+  hold(1500, 300);
+  // accelerate, ease off by more than the offset, back on
+  hold(1800, 500);
+  hold(1750, 30);
+  // the push is lost to the hold, the brake stays on past its 50ms
+  hold(1760, 200);
+  TEST_ASSERT_EQUAL_UINT8(BRAKE_LIGHT, brakeLevel(micros()));
+  hold(1700, 100);
+  // neutral and a quick brake through it
+  hold(1500, 30);
+  hold(1300, 300);
+  // neutral long enough to mean reverse next
+  hold(1500, 500);
+  hold(1300, 500);
+  // reverse to accel through neutral
+  hold(1500, 20);
+  hold(1900, 200);
+  // straight from accel into brake
+  hold(1200, 200);
+  hold(1500, 200);
+  TEST_ASSERT_TRUE(brakeOn > 50);
+  TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+}
+
+void test_random_traces() {
+  uint32_t total = 0;
+  uint32_t mismatched = 0;
+  for (uint8_t trace = 0; trace < 20; trace++) {
+    setUp();
+    seed = trace + 1;
+    // sticks at neutral at power up, the old code took boot as the time
+    // neutral was entered
+    uint16_t width = 1500;
+    hold(width, 100);
+    for (uint16_t segment = 0; segment < 300; segment++) {
+      switch (rnd(4)) {
+      case 0:
+        // a new stick position anywhere
+        width = 1000 + rnd(1001);
+        break;
+      case 1:
+        // ease off or push a bit
+        width = constrain(width + (int16_t)rnd(81) - 40, 1000, 2000);
+        break;
+      case 2:
+        width = 1500;
+        break;
+      default:
+        // noisy hold
+        break;
+      }
+      uint16_t ms = 10 + rnd(40) * 10;
+      for (uint16_t t = 0; t < ms; t += 10) {
+        feed(width + rnd(5) - 2);
+      }
+    }
+    total += passes;
+    mismatched += mismatches;
+    TEST_ASSERT_TRUE(brakeOn > 0);
+  }
+  char msg[64];
+  snprintf(msg, sizeof(msg), "%lu passes, %lu mismatched", (unsigned long)total, (unsigned long)mismatched);
+  TEST_MESSAGE(msg);
+  TEST_ASSERT_EQUAL_UINT32(0, mismatched);
+}
+
+void test_events_only_within_accel() {
+  hold(1500, 100);
+  // the pass entering accel is a zone change, not a push, as the old code
+  // had it; no output tells them apart, the event count does
+  uint16_t events = lights.events;
+  feed(1700);
+  TEST_ASSERT_EQUAL_UINT8(THR_ACCEL, lights.state(GROUP_THR));
+  TEST_ASSERT_EQUAL_UINT16(events, lights.events);
+  feed(1650);
+  TEST_ASSERT_EQUAL_UINT16(events + 1, lights.events);
+  TEST_ASSERT_EQUAL_UINT8(BRAKE_LIGHT, brakeLevel(micros()));
+  // nor on changes in the other zones
+  feed(1500);
+  feed(1450);
+  feed(1300);
+  TEST_ASSERT_EQUAL_UINT16(events + 1, lights.events);
+  TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+}
+
+void test_ease_hold_is_timed_not_counted() {
+  hold(1800, 200);
+  // the sketch reads the rc every 1ms now, the hold is still 50ms
+  uint32_t now = micros();
+  processThr(now, 1700);
+  uint16_t onFor = 0;
+  while (brakeLevel(now) == BRAKE_LIGHT && onFor < 1000) {
+    now += 1000;
+    processThr(now, 1701 + onFor % 2);
+    onFor++;
+  }
+  TEST_ASSERT_EQUAL_UINT16(BRAKE_LIGHT_OFF_DELAY / 1000, onFor);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_waiting_blink_until_throttle_moves);
+  RUN_TEST(test_scripted_drive);
+  RUN_TEST(test_random_traces);
+  RUN_TEST(test_events_only_within_accel);
+  RUN_TEST(test_ease_hold_is_timed_not_counted);
+  return UNITY_END();
+}
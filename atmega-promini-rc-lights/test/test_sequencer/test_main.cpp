@@ -0,0 +1,215 @@
+// LightSequencer replayed at the sketch's 1ms lights task, poll() standing in
+// for the Timer0 compare isr: every pwm write checked to the millisecond
+// against when the 2048us ticks and 65536us pattern steps fall.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <LightSequencer.h>
+
+#define PIN_BRAKE 10
+#define PIN_HAZARD 11
+#define PIN_REVERSE 9
+
+typedef LightSequencer<PIN_BRAKE, PIN_HAZARD, PIN_REVERSE> sequencer;
+
+#define PATTERN_BLINK 0
+#define PATTERN_ERROR 1
+#define PATTERN_ERROR_INV 2
+
+// the rc-lights sketch's
+static const lightsPattern_t patterns[] PROGMEM = {
+  {0x0007, 10},
+  {0xff00, 16},
+  {0x00ff, 16},
+};
+
+#define LOOP_US 1000UL
+
+struct write_t {
+  uint32_t ts;
+  uint8_t pin;
+  uint8_t value;
+};
+
+static write_t writes[1024];
+static uint16_t writeCount;
+
+static void record(const uint8_t pin, const int value) {
+  if (writeCount < sizeof(writes) / sizeof(writes[0])) {
+    writes[writeCount].ts = micros();
+    writes[writeCount].pin = pin;
+    writes[writeCount].value = value;
+    writeCount++;
+  }
+}
+
+static lightsOutput_t entry(const uint8_t output, const uint8_t level, const uint8_t pattern, const uint8_t fade) {
+  lightsOutput_t e;
+  e.output = output;
+  e.lights = 0;
+  e.level = level;
+  e.pattern = pattern;
+  e.fade = fade;
+  return e;
+}
+
+// loop() passes as the sketch's: run the ticks due, play what each output
+// should
+static void run(const lightsOutput_t *entries, const uint32_t ms) {
+  for (uint32_t i = 0; i < ms; i++) {
+    sequencer::poll(micros());
+    for (uint8_t o = 0; o < sequencer::count; o++) {
+      sequencer::play(o, entries[o]);
+    }
+    halAdvance(LOOP_US);
+  }
+}
+
+// the clock is never reset, ticks stay at multiples of 2048us from 0; up
+// to the first loop pass at or after ts, not run yet
+static void advanceTo(const uint32_t ts) {
+  static const lightsOutput_t off[] = {entry(0, 0, LIGHTS_STEADY, 0), entry(1, 0, LIGHTS_STEADY, 0), entry(2, 0, LIGHTS_STEADY, 0)};
+  while (micros() < ts) {
+    run(off, 1);
+  }
+  writeCount = 0;
+}
+
+// next multiple of period, far enough that the last test's outputs have
+// dropped to off before it
+static uint32_t boundary(const uint32_t period) {
+  return ((micros() + 2 * LIGHTS_TICK_US) / period + 1) * period;
+}
+
+// a write due at ts lands on the first loop pass at or after it
+static void checkWrite(const write_t &w, const uint8_t pin, const uint32_t ts, const uint8_t value) {
+  TEST_ASSERT_EQUAL_UINT8(pin, w.pin);
+  TEST_ASSERT_EQUAL_UINT8(value, w.value);
+  TEST_ASSERT_TRUE(w.ts >= ts);
+  TEST_ASSERT_TRUE(w.ts - ts < LOOP_US);
+}
+
+void setUp() {
+  writeCount = 0;
+  halWatchPin(PIN_BRAKE, record);
+  halWatchPin(PIN_HAZARD, record);
+  halWatchPin(PIN_REVERSE, record);
+}
+
+void tearDown() {
+  halWatchPin(PIN_BRAKE, nullptr);
+  halWatchPin(PIN_HAZARD, nullptr);
+  halWatchPin(PIN_REVERSE, nullptr);
+}
+
+void test_tick_and_step_periods() {
+  TEST_ASSERT_EQUAL_UINT32(2048, LIGHTS_TICK_US);
+  TEST_ASSERT_EQUAL_UINT32(32, LIGHTS_TICKS_PER_STEP);
+  TEST_ASSERT_EQUAL_UINT32(LIGHTS_STEP_US, LIGHTS_TICK_US * LIGHTS_TICKS_PER_STEP);
+}
+
+void test_steady_level_at_the_next_tick_written_once() {
+  advanceTo(3000);
+  static const lightsOutput_t entries[] = {entry(0, 200, LIGHTS_STEADY, 0), entry(1, 0, LIGHTS_STEADY, 0), entry(2, 0, LIGHTS_STEADY, 0)};
+  run(entries, 1000);
+  TEST_ASSERT_EQUAL_UINT16(1, writeCount);
+  // tick 2 at 4096us
+  checkWrite(writes[0], PIN_BRAKE, 2 * LIGHTS_TICK_US, 200);
+}
+
+void test_blink_steps_on_65536us_boundaries() {
+  // from a whole pattern of the old now >> 16 stepping, the sequence is
+  // the old one, steps on time instead of at the next 10ms loop pass
+  uint32_t start = boundary(10 * LIGHTS_STEP_US);
+  advanceTo(start);
+  static const lightsOutput_t entries[] = {entry(0, 127, PATTERN_BLINK, 0), entry(1, 0, LIGHTS_STEADY, 0), entry(2, 0, LIGHTS_STEADY, 0)};
+  run(entries, 5000);
+
+  // on for steps 0..2 of every 10, the write at the tick that steps
+  uint16_t n = 0;
+  for (uint32_t step = 0; (start + step * LIGHTS_STEP_US) < micros(); step++) {
+    uint32_t ts = start + step * LIGHTS_STEP_US;
+    uint8_t bit = (step % 10) < 3;
+    uint8_t last = step == 0 ? 0 : (((step - 1) % 10) < 3);
+    if (bit == last) {
+      continue;
+    }
+    // the very first is the tick after start
+    checkWrite(writes[n++], PIN_BRAKE, step == 0 ? ts + LIGHTS_TICK_US : ts, bit ? 127 : 0);
+    // the old loop's pattern at that time
+    TEST_ASSERT_EQUAL_UINT8(bit, (0x0007 >> ((ts >> 16) % 10)) & 1);
+  }
+  TEST_ASSERT_EQUAL_UINT16(n, writeCount);
+  TEST_ASSERT_TRUE(n >= 14);
+}
+
+void test_error_patterns_stay_complementary() {
+  uint32_t start = boundary(LIGHTS_STEP_US);
+  advanceTo(start);
+  static const lightsOutput_t entries[] = {entry(0, 255, PATTERN_ERROR_INV, 0), entry(1, 255, PATTERN_ERROR, 0), entry(2, 0, LIGHTS_STEADY, 0)};
+  for (uint16_t i = 0; i < 4000; i++) {
+    run(entries, 1);
+    if (micros() - start > 2 * LIGHTS_TICK_US) {
+      // same tick, never both on or both off
+      TEST_ASSERT_EQUAL_UINT8(255, sequencer::current(0) + sequencer::current(1));
+    }
+  }
+  // brake on at the tick after start, then 8 steps each way, both
+  // switching at the same tick
+  checkWrite(writes[0], PIN_BRAKE, start + LIGHTS_TICK_US, 255);
+  for (uint16_t i = 1; i + 1 < writeCount; i += 2) {
+    uint32_t ts = start + (i / 2 + 1) * 8 * LIGHTS_STEP_US;
+    uint8_t on = (i / 2) % 2 ? 255 : 0;
+    checkWrite(writes[i], PIN_BRAKE, ts, on);
+    checkWrite(writes[i + 1], PIN_HAZARD, ts, 255 - on);
+    TEST_ASSERT_EQUAL_UINT32(writes[i].ts, writes[i + 1].ts);
+  }
+  TEST_ASSERT_EQUAL_UINT16(1 + 2 * ((micros() - start) / (8 * LIGHTS_STEP_US)), writeCount);
+}
+
+void test_fade_moves_per_tick() {
+  uint32_t start = boundary(LIGHTS_TICK_US);
+  advanceTo(start);
+  // hazard up at 32 per tick
+  static const lightsOutput_t up[] = {entry(0, 0, LIGHTS_STEADY, 0), entry(1, 255, LIGHTS_STEADY, 32), entry(2, 0, LIGHTS_STEADY, 0)};
+  run(up, 100);
+  TEST_ASSERT_EQUAL_UINT16(8, writeCount);
+  for (uint8_t i = 0; i < 8; i++) {
+    checkWrite(writes[i], PIN_HAZARD, start + (i + 1) * LIGHTS_TICK_US, i < 7 ? (i + 1) * 32 : 255);
+  }
+
+  // steady 0 without a fade drops in one write
+  advanceTo(micros() + 2 * LIGHTS_TICK_US);
+  TEST_ASSERT_EQUAL_UINT8(0, sequencer::current(1));
+}
+
+void test_same_entry_keeps_the_pattern_running() {
+  uint32_t start = boundary(10 * LIGHTS_STEP_US);
+  advanceTo(start);
+  static const lightsOutput_t entries[] = {entry(0, 127, PATTERN_BLINK, 0), entry(1, 0, LIGHTS_STEADY, 0), entry(2, 0, LIGHTS_STEADY, 0)};
+  run(entries, 800);
+  // played every pass for 800ms: on 3 steps, off 7, on again
+  TEST_ASSERT_EQUAL_UINT16(3, writeCount);
+  checkWrite(writes[1], PIN_BRAKE, start + 3 * LIGHTS_STEP_US, 0);
+  checkWrite(writes[2], PIN_BRAKE, start + 10 * LIGHTS_STEP_US, 127);
+
+  // a different one restarts at step 0 from the next tick
+  static const lightsOutput_t other[] = {entry(0, 200, PATTERN_BLINK, 0), entry(1, 0, LIGHTS_STEADY, 0), entry(2, 0, LIGHTS_STEADY, 0)};
+  uint32_t change = micros();
+  run(other, 10);
+  TEST_ASSERT_EQUAL_UINT16(4, writeCount);
+  checkWrite(writes[3], PIN_BRAKE, (change / LIGHTS_TICK_US + 1) * LIGHTS_TICK_US, 200);
+}
+
+int main() {
+  sequencer::begin(patterns);
+  UNITY_BEGIN();
+  RUN_TEST(test_tick_and_step_periods);
+  RUN_TEST(test_steady_level_at_the_next_tick_written_once);
+  RUN_TEST(test_blink_steps_on_65536us_boundaries);
+  RUN_TEST(test_error_patterns_stay_complementary);
+  RUN_TEST(test_fade_moves_per_tick);
+  RUN_TEST(test_same_entry_keeps_the_pattern_running);
+  return UNITY_END();
+}
@@ -1,61 +1,121 @@
 #include <Arduino.h>
 #include <EnableInterrupt.h>
+#include <FastPin.h>
+#include <RcCapture.h>
+#include <RcChannels.h>
+#include <RcPpm.h>
+#include <RcSbus.h>
+#include <Probe.h>
 
 //#define DEBUG
 
+// build with -D RC_INPUT_PPM or -D RC_INPUT_SBUS to take all channels from
+// one wire instead of a pwm wire per channel
+
 // channel count and indexes (order does not actually matter but keep same as on receiver)
 #define CHN_COUNT 2
 #define CHN_STR 0
 #define CHN_THR 1
 
-// inputs from RC receiver (must be INT - not PCINT - capable pins)
-uint8_t chnInputPins[CHN_COUNT] = {
-  2,  // steering channel on INT0 pin
-  3,  // throttle channel on INT1 pin
-};
+// inputs from RC receiver, any pin with enableInterrupt()
+#define PIN_STR 2 // steering channel on INT0 pin
+#ifdef RC_CAPTURE_TIMER1
+#define PIN_THR RC_TIMER_ICP_PIN // throttle channel on ICP1 pin
+#else
+#define PIN_THR 3 // throttle channel on INT1 pin
+#endif
 
 // leds for visualising input level (must be pwm-capable pins)
-uint8_t chnOutputLeds[CHN_COUNT] = {
-  10, // steering led
-  11  // throttle led
-};
+#ifdef RC_CAPTURE_TIMER1
+#define LED_STR 6 // timer1 pins can't do pwm while capturing
+#else
+#define LED_STR 10
+#endif
+#define LED_THR 11
+
+uint8_t chnOutputLeds[CHN_COUNT] = {LED_STR, LED_THR};
 
 //
 
-volatile uint32_t chnLastPulseStart[CHN_COUNT];
-volatile uint32_t chnLastPulseWidth[CHN_COUNT];
+#if defined(RC_INPUT_PPM)
+
+// ppm sum on the INT0 pin
+#define PIN_PPM 2
+#define PPM_CHANNELS 8
+
+static RcPpm<PPM_CHANNELS> rcPpm;
+
+void ppmInterrupt() {
+  PROBE_BEGIN(PROBE_ISR_1);
+  rcPpm.handleEdge(rcTimerNow());
+  PROBE_END(PROBE_ISR_1);
+}
+
+rcPulse_t rcRead(const uint8_t chnIndex) {
+  return rcPpm.read(chnIndex);
+}
+
+#elif defined(RC_INPUT_SBUS)
 
-void handleChnEvent(uint32_t now, uint8_t chnIndex, uint8_t chnState) {
-  if (chnState == 1) {
-    // up transition, record start
-    chnLastPulseStart[chnIndex] = now;
-    return;
+// sbus on RX through an inverter, debug output goes out at the sbus rate
+static RcSbus rcSbus;
+
+// the 64 byte rx buffer fills in ~7.7ms at 100000 baud 8E2, poll every 1ms
+void sbusPoll() {
+  while (Serial.available()) {
+    uint8_t b = Serial.read();
+    PROBE_BEGIN(PROBE_DECODE);
+    rcSbus.handleByte(b, micros());
+    PROBE_END(PROBE_DECODE);
   }
-  
-  if (chnLastPulseStart[chnIndex] == 0) {
-    // no up transition yet
-    return;
+}
+
+rcPulse_t rcRead(const uint8_t chnIndex) {
+  return rcSbus.read(chnIndex);
+}
+
+#else
+
+// in channel order
+typedef RcChannels<PIN_STR, PIN_THR> rcChannels;
+
+#ifdef RC_CAPTURE_TIMER1
+ISR(TIMER1_CAPT_vect) {
+  PROBE_BEGIN(PROBE_ISR_2);
+  rcChannels::handleCapture();
+  PROBE_END(PROBE_ISR_2);
+}
+#endif
+
+void attachPinChange(const uint8_t pin, void (*handler)(), const uint8_t mode) {
+  enableInterrupt(pin, handler, mode);
+}
+
+rcPulse_t rcRead(const uint8_t chnIndex) {
+  return rcChannels::read(chnIndex);
+}
+
+#endif
+
+// delay, serving the sbus input meanwhile
+void wait(const uint32_t ms) {
+#ifdef RC_INPUT_SBUS
+  for (uint32_t i = 0; i < ms; i++) {
+    sbusPoll();
+    delay(1);
   }
+#else
+  delay(ms);
+#endif
+}
 
-  // down transition, compute width
-  uint16_t pulseWidth = now - chnLastPulseStart[chnIndex];
+uint16_t chnPulseWidth(const uint8_t chnIndex) {
+  uint16_t pulseWidth = rcRead(chnIndex).width;
   if (pulseWidth < 1000 || pulseWidth > 2000) {
     // invalid
     pulseWidth = 0;
   }
-  chnLastPulseWidth[chnIndex] = pulseWidth;
-}
-
-void strInterrupt() {
-  uint32_t now = micros();
-  uint8_t state = digitalRead(chnInputPins[CHN_STR]);
-  handleChnEvent(now, CHN_STR, state);
-}
-
-void thrInterrupt() {
-  uint32_t now = micros();
-  uint8_t state = digitalRead(chnInputPins[CHN_THR]);
-  handleChnEvent(now, CHN_THR, state);
+  return pulseWidth;
 }
 
 void printPulseData(const uint8_t chnIndex, uint16_t pulseWidth, uint8_t ledValue) {
@@ -69,15 +129,50 @@ void printPulseData(const uint8_t chnIndex, uint16_t pulseWidth, uint8_t ledValu
 #endif
 }
 
+void printDecoderStats() {
+#ifdef DEBUG
+#if defined(RC_INPUT_PPM)
+  rcPpmStats_t stats = rcPpm.getStats();
+  Serial.print("Ppm: frames ");
+  Serial.print(stats.frames);
+  Serial.print(" errors ");
+  Serial.print(stats.errors);
+  Serial.print(" channels ");
+  Serial.println(stats.channels);
+#elif defined(RC_INPUT_SBUS)
+  Serial.print("Sbus: frames ");
+  Serial.print(rcSbus.stats.frames);
+  Serial.print(" errors ");
+  Serial.print(rcSbus.stats.errors);
+  Serial.print(" lost ");
+  Serial.print(rcSbus.stats.lost);
+  Serial.print(" failsafes ");
+  Serial.println(rcSbus.stats.failsafes);
+#endif
+#endif
+}
+
 uint8_t pulseWidthToLedValue(uint16_t pulseWidth) {
   return pulseWidth > 0 ? (pulseWidth - 1000) / 4 : 0;
 }
 
+void writeLed(const uint8_t chnIndex, const uint8_t ledValue) {
+  if (chnIndex == CHN_STR) {
+    PwmPin<LED_STR>::write(ledValue);
+  } else {
+    PwmPin<LED_THR>::write(ledValue);
+  }
+}
+
 //
 
 void setup() {
-#ifdef DEBUG
+#if defined(RC_INPUT_SBUS)
+  Serial.begin(RC_SBUS_BAUD, SERIAL_8E2);
+#elif defined(DEBUG)
   Serial.begin(9600);
+#endif
+#ifdef DEBUG
   Serial.println("Initializing...");
 #endif
 
@@ -86,14 +181,16 @@ void setup() {
   //
 
   for (uint8_t chnIndex = 0; chnIndex < CHN_COUNT; chnIndex++) {
-    pinMode(chnInputPins[chnIndex], INPUT);
     pinMode(chnOutputLeds[chnIndex], OUTPUT);
   }
   
-  //attachInterrupt(digitalPinToInterrupt(chnInputPins[CHN_STR]), strInterrupt, CHANGE);
-  //attachInterrupt(digitalPinToInterrupt(chnInputPins[CHN_THR]), thrInterrupt, CHANGE);
-  enableInterrupt(chnInputPins[CHN_STR], strInterrupt, CHANGE);
-  enableInterrupt(chnInputPins[CHN_THR], thrInterrupt, CHANGE);
+#if defined(RC_INPUT_PPM)
+  rcTimerBegin();
+  FastPin<PIN_PPM>::input();
+  enableInterrupt(PIN_PPM, ppmInterrupt, RISING);
+#elif !defined(RC_INPUT_SBUS)
+  rcChannels::begin(INPUT, attachPinChange);
+#endif
 
 #ifdef DEBUG
   Serial.println("Interrupts set, ready to roll");
@@ -101,17 +198,23 @@ void setup() {
 }
 
 void loop() {
+  PROBE_BEGIN(PROBE_LOOP);
+
   // RC channel monitor outputs
   for (uint8_t chnIndex = 0; chnIndex < CHN_COUNT; chnIndex++) {
-    uint8_t ledValue = pulseWidthToLedValue(chnLastPulseWidth[chnIndex]);
+    uint16_t pulseWidth = chnPulseWidth(chnIndex);
+    uint8_t ledValue = pulseWidthToLedValue(pulseWidth);
 
-    analogWrite(chnOutputLeds[chnIndex], ledValue);
-    printPulseData(chnIndex, chnLastPulseWidth[chnIndex], ledValue);
+    writeLed(chnIndex, ledValue);
+    printPulseData(chnIndex, pulseWidth, ledValue);
   }
 
+  PROBE_END(PROBE_LOOP);
+
 #ifdef DEBUG
-  delay(1000);
+  printDecoderStats();
+  wait(1000);
 #else
-  delay(10);
+  wait(10);
 #endif
 }
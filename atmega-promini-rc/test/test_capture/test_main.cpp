@@ -0,0 +1,108 @@
+// RcCapture edge state machine on the micros() time base.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <RcCapture.h>
+
+static RcCapture<3> *capture;
+
+// pulse on a channel, edge times as the isr would read them
+static void pulse(const uint8_t chn, const uint16_t start, const uint16_t width) {
+  capture->handleEdge(chn, 1, start);
+  capture->handleEdge(chn, 0, start + width);
+}
+
+void setUp() {
+  halReset();
+  capture = new RcCapture<3>();
+}
+
+void tearDown() {
+  delete capture;
+}
+
+void test_nothing_before_first_pulse() {
+  rcPulse_t p = capture->read(0);
+  TEST_ASSERT_EQUAL_UINT32(0, p.ts);
+  TEST_ASSERT_EQUAL_UINT16(0, p.width);
+}
+
+void test_rise_then_fall_gives_width_and_end_time() {
+  halAdvance(5000);
+  pulse(0, 1000, 1500);
+  rcPulse_t p = capture->read(0);
+  TEST_ASSERT_EQUAL_UINT16(1500, p.width);
+  TEST_ASSERT_EQUAL_UINT32(5000, p.ts);
+}
+
+void test_fall_without_rise_is_ignored() {
+  capture->handleEdge(0, 0, 2000);
+  TEST_ASSERT_EQUAL_UINT16(0, capture->read(0).width);
+
+  // a second fall after a pulse doesn't make another one
+  pulse(0, 3000, 1200);
+  halAdvance(100);
+  capture->handleEdge(0, 0, 9000);
+  rcPulse_t p = capture->read(0);
+  TEST_ASSERT_EQUAL_UINT16(1200, p.width);
+  TEST_ASSERT_EQUAL_UINT32(0, p.ts);
+}
+
+void test_latest_rise_is_the_start() {
+  // missed fall, e.g. glitch: the next rise starts over
+  capture->handleEdge(1, 1, 1000);
+  capture->handleEdge(1, 1, 1400);
+  capture->handleEdge(1, 0, 2900);
+  TEST_ASSERT_EQUAL_UINT16(1500, capture->read(1).width);
+}
+
+void test_channels_keep_their_own_started_flag() {
+  capture->handleEdge(0, 1, 100);
+  capture->handleEdge(2, 1, 300);
+  capture->handleEdge(2, 0, 2300);
+  // channel 1 never rose
+  capture->handleEdge(1, 0, 2400);
+  capture->handleEdge(0, 0, 1600);
+
+  TEST_ASSERT_EQUAL_UINT16(1500, capture->read(0).width);
+  TEST_ASSERT_EQUAL_UINT16(0, capture->read(1).width);
+  TEST_ASSERT_EQUAL_UINT16(2000, capture->read(2).width);
+
+  // channel 2 done, its fall again is ignored, channel 0 still works
+  capture->handleEdge(2, 0, 4000);
+  TEST_ASSERT_EQUAL_UINT16(2000, capture->read(2).width);
+  pulse(0, 5000, 1100);
+  TEST_ASSERT_EQUAL_UINT16(1100, capture->read(0).width);
+}
+
+void test_width_across_time_base_wrap() {
+  // 16 bit edge times, micros() wraps them every 65.5ms
+  pulse(0, 65000, 1500);
+  TEST_ASSERT_EQUAL_UINT16(1500, capture->read(0).width);
+  pulse(0, 65535, 1);
+  TEST_ASSERT_EQUAL_UINT16(1, capture->read(0).width);
+}
+
+void test_edges_from_micros_after_32_bit_wrap() {
+  halAdvance(0xffffffffUL - 700);
+  uint16_t start = micros();
+  halAdvance(1500);
+  capture->handleEdge(0, 1, start);
+  capture->handleEdge(0, 0, micros());
+  rcPulse_t p = capture->read(0);
+  TEST_ASSERT_EQUAL_UINT16(1500, p.width);
+  TEST_ASSERT_EQUAL_UINT32(799, p.ts);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_nothing_before_first_pulse);
+  RUN_TEST(test_rise_then_fall_gives_width_and_end_time);
+  RUN_TEST(test_fall_without_rise_is_ignored);
+  RUN_TEST(test_latest_rise_is_the_start);
+  RUN_TEST(test_channels_keep_their_own_started_flag);
+  RUN_TEST(test_width_across_time_base_wrap);
+  RUN_TEST(test_edges_from_micros_after_32_bit_wrap);
+  return UNITY_END();
+}
@@ -0,0 +1,137 @@
+// RcChannels tables of 1, 3 and 8 channels: pins attached, each generated
+// isr capturing its own channel, overlapping pulses kept apart.
+
+#include <unity.h>
+
+#include <EnableInterrupt.h>
+#include <HalNative.h>
+#include <RcChannels.h>
+
+// INT0 only, attached with attachInterrupt()
+typedef RcChannels<2> oneChannel;
+// the rc sketch's two and one on a pin change pin
+typedef RcChannels<2, 3, 7> threeChannels;
+// a full receiver, pins out of order
+typedef RcChannels<4, 2, 9, 3, 8, 5, 7, 6> eightChannels;
+
+static void attachPinChange(const uint8_t pin, void (*handler)(), const uint8_t mode) {
+  enableInterrupt(pin, handler, mode);
+}
+
+// rising edges on all pins at once, each falls width[i] later
+template <class CHANNELS>
+static void pulses(const uint16_t *widths) {
+  for (uint8_t i = 0; i < CHANNELS::count; i++) {
+    halSetPin(CHANNELS::pins[i], 1);
+  }
+  uint32_t start = micros();
+  uint8_t done = 0;
+  while (done < CHANNELS::count) {
+    halAdvance(1);
+    for (uint8_t i = 0; i < CHANNELS::count; i++) {
+      if (micros() - start == widths[i]) {
+        halSetPin(CHANNELS::pins[i], 0);
+        done++;
+      }
+    }
+  }
+  halAdvance(5000);
+}
+
+template <class CHANNELS>
+static void checkWidths(const uint16_t *widths) {
+  rcPulse_t all[CHANNELS::count];
+  CHANNELS::readAll(all);
+  for (uint8_t i = 0; i < CHANNELS::count; i++) {
+    TEST_ASSERT_EQUAL_UINT16(widths[i], CHANNELS::read(i).width);
+    TEST_ASSERT_EQUAL_UINT16(widths[i], all[i].width);
+  }
+}
+
+void setUp() {
+  halReset();
+  halAdvance(1000);
+}
+
+void tearDown() {
+}
+
+void test_table_sizes_and_indexes() {
+  TEST_ASSERT_EQUAL_UINT8(1, oneChannel::count);
+  TEST_ASSERT_EQUAL_UINT8(3, threeChannels::count);
+  TEST_ASSERT_EQUAL_UINT8(8, eightChannels::count);
+
+  TEST_ASSERT_EQUAL_UINT8(0, eightChannels::indexOf(4));
+  TEST_ASSERT_EQUAL_UINT8(3, eightChannels::indexOf(3));
+  TEST_ASSERT_EQUAL_UINT8(7, eightChannels::indexOf(6));
+  // not in the table
+  TEST_ASSERT_EQUAL_UINT8(8, eightChannels::indexOf(10));
+  TEST_ASSERT_EQUAL_UINT8(1, oneChannel::indexOf(3));
+}
+
+void test_one_channel_on_int0() {
+  oneChannel::begin(INPUT);
+  static const uint16_t widths[] = {1234};
+  pulses<oneChannel>(widths);
+  checkWidths<oneChannel>(widths);
+  TEST_ASSERT_EQUAL_UINT32(1000 + 1234, oneChannel::read(0).ts);
+
+  // pin 3 isn't attached
+  halSetPin(3, 1);
+  halAdvance(1500);
+  halSetPin(3, 0);
+  TEST_ASSERT_EQUAL_UINT16(1234, oneChannel::read(0).width);
+}
+
+void test_three_channels_capture_their_own_pins() {
+  threeChannels::begin(INPUT, attachPinChange);
+  static const uint16_t widths[] = {1100, 1500, 1900};
+  pulses<threeChannels>(widths);
+  checkWidths<threeChannels>(widths);
+
+  // one channel at a time, the others keep theirs
+  static const uint16_t widths2[] = {1100, 1720, 1900};
+  halSetPin(3, 1);
+  halAdvance(1720);
+  halSetPin(3, 0);
+  checkWidths<threeChannels>(widths2);
+}
+
+void test_eight_channels_overlapping() {
+  eightChannels::begin(INPUT, attachPinChange);
+  uint16_t widths[8];
+  for (uint16_t n = 0; n < 20; n++) {
+    for (uint8_t i = 0; i < 8; i++) {
+      // all different, some equal to the us
+      widths[i] = 1000 + (n * 37 + i * 131) % 1000;
+    }
+    widths[n % 8] = widths[(n + 1) % 8];
+    pulses<eightChannels>(widths);
+    checkWidths<eightChannels>(widths);
+  }
+}
+
+void test_eight_channels_staggered() {
+  eightChannels::begin(INPUT, attachPinChange);
+  // a receiver sending channels one after another, each rising as the
+  // last falls
+  uint16_t widths[8];
+  for (uint8_t i = 0; i < 8; i++) {
+    widths[i] = 1050 + i * 111;
+    halSetPin(eightChannels::pins[i], 1);
+    halAdvance(widths[i]);
+    halSetPin(eightChannels::pins[i], 0);
+    TEST_ASSERT_EQUAL_UINT32(micros(), eightChannels::read(i).ts);
+  }
+  checkWidths<eightChannels>(widths);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_table_sizes_and_indexes);
+  RUN_TEST(test_one_channel_on_int0);
+  RUN_TEST(test_three_channels_capture_their_own_pins);
+  RUN_TEST(test_eight_channels_overlapping);
+  RUN_TEST(test_eight_channels_staggered);
+  return UNITY_END();
+}
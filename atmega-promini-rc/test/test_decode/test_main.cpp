@@ -0,0 +1,363 @@
+// RcPpm and RcSbus fed with generated streams on the micros() time base:
+// values, frame counters, and picking up again after corruption.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <RcPpm.h>
+#include <RcSbus.h>
+
+#define PPM_CHANNELS 8
+// 8E2 at 100000 baud
+#define SBUS_BYTE_US 120
+// the rc sketch reads the uart every 1ms
+#define SBUS_POLL_US 1000
+
+static RcPpm<PPM_CHANNELS> *ppm;
+static RcSbus *sbus;
+
+// ppm
+
+// one edge as the pin interrupt sees it
+static void ppmEdge(const uint16_t afterUs) {
+  halAdvance(afterUs);
+  ppm->handleEdge(rcTimerNow());
+}
+
+// a frame of count channels, then the sync gap to the next one
+static void ppmFrame(const uint16_t *widths, const uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    ppmEdge(widths[i]);
+  }
+  ppmEdge(6000);
+}
+
+static uint16_t ppmWidths[10];
+
+static void ppmMakeWidths(const uint16_t base) {
+  for (uint8_t i = 0; i < 10; i++) {
+    ppmWidths[i] = base + i * 90;
+  }
+}
+
+static void checkPpm(const uint8_t count) {
+  for (uint8_t i = 0; i < count; i++) {
+    TEST_ASSERT_EQUAL_UINT16(ppmWidths[i], ppm->read(i).width);
+  }
+}
+
+// sbus
+
+// 16 x 11 bit lsb first, like a receiver sends them
+static void sbusPack(uint8_t *frame, const uint16_t *values, const uint8_t flags) {
+  memset(frame, 0, RC_SBUS_FRAME);
+  frame[0] = RC_SBUS_START;
+  for (uint8_t i = 0; i < RC_SBUS_CHANNELS; i++) {
+    for (uint8_t b = 0; b < 11; b++) {
+      if (values[i] & (1 << b)) {
+        uint16_t bit = i * 11 + b;
+        frame[1 + bit / 8] |= 1 << (bit % 8);
+      }
+    }
+  }
+  frame[RC_SBUS_FRAME - 2] = flags;
+  frame[RC_SBUS_FRAME - 1] = RC_SBUS_END;
+}
+
+static uint16_t sbusValues[RC_SBUS_CHANNELS];
+
+static void sbusMakeValues(const uint16_t base) {
+  for (uint8_t i = 0; i < RC_SBUS_CHANNELS; i++) {
+    sbusValues[i] = 172 + (base + i * 101) % 1640;
+  }
+}
+
+static void checkSbus() {
+  for (uint8_t i = 0; i < RC_SBUS_CHANNELS; i++) {
+    TEST_ASSERT_EQUAL_UINT16(RcSbus::toMicros(sbusValues[i]), sbus->read(i).width);
+  }
+}
+
+// bytes on the line from now, read back by polling like the sketch, then
+// quiet until the next frame period
+static uint16_t sbusDecoded;
+
+static void sbusSend(const uint8_t *data, const uint8_t size, const uint32_t period) {
+  uint32_t start = micros();
+  uint8_t sent = 0;
+  while (sent < size) {
+    // poll: everything that arrived by now
+    uint32_t t = micros() - start;
+    while (sent < size && (uint32_t)(sent + 1) * SBUS_BYTE_US <= t) {
+      sbusDecoded += sbus->handleByte(data[sent++], micros());
+    }
+    halAdvance(SBUS_POLL_US);
+  }
+  halAdvance(period - (micros() - start) % period);
+}
+
+static void sbusSendFrame(const uint8_t flags, const uint32_t period) {
+  uint8_t frame[RC_SBUS_FRAME];
+  sbusPack(frame, sbusValues, flags);
+  sbusSend(frame, sizeof(frame), period);
+}
+
+void setUp() {
+  halReset();
+  halAdvance(10000);
+  ppm = new RcPpm<PPM_CHANNELS>();
+  sbus = new RcSbus();
+  sbusDecoded = 0;
+}
+
+void tearDown() {
+  delete ppm;
+  delete sbus;
+}
+
+void test_ppm_frames_decode() {
+  ppmEdge(6000);
+  for (uint16_t n = 0; n < 50; n++) {
+    ppmMakeWidths(1000 + n * 3);
+    ppmFrame(ppmWidths, PPM_CHANNELS);
+    checkPpm(PPM_CHANNELS);
+  }
+  rcPpmStats_t stats = ppm->getStats();
+  TEST_ASSERT_EQUAL_UINT16(50, stats.frames);
+  TEST_ASSERT_EQUAL_UINT16(0, stats.errors);
+  TEST_ASSERT_EQUAL_UINT8(PPM_CHANNELS, stats.channels);
+}
+
+void test_ppm_extra_channels_are_counted_not_kept() {
+  ppmEdge(6000);
+  ppmMakeWidths(1000);
+  ppmFrame(ppmWidths, 10);
+  checkPpm(PPM_CHANNELS);
+  TEST_ASSERT_EQUAL_UINT8(10, ppm->getStats().channels);
+}
+
+void test_ppm_glitch_drops_the_rest_of_the_frame() {
+  ppmEdge(6000);
+  ppmMakeWidths(1100);
+  ppmFrame(ppmWidths, PPM_CHANNELS);
+
+  // a spike 300us into channel 3
+  uint16_t glitched[PPM_CHANNELS + 1];
+  ppmMakeWidths(1300);
+  memcpy(glitched, ppmWidths, 3 * sizeof(uint16_t));
+  glitched[3] = 300;
+  glitched[4] = ppmWidths[3] - 300;
+  memcpy(glitched + 5, ppmWidths + 4, 4 * sizeof(uint16_t));
+  ppmFrame(glitched, PPM_CHANNELS + 1);
+
+  // the first 3 made it, the rest keep the last frame's
+  for (uint8_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_UINT16(1300 + i * 90, ppm->read(i).width);
+  }
+  for (uint8_t i = 3; i < PPM_CHANNELS; i++) {
+    TEST_ASSERT_EQUAL_UINT16(1100 + i * 90, ppm->read(i).width);
+  }
+  TEST_ASSERT_EQUAL_UINT16(1, ppm->getStats().errors);
+
+  // back at the next sync
+  ppmMakeWidths(1500);
+  ppmFrame(ppmWidths, PPM_CHANNELS);
+  checkPpm(PPM_CHANNELS);
+  TEST_ASSERT_EQUAL_UINT16(2, ppm->getStats().frames);
+}
+
+void test_ppm_joined_mid_frame_is_right_from_the_next() {
+  // the first edge heard is taken as sync, so the tail of a frame lands
+  // in the first channels
+  ppmMakeWidths(1000);
+  ppmFrame(ppmWidths + 5, 3);
+  TEST_ASSERT_EQUAL_UINT16(ppmWidths[6], ppm->read(0).width);
+
+  ppmMakeWidths(1200);
+  ppmFrame(ppmWidths, PPM_CHANNELS);
+  checkPpm(PPM_CHANNELS);
+  TEST_ASSERT_EQUAL_UINT8(PPM_CHANNELS, ppm->getStats().channels);
+}
+
+void test_ppm_missed_edge_is_an_error() {
+  ppmEdge(6000);
+  ppmMakeWidths(1000);
+  // channels 2 and 3 run together, 2170us is out of range
+  uint16_t missed[PPM_CHANNELS - 1];
+  memcpy(missed, ppmWidths, 2 * sizeof(uint16_t));
+  missed[2] = ppmWidths[2] + ppmWidths[3] - 100;
+  TEST_ASSERT_TRUE(missed[2] > RC_PPM_MAX_INTERVAL);
+  memcpy(missed + 3, ppmWidths + 4, 4 * sizeof(uint16_t));
+  ppmFrame(missed, PPM_CHANNELS - 1);
+  TEST_ASSERT_EQUAL_UINT16(1, ppm->getStats().errors);
+  TEST_ASSERT_EQUAL_UINT16(0, ppm->read(2).width);
+
+  ppmFrame(ppmWidths, PPM_CHANNELS);
+  checkPpm(PPM_CHANNELS);
+}
+
+void test_sbus_frames_decode_at_7_and_14ms() {
+  for (uint16_t n = 0; n < 500; n++) {
+    sbusMakeValues(n * 7);
+    sbusSendFrame(0, n < 250 ? 7000 : 14000);
+    checkSbus();
+  }
+  TEST_ASSERT_EQUAL_UINT16(500, sbusDecoded);
+  TEST_ASSERT_EQUAL_UINT16(500, sbus->stats.frames);
+  TEST_ASSERT_EQUAL_UINT16(0, sbus->stats.errors);
+}
+
+void test_sbus_values_to_micros() {
+  TEST_ASSERT_EQUAL_UINT16(987, RcSbus::toMicros(172));
+  TEST_ASSERT_EQUAL_UINT16(1500, RcSbus::toMicros(992));
+  TEST_ASSERT_EQUAL_UINT16(2011, RcSbus::toMicros(1811));
+}
+
+void test_sbus_start_byte_inside_a_frame_is_no_start() {
+  // noise running into a frame with start bytes all through its data
+  uint8_t stream[5 + RC_SBUS_FRAME] = {0x55, 0x21, 0x00, 0x80, 0x13};
+  sbusPack(stream + 5, sbusValues, 0);
+  memset(stream + 6, RC_SBUS_START, RC_SBUS_FRAME - 3);
+  sbusSend(stream, sizeof(stream), 7000);
+  TEST_ASSERT_EQUAL_UINT16(0, sbusDecoded);
+  TEST_ASSERT_EQUAL_UINT16(0, sbus->stats.errors);
+
+  sbusMakeValues(3);
+  sbusSendFrame(0, 7000);
+  checkSbus();
+  TEST_ASSERT_EQUAL_UINT16(1, sbusDecoded);
+}
+
+void test_sbus_joined_mid_frame_costs_one_error() {
+  sbusMakeValues(5);
+  uint8_t frame[RC_SBUS_FRAME];
+  sbusPack(frame, sbusValues, 0);
+  frame[9] = RC_SBUS_START;
+  // the first byte heard looks like a start after quiet
+  sbusSend(frame + 9, RC_SBUS_FRAME - 9, 7000);
+  sbusSendFrame(0, 7000);
+  checkSbus();
+  TEST_ASSERT_EQUAL_UINT16(1, sbusDecoded);
+  TEST_ASSERT_EQUAL_UINT16(1, sbus->stats.errors);
+}
+
+void test_sbus_resyncs_after_corruption() {
+  sbusMakeValues(0);
+  sbusSendFrame(0, 7000);
+
+  uint8_t frame[RC_SBUS_FRAME + 4];
+  // a byte lost: cut short by the next gap, counted when the next
+  // frame starts
+  sbusMakeValues(100);
+  sbusPack(frame, sbusValues, 0);
+  memmove(frame + 10, frame + 11, RC_SBUS_FRAME - 11);
+  sbusSend(frame, RC_SBUS_FRAME - 1, 7000);
+  TEST_ASSERT_EQUAL_UINT16(0, sbus->stats.errors);
+
+  // noise on the line: bytes in, wrong end byte
+  sbusMakeValues(200);
+  sbusPack(frame, sbusValues, 0);
+  memmove(frame + 4, frame + 1, RC_SBUS_FRAME - 1);
+  frame[1] = 0x0f;
+  frame[2] = 0x00;
+  frame[3] = 0x55;
+  sbusSend(frame, RC_SBUS_FRAME + 3, 7000);
+  TEST_ASSERT_EQUAL_UINT16(2, sbus->stats.errors);
+
+  // a bad end byte
+  sbusPack(frame, sbusValues, 0);
+  frame[RC_SBUS_FRAME - 1] = 0x04;
+  sbusSend(frame, RC_SBUS_FRAME, 7000);
+  TEST_ASSERT_EQUAL_UINT16(3, sbus->stats.errors);
+
+  // none decoded, the channels held the first frame
+  TEST_ASSERT_EQUAL_UINT16(1, sbusDecoded);
+  sbusMakeValues(0);
+  checkSbus();
+
+  // and the next good frame is taken
+  sbusMakeValues(300);
+  sbusSendFrame(0, 7000);
+  checkSbus();
+  TEST_ASSERT_EQUAL_UINT16(2, sbusDecoded);
+  TEST_ASSERT_EQUAL_UINT16(3, sbus->stats.errors);
+}
+
+// the uart drops bytes with parity or framing errors, so noise loses bytes
+// rather than adding them: an added byte could shift the flags byte into
+// the end byte and decode, sbus has no checksum
+void test_sbus_random_lost_bytes_never_decode_garbage() {
+  uint32_t seed = 11;
+  uint16_t good = 0;
+  uint16_t corrupted = 0;
+  for (uint16_t n = 0; n < 1000; n++) {
+    sbusMakeValues(n * 13);
+    uint8_t frame[RC_SBUS_FRAME + 1];
+    sbusPack(frame, sbusValues, 0);
+    uint8_t size = RC_SBUS_FRAME;
+
+    seed = seed * 1103515245UL + 12345UL;
+    uint8_t kind = (seed >> 16) % 4;
+    uint8_t at = 1 + (seed >> 8) % (RC_SBUS_FRAME - 2);
+    if (kind == 1 || kind == 2) {
+      // 1 or a run of up to 5 bytes lost
+      uint8_t lost = kind == 1 ? 1 : 1 + (seed >> 24) % 5;
+      if (at + lost > RC_SBUS_FRAME) {
+        lost = RC_SBUS_FRAME - at;
+      }
+      memmove(frame + at, frame + at + lost, RC_SBUS_FRAME - at - lost);
+      size -= lost;
+    }
+
+    uint16_t before = sbusDecoded;
+    sbusSend(frame, size, 7000);
+    if (kind == 1 || kind == 2) {
+      corrupted++;
+      // too short, cut by the next gap
+      TEST_ASSERT_EQUAL_UINT16(before, sbusDecoded);
+    } else {
+      good++;
+      TEST_ASSERT_EQUAL_UINT16(before + 1, sbusDecoded);
+      checkSbus();
+    }
+  }
+  // the last one if it was cut short
+  sbusSendFrame(0, 7000);
+  TEST_ASSERT_EQUAL_UINT16(good + 1, sbus->stats.frames);
+  TEST_ASSERT_EQUAL_UINT16(corrupted, sbus->stats.errors);
+  TEST_ASSERT_TRUE(corrupted > 300);
+}
+
+void test_sbus_flags() {
+  sbusMakeValues(10);
+  sbusSendFrame(RC_SBUS_LOST, 7000);
+  checkSbus();
+
+  // failsafe frames leave the channels to go stale
+  uint32_t ts = sbus->read(0).ts;
+  sbusMakeValues(20);
+  sbusSendFrame(RC_SBUS_FAILSAFE | RC_SBUS_LOST, 7000);
+  TEST_ASSERT_EQUAL_UINT32(ts, sbus->read(0).ts);
+  TEST_ASSERT_EQUAL_HEX8(RC_SBUS_FAILSAFE | RC_SBUS_LOST, sbus->flags());
+
+  TEST_ASSERT_EQUAL_UINT16(2, sbus->stats.frames);
+  TEST_ASSERT_EQUAL_UINT16(2, sbus->stats.lost);
+  TEST_ASSERT_EQUAL_UINT16(1, sbus->stats.failsafes);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ppm_frames_decode);
+  RUN_TEST(test_ppm_extra_channels_are_counted_not_kept);
+  RUN_TEST(test_ppm_glitch_drops_the_rest_of_the_frame);
+  RUN_TEST(test_ppm_joined_mid_frame_is_right_from_the_next);
+  RUN_TEST(test_ppm_missed_edge_is_an_error);
+  RUN_TEST(test_sbus_frames_decode_at_7_and_14ms);
+  RUN_TEST(test_sbus_values_to_micros);
+  RUN_TEST(test_sbus_start_byte_inside_a_frame_is_no_start);
+  RUN_TEST(test_sbus_joined_mid_frame_costs_one_error);
+  RUN_TEST(test_sbus_resyncs_after_corruption);
+  RUN_TEST(test_sbus_random_lost_bytes_never_decode_garbage);
+  RUN_TEST(test_sbus_flags);
+  return UNITY_END();
+}
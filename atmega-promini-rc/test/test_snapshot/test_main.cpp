@@ -0,0 +1,107 @@
+// Snapshot with a host thread standing in for the isr: one thread keeps
+// publishing while the test reads and checks every copy is whole.
+//
+// The writer publishes twice then yields. Two publishes during one read
+// is what overwrites the slot being copied, and yielding lets a reader
+// that was preempted mid copy carry on with a torn slot, so this also
+// catches tears on a single core host.
+
+#include <unity.h>
+
+#include <Snapshot.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+// every word carries the same count, a torn copy mixes two counts, big
+// enough that preemption mostly lands inside a copy (Snapshot copies at
+// most 255 bytes)
+#define SAMPLE_WORDS 32
+
+struct sample_t {
+  uint32_t n[SAMPLE_WORDS];
+};
+
+// wall clock time to keep reading (ms)
+#define RUN_MS 2000
+
+static Snapshot<sample_t> *snapshot;
+static std::atomic<bool> running;
+// publishes done, wider than the 8 bit seq
+static std::atomic<uint32_t> published;
+
+static void writer() {
+  uint32_t n = 0;
+  sample_t s;
+  while (running.load(std::memory_order_relaxed)) {
+    for (uint8_t i = 0; i < 2; i++) {
+      n++;
+      for (uint8_t w = 0; w < SAMPLE_WORDS; w++) {
+        s.n[w] = n;
+      }
+      snapshot->publish(s);
+      published.store(n, std::memory_order_release);
+    }
+    std::this_thread::yield();
+  }
+}
+
+void setUp() {
+  snapshot = new Snapshot<sample_t>();
+  published = 0;
+  running = true;
+}
+
+void tearDown() {
+  delete snapshot;
+}
+
+void test_read_before_publish_is_zero() {
+  sample_t s = snapshot->read();
+  for (uint8_t w = 0; w < SAMPLE_WORDS; w++) {
+    TEST_ASSERT_EQUAL_UINT32(0, s.n[w]);
+  }
+  TEST_ASSERT_EQUAL_UINT8(0, snapshot->version());
+}
+
+void test_reads_never_tear_under_a_publishing_thread() {
+  std::thread thread(writer);
+
+  uint32_t last = 0;
+  uint32_t checked = 0;
+  std::chrono::steady_clock::time_point end = std::chrono::steady_clock::now() + std::chrono::milliseconds(RUN_MS);
+  while (std::chrono::steady_clock::now() < end) {
+    uint32_t before = published.load(std::memory_order_acquire);
+    sample_t s = snapshot->read();
+    uint32_t after = published.load(std::memory_order_acquire);
+
+    // the seq only covers fewer than 256 publishes per read, a descheduled
+    // reader can see more - that's outside what Snapshot promises
+    if (after - before >= 200) {
+      continue;
+    }
+    checked++;
+
+    for (uint8_t w = 1; w < SAMPLE_WORDS; w++) {
+      TEST_ASSERT_EQUAL_UINT32_MESSAGE(s.n[0], s.n[w], "torn read");
+    }
+    // one whole published value, never an older one than the last read
+    TEST_ASSERT_TRUE(s.n[0] >= last);
+    TEST_ASSERT_TRUE(s.n[0] <= after + 1);
+    last = s.n[0];
+  }
+
+  running = false;
+  thread.join();
+
+  // reads really ran alongside the writer
+  TEST_ASSERT_TRUE(published.load() > 100);
+  TEST_ASSERT_TRUE(checked > 1000);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_read_before_publish_is_zero);
+  RUN_TEST(test_reads_never_tear_under_a_publishing_thread);
+  return UNITY_END();
+}
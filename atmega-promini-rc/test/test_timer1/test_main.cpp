@@ -0,0 +1,112 @@
+// Timer1 time base and ICP1 capture (RC_CAPTURE_TIMER1) against a model
+// of the Timer1 registers, the bits as in the atmega328p datasheet.
+
+#include <unity.h>
+
+#include <Arduino.h>
+
+static volatile uint8_t TCCR1A, TCCR1B, TIMSK1, TIFR1;
+static volatile uint16_t TCNT1, ICR1;
+
+#define CS10 0
+#define ICES1 6
+#define ICNC1 7
+#define ICF1 5
+#define ICIE1 5
+
+#define RC_CAPTURE_TIMER1
+#include <RcCapture.h>
+
+static RcCapture<1> capture;
+
+// what the input capture unit does on an edge it is armed for
+static void captureEdge(const uint16_t ticks) {
+  ICR1 = ticks;
+  TIFR1 |= _BV(ICF1);
+}
+
+// the isr: read the capture, hand the edge on
+static void captureIsr() {
+  uint16_t ticks;
+  uint8_t state = rcTimerCapture(ticks);
+  capture.handleEdge(0, state, ticks);
+}
+
+void setUp() {
+  TCCR1A = 0xff;
+  TCCR1B = TIMSK1 = TIFR1 = 0;
+  rcTimerBegin();
+  rcTimerBeginCapture();
+}
+
+void tearDown() {
+}
+
+void test_begin_runs_timer1_free_and_arms_rising_capture() {
+  TEST_ASSERT_EQUAL_HEX8(0, TCCR1A);
+  TEST_ASSERT_EQUAL_HEX8(_BV(CS10) | _BV(ICNC1) | _BV(ICES1), TCCR1B);
+  TEST_ASSERT_EQUAL_HEX8(_BV(ICIE1), TIMSK1);
+}
+
+void test_capture_flips_the_edge_and_clears_the_flag() {
+  captureEdge(100);
+  uint16_t ticks;
+  TEST_ASSERT_EQUAL_UINT8(1, rcTimerCapture(ticks));
+  TEST_ASSERT_EQUAL_UINT16(100, ticks);
+  TEST_ASSERT_FALSE(TCCR1B & _BV(ICES1));
+  // written as 1 to clear, a flag raised by the edge change
+  TEST_ASSERT_EQUAL_HEX8(_BV(ICF1), TIFR1);
+
+  TIFR1 = 0;
+  captureEdge(12100);
+  TEST_ASSERT_EQUAL_UINT8(0, rcTimerCapture(ticks));
+  TEST_ASSERT_EQUAL_UINT16(12100, ticks);
+  TEST_ASSERT_TRUE(TCCR1B & _BV(ICES1));
+  TEST_ASSERT_EQUAL_HEX8(_BV(ICF1), TIFR1);
+  // other bits left alone
+  TEST_ASSERT_EQUAL_HEX8(_BV(CS10) | _BV(ICNC1), TCCR1B & ~_BV(ICES1));
+}
+
+void test_capture_sequence_gives_pulse_widths() {
+  // 1500us at 8 ticks per us, then one across the counter wrap
+  captureEdge(1000);
+  captureIsr();
+  captureEdge(13000);
+  captureIsr();
+  TEST_ASSERT_EQUAL_UINT16(1500, capture.read(0).width);
+
+  captureEdge(60000);
+  captureIsr();
+  captureEdge((uint16_t)(60000 + 16000));
+  captureIsr();
+  TEST_ASSERT_EQUAL_UINT16(2000, capture.read(0).width);
+}
+
+void test_ticks_to_micros_rounds_to_nearest() {
+  TEST_ASSERT_EQUAL_UINT16(8, RC_TIMER_TICKS_PER_US);
+  TEST_ASSERT_EQUAL_UINT16(0, rcTimerToMicros(0));
+  TEST_ASSERT_EQUAL_UINT16(0, rcTimerToMicros(3));
+  TEST_ASSERT_EQUAL_UINT16(1, rcTimerToMicros(4));
+  TEST_ASSERT_EQUAL_UINT16(1500, rcTimerToMicros(12003));
+  TEST_ASSERT_EQUAL_UINT16(1501, rcTimerToMicros(12004));
+}
+
+void test_ticks_to_micros_at_the_top_of_the_counter() {
+  // whole range the wrap can give, no 16 bit overflow in the rounding
+  TEST_ASSERT_EQUAL_UINT16(8191, rcTimerToMicros(65531));
+  TEST_ASSERT_EQUAL_UINT16(8192, rcTimerToMicros(65532));
+  TEST_ASSERT_EQUAL_UINT16(8192, rcTimerToMicros(65535));
+  for (uint32_t t = 0; t <= 0xffff; t++) {
+    TEST_ASSERT_EQUAL_UINT16((t + 4) / 8, rcTimerToMicros(t));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_begin_runs_timer1_free_and_arms_rising_capture);
+  RUN_TEST(test_capture_flips_the_edge_and_clears_the_flag);
+  RUN_TEST(test_capture_sequence_gives_pulse_widths);
+  RUN_TEST(test_ticks_to_micros_rounds_to_nearest);
+  RUN_TEST(test_ticks_to_micros_at_the_top_of_the_counter);
+  return UNITY_END();
+}
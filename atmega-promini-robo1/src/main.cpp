@@ -1,8 +1,20 @@
 #define FASTLED_ALLOW_INTERRUPTS 1
 
 #include <Arduino.h>
-#include <digitalWriteFast.h>
+#include <BarGraph.h>
+#include <Calibration.h>
+#include <Failsafe.h>
 #include <FastLED.h>
+#include <FastPin.h>
+#include <Filters.h>
+#include <FrameRenderer.h>
+#include <Mixer.h>
+#include <MotorDriver.h>
+#include <RcChannels.h>
+#include <Recorder.h>
+#include <Probe.h>
+#include <Scheduler.h>
+#include <Telemetry.h>
 
 // serial led matrix 4x4
 #define LED_PIN 9
@@ -10,207 +22,177 @@
 
 static CRGB ledStrip[LED_COUNT];
 
+// only show changed frames, at most this often
+#define LED_MAX_FPS 30
+
+static FrameRenderer<LED_COUNT> ledRenderer(ledStrip, LED_MAX_FPS);
+
 // MOTOR outputs (must be pwm-capable pins)
+#ifdef RC_CAPTURE_TIMER1
+#define PIN_MOTOR_1A 3 // timer1 pins can't do pwm while capturing
+#else
 #define PIN_MOTOR_1A 10
+#endif
 #define PIN_MOTOR_1B 11
 #define PIN_MOTOR_2A 5
 #define PIN_MOTOR_2B 6
 
+// pwm steps per update, stop to full speed in ~250ms at 100 updates/s
+#define MOTOR_SLEW 8
+
+static Motor<PIN_MOTOR_1A, PIN_MOTOR_1B> motor1;
+static Motor<PIN_MOTOR_2A, PIN_MOTOR_2B> motor2;
+
+// steering/throttle mix: 100us deadband, 5us per percent
+static Mixer<100, 0, 5> mixer;
+
 // RC channel pins
 #define PIN_STR 2
+#ifdef RC_CAPTURE_TIMER1
+#define PIN_THR RC_TIMER_ICP_PIN
+#else
 #define PIN_THR 3
+#endif
 
 // RC channel data
 
-struct rcInputs_t {
-  uint32_t strLastPulseStart = 0;
-  uint32_t strLastPulseWidth = 0;
-  uint32_t thrLastPulseStart = 0;
-  uint32_t thrLastPulseWidth = 0;
-};
-
-volatile static rcInputs_t rcInputs;
-
-void strInterrupt() {
-  uint8_t state = digitalReadFast(PIN_STR);
-  uint32_t now = micros();
-
-  if (state == 1) {
-    rcInputs.strLastPulseStart = now;
-  } else {
-    rcInputs.strLastPulseWidth = now - rcInputs.strLastPulseStart;
-  }
-}
-
-void thrInterrupt() {
-  uint8_t state = digitalReadFast(PIN_THR);
-  uint32_t now = micros();
-
-  if (state == 1) {
-    rcInputs.thrLastPulseStart = now;
-  } else {
-    rcInputs.thrLastPulseWidth = now - rcInputs.thrLastPulseStart;
-  }
+#define CHN_STR 0
+#define CHN_THR 1
+
+// in channel order
+typedef RcChannels<PIN_STR, PIN_THR> rcChannels;
+
+// binary state records, see Telemetry.h
+static Telemetry<96> telemetry;
+
+// last ~5s of inputs and outputs, saved to eeprom when the failsafe stops
+// the motors and sent back on 'r' from serial
+#define RECORDER_PERIOD 40 // ms
+#define RECORDER_EEPROM_ADDR 0
+static Recorder<512> recorder(RECORDER_PERIOD, RECORDER_EEPROM_ADDR);
+static RecorderReader recorderReader(RECORDER_EEPROM_ADDR);
+
+// stick endpoints, centres and deadbands, full throttle at power up to
+// sweep, kept after the recorder image
+#define CALIBRATION_EEPROM_ADDR 0x300
+static Calibration<rcChannels::count> calibration(CALIBRATION_EEPROM_ADDR);
+static_assert(RECORDER_EEPROM_ADDR + decltype(recorder)::EEPROM_SIZE <= CALIBRATION_EEPROM_ADDR, "recorder image runs into the calibration");
+static_assert(CALIBRATION_EEPROM_ADDR + decltype(calibration)::EEPROM_SIZE <= E2END + 1, "calibration ring past the end of the eeprom");
+
+// lost after 100ms without good pulses, then stop motors right away
+static Failsafe<rcChannels::count> failsafe(100000UL, 100000UL, FAILSAFE_ACTION_STOP, 0);
+
+// median of last 3 pulses drops single glitches
+static MedianFilter<uint16_t, 3> strFilter;
+static MedianFilter<uint16_t, 3> thrFilter;
+
+// task rates (Hz)
+#define CONTROL_TASK_RATE 100 // the old delay(10) loop
+#define LED_TASK_RATE LED_MAX_FPS
+#define TELEMETRY_TASK_RATE 100
+#define RECORDER_TASK_RATE (1000 / RECORDER_PERIOD)
+
+static Scheduler<4> scheduler;
+
+// raw pulses for the failsafe, filtered ones for control, by channel, and
+// signal state, updated by controlTask
+static rcPulse_t rcPulses[rcChannels::count];
+static rcPulse_t rcInputs[rcChannels::count];
+static failsafeState_t signalState = FAILSAFE_STOP;
+
+// motor speeds and outputs, updated by controlTask
+static int16_t thr1Percent = 0;
+static int16_t thr2Percent = 0;
+static motorOutputs_t motors;
+
+// longest loop() since last record (us)
+static uint16_t loopTimeMax = 0;
+
+static bool recorderReading = false;
+
+#ifdef RC_CAPTURE_TIMER1
+ISR(TIMER1_CAPT_vect) {
+  PROBE_BEGIN(PROBE_ISR_2);
+  rcChannels::handleCapture();
+  PROBE_END(PROBE_ISR_2);
 }
+#endif
 
 void testMotors()
 {
   // motor test
-  analogWrite(PIN_MOTOR_1A, 31);
-  analogWrite(PIN_MOTOR_2A, 31);
+  PwmPin<PIN_MOTOR_1A>::write(31);
+  PwmPin<PIN_MOTOR_2A>::write(31);
   delay(100);
-  analogWrite(PIN_MOTOR_1A, 0);
-  analogWrite(PIN_MOTOR_2A, 0);
+  PwmPin<PIN_MOTOR_1A>::write(0);
+  PwmPin<PIN_MOTOR_2A>::write(0);
   delay(100);
-  analogWrite(PIN_MOTOR_1B, 31);
-  analogWrite(PIN_MOTOR_2B, 31);
+  PwmPin<PIN_MOTOR_1B>::write(31);
+  PwmPin<PIN_MOTOR_2B>::write(31);
   delay(100);
-  analogWrite(PIN_MOTOR_1B, 0);
-  analogWrite(PIN_MOTOR_2B, 0);
+  PwmPin<PIN_MOTOR_1B>::write(0);
+  PwmPin<PIN_MOTOR_2B>::write(0);
 }
 
-void setup() {
-  pinMode(LED_BUILTIN, OUTPUT);
-  analogWrite(LED_BUILTIN, 0);
-
-  Serial.begin(115200);
-  Serial.println("Initializing");
+void controlTask(const uint32_t) {
+  rcPulses[CHN_STR] = rcChannels::read(CHN_STR);
+  rcPulses[CHN_THR] = rcChannels::read(CHN_THR);
 
-  // make sure motors are stopped
-  pinMode(PIN_MOTOR_1A, OUTPUT);
-  pinMode(PIN_MOTOR_1B, OUTPUT);
-  pinMode(PIN_MOTOR_2A, OUTPUT);
-  pinMode(PIN_MOTOR_2B, OUTPUT);
-  analogWrite(PIN_MOTOR_1A, 0);
-  analogWrite(PIN_MOTOR_1B, 0);
-  analogWrite(PIN_MOTOR_2A, 0);
-  analogWrite(PIN_MOTOR_2B, 0);
-
-  FastLED.addLeds<WS2812, LED_PIN, GRB>(ledStrip, LED_COUNT);
-  FastLED.setBrightness(3);
-  for (int32_t i = 0xff0000; i != 0; i >>= 8) {
-    FastLED.showColor(CRGB(i));
-    delay(100);
+  // only filter new pulses, a frame may be read more than once
+  if (rcPulses[CHN_STR].ts != rcInputs[CHN_STR].ts) {
+    rcInputs[CHN_STR] = rcPulses[CHN_STR];
+    rcInputs[CHN_STR].width = strFilter.update(rcPulses[CHN_STR].width);
+  }
+  if (rcPulses[CHN_THR].ts != rcInputs[CHN_THR].ts) {
+    rcInputs[CHN_THR] = rcPulses[CHN_THR];
+    rcInputs[CHN_THR].width = thrFilter.update(rcPulses[CHN_THR].width);
   }
-  FastLED.showColor(CRGB(0));
-
-  pinModeFast(PIN_STR, INPUT_PULLUP);
-  attachInterrupt(digitalPinToInterrupt(PIN_STR), strInterrupt, CHANGE);
-
-  pinModeFast(PIN_THR, INPUT_PULLUP);
-  attachInterrupt(digitalPinToInterrupt(PIN_THR), thrInterrupt, CHANGE);
-
-  testMotors();
-
-  analogWrite(LED_BUILTIN, 255);
-  Serial.println("Running");
-}
-
-void loop() {
-  static rcInputs_t rcInputsCopy;
-  static uint8_t badConsecutivePulses = 0;
-
-  #if 0
-  static char buffer[64];
-  snprintf(buffer, sizeof(buffer), "STR=%ld THR=%ld", strLastPulseWidth, thrLastPulseWidth);
-  Serial.println(buffer);
-  #endif
 
+  // after reading pulses, so they can't be newer than now
   uint32_t now = micros();
 
-  noInterrupts();
-  memcpy(&rcInputsCopy, (void *)&rcInputs, sizeof(rcInputs_t));
-  interrupts();
+  // unfiltered, the median would hide the glitches it counts
+  signalState = failsafe.update(now, rcPulses);
 
-  bool validStr = rcInputsCopy.strLastPulseWidth >= 1000U && rcInputsCopy.strLastPulseWidth <= 2000U;
-  bool freshStr = now - rcInputsCopy.strLastPulseStart <= 1000000U;
-  bool validThr = rcInputsCopy.thrLastPulseWidth >= 1000U && rcInputsCopy.thrLastPulseWidth <= 2000U;
-  bool freshThr = now - rcInputsCopy.thrLastPulseStart <= 1000000U;
-
-  bool validPulse = validStr && validThr;
-  bool freshPulse = freshStr && freshThr;
-
-  if (validPulse && freshPulse) {
-    badConsecutivePulses = 0;
-  } else {
-    if (badConsecutivePulses < 255) {
-      badConsecutivePulses++;
-    }
+  if (signalState == FAILSAFE_OK) {
+    calibration.entry(now, rcInputs[CHN_THR].width);
+    calibration.sweep(now, rcInputs);
   }
 
-  if (!freshPulse || badConsecutivePulses > 10) {
-    //Serial.println("No signal");
-    Serial.write("No signal: thr ");
-    Serial.write(validThr ? "+" : "-");
-    Serial.write("/");
-    Serial.write(freshThr ? "+" : "-");
-    Serial.write(" str ");
-    Serial.write(validStr ? "+" : "-");
-    Serial.write("/");
-    Serial.write(freshStr ? "+" : "-");
-    Serial.write(" bad ");
-    Serial.print(badConsecutivePulses);
-    Serial.println();
-
-    // no good signal for a while
-    analogWrite(PIN_MOTOR_1A, 0);
-    analogWrite(PIN_MOTOR_1B, 0);
-    analogWrite(PIN_MOTOR_2A, 0);
-    analogWrite(PIN_MOTOR_2B, 0);
-
-    analogWrite(LED_BUILTIN, 0);
-
-    FastLED.showColor(CHSV(0, 0, 0));
-
-  } else if (validPulse) {
+  if (signalState == FAILSAFE_STOP || calibration.sweeping()) {
+    // no good signal for a while, or sticks being swept
+    mixer.reset();
+    thr1Percent = thr2Percent = 0;
+    PROBE_BEGIN(PROBE_MOTORS);
+    motor1.stop();
+    motor2.stop();
+    PROBE_END(PROBE_MOTORS);
+  } else if (signalState == FAILSAFE_OK) {
     // good signal
-    uint8_t motor1a = 0;
-    uint8_t motor1b = 0;
-    uint8_t motor2a = 0;
-    uint8_t motor2b = 0;
-
-    int16_t thrPercent = 0;
-    if (rcInputsCopy.thrLastPulseWidth > 1600 || rcInputsCopy.thrLastPulseWidth < 1400) {
-      thrPercent = ((int16_t)(rcInputsCopy.thrLastPulseWidth) - 1500) / 5;
-    }
-
-    int16_t strPercent = 0;
-    if (rcInputsCopy.strLastPulseWidth > 1600 || rcInputsCopy.strLastPulseWidth < 1400) {
-      strPercent = ((int16_t)(rcInputsCopy.strLastPulseWidth) - 1500) / 5;
-    }
-
-    int16_t thr1Percent = 0;
-    int16_t thr2Percent = 0;
-    if (thrPercent >= 0) { 
-      thr1Percent = thrPercent + strPercent;
-      thr2Percent = thrPercent - strPercent;
-    } else {
-      thr1Percent = thrPercent - strPercent;
-      thr2Percent = thrPercent + strPercent;
-    }
-
-    if (thr1Percent > 100) thr1Percent = 100;
-    if (thr1Percent < -100) thr1Percent = -100;
-    if (thr2Percent > 100) thr2Percent = 100;
-    if (thr2Percent < -100) thr2Percent = -100;
-    
-    if (thr1Percent > 0) {
-      motor1a = thr1Percent * 2;
-    } else if (thr1Percent < 0) {
-      motor1b = -thr1Percent * 2;
-    }
+    mixer.update(calibration.normalize(CHN_STR, rcInputs[CHN_STR].width),
+                 calibration.normalize(CHN_THR, rcInputs[CHN_THR].width));
+    thr1Percent = mixer.thr1Percent;
+    thr2Percent = mixer.thr2Percent;
+
+    PROBE_BEGIN(PROBE_MOTORS);
+    motor1.update(thr1Percent * 2);
+    motor2.update(thr2Percent * 2);
+    PROBE_END(PROBE_MOTORS);
+  }
+  // stale but not bad enough to take action keeps them
 
-    if (thr2Percent > 0) {
-      motor2a = thr2Percent * 2;
-    } else if (thr2Percent < 0) {
-      motor2b = -thr2Percent * 2;
-    }
+  motors.motor1a = motor1.outA;
+  motors.motor1b = motor1.outB;
+  motors.motor2a = motor2.outA;
+  motors.motor2b = motor2.outB;
+}
 
-    analogWrite(PIN_MOTOR_1A, motor1a);
-    analogWrite(PIN_MOTOR_1B, motor1b);
-    analogWrite(PIN_MOTOR_2A, motor2a);
-    analogWrite(PIN_MOTOR_2B, motor2b);
+void ledTask(const uint32_t now) {
+  if (signalState == FAILSAFE_STOP || calibration.sweeping()) {
+    FastPin<LED_BUILTIN>::low();
+    ledRenderer.showColor(now, calibration.sweeping() ? CRGB::Blue : CRGB::Black);
 
+  } else if (signalState == FAILSAFE_OK) {
     #if 0
     // hsv: 0 = red, 96 = green
     static uint8_t bar1O[4] = {15, 8, 7, 0};
@@ -244,37 +226,119 @@ void loop() {
     static uint8_t bar1[8] = {14, 15, 8, 9, 6, 7, 0, 1};
     static uint8_t bar2[8] = {13, 12, 11, 10, 5, 4, 3, 2};
 
-    uint8_t hsv1V = floor(abs(thr1Percent) * 96U / 100U);
-    uint8_t hsv2V = floor(abs(thr2Percent) * 96U / 100U);
-    uint8_t hsv1L = floor(min(abs(thr1Percent), 95U) / 12U);
-    uint8_t hsv2L = floor(min(abs(thr2Percent), 95U) / 12U);
-
-    for (uint8_t i = 0; i < LED_COUNT; i++) {
-      ledStrip[i] = CHSV(0, 0, 0);
-    }
-    if (thr1Percent != 0) {
-      for (uint8_t l = 0; l <= hsv1L; l++) {
-        uint8_t i = (thr1Percent > 0) ? l : 7 - l;
-        ledStrip[bar1[i]] = CHSV(hsv1V, 255, 255);
-      }
-    }
-    if (thr2Percent != 0) {
-      for (uint8_t l = 0; l <= hsv2L; l++) {
-        uint8_t i = (thr2Percent > 0) ? l : 7 - l;
-        ledStrip[bar2[i]] = CHSV(hsv2V, 255, 255);
-      }
-    }
+    // the two bars cover the whole matrix
+    drawBarGraph(ledStrip, bar1, thr1Percent);
+    drawBarGraph(ledStrip, bar2, thr2Percent);
     #endif
-    FastLED.show();
-    
-    analogWrite(LED_BUILTIN, 255);
+    ledRenderer.show(now);
+
+    FastPin<LED_BUILTIN>::high();
 
   } else {
     // stale but not bad enough to take action
-    Serial.println("Stale signal");
-    FastLED.showColor(CHSV(0, 0, 0));
-    analogWrite(LED_BUILTIN, 127);
+    ledRenderer.showColor(now, CRGB::Black);
+    // pin 13 has no pwm, analogWrite(127) turned it off too
+    FastPin<LED_BUILTIN>::low();
+  }
+}
+
+void telemetryTask(const uint32_t now) {
+  // as written, stale signal keeps them
+  telemetryRobo_t record;
+  record.ts = now;
+  record.str = rcInputs[CHN_STR].width;
+  record.thr = rcInputs[CHN_THR].width;
+  record.motor1a = motors.motor1a;
+  record.motor1b = motors.motor1b;
+  record.motor2a = motors.motor2a;
+  record.motor2b = motors.motor2b;
+  record.prox = 0;
+  record.signal = signalState;
+  record.loopTime = loopTimeMax;
+  telemetry.send(TELEMETRY_ROBO, &record, sizeof(record));
+  loopTimeMax = 0;
+}
+
+void recorderTask(const uint32_t) {
+  static uint16_t lastStops = 0;
+
+  recorderSample_t sample;
+  sample.str = rcInputs[CHN_STR].width;
+  sample.thr = rcInputs[CHN_THR].width;
+  sample.motor1a = motors.motor1a;
+  sample.motor1b = motors.motor1b;
+  sample.motor2a = motors.motor2a;
+  sample.motor2b = motors.motor2b;
+  sample.bits = signalState << 4;
+
+  PROBE_BEGIN(PROBE_RECORDER);
+  recorder.record(millis(), sample);
+  PROBE_END(PROBE_RECORDER);
+
+  if (failsafe.stops != lastStops) {
+    lastStops = failsafe.stops;
+    recorder.dump();
+  }
+}
+
+void setup() {
+  FastPin<LED_BUILTIN>::output();
+  FastPin<LED_BUILTIN>::low();
+
+  Serial.begin(115200);
+  Serial.println("Initializing");
+
+  // make sure motors are stopped
+  motorPwmBegin();
+  motor1.begin();
+  motor2.begin();
+  motor1.slew = MOTOR_SLEW;
+  motor2.slew = MOTOR_SLEW;
+
+  FastLED.addLeds<WS2812, LED_PIN, GRB>(ledStrip, LED_COUNT);
+  FastLED.setBrightness(3);
+  for (int32_t i = 0xff0000; i != 0; i >>= 8) {
+    FastLED.showColor(CRGB(i));
+    delay(100);
+  }
+  FastLED.showColor(CRGB(0));
+
+  rcChannels::begin(INPUT_PULLUP);
+
+  testMotors();
+
+  scheduler.add(controlTask, TASK_HZ(CONTROL_TASK_RATE));
+  scheduler.add(ledTask, TASK_HZ(LED_TASK_RATE));
+  scheduler.add(telemetryTask, TASK_HZ(TELEMETRY_TASK_RATE));
+  scheduler.add(recorderTask, TASK_HZ(RECORDER_TASK_RATE));
+  scheduler.begin();
+
+  calibration.begin(micros());
+  Serial.println(calibration.loaded ? "Calibration loaded" : "Calibration defaults");
+
+  FastPin<LED_BUILTIN>::high();
+  Serial.println("Running");
+}
+
+void loop() {
+  PROBE_BEGIN(PROBE_LOOP);
+  uint32_t start = micros();
+
+  scheduler.run();
+
+  recorder.dumpStep();
+  calibration.saveStep();
+  if (Serial.read() == 'r') {
+    recorderReading = recorderReader.begin();
+  }
+  if (recorderReading) {
+    recorderReading = recorderReader.step(telemetry);
   }
+  telemetry.flush();
 
-  delay(10);
+  uint32_t elapsed = micros() - start;
+  if (elapsed > loopTimeMax) {
+    loopTimeMax = elapsed > 0xffff ? 0xffff : elapsed;
+  }
+  PROBE_END(PROBE_LOOP);
 }
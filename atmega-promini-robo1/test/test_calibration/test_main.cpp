@@ -0,0 +1,210 @@
+// Calibration eeprom ring: records saved, loaded back by a fresh instance
+// like at power up, the newest of the slots winning across the seq wrap,
+// crc failures and cut writes falling back to the record before, or to
+// the defaults.
+
+#include <unity.h>
+
+#include <Calibration.h>
+#include <HalNative.h>
+
+// robo1's two channels at its address
+#define ADDR 0x300
+#define SLOTS 8
+#define RECORD_SIZE (sizeof(calibrationHeader_t) + 2 * sizeof(calChannel_t) + 2)
+
+typedef Calibration<2, SLOTS> calibration_t;
+
+static calChannel_t channel(const uint16_t min, const uint16_t center, const uint16_t max, const uint8_t deadband) {
+  calChannel_t c;
+  c.min = min;
+  c.center = center;
+  c.max = max;
+  c.deadband = deadband;
+  return c;
+}
+
+// n-th record of a test, all different
+static void saveNth(calibration_t &cal, const uint16_t n) {
+  calChannel_t chn[2] = {channel(1000 + n % 50, 1450 + n % 100, 1950, 8), channel(1100, 1500, 1900 + n % 100, 4)};
+  TEST_ASSERT_TRUE(cal.save(chn));
+  while (!cal.saveStep()) {
+  }
+}
+
+static void checkNth(const calibration_t &cal, const uint16_t n) {
+  TEST_ASSERT_EQUAL_UINT16(1000 + n % 50, cal.channel(0).min);
+  TEST_ASSERT_EQUAL_UINT16(1450 + n % 100, cal.channel(0).center);
+  TEST_ASSERT_EQUAL_UINT16(1900 + n % 100, cal.channel(1).max);
+}
+
+static void checkDefaults(const calibration_t &cal) {
+  TEST_ASSERT_FALSE(cal.loaded);
+  for (uint8_t i = 0; i < 2; i++) {
+    TEST_ASSERT_EQUAL_UINT16(1000, cal.channel(i).min);
+    TEST_ASSERT_EQUAL_UINT16(1500, cal.channel(i).center);
+    TEST_ASSERT_EQUAL_UINT16(2000, cal.channel(i).max);
+    TEST_ASSERT_EQUAL_UINT8(0, cal.channel(i).deadband);
+    // the identity over 1000..2000
+    TEST_ASSERT_EQUAL_UINT16(1000, cal.normalize(i, 1000));
+    TEST_ASSERT_EQUAL_UINT16(1234, cal.normalize(i, 1234));
+    TEST_ASSERT_EQUAL_UINT16(1777, cal.normalize(i, 1777));
+    TEST_ASSERT_EQUAL_UINT16(2000, cal.normalize(i, 2000));
+  }
+}
+
+static void flipByte(const uint16_t addr) {
+  uint8_t *p = (uint8_t *)(uintptr_t)addr;
+  eeprom_update_byte(p, eeprom_read_byte(p) ^ 0x01);
+}
+
+void setUp() {
+  halReset();
+}
+
+void tearDown() {
+}
+
+void test_ring_fits_its_slots() {
+  TEST_ASSERT_EQUAL_UINT16(20, RECORD_SIZE);
+  TEST_ASSERT_EQUAL_UINT16(SLOTS * RECORD_SIZE, calibration_t::EEPROM_SIZE);
+}
+
+void test_erased_eeprom_gives_the_defaults() {
+  calibration_t cal(ADDR);
+  TEST_ASSERT_FALSE(cal.load());
+  checkDefaults(cal);
+  TEST_ASSERT_EQUAL_UINT8(0, cal.badSlots);
+  TEST_ASSERT_EQUAL_UINT8(SLOTS - 1, cal.slot);
+  TEST_ASSERT_EQUAL_UINT8(0xff, cal.seq);
+}
+
+void test_saved_record_loads_at_power_up() {
+  calibration_t cal(ADDR);
+  cal.load();
+  saveNth(cal, 7);
+  TEST_ASSERT_EQUAL_UINT8(0, cal.slot);
+  TEST_ASSERT_EQUAL_UINT8(0, cal.seq);
+
+  calibration_t next(ADDR);
+  TEST_ASSERT_TRUE(next.load());
+  checkNth(next, 7);
+  TEST_ASSERT_EQUAL_UINT8(0, next.slot);
+  TEST_ASSERT_EQUAL_UINT8(0, next.seq);
+  // and nothing written outside its slot
+  TEST_ASSERT_EQUAL_HEX8(0xff, eeprom_read_byte((const uint8_t *)(uintptr_t)(ADDR + RECORD_SIZE)));
+  TEST_ASSERT_EQUAL_HEX8(0xff, eeprom_read_byte((const uint8_t *)(uintptr_t)(ADDR - 1)));
+}
+
+void test_crc_rejects_any_flipped_byte() {
+  calibration_t cal(ADDR);
+  cal.load();
+  saveNth(cal, 1);
+
+  // past the magic, every byte of the record up to and including the crc
+  for (uint16_t i = 1; i < RECORD_SIZE; i++) {
+    flipByte(ADDR + i);
+    calibration_t next(ADDR);
+    TEST_ASSERT_FALSE(next.load());
+    checkDefaults(next);
+    TEST_ASSERT_EQUAL_UINT8(1, next.badSlots);
+    flipByte(ADDR + i);
+  }
+
+  calibration_t next(ADDR);
+  TEST_ASSERT_TRUE(next.load());
+  checkNth(next, 1);
+}
+
+void test_bad_newest_falls_back_to_the_one_before() {
+  calibration_t cal(ADDR);
+  cal.load();
+  saveNth(cal, 1);
+  saveNth(cal, 2);
+  // a centre byte of the newest, slot 1
+  flipByte(ADDR + RECORD_SIZE + sizeof(calibrationHeader_t) + 2);
+
+  calibration_t next(ADDR);
+  TEST_ASSERT_TRUE(next.load());
+  checkNth(next, 1);
+  TEST_ASSERT_EQUAL_UINT8(0, next.slot);
+  TEST_ASSERT_EQUAL_UINT8(1, next.badSlots);
+
+  // the next save goes after the good one, over the bad slot
+  saveNth(next, 3);
+  TEST_ASSERT_EQUAL_UINT8(1, next.slot);
+  calibration_t last(ADDR);
+  TEST_ASSERT_TRUE(last.load());
+  checkNth(last, 3);
+  TEST_ASSERT_EQUAL_UINT8(0, last.badSlots);
+}
+
+void test_cut_write_loses_only_itself() {
+  calibration_t cal(ADDR);
+  cal.load();
+  saveNth(cal, 1);
+
+  // the real write time, power lost some bytes into the next save
+  halEepromWriteUs = 3300;
+  calChannel_t chn[2] = {channel(1010, 1480, 1960, 6), channel(1100, 1500, 1900, 4)};
+  TEST_ASSERT_TRUE(cal.save(chn));
+  for (uint8_t i = 0; i < RECORD_SIZE / 2; i++) {
+    TEST_ASSERT_FALSE(cal.saveStep());
+    halAdvance(3300);
+  }
+
+  calibration_t next(ADDR);
+  TEST_ASSERT_TRUE(next.load());
+  checkNth(next, 1);
+  TEST_ASSERT_EQUAL_UINT8(0, next.slot);
+}
+
+void test_newest_wins_across_the_seq_wrap() {
+  calibration_t cal(ADDR);
+  cal.load();
+  // seq 0..259, the ring holds 252..255 and 0..3 (wrapped)
+  for (uint16_t n = 0; n < 260; n++) {
+    saveNth(cal, n);
+    if (n % 37 == 0 || n >= 250) {
+      // at power up any time, the last one saved is back
+      calibration_t next(ADDR);
+      TEST_ASSERT_TRUE(next.load());
+      checkNth(next, n);
+      TEST_ASSERT_EQUAL_UINT8(n & 0xff, next.seq);
+      TEST_ASSERT_EQUAL_UINT8(n % SLOTS, next.slot);
+    }
+  }
+
+  for (uint8_t s = 0; s < SLOTS; s++) {
+    uint8_t seq = eeprom_read_byte((const uint8_t *)(uintptr_t)(ADDR + s * RECORD_SIZE + 2));
+    // 259 in slot 3, back from there
+    TEST_ASSERT_EQUAL_UINT8((259 - (3 + SLOTS - s) % SLOTS) & 0xff, seq);
+  }
+}
+
+void test_other_channel_count_is_not_loaded() {
+  // a record of robo1's layout read by a 1 channel sketch at the same
+  // address: the header says 2 channels
+  calibration_t cal(ADDR);
+  cal.load();
+  saveNth(cal, 1);
+
+  Calibration<1, SLOTS> one(ADDR);
+  TEST_ASSERT_FALSE(one.load());
+  // its smaller slots read into the record too
+  TEST_ASSERT_TRUE(one.badSlots >= 1);
+  TEST_ASSERT_EQUAL_UINT16(1500, one.channel(0).center);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_ring_fits_its_slots);
+  RUN_TEST(test_erased_eeprom_gives_the_defaults);
+  RUN_TEST(test_saved_record_loads_at_power_up);
+  RUN_TEST(test_crc_rejects_any_flipped_byte);
+  RUN_TEST(test_bad_newest_falls_back_to_the_one_before);
+  RUN_TEST(test_cut_write_loses_only_itself);
+  RUN_TEST(test_newest_wins_across_the_seq_wrap);
+  RUN_TEST(test_other_channel_count_is_not_loaded);
+  return UNITY_END();
+}
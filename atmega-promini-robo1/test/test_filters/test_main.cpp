@@ -0,0 +1,143 @@
+// Filters against plain reference implementations over random streams.
+
+#include <unity.h>
+
+#include <Filters.h>
+#include <stdlib.h>
+
+static uint32_t seed;
+
+// small lcg, same streams on every run
+static uint16_t rnd(const uint16_t range) {
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 8) % range;
+}
+
+// rc pulse like: around 1500 with glitches
+static uint16_t pulseSample() {
+  return rnd(10) == 0 ? rnd(4000) : 1400 + rnd(200);
+}
+
+void setUp() {
+  seed = 1;
+}
+
+void tearDown() {
+}
+
+template <uint8_t N>
+static void checkMovingAverage() {
+  MovingAverage<uint16_t, uint32_t, N> filter;
+  uint16_t history[N] = {};
+
+  for (uint16_t i = 0; i < 2000; i++) {
+    uint16_t x = pulseSample();
+    history[i % N] = x;
+    uint32_t sum = 0;
+    for (uint8_t k = 0; k < N; k++) {
+      sum += history[k];
+    }
+    TEST_ASSERT_EQUAL_UINT16(sum / N, filter.update(x));
+  }
+}
+
+void test_moving_average_is_mean_of_last_n() {
+  checkMovingAverage<1>();
+  checkMovingAverage<4>();
+  checkMovingAverage<5>();
+  checkMovingAverage<16>();
+}
+
+void test_moving_average_reset_fills_the_window() {
+  MovingAverage<uint16_t, uint16_t, 4> filter;
+  filter.reset(1000);
+  TEST_ASSERT_EQUAL_UINT16(1000, filter.value());
+  TEST_ASSERT_EQUAL_UINT16(1250, filter.update(2000));
+  filter.update(2000);
+  filter.update(2000);
+  TEST_ASSERT_EQUAL_UINT16(2000, filter.update(2000));
+}
+
+template <uint8_t SHIFT>
+static void checkExpFilter() {
+  ExpFilter<uint16_t, uint32_t, SHIFT> filter;
+  filter.reset(1500);
+  double y = 1500;
+  const double a = 1.0 / (1 << SHIFT);
+
+  for (uint16_t i = 0; i < 5000; i++) {
+    uint16_t x = pulseSample();
+    y += (x - y) * a;
+    uint16_t v = filter.update(x);
+    // truncation only ever leaves the state a little high, less than 1 in all
+    TEST_ASSERT_GREATER_OR_EQUAL((long)y - 1, v);
+    TEST_ASSERT_LESS_OR_EQUAL((long)y + 1, v);
+  }
+}
+
+void test_exp_filter_follows_floating_point_ema() {
+  checkExpFilter<1>();
+  checkExpFilter<3>();
+  checkExpFilter<6>();
+}
+
+void test_exp_filter_settles_on_a_constant() {
+  ExpFilter<uint16_t, uint32_t, 3> filter;
+  for (uint8_t i = 0; i < 200; i++) {
+    filter.update(1234);
+  }
+  TEST_ASSERT_EQUAL_UINT16(1234, filter.value());
+}
+
+template <uint8_t N>
+static void checkMedian(const uint16_t range) {
+  MedianFilter<uint16_t, N> filter;
+  uint16_t history[N];
+
+  for (uint16_t i = 0; i < 3000; i++) {
+    // narrow range gives lots of equal samples
+    uint16_t x = range ? rnd(range) : pulseSample();
+    history[i % N] = x;
+
+    uint8_t count = i + 1 < N ? i + 1 : N;
+    uint16_t sorted[N];
+    memcpy(sorted, history, sizeof(sorted));
+    for (uint8_t a = 1; a < count; a++) {
+      for (uint8_t b = a; b > 0 && sorted[b - 1] > sorted[b]; b--) {
+        uint16_t t = sorted[b];
+        sorted[b] = sorted[b - 1];
+        sorted[b - 1] = t;
+      }
+    }
+    TEST_ASSERT_EQUAL_UINT16(sorted[count / 2], filter.update(x));
+  }
+}
+
+void test_median_is_middle_of_last_n() {
+  checkMedian<1>(0);
+  checkMedian<3>(0);
+  checkMedian<5>(0);
+  checkMedian<3>(3);
+  checkMedian<7>(4);
+}
+
+void test_median_drops_a_single_glitch() {
+  MedianFilter<uint16_t, 3> filter;
+  TEST_ASSERT_EQUAL_UINT16(0, filter.value());
+  filter.update(1500);
+  filter.update(1500);
+  TEST_ASSERT_EQUAL_UINT16(1500, filter.update(3000));
+  TEST_ASSERT_EQUAL_UINT16(1510, filter.update(1510));
+  TEST_ASSERT_EQUAL_UINT16(1510, filter.update(1510));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_moving_average_is_mean_of_last_n);
+  RUN_TEST(test_moving_average_reset_fills_the_window);
+  RUN_TEST(test_exp_filter_follows_floating_point_ema);
+  RUN_TEST(test_exp_filter_settles_on_a_constant);
+  RUN_TEST(test_median_is_middle_of_last_n);
+  RUN_TEST(test_median_drops_a_single_glitch);
+  return UNITY_END();
+}
@@ -0,0 +1,130 @@
+// Motor: slew limited steps, reversing through zero, stop and brake, and
+// only changed pwm outputs written.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <MotorDriver.h>
+
+#define PIN_A 10
+#define PIN_B 11
+
+static Motor<PIN_A, PIN_B> *motor;
+static uint16_t writesA;
+static uint16_t writesB;
+
+static void countWrite(const uint8_t pin, const int) {
+  if (pin == PIN_A) {
+    writesA++;
+  } else {
+    writesB++;
+  }
+}
+
+void setUp() {
+  halReset();
+  motor = new Motor<PIN_A, PIN_B>();
+  motor->begin();
+  halWatchPin(PIN_A, countWrite);
+  halWatchPin(PIN_B, countWrite);
+  writesA = writesB = 0;
+}
+
+void tearDown() {
+  halWatchPin(PIN_A, nullptr);
+  halWatchPin(PIN_B, nullptr);
+  delete motor;
+}
+
+void test_no_slew_goes_straight_to_target() {
+  motor->update(180);
+  TEST_ASSERT_EQUAL_INT16(180, motor->getSpeed());
+  TEST_ASSERT_EQUAL(180, halGetPin(PIN_A));
+  TEST_ASSERT_EQUAL(0, halGetPin(PIN_B));
+  motor->update(-400);
+  TEST_ASSERT_EQUAL_INT16(-255, motor->getSpeed());
+  TEST_ASSERT_EQUAL(0, halGetPin(PIN_A));
+  TEST_ASSERT_EQUAL(255, halGetPin(PIN_B));
+}
+
+void test_slew_limits_every_step() {
+  motor->slew = 8;
+  int16_t last = 0;
+  uint8_t updates = 0;
+  while (motor->getSpeed() != 200) {
+    motor->update(200);
+    TEST_ASSERT_TRUE(motor->getSpeed() - last <= 8);
+    TEST_ASSERT_TRUE(motor->getSpeed() > last);
+    last = motor->getSpeed();
+    updates++;
+  }
+  // 200 / 8, the last step lands on the target
+  TEST_ASSERT_EQUAL_UINT8(25, updates);
+  TEST_ASSERT_EQUAL(200, halGetPin(PIN_A));
+}
+
+void test_reverse_crosses_zero_at_slew_rate() {
+  motor->slew = 50;
+  for (uint8_t i = 0; i < 10; i++) {
+    motor->update(100);
+  }
+  TEST_ASSERT_EQUAL_INT16(100, motor->getSpeed());
+
+  static const int16_t steps[] = {50, 0, -50, -100, -100};
+  for (uint8_t i = 0; i < 5; i++) {
+    motor->update(-100);
+    TEST_ASSERT_EQUAL_INT16(steps[i], motor->getSpeed());
+    // never both bridge inputs driven
+    TEST_ASSERT_TRUE(halGetPin(PIN_A) == 0 || halGetPin(PIN_B) == 0);
+  }
+  TEST_ASSERT_EQUAL(100, halGetPin(PIN_B));
+}
+
+void test_stop_skips_the_slew() {
+  motor->slew = 8;
+  for (uint8_t i = 0; i < 40; i++) {
+    motor->update(-255);
+  }
+  motor->stop();
+  TEST_ASSERT_EQUAL_INT16(0, motor->getSpeed());
+  TEST_ASSERT_EQUAL(0, halGetPin(PIN_A));
+  TEST_ASSERT_EQUAL(0, halGetPin(PIN_B));
+}
+
+void test_brake_drives_both_inputs_at_zero() {
+  motor->stopMode = MOTOR_BRAKE;
+  motor->update(0);
+  TEST_ASSERT_EQUAL(255, halGetPin(PIN_A));
+  TEST_ASSERT_EQUAL(255, halGetPin(PIN_B));
+  motor->update(40);
+  TEST_ASSERT_EQUAL(40, halGetPin(PIN_A));
+  TEST_ASSERT_EQUAL(0, halGetPin(PIN_B));
+}
+
+void test_only_changed_outputs_are_written() {
+  motor->update(120);
+  TEST_ASSERT_EQUAL_UINT16(1, writesA);
+  TEST_ASSERT_EQUAL_UINT16(0, writesB);
+
+  // same target every control cycle
+  for (uint8_t i = 0; i < 100; i++) {
+    motor->update(120);
+  }
+  TEST_ASSERT_EQUAL_UINT16(1, writesA);
+  TEST_ASSERT_EQUAL_UINT16(0, writesB);
+
+  motor->update(-120);
+  TEST_ASSERT_EQUAL_UINT16(2, writesA);
+  TEST_ASSERT_EQUAL_UINT16(1, writesB);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_no_slew_goes_straight_to_target);
+  RUN_TEST(test_slew_limits_every_step);
+  RUN_TEST(test_reverse_crosses_zero_at_slew_rate);
+  RUN_TEST(test_stop_skips_the_slew);
+  RUN_TEST(test_brake_drives_both_inputs_at_zero);
+  RUN_TEST(test_only_changed_outputs_are_written);
+  return UNITY_END();
+}
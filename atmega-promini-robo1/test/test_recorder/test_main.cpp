@@ -0,0 +1,333 @@
+// Recorder: record encoding, ring eviction and wraparound, and the eeprom
+// image decoded back like tools/telemetry does, cut dumps included.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <Recorder.h>
+
+#define PERIOD 40
+#define ADDR 0x10
+
+// eeprom write time of the atmega328p
+#define EEPROM_WRITE_US 3300
+
+static uint32_t seed;
+
+static uint16_t rnd(const uint16_t range) {
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 8) % range;
+}
+
+static recorderSample_t sample(const uint16_t str, const uint16_t thr, const uint8_t motor = 0, const uint8_t bits = 0) {
+  recorderSample_t s;
+  s.str = str;
+  s.thr = thr;
+  s.motor1a = motor;
+  s.motor1b = 0;
+  s.motor2a = motor;
+  s.motor2b = 0;
+  s.bits = bits;
+  return s;
+}
+
+static bool same(const recorderSample_t &a, const recorderSample_t &b) {
+  return memcmp(&a, &b, sizeof(a)) == 0;
+}
+
+static uint16_t le16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+// eeprom image back to samples, as teledecode replays it, 0 if not valid
+static uint16_t decode(recorderSample_t *out, const uint16_t max, uint32_t *endTs = nullptr) {
+  recorderHeader_t header;
+  eeprom_read_block(&header, (const void *)ADDR, sizeof(header));
+  if (header.magic != RECORDER_MAGIC || header.version != RECORDER_VERSION) {
+    return 0;
+  }
+  if (endTs) {
+    *endTs = header.endTs;
+  }
+
+  uint8_t records[1024];
+  eeprom_read_block(records, (const void *)(ADDR + sizeof(header)), header.length);
+
+  recorderSample_t s = header.base;
+  uint16_t n = 0;
+  out[n++] = s;
+  const uint8_t *rec = records;
+  const uint8_t *end = records + header.length;
+  while (rec < end) {
+    uint8_t flags = *rec++;
+    if (flags & RECORDER_REPEAT) {
+      for (uint8_t i = 0; i < (flags & 0x7f); i++) {
+        TEST_ASSERT_TRUE(n < max);
+        out[n++] = s;
+      }
+      continue;
+    }
+    if (flags & RECORDER_STR_DELTA) {
+      s.str += (int8_t)*rec++;
+    } else if (flags & RECORDER_STR_FULL) {
+      s.str = le16(rec);
+      rec += 2;
+    }
+    if (flags & RECORDER_THR_DELTA) {
+      s.thr += (int8_t)*rec++;
+    } else if (flags & RECORDER_THR_FULL) {
+      s.thr = le16(rec);
+      rec += 2;
+    }
+    if (flags & RECORDER_MOTORS) {
+      s.motor1a = rec[0];
+      s.motor1b = rec[1];
+      s.motor2a = rec[2];
+      s.motor2b = rec[3];
+      rec += 4;
+    }
+    if (flags & RECORDER_BITS) {
+      s.bits = *rec++;
+    }
+    TEST_ASSERT_TRUE(n < max);
+    out[n++] = s;
+  }
+  TEST_ASSERT_TRUE(rec == end);
+  TEST_ASSERT_EQUAL_UINT16(header.samples, n);
+  return n;
+}
+
+template <uint16_t BUDGET>
+static void dumpAll(Recorder<BUDGET> &recorder) {
+  recorder.dump();
+  while (!recorder.dumpStep()) {
+    halAdvance(1000);
+  }
+}
+
+void setUp() {
+  halReset();
+  seed = 1;
+}
+
+void tearDown() {
+}
+
+void test_records_take_only_what_changed() {
+  Recorder<256> recorder(PERIOD, ADDR);
+  uint32_t ms = 0;
+
+  recorder.record(ms, sample(1500, 1500));
+  TEST_ASSERT_EQUAL_UINT16(1, recorder.size());
+  TEST_ASSERT_EQUAL_UINT16(0, recorder.bytes());
+
+  // small change: flags and a delta byte
+  recorder.record(ms += PERIOD, sample(1505, 1500));
+  TEST_ASSERT_EQUAL_UINT16(2, recorder.bytes());
+  // deltas at the int8 edges, then just past them
+  recorder.record(ms += PERIOD, sample(1505 + 127, 1500 - 128));
+  TEST_ASSERT_EQUAL_UINT16(5, recorder.bytes());
+  recorder.record(ms += PERIOD, sample(1505 + 127 + 128, 1500 - 128 - 129));
+  TEST_ASSERT_EQUAL_UINT16(10, recorder.bytes());
+  // motors and bits
+  recorder.record(ms += PERIOD, sample(1760, 1243, 200));
+  TEST_ASSERT_EQUAL_UINT16(15, recorder.bytes());
+  recorder.record(ms += PERIOD, sample(1760, 1243, 200, 0x31));
+  TEST_ASSERT_EQUAL_UINT16(17, recorder.bytes());
+
+  // unchanged: one repeat byte counting up to 127
+  for (uint8_t i = 0; i < 127; i++) {
+    recorder.record(ms += PERIOD, sample(1760, 1243, 200, 0x31));
+    TEST_ASSERT_EQUAL_UINT16(18, recorder.bytes());
+  }
+  recorder.record(ms += PERIOD, sample(1760, 1243, 200, 0x31));
+  TEST_ASSERT_EQUAL_UINT16(19, recorder.bytes());
+  TEST_ASSERT_EQUAL_UINT16(6 + 128, recorder.size());
+
+  dumpAll(recorder);
+  static recorderSample_t out[256];
+  uint32_t endTs;
+  TEST_ASSERT_EQUAL_UINT16(134, decode(out, 256, &endTs));
+  TEST_ASSERT_EQUAL_UINT32(ms, endTs);
+  TEST_ASSERT_TRUE(same(sample(1500, 1500), out[0]));
+  TEST_ASSERT_TRUE(same(sample(1632, 1372), out[2]));
+  TEST_ASSERT_TRUE(same(sample(1760, 1243), out[3]));
+  TEST_ASSERT_TRUE(same(sample(1760, 1243, 200, 0x31), out[133]));
+}
+
+void test_ring_keeps_the_newest_samples_through_wraps() {
+  // small ring, wraps many times over
+  Recorder<64> recorder(PERIOD, ADDR);
+  static recorderSample_t history[2000];
+  uint32_t ms = 5000;
+
+  recorderSample_t s = sample(1500, 1500);
+  for (uint16_t i = 0; i < 2000; i++) {
+    // sticks mostly still, sometimes a jump, motors following
+    switch (rnd(8)) {
+      case 0:
+        s.str = 1000 + rnd(1000);
+        break;
+      case 1:
+        s.thr += rnd(41) - 20;
+        break;
+      case 2:
+        s.motor1a = rnd(256);
+        break;
+      case 3:
+        s.bits = rnd(256);
+        break;
+    }
+    history[i] = s;
+    recorder.record(ms += PERIOD, s);
+    TEST_ASSERT_TRUE(recorder.bytes() <= 64);
+  }
+
+  uint16_t kept = recorder.size();
+  TEST_ASSERT_TRUE(kept > 20);
+  dumpAll(recorder);
+
+  static recorderSample_t out[2000];
+  uint32_t endTs;
+  TEST_ASSERT_EQUAL_UINT16(kept, decode(out, 2000, &endTs));
+  TEST_ASSERT_EQUAL_UINT32(ms, endTs);
+  for (uint16_t i = 0; i < kept; i++) {
+    TEST_ASSERT_TRUE_MESSAGE(same(history[2000 - kept + i], out[i]), "sample differs");
+  }
+}
+
+void test_evicting_repeats_drops_their_samples() {
+  Recorder<16> recorder(PERIOD, ADDR);
+  uint32_t ms = 0;
+
+  recorder.record(ms, sample(1500, 1500));
+  recorder.record(ms += PERIOD, sample(1510, 1500));
+  for (uint8_t i = 0; i < 100; i++) {
+    recorder.record(ms += PERIOD, sample(1510, 1500));
+  }
+  TEST_ASSERT_EQUAL_UINT16(102, recorder.size());
+  TEST_ASSERT_EQUAL_UINT16(3, recorder.bytes());
+
+  // fill the ring with changes
+  for (uint8_t i = 0; i < 6; i++) {
+    recorder.record(ms += PERIOD, sample(1511 + i, 1500));
+  }
+  TEST_ASSERT_EQUAL_UINT16(15, recorder.bytes());
+  TEST_ASSERT_EQUAL_UINT16(108, recorder.size());
+  // the oldest change goes into the base
+  recorder.record(ms += PERIOD, sample(1517, 1500));
+  TEST_ASSERT_EQUAL_UINT16(108, recorder.size());
+  // then the repeat run, all its samples in one go
+  recorder.record(ms += PERIOD, sample(1600, 1500));
+  TEST_ASSERT_EQUAL_UINT16(16, recorder.bytes());
+  TEST_ASSERT_EQUAL_UINT16(9, recorder.size());
+
+  dumpAll(recorder);
+  static recorderSample_t out[16];
+  TEST_ASSERT_EQUAL_UINT16(9, decode(out, 16));
+  TEST_ASSERT_EQUAL_UINT16(1510, out[0].str);
+  TEST_ASSERT_EQUAL_UINT16(1511, out[1].str);
+  TEST_ASSERT_EQUAL_UINT16(1600, out[8].str);
+}
+
+void test_magic_is_cleared_first_and_set_last() {
+  Recorder<64> recorder(PERIOD, ADDR);
+  uint32_t ms = 0;
+  for (uint8_t i = 0; i < 30; i++) {
+    recorder.record(ms += PERIOD, sample(1500 + i, 1500));
+  }
+  dumpAll(recorder);
+  TEST_ASSERT_EQUAL_HEX8(RECORDER_MAGIC, eeprom_read_byte((const uint8_t *)ADDR));
+
+  // second dump with the real write time, a byte per step
+  for (uint8_t i = 0; i < 30; i++) {
+    recorder.record(ms += PERIOD, sample(1600 + i, 1400));
+  }
+  halEepromWriteUs = EEPROM_WRITE_US;
+  halAdvance(EEPROM_WRITE_US);
+  recorder.dump();
+  uint16_t steps = 0;
+  bool cleared = false;
+  while (!recorder.dumpStep()) {
+    steps++;
+    uint8_t magic = eeprom_read_byte((const uint8_t *)ADDR);
+    // never valid again until the last byte
+    TEST_ASSERT_EQUAL_HEX8(0xff, magic);
+    cleared = true;
+    // the recorder doesn't record meanwhile
+    recorder.record(ms += PERIOD, sample(1000, 1000));
+    halAdvance(EEPROM_WRITE_US);
+  }
+  TEST_ASSERT_TRUE(cleared);
+  TEST_ASSERT_TRUE(steps > 10);
+  TEST_ASSERT_EQUAL_HEX8(RECORDER_MAGIC, eeprom_read_byte((const uint8_t *)ADDR));
+  TEST_ASSERT_EQUAL_UINT16(2, recorder.dumps);
+
+  static recorderSample_t out[64];
+  uint16_t n = decode(out, 64);
+  TEST_ASSERT_TRUE(n > 0);
+  TEST_ASSERT_EQUAL_UINT16(1629, out[n - 1].str);
+}
+
+void test_cut_dump_is_never_read_and_the_next_one_is() {
+  static recorderSample_t out[512];
+  Recorder<128> recorder(PERIOD, ADDR);
+  uint32_t ms = 0;
+  recorderSample_t s = sample(1500, 1500);
+  for (uint16_t i = 0; i < 300; i++) {
+    s.thr = 1000 + rnd(1000);
+    recorder.record(ms += PERIOD, s);
+  }
+  dumpAll(recorder);
+  uint16_t complete = decode(out, 512);
+  TEST_ASSERT_TRUE(complete > 0);
+
+  // power cut after every possible byte of a second dump
+  halEepromWriteUs = EEPROM_WRITE_US;
+  for (uint16_t cut = 1; cut < sizeof(recorderHeader_t) + 128; cut += 7) {
+    // the old image, unchanged records still valid
+    dumpAll(recorder);
+    TEST_ASSERT_EQUAL_UINT16(complete, decode(out, 512));
+
+    Recorder<128> next(PERIOD, ADDR);
+    for (uint16_t i = 0; i < 300; i++) {
+      s.thr = 1000 + rnd(1000);
+      next.record(ms += PERIOD, s);
+    }
+    // first step writes
+    halAdvance(EEPROM_WRITE_US);
+    next.dump();
+    for (uint16_t i = 0; i < cut && !next.dumpStep(); i++) {
+      halAdvance(EEPROM_WRITE_US);
+    }
+    if (next.dumping()) {
+      // cut: a mix of two images, not taken as one
+      RecorderReader reader(ADDR);
+      TEST_ASSERT_FALSE(reader.begin());
+      TEST_ASSERT_EQUAL_UINT16(0, decode(out, 512));
+    }
+  }
+
+  // after a cut, dumping again gives a whole image
+  Recorder<128> last(PERIOD, ADDR);
+  for (uint16_t i = 0; i < 300; i++) {
+    s.thr = 1000 + rnd(1000);
+    last.record(ms += PERIOD, s);
+  }
+  dumpAll(last);
+  RecorderReader reader(ADDR);
+  TEST_ASSERT_TRUE(reader.begin());
+  uint16_t n = decode(out, 512);
+  TEST_ASSERT_EQUAL_UINT16(last.size(), n);
+  TEST_ASSERT_EQUAL_UINT16(s.thr, out[n - 1].thr);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_records_take_only_what_changed);
+  RUN_TEST(test_ring_keeps_the_newest_samples_through_wraps);
+  RUN_TEST(test_evicting_repeats_drops_their_samples);
+  RUN_TEST(test_magic_is_cleared_first_and_set_last);
+  RUN_TEST(test_cut_dump_is_never_read_and_the_next_one_is);
+  return UNITY_END();
+}
@@ -0,0 +1,103 @@
+// Runs the robo1 sketch on the host: rc frames in, motor pwm out.
+
+#include <unity.h>
+
+#include "../../src/main.cpp"
+
+#include <HalNative.h>
+
+static uint8_t serialOut[4096];
+
+// loop() passes for us of time, like the native main()
+static void run(uint32_t us) {
+  while (us >= halLoopStep) {
+    loop();
+    halAdvance(halLoopStep);
+    us -= halLoopStep;
+  }
+  halAdvance(us);
+}
+
+// one 20ms rc frame, the pulses one after the other
+static void frame(const uint16_t strUs, const uint16_t thrUs) {
+  halSetPin(PIN_STR, 1);
+  run(strUs);
+  halSetPin(PIN_STR, 0);
+  halSetPin(PIN_THR, 1);
+  run(thrUs);
+  halSetPin(PIN_THR, 0);
+  run(20000 - strUs - thrUs);
+}
+
+static void frames(const uint16_t count, const uint16_t strUs, const uint16_t thrUs) {
+  for (uint16_t i = 0; i < count; i++) {
+    frame(strUs, thrUs);
+  }
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_centre_sticks_keep_motors_stopped() {
+  // past the calibration entry window, sticks centred
+  frames(150, 1500, 1500);
+  TEST_ASSERT_EQUAL(FAILSAFE_OK, failsafe.getState());
+  TEST_ASSERT_FALSE(calibration.sweeping());
+  TEST_ASSERT_EQUAL_INT16(0, motor1.getSpeed());
+  TEST_ASSERT_EQUAL_INT16(0, motor2.getSpeed());
+}
+
+void test_full_throttle_ramps_both_motors_forward() {
+  frame(1500, 2000);
+  // slew limited, not full speed after one frame (two control cycles)
+  TEST_ASSERT_LESS_OR_EQUAL(3 * MOTOR_SLEW, motor1.getSpeed());
+  frames(20, 1500, 2000);
+  TEST_ASSERT_EQUAL_INT16(200, motor1.getSpeed());
+  TEST_ASSERT_EQUAL_INT16(200, motor2.getSpeed());
+  TEST_ASSERT_EQUAL(200, halGetPin(PIN_MOTOR_1A));
+  TEST_ASSERT_EQUAL(0, halGetPin(PIN_MOTOR_1B));
+  TEST_ASSERT_EQUAL(200, halGetPin(PIN_MOTOR_2A));
+}
+
+void test_glitch_reaches_failsafe_not_motors() {
+  uint16_t glitches = failsafe.channel(CHN_THR).glitches;
+  // out of range throttle pulse, the median keeps it from the mixer
+  frame(1500, 2600);
+  TEST_ASSERT_EQUAL_UINT16(glitches + 1, failsafe.channel(CHN_THR).glitches);
+  TEST_ASSERT_EQUAL_INT16(200, motor1.getSpeed());
+  TEST_ASSERT_EQUAL_INT16(200, motor2.getSpeed());
+  frames(2, 1500, 2000);
+  TEST_ASSERT_EQUAL(FAILSAFE_OK, failsafe.getState());
+}
+
+void test_control_runs_at_its_rate() {
+  const task_t &control = scheduler.task(0);
+  TEST_ASSERT_EQUAL_UINT32(TASK_HZ(CONTROL_TASK_RATE), control.period);
+  TEST_ASSERT_EQUAL_UINT16(0, control.overruns);
+}
+
+void test_lost_signal_stops_motors() {
+  // no more pulses
+  run(150000);
+  TEST_ASSERT_EQUAL(FAILSAFE_STOP, failsafe.getState());
+  TEST_ASSERT_EQUAL_INT16(0, motor1.getSpeed());
+  TEST_ASSERT_EQUAL(0, halGetPin(PIN_MOTOR_1A));
+  TEST_ASSERT_EQUAL(0, halGetPin(PIN_MOTOR_2A));
+}
+
+int main() {
+  halReset();
+  halSerialCapture(serialOut, sizeof(serialOut));
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_centre_sticks_keep_motors_stopped);
+  RUN_TEST(test_full_throttle_ramps_both_motors_forward);
+  RUN_TEST(test_glitch_reaches_failsafe_not_motors);
+  RUN_TEST(test_control_runs_at_its_rate);
+  RUN_TEST(test_lost_signal_stops_motors);
+  return UNITY_END();
+}
@@ -0,0 +1,319 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Obstacle handling for the corner proximity sensors of a differential
+// drive, between the mixer and the motors.
+//
+// The outputs move at most slew percent per period towards what is asked
+// for, this is the motors' slew so there is one ramp. Steps are scaled by
+// the time since the last update, so updates may come faster than the
+// period (e.g. on each new rc frame) without ramping faster, only the
+// first step towards a new target is taken whole right away, at most one
+// step early per change. When a side (front or rear) gets blocked, speed
+// towards it goes to 0 at a brake step picked from the kept updates: the
+// closing speed is the larger of the current speed towards the side and
+// its mean over the last OBSTACLE_HISTORY updates, as the robot still
+// carries what it was doing, and the step takes that to 0 in 2^brakeShift
+// periods, so stopping distance goes with speed, not its square as with a
+// fixed rate. It is never below the slew step, a slow robot doesn't stop
+// slower than letting go of the stick would. Any speed away from it
+// passes. The side stays blocked for holdTime after its sensors clear, so
+// a bouncy sensor can't make it lurch back and forth, and for cautionTime
+// after that speed towards it is capped at cautionSpeed, as something is
+// likely still just out of sensor range. The history can also be read
+// back when tuning.
+//
+// Pushing into a stopped obstacle for escapeDelay starts an escape: the
+// motor on the other side from the hit corner backs away for escapeTime,
+// pivoting the robot about the wheel next to the obstacle, or both back
+// off if both corners are hit. It ends early if the stick lets go or the
+// way out gets blocked.
+//
+// Time from a sensor hit to no speed towards it is at most
+//   2^brakeShift + 1 periods
+// on top of the sensor sampling, the worst seen is kept in maxStopTime.
+// With slew 0 outputs follow at once and a hit is a hard stop.
+// Motors on 1 (left) and 2 (right), prox bits as below.
+
+// prox bits
+#define PROX_FR _BV(0)
+#define PROX_FL _BV(1)
+#define PROX_RR _BV(2)
+#define PROX_RL _BV(3)
+#define PROX_FRONT (PROX_FR | PROX_FL)
+#define PROX_REAR (PROX_RR | PROX_RL)
+
+enum obstacleState_t {
+  OBSTACLE_CLEAR,
+  OBSTACLE_CAUTION, // recently blocked, speed capped
+  OBSTACLE_BRAKING, // ramping down
+  OBSTACLE_BLOCKED, // stopped, held
+  OBSTACLE_ESCAPE
+};
+
+// last updates, a power of 2
+#define OBSTACLE_HISTORY_BITS 3
+#define OBSTACLE_HISTORY (1 << OBSTACLE_HISTORY_BITS)
+
+struct obstacleSample_t {
+  uint32_t ts; // us
+  uint8_t prox;
+  uint8_t state;
+  int8_t thr1; // given to the motors, -100..100
+  int8_t thr2;
+};
+
+class Obstacle {
+public:
+  // speeds in percent, times in us
+  // per period, 0 = none
+  uint8_t slew = 0;
+  // full speed to 0 in 2^brakeShift periods, up to 8
+  uint8_t brakeShift = 4;
+  // the slew and brake steps are per this much time
+  uint32_t period = 10000;
+  uint32_t holdTime = 200000;
+  uint32_t cautionTime = 1000000;
+  int8_t cautionSpeed = 30;
+  // 0 = no escapes
+  uint32_t escapeDelay = 500000;
+  uint32_t escapeTime = 300000;
+  int8_t escapeSpeed = 40;
+
+  // thr1, thr2 are the mixer outputs, limited in place
+  void update(const uint32_t now, const uint8_t prox, int16_t &thr1, int16_t &thr2) {
+    int16_t cmd1 = thr1;
+    int16_t cmd2 = thr2;
+
+    updateSide(front, now, prox & PROX_FRONT, thr1, thr2, 1);
+    updateSide(rear, now, prox & PROX_REAR, thr1, thr2, -1);
+
+    if (escapeActive && (now - escapeTs >= escapeTime || !escaping(cmd1, cmd2))) {
+      // another escape needs another escapeDelay of pushing
+      escapeActive = false;
+      front.pushTs = now;
+      rear.pushTs = now;
+    }
+    if (!escapeActive) {
+      startEscape(front, now, cmd1, cmd2, 1);
+      startEscape(rear, now, cmd1, cmd2, -1);
+    }
+    if (escapeActive) {
+      thr1 = escape1;
+      thr2 = escape2;
+    }
+
+    // 8.8 periods since the last update, a long gap counts as 4; a new
+    // target takes its first step at once, not when a period is up
+    uint32_t dt = events ? now - history(0).ts : period;
+    stepScale = dt >= 4 * period ? 1024 : (dt << 8) / period;
+    if ((thr1 != target1 || thr2 != target2) && stepScale < 256) {
+      stepScale = 256;
+    }
+    target1 = thr1;
+    target2 = thr2;
+
+    out1 = slewTo(out1, thr1 << 8);
+    out2 = slewTo(out2, thr2 << 8);
+    thr1 = out1 / 256;
+    thr2 = out2 / 256;
+    checkStopped(front, now, 1);
+    checkStopped(rear, now, -1);
+    setState(now, prox);
+  }
+
+  // right away, no slew, for failsafe
+  void stop() {
+    out1 = 0;
+    out2 = 0;
+  }
+
+  obstacleState_t getState() const {
+    return state;
+  }
+
+  // i = 0 is the newest
+  uint8_t historySize() const {
+    return events;
+  }
+
+  const obstacleSample_t &history(const uint8_t i) const {
+    return history_[(uint8_t)(head - 1 - i) % OBSTACLE_HISTORY];
+  }
+
+  // counters since start
+  uint16_t stops = 0;
+  uint16_t escapes = 0;
+  uint32_t lastStopTime = 0;
+  uint32_t maxStopTime = 0;
+
+private:
+  struct side_t {
+    uint8_t blocked = 0; // corners hit, kept through holdTime
+    bool seen = false;
+    uint32_t hitTs = 0;
+    uint32_t clearTs = 0; // sensors last read hit
+    uint16_t brakeStep = 0; // per period, 8.8, from the closing speed when hit
+    bool stopped = false;
+    uint32_t pushTs = 0; // stick towards the stopped side since
+  };
+
+  side_t front;
+  side_t rear;
+
+  // percent 8.8, so braking from any speed takes the same time
+  int16_t out1 = 0;
+  int16_t out2 = 0;
+  uint16_t stepScale = 256;
+  // what the last update asked for
+  int16_t target1 = 0;
+  int16_t target2 = 0;
+
+  bool escapeActive = false;
+  uint32_t escapeTs = 0;
+  int16_t escape1 = 0;
+  int16_t escape2 = 0;
+  int8_t escapeDir = 0;
+
+  obstacleState_t state = OBSTACLE_CLEAR;
+  obstacleSample_t history_[OBSTACLE_HISTORY] = {};
+  uint8_t head = 0;
+  uint8_t events = 0;
+
+  // dir 1 limits positive (forward) speeds, -1 negative ones
+  void updateSide(side_t &side, const uint32_t now, const uint8_t hit, int16_t &thr1, int16_t &thr2, const int8_t dir) {
+    if (hit) {
+      if (!side.blocked) {
+        side.hitTs = now;
+        side.brakeStep = ((uint16_t)closing(dir) << (8 - brakeShift)) + 1;
+        side.stopped = false;
+      }
+      side.blocked = hit;
+      side.seen = true;
+      side.clearTs = now;
+    } else if (side.blocked && now - side.clearTs >= holdTime) {
+      side.blocked = 0;
+    }
+
+    int16_t limit;
+    if (side.blocked) {
+      limit = 0;
+    } else if (cautious(side, now)) {
+      limit = cautionSpeed;
+    } else {
+      return;
+    }
+
+    if (dir * thr1 > limit) {
+      thr1 = dir * limit;
+    }
+    if (dir * thr2 > limit) {
+      thr2 = dir * limit;
+    }
+  }
+
+  // speed towards a side, the larger of now and the mean of the history
+  int16_t closing(const int8_t dir) const {
+    int16_t sum = 0;
+    for (uint8_t i = 0; i < OBSTACLE_HISTORY; i++) {
+      sum += max(0, max(dir * history_[i].thr1, dir * history_[i].thr2));
+    }
+    return max((int16_t)(sum >> OBSTACLE_HISTORY_BITS), (int16_t)max(dir * out1 / 256, dir * out2 / 256));
+  }
+
+  bool braking(const side_t &side) const {
+    return side.blocked && !side.stopped;
+  }
+
+  int16_t slewTo(const int16_t from, const int16_t to) const {
+    if (!slew) {
+      return to;
+    }
+    uint16_t step = slew << 8;
+    if (braking(front) && to < from) {
+      step = max(step, front.brakeStep);
+    }
+    if (braking(rear) && to > from) {
+      step = max(step, rear.brakeStep);
+    }
+    uint32_t scaled = ((uint32_t)step * stepScale) >> 8;
+    step = scaled > 0x7fff ? 0x7fff : (scaled ? scaled : 1);
+    if (to > from && (uint16_t)(to - from) > step) {
+      return from + step;
+    }
+    if (to < from && (uint16_t)(from - to) > step) {
+      return from - step;
+    }
+    return to;
+  }
+
+  void checkStopped(side_t &side, const uint32_t now, const int8_t dir) {
+    if (braking(side) && dir * out1 / 256 <= 0 && dir * out2 / 256 <= 0) {
+      side.stopped = true;
+      lastStopTime = now - side.hitTs;
+      if (lastStopTime > maxStopTime) {
+        maxStopTime = lastStopTime;
+      }
+      stops++;
+    }
+  }
+
+  bool cautious(const side_t &side, const uint32_t now) const {
+    return side.seen && now - side.clearTs < holdTime + cautionTime;
+  }
+
+  void startEscape(side_t &side, const uint32_t now, const int16_t cmd1, const int16_t cmd2, const int8_t dir) {
+    side_t &other = dir > 0 ? rear : front;
+    bool pushing = side.stopped && side.blocked && (dir * cmd1 > 0 || dir * cmd2 > 0);
+
+    if (!pushing) {
+      side.pushTs = now;
+      return;
+    }
+    if (escapeDelay == 0 || now - side.pushTs < escapeDelay || other.blocked) {
+      return;
+    }
+
+    // back away with the motor on the other side from the hit
+    uint8_t right = dir > 0 ? PROX_FR : PROX_RR;
+    uint8_t left = dir > 0 ? PROX_FL : PROX_RL;
+    escape1 = (side.blocked & right) ? -dir * escapeSpeed : 0;
+    escape2 = (side.blocked & left) ? -dir * escapeSpeed : 0;
+    escapeDir = dir;
+    escapeActive = true;
+    escapeTs = now;
+    escapes++;
+  }
+
+  // still wanted: stick towards the obstacle and the way out clear
+  bool escaping(const int16_t cmd1, const int16_t cmd2) const {
+    const side_t &other = escapeDir > 0 ? rear : front;
+    return (escapeDir * cmd1 > 0 || escapeDir * cmd2 > 0) && !other.blocked;
+  }
+
+  void setState(const uint32_t now, const uint8_t prox) {
+    if (escapeActive) {
+      state = OBSTACLE_ESCAPE;
+    } else if (braking(front) || braking(rear)) {
+      state = OBSTACLE_BRAKING;
+    } else if (front.blocked || rear.blocked) {
+      state = OBSTACLE_BLOCKED;
+    } else if (cautious(front, now) || cautious(rear, now)) {
+      state = OBSTACLE_CAUTION;
+    } else {
+      state = OBSTACLE_CLEAR;
+    }
+
+    obstacleSample_t &sample = history_[head];
+    sample.ts = now;
+    sample.prox = prox;
+    sample.state = state;
+    sample.thr1 = out1 / 256;
+    sample.thr2 = out2 / 256;
+    head = (head + 1) % OBSTACLE_HISTORY;
+    if (events < OBSTACLE_HISTORY) {
+      events++;
+    }
+  }
+};
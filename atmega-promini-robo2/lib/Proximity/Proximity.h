@@ -0,0 +1,84 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastPin.h>
+#include <Tables.h>
+
+// Active low proximity sensors handled as one bitmask, bit i = sensor i.
+//
+// update() samples all sensors at once through a PinGroup and debounces
+// them in parallel with a 2 bit vertical counter per bit, so the work is
+// the same for 1 or 8 sensors. A new obstacle shows right away, it only
+// clears after PROX_RELEASE_SAMPLES clear samples in a row, so a bouncy
+// sensor can't flicker the output.
+//
+// ProxOverlay turns the sensor mask into the mask of leds to light with a
+// single flash lookup, built at compile time from the leds of each sensor.
+
+// clear samples before a sensor releases, fixed by the 2 bit counter
+#define PROX_RELEASE_SAMPLES 4
+
+template <typename PINS>
+class Proximity {
+public:
+  static const uint8_t N = PINS::count;
+
+  // call at a fixed rate, returns the debounced mask
+  uint8_t update() {
+    uint8_t raw = ~PINS::read() & ALL;
+
+    // sensors that went off and back on while still held
+    uint8_t bounced = raw & ~lastRaw & active;
+    lastRaw = raw;
+
+    uint8_t rising = raw & ~active;
+    active |= rising;
+
+    // count held bits that read clear, reset the others
+    uint8_t clear = active & ~raw;
+    ct0 = ~(ct0 & clear);
+    ct1 = ct0 ^ (ct1 & clear);
+    active &= ~(clear & ct0 & ct1);
+
+    if (rising | bounced) {
+      for (uint8_t i = 0; i < N; i++) {
+        if (rising & _BV(i)) {
+          triggers[i]++;
+        }
+        if (bounced & _BV(i)) {
+          bounces[i]++;
+        }
+      }
+    }
+
+    return active;
+  }
+
+  uint8_t state() const {
+    return active;
+  }
+
+  // counters since start, by sensor
+  uint16_t triggers[N] = {};
+  uint16_t bounces[N] = {};
+
+private:
+  static const uint8_t ALL = (uint8_t)((1U << N) - 1);
+
+  uint8_t active = 0;
+  uint8_t lastRaw = 0;
+  uint8_t ct0 = 0xff;
+  uint8_t ct1 = 0xff;
+};
+
+// LEDS::at(i) gives the led mask of sensor i
+template <typename LEDS, uint8_t N>
+struct proxOverlayGen {
+  static constexpr uint16_t at(const uint16_t sensors, const uint8_t i = 0) {
+    return i == N ? 0 : (((sensors >> i) & 1) ? LEDS::at(i) : 0) | at(sensors, i + 1);
+  }
+};
+
+// ProxOverlay<LEDS, N>::read(sensors) = leds of all sensors in the mask
+template <typename LEDS, uint8_t N>
+struct ProxOverlay : ProgmemTable<uint16_t, proxOverlayGen<LEDS, N>, (1U << N)> {};
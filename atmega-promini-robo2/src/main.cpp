@@ -1,7 +1,24 @@
 #define FASTLED_ALLOW_INTERRUPTS 1
 
+//#define DEBUG
+
 #include <Arduino.h>
+#include <BarGraph.h>
+#include <Calibration.h>
+#include <Failsafe.h>
 #include <FastLED.h>
+#include <FastPin.h>
+#include <Filters.h>
+#include <FrameRenderer.h>
+#include <Mixer.h>
+#include <MotorDriver.h>
+#include <Obstacle.h>
+#include <Probe.h>
+#include <Proximity.h>
+#include <RcChannels.h>
+#include <Recorder.h>
+#include <Scheduler.h>
+#include <Telemetry.h>
 
 // serial led matrix 4x4
 #define LED_PIN 7
@@ -13,327 +30,479 @@
 #define PIN_PROX_RR 12
 #define PIN_PROX_RL 4 // 13 is internal led...
 
+// PROX_* bits in Obstacle.h, same order as the telemetry and recorder prox bits
+#define PROX_COUNT 4
+
+static Proximity<PinGroup<PIN_PROX_FR, PIN_PROX_FL, PIN_PROX_RR, PIN_PROX_RL>> proximity;
+
+// leds lit by each sensor on the matrix, bit n = led n
+struct proxLeds {
+  static constexpr uint16_t at(const uint8_t i) {
+    return i == 0 ? 0x001c    // fr: 2, 3, 4
+         : i == 1 ? 0x0083    // fl: 0, 1, 7
+         : i == 2 ? 0x3800    // rr: 11, 12, 13
+         : 0xc100;            // rl: 8, 14, 15
+  }
+};
+
+typedef ProxOverlay<proxLeds, PROX_COUNT> proxOverlay;
+
 static CRGB ledStrip[LED_COUNT];
 
+// only show changed frames, at most this often
+#define LED_MAX_FPS 30
+
+// dithering is on, so lit frames keep going out at the full rate
+static FrameRenderer<LED_COUNT> ledRenderer(ledStrip, LED_MAX_FPS, LED_MAX_FPS);
+
 // MOTOR outputs (must be pwm-capable pins)
 #define PIN_MOTOR_1A 10
 #define PIN_MOTOR_1B 11
 #define PIN_MOTOR_2A 5
 #define PIN_MOTOR_2B 6
 
-// RC channel pins
+// percent per mix period (10ms), stop to full speed in 250ms, done by
+// obstacle so braking and slew are one ramp
+#define MOTOR_SLEW 4
+
+static Motor<PIN_MOTOR_1A, PIN_MOTOR_1B> motor1;
+static Motor<PIN_MOTOR_2A, PIN_MOTOR_2B> motor2;
+
+// steering/throttle mix: 100us deadband, then 3us per percent
+static Mixer<100, 100, 3> mixer;
+
+// slews the motors and brakes towards a hit sensor, defaults tuned for this robot
+static Obstacle obstacle;
+
+// RC channel pins (must be INT - not PCINT - capable pins)
 #define PIN_STR 2
 #define PIN_THR 3
 
 // RC channel data
 
-struct rcInputs_t {
-  uint32_t strLastPulseStart = 0;
-  uint32_t strLastPulseWidth = 0;
-  uint32_t thrLastPulseStart = 0;
-  uint32_t thrLastPulseWidth = 0;
-};
+#define CHN_STR 0
+#define CHN_THR 1
+
+// in channel order
+typedef RcChannels<PIN_STR, PIN_THR> rcChannels;
+
+// raw pulses for the failsafe, filtered ones for control, by channel
+static rcPulse_t rcPulses[rcChannels::count];
+static rcPulse_t rcInputs[rcChannels::count];
 
-static rcInputs_t rcInputs;
+// median of last 3 pulses drops single glitches
+static MedianFilter<uint16_t, 3> strFilter;
+static MedianFilter<uint16_t, 3> thrFilter;
 
 void testMotors()
 {
   // motor test
-  analogWrite(PIN_MOTOR_1A, 31);
-  analogWrite(PIN_MOTOR_2A, 31);
+  PwmPin<PIN_MOTOR_1A>::write(31);
+  PwmPin<PIN_MOTOR_2A>::write(31);
   delay(100);
-  analogWrite(PIN_MOTOR_1A, 0);
-  analogWrite(PIN_MOTOR_2A, 0);
+  PwmPin<PIN_MOTOR_1A>::write(0);
+  PwmPin<PIN_MOTOR_2A>::write(0);
   delay(100);
-  analogWrite(PIN_MOTOR_1B, 31);
-  analogWrite(PIN_MOTOR_2B, 31);
+  PwmPin<PIN_MOTOR_1B>::write(31);
+  PwmPin<PIN_MOTOR_2B>::write(31);
   delay(100);
-  analogWrite(PIN_MOTOR_1B, 0);
-  analogWrite(PIN_MOTOR_2B, 0);
+  PwmPin<PIN_MOTOR_1B>::write(0);
+  PwmPin<PIN_MOTOR_2B>::write(0);
 }
 
-void setup() {
-  pinMode(LED_BUILTIN, OUTPUT);
-  analogWrite(LED_BUILTIN, 0);
-
-  Serial.begin(115200);
-  Serial.println("Initializing");
-
-  // proximity sensors
-  pinMode(PIN_PROX_FR, INPUT);
-  pinMode(PIN_PROX_FL, INPUT);
-  pinMode(PIN_PROX_RR, INPUT);
-  pinMode(PIN_PROX_RL, INPUT);
-
-  // rc signal inputs
-  pinMode(PIN_STR, INPUT);
-  pinMode(PIN_THR, INPUT);
-
-  // make sure motors are stopped
-  pinMode(PIN_MOTOR_1A, OUTPUT);
-  pinMode(PIN_MOTOR_1B, OUTPUT);
-  pinMode(PIN_MOTOR_2A, OUTPUT);
-  pinMode(PIN_MOTOR_2B, OUTPUT);
-  analogWrite(PIN_MOTOR_1A, 0);
-  analogWrite(PIN_MOTOR_1B, 0);
-  analogWrite(PIN_MOTOR_2A, 0);
-  analogWrite(PIN_MOTOR_2B, 0);
-  // and do a short twitch to test them
-  testMotors();
-
-  // led matrix
-  FastLED.addLeds<WS2812, LED_PIN, GRB>(ledStrip, LED_COUNT);
-  FastLED.setBrightness(16);
-  FastLED.setCorrection(TypicalLEDStrip);
-  FastLED.setDither(true);
-  // and do a short test pattern
-  for (int32_t i = 0xff0000; i != 0; i >>= 8) {
-    FastLED.showColor(CRGB(i));
-    delay(100);
+// RC signal state, updated by rcTask
+// lost after 100ms without good pulses, then motors ramp down over 250ms
+static Failsafe<rcChannels::count> failsafe(100000UL, 100000UL, FAILSAFE_ACTION_RAMP, 250000UL);
+
+// task rates (Hz)
+// polls the capture, cheap unless a pulse is new, then the mix runs in the
+// same pass: a pulse reaches the motors within ~1ms, not up to 15ms
+#define RC_TASK_RATE 1000
+#define PROX_TASK_RATE 100
+// at least, and on every new pulse
+#define MIX_TASK_RATE 100
+#define LED_TASK_RATE 30
+#define TELEMETRY_TASK_RATE 10
+#define RECORDER_TASK_RATE 25
+
+// motor speeds and outputs, updated by mixTask
+static int16_t thr1Percent = 0;
+static int16_t thr2Percent = 0;
+static motorOutputs_t motors;
+
+// debounced proximity bits, updated by proxTask
+static uint8_t prox = 0;
+
+static Scheduler<6> scheduler;
+static uint8_t mixTaskId;
+
+// binary state records, see Telemetry.h
+static Telemetry<96> telemetry;
+
+// longest loop() since last record (us)
+static uint16_t loopTimeMax = 0;
+
+// last ~5s of inputs and outputs, saved to eeprom when the failsafe stops
+// the motors and sent back on 'r' from serial
+#define RECORDER_EEPROM_ADDR 0
+static Recorder<512> recorder(1000 / RECORDER_TASK_RATE, RECORDER_EEPROM_ADDR);
+static RecorderReader recorderReader(RECORDER_EEPROM_ADDR);
+static bool recorderReading = false;
+
+// stick endpoints, centres and deadbands, full throttle at power up to
+// sweep, kept after the recorder image
+#define CALIBRATION_EEPROM_ADDR 0x300
+static Calibration<rcChannels::count> calibration(CALIBRATION_EEPROM_ADDR);
+static_assert(RECORDER_EEPROM_ADDR + decltype(recorder)::EEPROM_SIZE <= CALIBRATION_EEPROM_ADDR, "recorder image runs into the calibration");
+static_assert(CALIBRATION_EEPROM_ADDR + decltype(calibration)::EEPROM_SIZE <= E2END + 1, "calibration ring past the end of the eeprom");
+
+void rcTask(const uint32_t) {
+  rcPulses[CHN_STR] = rcChannels::read(CHN_STR);
+  rcPulses[CHN_THR] = rcChannels::read(CHN_THR);
+
+  // only filter new pulses, a frame is read several times, and mix them
+  // right away
+  if (rcPulses[CHN_STR].ts != rcInputs[CHN_STR].ts) {
+    rcInputs[CHN_STR] = rcPulses[CHN_STR];
+    rcInputs[CHN_STR].width = strFilter.update(rcPulses[CHN_STR].width);
+    scheduler.trigger(mixTaskId);
+  }
+  if (rcPulses[CHN_THR].ts != rcInputs[CHN_THR].ts) {
+    rcInputs[CHN_THR] = rcPulses[CHN_THR];
+    rcInputs[CHN_THR].width = thrFilter.update(rcPulses[CHN_THR].width);
+    scheduler.trigger(mixTaskId);
   }
-  FastLED.showColor(CRGB(0));
 
-  analogWrite(LED_BUILTIN, 255);
-  Serial.println("Running");
+  // after reading pulses, so they can't be newer than now
+  // unfiltered, the median would hide the glitches it counts
+  failsafe.update(micros(), rcPulses);
 }
 
-static uint32_t tick = 0;
+// at a fixed rate, the debounce counts calls
+void proxTask(const uint32_t) {
+  prox = proximity.update();
+}
 
-void loop() {
-  uint32_t now = micros();
-  bool blinkState = now & 0x20000;
+void mixTask(const uint32_t) {
+  failsafeState_t signalState = failsafe.getState();
 
-  uint32_t strPulseWidth = pulseIn(PIN_STR, HIGH, 25000);
-  if (strPulseWidth > 0) {
-    rcInputs.strLastPulseWidth = strPulseWidth;
-    rcInputs.strLastPulseStart = now;
+  if (signalState == FAILSAFE_OK) {
+    calibration.entry(micros(), rcInputs[CHN_THR].width);
+    calibration.sweep(micros(), rcInputs);
   }
-  uint32_t thrPulseWidth = pulseIn(PIN_THR, HIGH, 25000);
-  if (thrPulseWidth > 0) {
-    rcInputs.thrLastPulseWidth = thrPulseWidth;
-    rcInputs.thrLastPulseStart = now;
+
+  if (calibration.sweeping() || signalState == FAILSAFE_STOP) {
+    mixer.reset();
+  } else if (signalState == FAILSAFE_OK) {
+    mixer.update(calibration.normalize(CHN_STR, rcInputs[CHN_STR].width),
+                 calibration.normalize(CHN_THR, rcInputs[CHN_THR].width));
   }
 
-  bool validStr = rcInputs.strLastPulseWidth >= 1000U && rcInputs.strLastPulseWidth <= 2000U;
-  bool freshStr = now - rcInputs.strLastPulseStart <= 100000U;
-  bool validThr = rcInputs.thrLastPulseWidth >= 1000U && rcInputs.thrLastPulseWidth <= 2000U;
-  bool freshThr = now - rcInputs.thrLastPulseStart <= 100000U;
+  // stale and hold keep last outputs, ramp scales them down
+  uint16_t scale = failsafe.scale();
+  thr1Percent = (mixer.thr1Percent * (int16_t)scale) >> 8;
+  thr2Percent = (mixer.thr2Percent * (int16_t)scale) >> 8;
+
+  // limit motion in direction of proximity sensors
+  obstacle.update(micros(), prox, thr1Percent, thr2Percent);
 
-  bool validPulse = validStr && validThr;
-  bool freshPulse = freshStr && freshThr;
+  // update motors
 
-  static uint8_t badConsecutivePulses = 0;
-  if (validPulse && freshPulse) {
-    badConsecutivePulses = 0;
+  PROBE_BEGIN(PROBE_MOTORS);
+  if (signalState == FAILSAFE_STOP) {
+    obstacle.stop();
+    motor1.stop();
+    motor2.stop();
   } else {
-    if (badConsecutivePulses < 255) {
-      badConsecutivePulses++;
-    }
+    motor1.update(thr1Percent * 2);
+    motor2.update(thr2Percent * 2);
   }
+  PROBE_END(PROBE_MOTORS);
 
-  if (!freshPulse || badConsecutivePulses > 10) {
-    //Serial.println("No signal");
-    Serial.write("No signal: thr ");
-    Serial.write(validThr ? "+" : "-");
-    Serial.write("/");
-    Serial.write(freshThr ? "+" : "-");
-    Serial.write(" str ");
-    Serial.write(validStr ? "+" : "-");
-    Serial.write("/");
-    Serial.write(freshStr ? "+" : "-");
-    Serial.write(" bad ");
-    Serial.print(badConsecutivePulses);
-    Serial.println();
-
-    // no good signal for a while
-    analogWrite(PIN_MOTOR_1A, 0);
-    analogWrite(PIN_MOTOR_1B, 0);
-    analogWrite(PIN_MOTOR_2A, 0);
-    analogWrite(PIN_MOTOR_2B, 0);
-
-    analogWrite(LED_BUILTIN, 0);
-
-    FastLED.showColor(CHSV(0, 0, 0));
-
-  } else if (validPulse) {
-    // good signal
-    uint8_t motor1a = 0;
-    uint8_t motor1b = 0;
-    uint8_t motor2a = 0;
-    uint8_t motor2b = 0;
-
-    int16_t thrPercent = 0;
-    if (rcInputs.thrLastPulseWidth > 1600) {
-      thrPercent = ((int16_t)(rcInputs.thrLastPulseWidth - 100) - 1500) / 3;
-      if (thrPercent > 100) {
-        thrPercent = 100;
-      }
-    }
-    if (rcInputs.thrLastPulseWidth < 1400) {
-      thrPercent = ((int16_t)(rcInputs.thrLastPulseWidth + 100) - 1500) / 3;
-      if (thrPercent < -100) {
-        thrPercent = -100;
-      }
-    }
+  motors.motor1a = motor1.outA;
+  motors.motor1b = motor1.outB;
+  motors.motor2a = motor2.outA;
+  motors.motor2b = motor2.outB;
+}
 
-    int16_t strPercent = 0;
-    if (rcInputs.strLastPulseWidth > 1600) {
-      strPercent = ((int16_t)(rcInputs.strLastPulseWidth - 100) - 1500) / 3;
-      if (strPercent > 100) {
-        strPercent = 100;
-      }
-    }
-    if (rcInputs.strLastPulseWidth < 1400) {
-      strPercent = ((int16_t)(rcInputs.strLastPulseWidth + 100) - 1500) / 3;
-      if (strPercent < -100) {
-        strPercent = -100;
-      }
-    }
+void ledTask(const uint32_t now) {
+  if (calibration.sweeping()) {
+    ledRenderer.showColor(now, CRGB::Blue);
+    return;
+  }
 
-    int16_t thr1Percent = 0;
-    int16_t thr2Percent = 0;
-    if (thrPercent >= 0) { 
-      thr1Percent = thrPercent + strPercent;
-      thr2Percent = thrPercent - strPercent;
-    } else {
-      thr1Percent = thrPercent - strPercent;
-      thr2Percent = thrPercent + strPercent;
-    }
+  if (!failsafe.ok()) {
+    ledRenderer.showColor(now, CRGB::Black);
+    // pin 13 has no pwm, analogWrite(127) for stale turned it off too
+    FastPin<LED_BUILTIN>::low();
+    return;
+  }
 
-    if (thr1Percent > 100) thr1Percent = 100;
-    if (thr1Percent < -100) thr1Percent = -100;
-    if (thr2Percent > 100) thr2Percent = 100;
-    if (thr2Percent < -100) thr2Percent = -100;
-    
-    bool prox_fr = !digitalRead(PIN_PROX_FR); 
-    bool prox_fl = !digitalRead(PIN_PROX_FL);
-    bool prox_rr = !digitalRead(PIN_PROX_RR);
-    bool prox_rl = !digitalRead(PIN_PROX_RL);
-
-    // block motion in direction of proximity sensors
-
-    if (prox_fr || prox_fl) {
-      if (thr1Percent > 0 || thr2Percent > 0) {
-        thr1Percent = 0;
-        thr2Percent = 0;
-      }
-    }
+  bool blinkState = now & 0x20000;
 
-    if (prox_rr || prox_rl) {
-      if (thr1Percent < 0 || thr2Percent < 0) {
-        thr1Percent = 0;
-        thr2Percent = 0;
-      }
-    }
+  // draw motor speed on led matrix
 
-    // steering mix
+  // use half matrix for each motor
+  static uint8_t bar1[8] = {14, 15, 8, 9, 6, 7, 0, 1};
+  static uint8_t bar2[8] = {13, 12, 11, 10, 5, 4, 3, 2};
+  // center dot when stopped
+  static uint8_t stop[4] = {5, 6, 9, 10};
 
-    if (thr1Percent > 0) {
-      motor1a = thr1Percent * 2;
-    } else if (thr1Percent < 0) {
-      motor1b = -thr1Percent * 2;
-    }
+  // the two bars cover the whole matrix
+  drawBarGraph(ledStrip, bar1, thr1Percent);
+  drawBarGraph(ledStrip, bar2, thr2Percent);
 
-    if (thr2Percent > 0) {
-      motor2a = thr2Percent * 2;
-    } else if (thr2Percent < 0) {
-      motor2b = -thr2Percent * 2;
+  if (thr1Percent == 0 && thr2Percent == 0) {
+    // rotate hue at 50 steps per second
+    uint8_t stopHue = now / 20000U;
+    for (uint8_t i = 0; i < sizeof(stop) / sizeof(stop[0]); i++) {
+      ledStrip[stop[i]] = CHSV(stopHue, 255, 255);
     }
+  }
 
-    // update motors
+  // now draw proximity on led matrix
 
-    analogWrite(PIN_MOTOR_1A, motor1a);
-    analogWrite(PIN_MOTOR_1B, motor1b);
-    analogWrite(PIN_MOTOR_2A, motor2a);
-    analogWrite(PIN_MOTOR_2B, motor2b);
+  #define PROX_LED_HUE 190 // violet-ish
 
-    // draw motor speed on led matrix
+  uint16_t proxLedMask = proxOverlay::read(prox);
+  for (uint8_t i = 0; proxLedMask; i++, proxLedMask >>= 1) {
+    if (proxLedMask & 1) {
+      ledStrip[i] = CHSV(PROX_LED_HUE, 255, blinkState * 255);
+    }
+  }
 
-    // use half matrix for each motor
-    static uint8_t bar1[8] = {14, 15, 8, 9, 6, 7, 0, 1};
-    static uint8_t bar2[8] = {13, 12, 11, 10, 5, 4, 3, 2};
-    // center dot when stopped
-    static uint8_t stop[4] = {5, 6, 9, 10};
+  ledRenderer.show(now);
 
-    // bar hue (color)
-    uint8_t hsv1V = floor(abs(thr1Percent) * 96U / 100U);
-    uint8_t hsv2V = floor(abs(thr2Percent) * 96U / 100U);
-    // bar length, must be <= 7
-    uint8_t hsv1L = floor(min(abs(thr1Percent), 95U) / 12U);
-    uint8_t hsv2L = floor(min(abs(thr2Percent), 95U) / 12U);
+  FastPin<LED_BUILTIN>::high();
+}
 
-    for (uint8_t i = 0; i < LED_COUNT; i++) {
-      ledStrip[i] = CHSV(0, 0, 0);
+#ifdef DEBUG
+// text next to the binary records, straight Serial prints would corrupt them
+static TelemetryText<Telemetry<96> > debugText(telemetry);
+
+// the stats take a telemetry call per line, more calls than a second has
+#define STATS_PERIOD_S 2
+
+// stats line n, false past the last one
+static bool printStats(uint8_t n) {
+  if (n < scheduler.size()) {
+    debugText.print("Task ");
+    debugText.print(n);
+    debugText.print(": overruns ");
+    debugText.print(scheduler.task(n).overruns);
+    debugText.print(" wcet ");
+    debugText.print(scheduler.task(n).wcet);
+    debugText.println("us");
+    return true;
+  }
+  n -= scheduler.size();
+
+  if (n < 2) {
+    const failsafeChannel_t &chn = failsafe.channel(n);
+    debugText.print("Chn ");
+    debugText.print(n);
+    debugText.print(": ");
+    debugText.print(failsafe.frameRate(n));
+    debugText.print("fps jitter ");
+    debugText.print(chn.jitter.value());
+    debugText.print("us glitches ");
+    debugText.print(chn.glitches);
+    debugText.print(" gaps");
+    for (uint8_t b = 0; b < FAILSAFE_GAP_BUCKETS; b++) {
+      debugText.print(" ");
+      debugText.print(chn.gaps[b]);
     }
-
-    if (thr1Percent != 0) {
-      for (uint8_t l = 0; l <= hsv1L; l++) {
-        uint8_t i = (thr1Percent > 0) ? l : 7 - l;
-        ledStrip[bar1[i]] = CHSV(hsv1V, 255, 255);
+    debugText.println();
+    return true;
+  }
+  n -= 2;
+
+  switch (n) {
+    case 0: {
+      static uint16_t lastTriggers[PROX_COUNT];
+      debugText.print("Prox: triggers/s");
+      for (uint8_t i = 0; i < PROX_COUNT; i++) {
+        debugText.print(" ");
+        debugText.print((uint16_t)(proximity.triggers[i] - lastTriggers[i]) / STATS_PERIOD_S);
+        lastTriggers[i] = proximity.triggers[i];
       }
-    }
-
-    if (thr2Percent != 0) {
-      for (uint8_t l = 0; l <= hsv2L; l++) {
-        uint8_t i = (thr2Percent > 0) ? l : 7 - l;
-        ledStrip[bar2[i]] = CHSV(hsv2V, 255, 255);
+      debugText.print(" bounces");
+      for (uint8_t i = 0; i < PROX_COUNT; i++) {
+        debugText.print(" ");
+        debugText.print(proximity.bounces[i]);
       }
+      debugText.println();
+      return true;
     }
 
-    if (thr1Percent == 0 && thr2Percent == 0) {
-      for (uint8_t i = 0; i < sizeof(stop) / sizeof(stop[0]); i++) {
-        ledStrip[stop[i]] = CHSV((tick / 2) & 0xff, 255, 255);
-      }
-    }
+    case 1:
+      debugText.print("Obstacle: state ");
+      debugText.print(obstacle.getState());
+      debugText.print(" stops ");
+      debugText.print(obstacle.stops);
+      debugText.print(" escapes ");
+      debugText.print(obstacle.escapes);
+      debugText.print(" max stop time ");
+      debugText.print(obstacle.maxStopTime / 1000);
+      debugText.println("ms");
+      return true;
+
+    case 2:
+      debugText.print("Failsafe: stops ");
+      debugText.print(failsafe.stops);
+      debugText.print(" max reaction ");
+      debugText.print(failsafe.maxReactionTime / 1000);
+      debugText.println("ms");
+      return true;
+
+    case 3:
+      debugText.print("Leds: shows ");
+      debugText.print(ledRenderer.shows);
+      debugText.print(" skipped ");
+      debugText.print(ledRenderer.skipped);
+      debugText.print(" limited ");
+      debugText.print(ledRenderer.limited);
+      debugText.print(" refreshed ");
+      debugText.print(ledRenderer.refreshed);
+      debugText.println();
+      return true;
+
+    case 4:
+      debugText.print("Leds: show time ");
+      debugText.print(ledRenderer.showTime);
+      debugText.print("us max ");
+      debugText.print(ledRenderer.maxShowTime);
+      debugText.println("us");
+      return true;
+  }
+  return false;
+}
+#endif
+
+void telemetryTask(const uint32_t now) {
+  telemetryRobo_t record;
+  record.ts = now;
+  record.str = rcInputs[CHN_STR].width;
+  record.thr = rcInputs[CHN_THR].width;
+  record.motor1a = motors.motor1a;
+  record.motor1b = motors.motor1b;
+  record.motor2a = motors.motor2a;
+  record.motor2b = motors.motor2b;
+  record.prox = prox;
+  record.signal = failsafe.getState();
+  record.loopTime = loopTimeMax;
+  telemetry.send(TELEMETRY_ROBO, &record, sizeof(record));
+  loopTimeMax = 0;
+
+#ifdef DEBUG
+  // task stats every STATS_PERIOD_S, a line per call so they fit the ring
+  // next to the records
+  static uint8_t statsCountdown = 0;
+  static uint8_t statsLine = 0xff;
+  if (statsCountdown-- == 0) {
+    statsCountdown = STATS_PERIOD_S * TELEMETRY_TASK_RATE - 1;
+    statsLine = 0;
+  }
+  if (statsLine != 0xff && !printStats(statsLine++)) {
+    statsLine = 0xff;
+  }
+#endif
+}
 
-    // now draw proximity on led matrix
-    // this can be deduplicated by using arrays of sensors and associated leds
+void recorderTask(const uint32_t) {
+  static uint16_t lastStops = 0;
+
+  recorderSample_t sample;
+  sample.str = rcInputs[CHN_STR].width;
+  sample.thr = rcInputs[CHN_THR].width;
+  sample.motor1a = motors.motor1a;
+  sample.motor1b = motors.motor1b;
+  sample.motor2a = motors.motor2a;
+  sample.motor2b = motors.motor2b;
+  sample.bits = prox | (failsafe.getState() << 4);
+
+  PROBE_BEGIN(PROBE_RECORDER);
+  recorder.record(millis(), sample);
+  PROBE_END(PROBE_RECORDER);
+
+  if (failsafe.stops != lastStops) {
+    lastStops = failsafe.stops;
+    recorder.dump();
+  }
+}
 
-    #define PROX_LED_CNT 3
-    #define PROX_LED_HUE 190 // violet-ish
+void setup() {
+  FastPin<LED_BUILTIN>::output();
+  FastPin<LED_BUILTIN>::low();
 
-    static uint8_t prox_led_fr[PROX_LED_CNT] = {2, 3, 4};
-    if (prox_fr) {
-      for (uint8_t i = 0; i < PROX_LED_CNT; i++) {
-        ledStrip[prox_led_fr[i]] = CHSV(PROX_LED_HUE, 255, blinkState * 255);
-      }
-    }
+  Serial.begin(115200);
+  Serial.println("Initializing");
 
-    static uint8_t prox_led_fl[PROX_LED_CNT] = {0, 1, 7};
-    if (prox_fl) {
-      for (uint8_t i = 0; i < PROX_LED_CNT; i++) {
-        ledStrip[prox_led_fl[i]] = CHSV(PROX_LED_HUE, 255, blinkState * 255);
-      }
-    }
+  // proximity sensors
+  FastPin<PIN_PROX_FR>::input();
+  FastPin<PIN_PROX_FL>::input();
+  FastPin<PIN_PROX_RR>::input();
+  FastPin<PIN_PROX_RL>::input();
 
-    static uint8_t prox_led_rr[PROX_LED_CNT] = {11, 12, 13};
-    if (prox_rr) {
-      for (uint8_t i = 0; i < PROX_LED_CNT; i++) {
-        ledStrip[prox_led_rr[i]] = CHSV(PROX_LED_HUE, 255, blinkState * 255);
-      }
-    }
+  // rc signal inputs
+  rcChannels::begin(INPUT);
 
-    static uint8_t prox_led_rl[PROX_LED_CNT] = {8, 14, 15};
-    if (prox_rl) {
-      for (uint8_t i = 0; i < PROX_LED_CNT; i++) {
-        ledStrip[prox_led_rl[i]] = CHSV(PROX_LED_HUE, 255, blinkState * 255);
-      }
-    }
+  // make sure motors are stopped
+  motorPwmBegin();
+  motor1.begin();
+  motor2.begin();
+  obstacle.slew = MOTOR_SLEW;
+  obstacle.period = TASK_HZ(MIX_TASK_RATE);
+  // and do a short twitch to test them
+  testMotors();
+
+  // led matrix
+  FastLED.addLeds<WS2812, LED_PIN, GRB>(ledStrip, LED_COUNT);
+  FastLED.setBrightness(16);
+  FastLED.setCorrection(TypicalLEDStrip);
+  FastLED.setDither(true);
+  // and do a short test pattern
+  for (int32_t i = 0xff0000; i != 0; i >>= 8) {
+    FastLED.showColor(CRGB(i));
+    delay(100);
+  }
+  FastLED.showColor(CRGB(0));
 
-    FastLED.show();
-    
-    // done
+  scheduler.add(proxTask, TASK_HZ(PROX_TASK_RATE));
+  scheduler.add(rcTask, TASK_HZ(RC_TASK_RATE));
+  // after rcTask, so a trigger from it runs in the same pass
+  mixTaskId = scheduler.add(mixTask, TASK_HZ(MIX_TASK_RATE));
+  scheduler.add(ledTask, TASK_HZ(LED_TASK_RATE));
+  scheduler.add(telemetryTask, TASK_HZ(TELEMETRY_TASK_RATE));
+  scheduler.add(recorderTask, TASK_HZ(RECORDER_TASK_RATE));
+  scheduler.begin();
 
-    analogWrite(LED_BUILTIN, 255);
+  calibration.begin(micros());
+  Serial.println(calibration.loaded ? "Calibration loaded" : "Calibration defaults");
 
-  } else {
-    // stale but not bad enough to take action
-    Serial.println("Stale signal");
-    FastLED.showColor(CHSV(0, 0, 0));
-    analogWrite(LED_BUILTIN, 127);
-  }
+  FastPin<LED_BUILTIN>::high();
+  Serial.println("Running");
+}
+
+void loop() {
+  PROBE_BEGIN(PROBE_LOOP);
+  uint32_t start = micros();
 
-  tick++;
+  scheduler.run();
 
-  delay(10);
+  recorder.dumpStep();
+  calibration.saveStep();
+  if (Serial.read() == 'r') {
+    recorderReading = recorderReader.begin();
+  }
+  if (recorderReading) {
+    recorderReading = recorderReader.step(telemetry);
+  }
+  telemetry.flush();
+
+  uint32_t elapsed = micros() - start;
+  if (elapsed > loopTimeMax) {
+    loopTimeMax = elapsed > 0xffff ? 0xffff : elapsed;
+  }
+  PROBE_END(PROBE_LOOP);
 }
@@ -0,0 +1,97 @@
+// BarGraph's flash table against FastLED's runtime hsv2rgb_rainbow and
+// the per frame bar drawing it replaced.
+
+#include <unity.h>
+
+#include <BarGraph.h>
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_rainbow_anchors_are_fastled_ones() {
+  // section starts of FastLED's rainbow map
+  static const struct {
+    uint8_t hue, r, g, b;
+  } anchors[] = {
+    {0, 255, 0, 0}, {32, 171, 85, 0}, {64, 171, 170, 0}, {96, 0, 255, 0}, {128, 0, 171, 85},
+  };
+  for (uint8_t i = 0; i < sizeof(anchors) / sizeof(anchors[0]); i++) {
+    CRGB rgb = CHSV(anchors[i].hue, 255, 255);
+    TEST_ASSERT_EQUAL_UINT8(anchors[i].r, rgb.r);
+    TEST_ASSERT_EQUAL_UINT8(anchors[i].g, rgb.g);
+    TEST_ASSERT_EQUAL_UINT8(anchors[i].b, rgb.b);
+  }
+}
+
+void test_constexpr_rainbow_matches_runtime_for_bar_hues() {
+  // hues 0..127 are all the bars use (0..96)
+  for (uint16_t hue = 0; hue < 128; hue++) {
+    CRGB rgb = CHSV(hue, 255, 255);
+    TEST_ASSERT_EQUAL_UINT8(rgb.r, barRed(hue));
+    TEST_ASSERT_EQUAL_UINT8(rgb.g, barGreen(hue));
+    TEST_ASSERT_EQUAL_UINT8(rgb.b, barBlue(hue));
+  }
+}
+
+void test_table_entries_match_runtime_colour_and_length() {
+  for (int16_t percent = -100; percent <= 100; percent++) {
+    barFrame_t frame = barFrameTable::read(percent + 100);
+    uint8_t speed = abs(percent);
+    CRGB rgb = CHSV(speed * 96U / 100U, 255, 255);
+
+    TEST_ASSERT_EQUAL_UINT8(rgb.r, frame.r);
+    TEST_ASSERT_EQUAL_UINT8(rgb.g, frame.g);
+    TEST_ASSERT_EQUAL_UINT8(rgb.b, frame.b);
+
+    uint8_t lit = 0;
+    for (uint8_t m = frame.mask; m; m >>= 1) {
+      lit += m & 1;
+    }
+    TEST_ASSERT_EQUAL_UINT8(percent == 0 ? 0 : min(speed, 95U) / 12U + 1, lit);
+  }
+}
+
+// robo2's bar drawing before the table
+static void oldDraw(CRGB *leds, const uint8_t *bar, const int16_t percent) {
+  uint8_t hue = floor(abs(percent) * 96U / 100U);
+  uint8_t length = floor(min(abs(percent), 95U) / 12U);
+
+  for (uint8_t i = 0; i < 8; i++) {
+    leds[bar[i]] = CHSV(0, 0, 0);
+  }
+  if (percent != 0) {
+    for (uint8_t l = 0; l <= length; l++) {
+      uint8_t i = (percent > 0) ? l : 7 - l;
+      leds[bar[i]] = CHSV(hue, 255, 255);
+    }
+  }
+}
+
+void test_draw_matches_old_drawing_for_every_percent() {
+  static const uint8_t bar[8] = {14, 15, 8, 9, 6, 7, 0, 1};
+
+  for (int16_t percent = -100; percent <= 100; percent++) {
+    CRGB want[16];
+    CRGB got[16];
+    fill_solid(want, 16, CRGB(9, 9, 9));
+    fill_solid(got, 16, CRGB(9, 9, 9));
+
+    oldDraw(want, bar, percent);
+    drawBarGraph(got, bar, percent);
+    for (uint8_t i = 0; i < 16; i++) {
+      TEST_ASSERT_TRUE_MESSAGE(want[i] == got[i], "led differs");
+    }
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_rainbow_anchors_are_fastled_ones);
+  RUN_TEST(test_constexpr_rainbow_matches_runtime_for_bar_hues);
+  RUN_TEST(test_table_entries_match_runtime_colour_and_length);
+  RUN_TEST(test_draw_matches_old_drawing_for_every_percent);
+  return UNITY_END();
+}
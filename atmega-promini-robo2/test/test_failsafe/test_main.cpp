@@ -0,0 +1,163 @@
+// Failsafe over rc traces with glitches and dropouts, updated every 5ms
+// like robo2's rcTask, 50Hz frames on two channels.
+
+#include <unity.h>
+
+#include <Failsafe.h>
+
+#define UPDATE_US 5000UL
+#define FRAME_US 20000UL
+
+#define FRESH_US 100000UL
+#define BAD_US 100000UL
+#define RAMP_US 250000UL
+
+static Failsafe<2> *failsafe;
+static rcPulse_t pulses[2];
+static uint32_t now;
+// next frame due, 0 = receiver off
+static uint32_t nextFrame;
+
+// trace step: frames come in with the given width until the receiver goes off
+static failsafeState_t step(const uint16_t width) {
+  now += UPDATE_US;
+  if (nextFrame && now >= nextFrame) {
+    for (uint8_t i = 0; i < 2; i++) {
+      pulses[i].ts = nextFrame;
+      pulses[i].width = width;
+    }
+    nextFrame += FRAME_US;
+  }
+  return failsafe->update(now, pulses);
+}
+
+static void steps(uint16_t count, const uint16_t width) {
+  while (count--) {
+    step(width);
+  }
+}
+
+void setUp() {
+  failsafe = new Failsafe<2>(FRESH_US, BAD_US, FAILSAFE_ACTION_RAMP, RAMP_US);
+  pulses[0] = pulses[1] = rcPulse_t();
+  now = 1000;
+  nextFrame = now + FRAME_US;
+}
+
+void tearDown() {
+  delete failsafe;
+}
+
+void test_stopped_until_first_frames_then_ok() {
+  TEST_ASSERT_EQUAL(FAILSAFE_STOP, step(1500));
+  steps(20, 1500);
+  TEST_ASSERT_EQUAL(FAILSAFE_OK, failsafe->getState());
+  TEST_ASSERT_EQUAL_UINT16(256, failsafe->scale());
+  TEST_ASSERT_EQUAL_UINT16(50, failsafe->frameRate(0));
+  TEST_ASSERT_EQUAL_UINT16(0, failsafe->channel(1).jitter.value());
+}
+
+void test_single_glitch_is_stale_then_recovers() {
+  steps(40, 1500);
+  // one frame out of range
+  while (step(300) == FAILSAFE_OK) {
+  }
+  TEST_ASSERT_EQUAL(FAILSAFE_STALE, failsafe->getState());
+  TEST_ASSERT_EQUAL_UINT16(256, failsafe->scale());
+  // next good frame
+  steps(4, 1500);
+  TEST_ASSERT_EQUAL(FAILSAFE_OK, failsafe->getState());
+  TEST_ASSERT_EQUAL_UINT16(1, failsafe->channel(0).glitches);
+  TEST_ASSERT_EQUAL_UINT16(0, failsafe->stops);
+}
+
+void test_glitches_for_bad_window_are_lost() {
+  steps(40, 1500);
+  while (step(2500) == FAILSAFE_OK) {
+  }
+  uint32_t badSince = now;
+  while (step(2500) == FAILSAFE_STALE) {
+  }
+  TEST_ASSERT_EQUAL(FAILSAFE_RAMP, failsafe->getState());
+  TEST_ASSERT_TRUE(now - badSince >= BAD_US);
+  TEST_ASSERT_TRUE(now - badSince < BAD_US + UPDATE_US + FRAME_US);
+}
+
+void test_dropout_ramps_down_then_stops() {
+  steps(40, 1500);
+  uint32_t lastFrame = pulses[0].ts;
+  nextFrame = 0;
+
+  // fresh window runs out
+  while (step(0) != FAILSAFE_RAMP) {
+    TEST_ASSERT_TRUE(now - lastFrame <= FRESH_US + UPDATE_US);
+  }
+  uint32_t lostTs = now;
+
+  // scale follows the old 256 - elapsed * 256 / time divide, never above it
+  uint16_t last = 256;
+  while (step(0) == FAILSAFE_RAMP) {
+    uint16_t want = 256 - (now - lostTs) * 256 / RAMP_US;
+    uint16_t scale = failsafe->scale();
+    TEST_ASSERT_UINT16_WITHIN(1, want, scale);
+    TEST_ASSERT_TRUE(scale <= last);
+    last = scale;
+  }
+  TEST_ASSERT_EQUAL(FAILSAFE_STOP, failsafe->getState());
+  TEST_ASSERT_EQUAL_UINT16(0, failsafe->scale());
+  TEST_ASSERT_EQUAL_UINT32(RAMP_US, now - lostTs);
+
+  // within the bound in Failsafe.h
+  TEST_ASSERT_EQUAL_UINT16(1, failsafe->stops);
+  TEST_ASSERT_TRUE(failsafe->lastReactionTime <= FRESH_US + RAMP_US + UPDATE_US + FRAME_US);
+  TEST_ASSERT_EQUAL_UINT32(failsafe->lastReactionTime, failsafe->maxReactionTime);
+}
+
+void test_recovery_logs_the_gap() {
+  steps(40, 1500);
+  nextFrame = 0;
+  steps(120, 0); // 600ms off
+  TEST_ASSERT_EQUAL(FAILSAFE_STOP, failsafe->getState());
+
+  nextFrame = now + FRAME_US;
+  steps(8, 1500);
+  TEST_ASSERT_EQUAL(FAILSAFE_OK, failsafe->getState());
+  TEST_ASSERT_EQUAL_UINT16(256, failsafe->scale());
+  // 250ms..1s bucket, the normal frames all <= 25ms
+  TEST_ASSERT_EQUAL_UINT16(1, failsafe->channel(0).gaps[4]);
+  TEST_ASSERT_EQUAL_UINT16(failsafe->channel(0).frames - 2, failsafe->channel(0).gaps[0]);
+  // the dropout stays out of the rate
+  TEST_ASSERT_EQUAL_UINT16(50, failsafe->frameRate(0));
+}
+
+void test_ramp_scale_for_short_and_long_action_times() {
+  // extremes of actionTime, the fixed point step has to stay in range
+  static const uint32_t times[] = {1000UL, 8000000UL};
+  for (uint8_t t = 0; t < 2; t++) {
+    Failsafe<1> fs(FRESH_US, BAD_US, FAILSAFE_ACTION_RAMP, times[t]);
+    rcPulse_t pulse;
+    pulse.ts = 1000;
+    pulse.width = 1500;
+    TEST_ASSERT_EQUAL(FAILSAFE_OK, fs.update(1000, &pulse));
+
+    uint32_t lostTs = 1000 + FRESH_US + 1;
+    TEST_ASSERT_EQUAL(FAILSAFE_RAMP, fs.update(lostTs, &pulse));
+    for (uint8_t i = 1; i < 8; i++) {
+      uint32_t at = lostTs + times[t] * i / 8;
+      TEST_ASSERT_EQUAL(FAILSAFE_RAMP, fs.update(at, &pulse));
+      TEST_ASSERT_UINT16_WITHIN(1, 256 - 32 * i, fs.scale());
+    }
+    TEST_ASSERT_EQUAL(FAILSAFE_STOP, fs.update(lostTs + times[t], &pulse));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_stopped_until_first_frames_then_ok);
+  RUN_TEST(test_single_glitch_is_stale_then_recovers);
+  RUN_TEST(test_glitches_for_bad_window_are_lost);
+  RUN_TEST(test_dropout_ramps_down_then_stops);
+  RUN_TEST(test_recovery_logs_the_gap);
+  RUN_TEST(test_ramp_scale_for_short_and_long_action_times);
+  return UNITY_END();
+}
@@ -0,0 +1,154 @@
+// FastPin, PinGroup and PwmPin register code (FASTPIN_REGISTERS) against a
+// model of the atmega328p port and timer registers.
+
+#include <unity.h>
+
+#include <Arduino.h>
+
+static volatile uint8_t PORTB, PORTC, PORTD;
+static volatile uint8_t DDRB, DDRC, DDRD;
+static volatile uint8_t PINB, PINC, PIND;
+static volatile uint8_t TCCR0A, TCCR1A, TCCR2A;
+static volatile uint8_t OCR0A, OCR0B, OCR2A, OCR2B;
+static volatile uint16_t OCR1A, OCR1B;
+
+#define COM0A1 7
+#define COM0B1 5
+#define COM1A1 7
+#define COM1B1 5
+#define COM2A1 7
+#define COM2B1 5
+
+#define FASTPIN_REGISTERS
+#include <FastPin.h>
+
+// robo2's proximity inputs, over two ports
+typedef PinGroup<8, 9, 12, 4> proxPins;
+
+void setUp() {
+  PORTB = PORTC = PORTD = 0;
+  DDRB = DDRC = DDRD = 0;
+  PINB = PINC = PIND = 0;
+  TCCR0A = TCCR1A = TCCR2A = 0;
+}
+
+void tearDown() {
+}
+
+template <uint8_t PIN>
+static void checkMapping(const uint8_t port, const uint8_t bit) {
+  TEST_ASSERT_EQUAL_UINT8(port, FastPin<PIN>::portIndex);
+  TEST_ASSERT_EQUAL_UINT8(bit, FastPin<PIN>::bitIndex);
+}
+
+void test_pins_map_to_arduino_ports() {
+  checkMapping<0>(FASTPIN_PORTD, 0);
+  checkMapping<7>(FASTPIN_PORTD, 7);
+  checkMapping<8>(FASTPIN_PORTB, 0);
+  checkMapping<13>(FASTPIN_PORTB, 5);
+  checkMapping<14>(FASTPIN_PORTC, 0);
+  checkMapping<19>(FASTPIN_PORTC, 5);
+}
+
+void test_writes_touch_only_their_bit() {
+  PORTB = 0xa0;
+  FastPin<9>::high();
+  TEST_ASSERT_EQUAL_HEX8(0xa2, PORTB);
+  FastPin<13>::low();
+  TEST_ASSERT_EQUAL_HEX8(0x82, PORTB);
+  FastPin<9>::write(0);
+  TEST_ASSERT_EQUAL_HEX8(0x80, PORTB);
+  FastPin<8>::write(7);
+  TEST_ASSERT_EQUAL_HEX8(0x81, PORTB);
+  TEST_ASSERT_EQUAL_HEX8(0, PORTC);
+  TEST_ASSERT_EQUAL_HEX8(0, PORTD);
+}
+
+void test_direction_and_pullup() {
+  FastPin<3>::output();
+  TEST_ASSERT_EQUAL_HEX8(0x08, DDRD);
+  FastPin<3>::high();
+  FastPin<3>::input();
+  // input() also drops the pullup
+  TEST_ASSERT_EQUAL_HEX8(0, DDRD);
+  TEST_ASSERT_EQUAL_HEX8(0, PORTD);
+  FastPin<16>::inputPullup();
+  TEST_ASSERT_EQUAL_HEX8(0, DDRC);
+  TEST_ASSERT_EQUAL_HEX8(0x04, PORTC);
+}
+
+void test_toggle_writes_the_pin_register() {
+  // the chip flips PORTx bits written as 1 to PINx, a plain write of the mask
+  PIND = 0xff;
+  FastPin<5>::toggle();
+  TEST_ASSERT_EQUAL_HEX8(0x20, PIND);
+  TEST_ASSERT_EQUAL_HEX8(0, PORTD);
+}
+
+void test_read_samples_the_pin_register() {
+  PINC = 0x08;
+  TEST_ASSERT_EQUAL_UINT8(1, FastPin<17>::read());
+  TEST_ASSERT_EQUAL_UINT8(0, FastPin<16>::read());
+  TEST_ASSERT_EQUAL_UINT8(0, FastPin<3>::read());
+}
+
+void test_group_bit_i_is_pin_i() {
+  TEST_ASSERT_EQUAL_UINT8(4, proxPins::count);
+  // only port B and D are read
+  TEST_ASSERT_EQUAL_HEX8(_BV(FASTPIN_PORTB) | _BV(FASTPIN_PORTD), proxPins::ports);
+
+  for (uint8_t bits = 0; bits < 16; bits++) {
+    PINB = ((bits & 1) ? _BV(0) : 0) | ((bits & 2) ? _BV(1) : 0) | ((bits & 4) ? _BV(4) : 0) | 0x28;
+    PIND = ((bits & 8) ? _BV(4) : 0) | 0xe3;
+    PINC = 0xff;
+    TEST_ASSERT_EQUAL_HEX8(bits, proxPins::read());
+  }
+}
+
+void test_group_of_eight_over_three_ports() {
+  typedef PinGroup<0, 14, 8, 1, 15, 9, 2, 16> pins;
+  TEST_ASSERT_EQUAL_UINT8(8, pins::count);
+  PIND = 0x05; // pins 0, 2
+  PINC = 0x02; // pin 15
+  PINB = 0x00;
+  TEST_ASSERT_EQUAL_HEX8(0x51, pins::read());
+}
+
+void test_pwm_sets_compare_and_connects_output() {
+  PwmPin<5>::write(100);
+  TEST_ASSERT_EQUAL_UINT8(100, OCR0B);
+  TEST_ASSERT_EQUAL_HEX8(_BV(COM0B1), TCCR0A);
+  PwmPin<6>::write(7);
+  TEST_ASSERT_EQUAL_UINT8(7, OCR0A);
+  TEST_ASSERT_EQUAL_HEX8(_BV(COM0B1) | _BV(COM0A1), TCCR0A);
+
+  // 0 disconnects, the compare value is left alone
+  PwmPin<5>::write(0);
+  TEST_ASSERT_EQUAL_HEX8(_BV(COM0A1), TCCR0A);
+  TEST_ASSERT_EQUAL_UINT8(100, OCR0B);
+
+  PwmPin<9>::write(1);
+  PwmPin<10>::write(255);
+  TEST_ASSERT_EQUAL_UINT16(1, OCR1A);
+  TEST_ASSERT_EQUAL_UINT16(255, OCR1B);
+  TEST_ASSERT_EQUAL_HEX8(_BV(COM1A1) | _BV(COM1B1), TCCR1A);
+
+  PwmPin<3>::write(30);
+  PwmPin<11>::write(40);
+  TEST_ASSERT_EQUAL_UINT8(30, OCR2B);
+  TEST_ASSERT_EQUAL_UINT8(40, OCR2A);
+  TEST_ASSERT_EQUAL_HEX8(_BV(COM2A1) | _BV(COM2B1), TCCR2A);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_pins_map_to_arduino_ports);
+  RUN_TEST(test_writes_touch_only_their_bit);
+  RUN_TEST(test_direction_and_pullup);
+  RUN_TEST(test_toggle_writes_the_pin_register);
+  RUN_TEST(test_read_samples_the_pin_register);
+  RUN_TEST(test_group_bit_i_is_pin_i);
+  RUN_TEST(test_group_of_eight_over_three_ports);
+  RUN_TEST(test_pwm_sets_compare_and_connects_output);
+  return UNITY_END();
+}
@@ -0,0 +1,137 @@
+// Runs the robo2 sketch on the host: rc pulse edges in, the time until the
+// motor outputs move measured on the virtual clock.
+
+#include <unity.h>
+
+#include "../../src/main.cpp"
+
+#include <HalNative.h>
+
+static uint8_t serialOut[4096];
+
+// loop() passes for us of time, like the native main()
+static void run(uint32_t us) {
+  while (us >= halLoopStep) {
+    loop();
+    halAdvance(halLoopStep);
+    us -= halLoopStep;
+  }
+  halAdvance(us);
+}
+
+// loop() passes until motor 1 moves, us from now, 0xffffffff if not in limit
+static uint32_t untilMotorMoves(const uint32_t limit) {
+  int16_t speed = motor1.getSpeed();
+  uint8_t pwm = halGetPin(PIN_MOTOR_1A);
+  uint32_t start = micros();
+  while (micros() - start <= limit) {
+    loop();
+    if (motor1.getSpeed() != speed && halGetPin(PIN_MOTOR_1A) != pwm) {
+      return micros() - start;
+    }
+    halAdvance(halLoopStep);
+  }
+  return 0xffffffff;
+}
+
+// one rc frame, the pulses one after the other, period us long; the
+// latency from the throttle pulse's falling edge if measure
+static uint32_t frame(const uint16_t strUs, const uint16_t thrUs, const uint32_t period, const bool measure = false) {
+  halSetPin(PIN_STR, 1);
+  run(strUs);
+  halSetPin(PIN_STR, 0);
+  halSetPin(PIN_THR, 1);
+  run(thrUs);
+  halSetPin(PIN_THR, 0);
+  uint32_t latency = 0;
+  uint32_t rest = period - strUs - thrUs;
+  if (measure) {
+    latency = untilMotorMoves(rest - halLoopStep);
+    rest -= latency == 0xffffffff ? rest : latency;
+  }
+  run(rest);
+  return latency;
+}
+
+static uint32_t seed = 1;
+
+static uint16_t rnd(const uint16_t range) {
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 8) % range;
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_centre_sticks_past_the_calibration_window() {
+  for (uint16_t i = 0; i < 200; i++) {
+    frame(1500, 1500, 20000);
+  }
+  TEST_ASSERT_EQUAL(FAILSAFE_OK, failsafe.getState());
+  TEST_ASSERT_FALSE(calibration.sweeping());
+  TEST_ASSERT_EQUAL_INT16(0, motor1.getSpeed());
+}
+
+void test_throttle_reaches_the_motors_within_2ms() {
+  // the median of 3 takes a new stick position on its second frame, the
+  // latency is from the edge that ends that frame's throttle pulse
+  frame(1500, 1800, 20000);
+  uint32_t latency = frame(1500, 1800, 20000, true);
+  TEST_ASSERT_TRUE(latency <= 2000);
+  TEST_ASSERT_TRUE(motor1.getSpeed() > 0);
+}
+
+void test_latency_at_any_frame_phase() {
+  // frame periods of other receivers, so the pulses fall anywhere against
+  // the fixed rate tasks
+  uint32_t worst = 0;
+  uint32_t sum = 0;
+  uint16_t n = 0;
+  uint16_t thr = 1500;
+  for (uint16_t i = 0; i < 100; i++) {
+    uint32_t period = 14000 + rnd(9000);
+    // back and forth through the deadband and the slew
+    thr = thr >= 1700 ? 1300 + rnd(100) : 1700 + rnd(300);
+    frame(1500, thr, period);
+    uint32_t latency = frame(1500, thr, period, true);
+    TEST_ASSERT_TRUE(latency != 0xffffffff);
+    worst = latency > worst ? latency : worst;
+    sum += latency;
+    n++;
+  }
+  TEST_ASSERT_TRUE(worst <= 2000);
+
+  char msg[64];
+  snprintf(msg, sizeof(msg), "edge to motor: worst %luus, mean %luus over %u", (unsigned long)worst,
+           (unsigned long)(sum / n), n);
+  TEST_MESSAGE(msg);
+}
+
+void test_mix_keeps_its_rate_without_pulses() {
+  // the fixed rate tasks don't overrun with the rc task at 1kHz
+  for (uint8_t i = 0; i < scheduler.size(); i++) {
+    TEST_ASSERT_EQUAL_UINT16(0, scheduler.task(i).overruns);
+  }
+  TEST_ASSERT_EQUAL_UINT32(TASK_HZ(MIX_TASK_RATE), scheduler.task(mixTaskId).period);
+}
+
+int main() {
+  halReset();
+  halSerialCapture(serialOut, sizeof(serialOut));
+  // active low, nothing in sight
+  halSetPin(PIN_PROX_FR, 1);
+  halSetPin(PIN_PROX_FL, 1);
+  halSetPin(PIN_PROX_RR, 1);
+  halSetPin(PIN_PROX_RL, 1);
+  setup();
+
+  UNITY_BEGIN();
+  RUN_TEST(test_centre_sticks_past_the_calibration_window);
+  RUN_TEST(test_throttle_reaches_the_motors_within_2ms);
+  RUN_TEST(test_latency_at_any_frame_phase);
+  RUN_TEST(test_mix_keeps_its_rate_without_pulses);
+  return UNITY_END();
+}
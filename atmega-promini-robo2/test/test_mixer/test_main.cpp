@@ -0,0 +1,192 @@
+// Mixer against the percent/clamp code it replaced in robo1 and robo2,
+// for every pair of 1000..2000us inputs.
+
+#include <unity.h>
+
+#include <Mixer.h>
+
+struct percents_t {
+  int16_t thr1;
+  int16_t thr2;
+};
+
+// robo1 before lib/Mixer
+static percents_t oldRobo1(const uint16_t strWidth, const uint16_t thrWidth) {
+  int16_t thrPercent = 0;
+  if (thrWidth > 1600 || thrWidth < 1400) {
+    thrPercent = ((int16_t)(thrWidth) - 1500) / 5;
+  }
+
+  int16_t strPercent = 0;
+  if (strWidth > 1600 || strWidth < 1400) {
+    strPercent = ((int16_t)(strWidth) - 1500) / 5;
+  }
+
+  percents_t p;
+  if (thrPercent >= 0) {
+    p.thr1 = thrPercent + strPercent;
+    p.thr2 = thrPercent - strPercent;
+  } else {
+    p.thr1 = thrPercent - strPercent;
+    p.thr2 = thrPercent + strPercent;
+  }
+
+  if (p.thr1 > 100) p.thr1 = 100;
+  if (p.thr1 < -100) p.thr1 = -100;
+  if (p.thr2 > 100) p.thr2 = 100;
+  if (p.thr2 < -100) p.thr2 = -100;
+  return p;
+}
+
+static int16_t oldRobo2Percent(const uint16_t width) {
+  int16_t percent = 0;
+  if (width > 1600) {
+    percent = ((int16_t)(width - 100) - 1500) / 3;
+    if (percent > 100) {
+      percent = 100;
+    }
+  }
+  if (width < 1400) {
+    percent = ((int16_t)(width + 100) - 1500) / 3;
+    if (percent < -100) {
+      percent = -100;
+    }
+  }
+  return percent;
+}
+
+// robo2 before lib/Mixer
+static percents_t oldRobo2(const uint16_t strWidth, const uint16_t thrWidth) {
+  int16_t thrPercent = oldRobo2Percent(thrWidth);
+  int16_t strPercent = oldRobo2Percent(strWidth);
+
+  percents_t p;
+  if (thrPercent >= 0) {
+    p.thr1 = thrPercent + strPercent;
+    p.thr2 = thrPercent - strPercent;
+  } else {
+    p.thr1 = thrPercent - strPercent;
+    p.thr2 = thrPercent + strPercent;
+  }
+
+  if (p.thr1 > 100) p.thr1 = 100;
+  if (p.thr1 < -100) p.thr1 = -100;
+  if (p.thr2 > 100) p.thr2 = 100;
+  if (p.thr2 < -100) p.thr2 = -100;
+  return p;
+}
+
+// old motor pwm split
+static motorOutputs_t oldOutputs(const percents_t p) {
+  motorOutputs_t out;
+  if (p.thr1 > 0) {
+    out.motor1a = p.thr1 * 2;
+  } else if (p.thr1 < 0) {
+    out.motor1b = -p.thr1 * 2;
+  }
+  if (p.thr2 > 0) {
+    out.motor2a = p.thr2 * 2;
+  } else if (p.thr2 < 0) {
+    out.motor2b = -p.thr2 * 2;
+  }
+  return out;
+}
+
+template <typename M>
+static void checkAllPairs(percents_t (*old)(uint16_t, uint16_t)) {
+  M mixer;
+  uint32_t mismatches = 0;
+
+  for (uint16_t str = 1000; str <= 2000; str++) {
+    for (uint16_t thr = 1000; thr <= 2000; thr++) {
+      percents_t want = old(str, thr);
+      mixer.update(str, thr);
+
+      motorOutputs_t wantOut = oldOutputs(want);
+      motorOutputs_t out = M::motorOutputs(mixer.thr1Percent, mixer.thr2Percent);
+
+      if (mixer.thr1Percent != want.thr1 || mixer.thr2Percent != want.thr2 ||
+          memcmp(&out, &wantOut, sizeof(out)) != 0) {
+        if (mismatches++ == 0) {
+          char msg[80];
+          snprintf(msg, sizeof(msg), "first mismatch at str %u thr %u", str, thr);
+          TEST_MESSAGE(msg);
+        }
+      }
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, mismatches);
+}
+
+void setUp() {
+}
+
+void tearDown() {
+}
+
+void test_robo1_mix_matches_old_code() {
+  checkAllPairs<Mixer<100, 0, 5> >(oldRobo1);
+}
+
+void test_robo2_mix_matches_old_code() {
+  checkAllPairs<Mixer<100, 100, 3> >(oldRobo2);
+}
+
+template <uint16_t DEADBAND, uint16_t OFFSET, uint8_t DIVISOR>
+static void checkPercentDivide() {
+  // multiply-shift against the divide, offsets up to 1000us either side
+  for (uint16_t width = 500; width <= 2500; width++) {
+    int16_t x = (int16_t)width - 1500;
+    uint16_t ax = x < 0 ? -x : x;
+    int16_t want = 0;
+    if (ax > DEADBAND) {
+      want = (ax - OFFSET) / DIVISOR;
+      if (want > 100) want = 100;
+      if (x < 0) want = -want;
+    }
+    TEST_ASSERT_EQUAL_INT16(want, (Mixer<DEADBAND, OFFSET, DIVISOR>::pulseToPercent(width)));
+  }
+}
+
+void test_percent_multiply_shift_is_exact() {
+  checkPercentDivide<100, 0, 5>();
+  checkPercentDivide<100, 100, 3>();
+  checkPercentDivide<0, 0, 1>();
+  checkPercentDivide<0, 0, 7>();
+  checkPercentDivide<50, 20, 9>();
+  checkPercentDivide<0, 0, 10>();
+}
+
+void test_rate_limit_and_reset() {
+  Mixer<100, 0, 5> mixer;
+  mixer.rateLimit = 10;
+  mixer.update(1500, 2000);
+  TEST_ASSERT_EQUAL_INT8(10, mixer.thr1Percent);
+  mixer.update(1500, 2000);
+  TEST_ASSERT_EQUAL_INT8(20, mixer.thr2Percent);
+  mixer.reset();
+  TEST_ASSERT_EQUAL_INT8(0, mixer.thr1Percent);
+  TEST_ASSERT_EQUAL_INT8(0, mixer.thr2Percent);
+}
+
+void test_expo_keeps_ends_and_softens_middle() {
+  Mixer<0, 0, 5> mixer;
+  mixer.expo = 255;
+  mixer.update(1500, 2000);
+  TEST_ASSERT_EQUAL_INT8(100, mixer.thr1Percent);
+  mixer.update(1500, 1000);
+  TEST_ASSERT_EQUAL_INT8(-100, mixer.thr1Percent);
+  // 50% -> about 50^3 / 10000
+  mixer.update(1500, 1750);
+  TEST_ASSERT_INT_WITHIN(1, 12, mixer.thr1Percent);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_robo1_mix_matches_old_code);
+  RUN_TEST(test_robo2_mix_matches_old_code);
+  RUN_TEST(test_percent_multiply_shift_is_exact);
+  RUN_TEST(test_rate_limit_and_reset);
+  RUN_TEST(test_expo_keeps_ends_and_softens_middle);
+  return UNITY_END();
+}
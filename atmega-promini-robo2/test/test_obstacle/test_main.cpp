@@ -0,0 +1,312 @@
+// Obstacle against scripted scenarios: a robot driving at a wall on a line,
+// at robo2's 100 updates/s and slew. Position in ticks, a tick being what
+// 1% of speed covers in one update. Stopping distances are reported.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <Obstacle.h>
+
+#define UPDATE_US 10000UL
+#define SLEW 4
+// the ir sensors see this far
+#define SENSOR_RANGE 1200
+
+static Obstacle *obstacle;
+static uint32_t now;
+
+struct robot_t {
+  int32_t pos;
+  int16_t out1;
+  int16_t out2;
+};
+
+static robot_t robot;
+
+// one update, the robot moves by the mean of its wheels
+static void step(const uint8_t prox, int16_t thr1, int16_t thr2) {
+  obstacle->update(now, prox, thr1, thr2);
+  robot.out1 = thr1;
+  robot.out2 = thr2;
+  robot.pos += (thr1 + thr2) / 2;
+  now += UPDATE_US;
+}
+
+// front sensors by distance to a wall at wall
+static uint8_t sense(const int32_t wall) {
+  return wall - robot.pos < SENSOR_RANGE ? PROX_FRONT : 0;
+}
+
+struct stop_t {
+  int32_t distance; // from the hit, ticks
+  uint16_t updates;
+  int32_t gap; // left to the wall
+};
+
+// full stick forward at a wall until stopped, from cruising at speed
+static stop_t driveAtWall(const int16_t speed) {
+  const int32_t wall = 100000;
+  while (robot.out1 != speed) {
+    step(0, speed, speed);
+  }
+
+  stop_t result = {};
+  int32_t hitPos = 0;
+  bool hit = false;
+  while (robot.pos < wall) {
+    uint8_t prox = sense(wall);
+    if (prox && !hit) {
+      hit = true;
+      hitPos = robot.pos;
+    }
+    step(prox, speed, speed);
+    if (hit) {
+      result.updates++;
+      if (robot.out1 <= 0 && robot.out2 <= 0) {
+        break;
+      }
+    }
+  }
+  result.distance = robot.pos - hitPos;
+  result.gap = wall - robot.pos;
+
+  char msg[80];
+  snprintf(msg, sizeof(msg), "speed %d: stopped in %ld ticks, %u updates", speed, (long)result.distance, result.updates);
+  TEST_MESSAGE(msg);
+  return result;
+}
+
+void setUp() {
+  halReset();
+  obstacle = new Obstacle();
+  obstacle->slew = SLEW;
+  now = 0;
+  robot = robot_t();
+}
+
+void tearDown() {
+  delete obstacle;
+}
+
+void test_slew_ramps_the_outputs() {
+  uint8_t updates = 0;
+  int16_t last = 0;
+  while (robot.out1 != 100) {
+    step(0, 100, 100);
+    TEST_ASSERT_EQUAL_INT16(last + SLEW, robot.out1);
+    last = robot.out1;
+    updates++;
+  }
+  TEST_ASSERT_EQUAL_UINT8(100 / SLEW, updates);
+  TEST_ASSERT_EQUAL(OBSTACLE_CLEAR, obstacle->getState());
+}
+
+void test_full_speed_stops_short_of_the_wall() {
+  stop_t s = driveAtWall(100);
+  TEST_ASSERT_TRUE(s.gap > 0);
+  // 100 down in 16 steps of 6.25
+  TEST_ASSERT_EQUAL_UINT16(16, s.updates);
+  TEST_ASSERT_EQUAL_INT32(741, s.distance);
+  TEST_ASSERT_EQUAL_UINT16(1, obstacle->stops);
+  TEST_ASSERT_EQUAL(OBSTACLE_BLOCKED, obstacle->getState());
+}
+
+void test_stopping_is_bounded_at_any_speed() {
+  uint32_t bound = ((1UL << obstacle->brakeShift) + 1) * UPDATE_US;
+  int32_t lastDistance = 0;
+  for (int16_t speed = 8; speed <= 100; speed += 4) {
+    setUp();
+    stop_t s = driveAtWall(speed);
+    TEST_ASSERT_TRUE(s.gap > 0);
+    TEST_ASSERT_LESS_OR_EQUAL_UINT32(bound, obstacle->maxStopTime);
+    TEST_ASSERT_TRUE(s.updates <= (1 << obstacle->brakeShift) + 1);
+    // about proportional to speed, not to its square
+    TEST_ASSERT_TRUE(s.distance >= lastDistance);
+    TEST_ASSERT_TRUE(s.distance <= speed * 9);
+    lastDistance = s.distance;
+    tearDown();
+  }
+  setUp();
+}
+
+void test_slow_robot_brakes_at_least_at_the_slew() {
+  // 12 to 0 in 16 steps would be slower than ramping down when the stick
+  // lets go, the slew step is taken
+  stop_t slow = driveAtWall(12);
+  TEST_ASSERT_TRUE(slow.gap > 0);
+  TEST_ASSERT_EQUAL_UINT16(12 / SLEW, slow.updates);
+  TEST_ASSERT_EQUAL_UINT16(1, obstacle->stops);
+  TEST_ASSERT_LESS_OR_EQUAL_UINT32(12 / SLEW * UPDATE_US, obstacle->maxStopTime);
+  // and from 5 it takes 2, not one step short of 0
+  tearDown();
+  setUp();
+  TEST_ASSERT_EQUAL_UINT16(2, driveAtWall(5).updates);
+}
+
+void test_closing_speed_comes_from_the_history() {
+  // cruising at 60, the step takes it to 0 in 16, but the slew's is larger
+  stop_t cruising = driveAtWall(60);
+
+  tearDown();
+  setUp();
+  // from 100, the stick let go to 60 just before the hit: the robot still
+  // has the speed of the last updates and brakes harder
+  while (robot.out1 != 100) {
+    step(0, 100, 100);
+  }
+  for (uint8_t i = 0; i < 10; i++) {
+    step(0, 60, 60);
+  }
+  TEST_ASSERT_EQUAL_INT16(60, robot.out1);
+  uint16_t updates = 0;
+  step(PROX_FRONT, 60, 60);
+  updates++;
+  while (robot.out1 > 0) {
+    step(PROX_FRONT, 60, 60);
+    updates++;
+  }
+
+  TEST_ASSERT_EQUAL_UINT16(60 / SLEW, cruising.updates);
+  // mean of 88..60 is 74, braking as if from that
+  TEST_ASSERT_EQUAL_UINT16(13, updates);
+}
+
+void test_bouncy_sensor_never_lurches_forward() {
+  while (robot.out1 != 100) {
+    step(0, 100, 100);
+  }
+  const int32_t wall = robot.pos + SENSOR_RANGE + 500;
+  uint32_t seed = 5;
+  bool hit = false;
+  int16_t lowest = 100;
+  for (uint16_t i = 0; i < 300; i++) {
+    uint8_t prox = sense(wall);
+    // at the edge of range the sensor reads hit one time in 3
+    seed = seed * 1103515245UL + 12345UL;
+    if (prox && (seed >> 16) % 3) {
+      prox = 0;
+    }
+    hit |= prox != 0;
+    step(prox, 100, 100);
+    int16_t forward = max(robot.out1, 0);
+    if (hit && !obstacle->stops) {
+      // down only while the sensor flickers
+      TEST_ASSERT_TRUE(forward <= lowest);
+      lowest = forward;
+    } else if (hit) {
+      // then escapes back off, and it comes back no faster than caution
+      TEST_ASSERT_TRUE(forward <= obstacle->cautionSpeed);
+    }
+  }
+  TEST_ASSERT_TRUE(hit);
+  TEST_ASSERT_TRUE(robot.pos < wall);
+  TEST_ASSERT_TRUE(obstacle->stops >= 1);
+}
+
+void test_reverse_passes_and_caution_caps_after_clear() {
+  driveAtWall(100);
+  // backing off is not limited, only slewed
+  step(PROX_FRONT, -50, -50);
+  TEST_ASSERT_EQUAL_INT16(-SLEW, robot.out1);
+
+  // clear, held, then capped at cautionSpeed
+  for (uint8_t i = 0; i < 30; i++) {
+    step(0, 0, 0);
+  }
+  for (uint8_t i = 0; i < 40; i++) {
+    step(0, 100, 100);
+  }
+  TEST_ASSERT_EQUAL(OBSTACLE_CAUTION, obstacle->getState());
+  TEST_ASSERT_EQUAL_INT16(obstacle->cautionSpeed, robot.out1);
+
+  // and free once cautionTime has passed
+  for (uint8_t i = 0; i < 120; i++) {
+    step(0, 100, 100);
+  }
+  TEST_ASSERT_EQUAL(OBSTACLE_CLEAR, obstacle->getState());
+  TEST_ASSERT_EQUAL_INT16(100, robot.out1);
+}
+
+void test_single_corner_hit_pivots_away() {
+  while (robot.out1 != 40) {
+    step(0, 40, 40);
+  }
+  // right front corner, pushing on
+  while (robot.out1 > 0 || robot.out2 > 0) {
+    step(PROX_FR, 40, 40);
+  }
+  uint32_t stoppedTs = now;
+  while (obstacle->getState() != OBSTACLE_ESCAPE) {
+    step(PROX_FR, 40, 40);
+    TEST_ASSERT_TRUE(now - stoppedTs <= obstacle->escapeDelay + UPDATE_US);
+  }
+  TEST_ASSERT_EQUAL_UINT16(1, obstacle->escapes);
+  // motor 1 backs away, motor 2 holds: a pivot on the right wheel
+  for (uint8_t i = 0; i < 10; i++) {
+    step(PROX_FR, 40, 40);
+  }
+  TEST_ASSERT_EQUAL_INT16(-obstacle->escapeSpeed, robot.out1);
+  TEST_ASSERT_EQUAL_INT16(0, robot.out2);
+}
+
+void test_history_keeps_the_last_updates() {
+  for (uint8_t i = 0; i < 20; i++) {
+    step(i >= 15 ? PROX_RL : 0, -(int16_t)i, 0);
+  }
+  TEST_ASSERT_EQUAL_UINT8(OBSTACLE_HISTORY, obstacle->historySize());
+  // newest first
+  TEST_ASSERT_EQUAL_UINT32(19 * UPDATE_US, obstacle->history(0).ts);
+  TEST_ASSERT_EQUAL_HEX8(PROX_RL, obstacle->history(0).prox);
+  TEST_ASSERT_EQUAL_UINT32(12 * UPDATE_US, obstacle->history(7).ts);
+  TEST_ASSERT_EQUAL_HEX8(0, obstacle->history(7).prox);
+  TEST_ASSERT_EQUAL_INT8(robot.out1, obstacle->history(0).thr1);
+}
+
+void test_faster_updates_ramp_in_the_same_time() {
+  // every 2.5ms, as when each new rc frame runs the mix early
+  uint32_t start = now;
+  while (robot.out1 != 100) {
+    obstacle->update(now, 0, robot.out1 = 100, robot.out2 = 100);
+    now += UPDATE_US / 4;
+  }
+  // the first update has no last one, it takes a whole period
+  TEST_ASSERT_UINT32_WITHIN(UPDATE_US, 100 / SLEW * UPDATE_US, now - start);
+
+  // and braking at a wall takes as long as at 100 updates/s, less up to a
+  // period: the first step is taken as the hit comes, not a period later
+  uint32_t hitTs = now;
+  int16_t thr1 = 100;
+  int16_t thr2 = 100;
+  while (thr1 > 0) {
+    thr1 = thr2 = 100;
+    obstacle->update(now, PROX_FRONT, thr1, thr2);
+    now += UPDATE_US / 4;
+  }
+  TEST_ASSERT_UINT32_WITHIN(UPDATE_US, 16 * UPDATE_US, now - hitTs);
+}
+
+void test_failsafe_stop_skips_the_slew() {
+  while (robot.out1 != 100) {
+    step(0, 100, 100);
+  }
+  obstacle->stop();
+  step(0, 0, 0);
+  TEST_ASSERT_EQUAL_INT16(0, robot.out1);
+  TEST_ASSERT_EQUAL_INT16(0, robot.out2);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_slew_ramps_the_outputs);
+  RUN_TEST(test_full_speed_stops_short_of_the_wall);
+  RUN_TEST(test_stopping_is_bounded_at_any_speed);
+  RUN_TEST(test_slow_robot_brakes_at_least_at_the_slew);
+  RUN_TEST(test_closing_speed_comes_from_the_history);
+  RUN_TEST(test_bouncy_sensor_never_lurches_forward);
+  RUN_TEST(test_reverse_passes_and_caution_caps_after_clear);
+  RUN_TEST(test_single_corner_hit_pivots_away);
+  RUN_TEST(test_history_keeps_the_last_updates);
+  RUN_TEST(test_faster_updates_ramp_in_the_same_time);
+  RUN_TEST(test_failsafe_stop_skips_the_slew);
+  return UNITY_END();
+}
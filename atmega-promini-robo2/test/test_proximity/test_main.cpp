@@ -0,0 +1,171 @@
+// Proximity debounce (vertical counter) against a plain per sensor
+// counter, and the ProxOverlay led table, robo2's pins and leds.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <Proximity.h>
+
+static const uint8_t pins[4] = {8, 9, 12, 4};
+
+static Proximity<PinGroup<8, 9, 12, 4>> *proximity;
+
+// robo2's matrix leds by sensor
+struct testLeds {
+  static constexpr uint16_t at(const uint8_t i) {
+    return i == 0 ? 0x001c : i == 1 ? 0x0083 : i == 2 ? 0x3800 : 0xc100;
+  }
+};
+
+typedef ProxOverlay<testLeds, 4> overlay;
+
+// sensors are active low
+static void sense(const uint8_t mask) {
+  for (uint8_t i = 0; i < 4; i++) {
+    halSetPin(pins[i], (mask >> i) & 1 ? 0 : 1);
+  }
+}
+
+static uint8_t step(const uint8_t mask) {
+  sense(mask);
+  return proximity->update();
+}
+
+static uint32_t seed;
+
+static uint8_t rnd(const uint8_t range) {
+  seed = seed * 1103515245UL + 12345UL;
+  return (seed >> 8) % range;
+}
+
+void setUp() {
+  halReset();
+  seed = 3;
+  proximity = new Proximity<PinGroup<8, 9, 12, 4>>();
+  sense(0);
+}
+
+void tearDown() {
+  delete proximity;
+}
+
+void test_press_shows_on_the_first_sample() {
+  TEST_ASSERT_EQUAL_HEX8(0, step(0));
+  TEST_ASSERT_EQUAL_HEX8(0x04, step(0x04));
+  TEST_ASSERT_EQUAL_UINT16(1, proximity->triggers[2]);
+  TEST_ASSERT_EQUAL_UINT16(0, proximity->triggers[0]);
+}
+
+void test_release_after_four_clear_samples() {
+  step(0x01);
+  step(0x01);
+  for (uint8_t i = 0; i < PROX_RELEASE_SAMPLES - 1; i++) {
+    TEST_ASSERT_EQUAL_HEX8(0x01, step(0));
+  }
+  TEST_ASSERT_EQUAL_HEX8(0, step(0));
+  TEST_ASSERT_EQUAL_UINT16(1, proximity->triggers[0]);
+}
+
+void test_bounce_holds_and_restarts_the_count() {
+  step(0x08);
+  // clear for 3, back for one: still held, counted as a bounce
+  for (uint8_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_HEX8(0x08, step(0));
+  }
+  TEST_ASSERT_EQUAL_HEX8(0x08, step(0x08));
+  TEST_ASSERT_EQUAL_UINT16(1, proximity->bounces[3]);
+  TEST_ASSERT_EQUAL_UINT16(1, proximity->triggers[3]);
+
+  // a full 4 again needed after it
+  for (uint8_t i = 0; i < 3; i++) {
+    TEST_ASSERT_EQUAL_HEX8(0x08, step(0));
+  }
+  TEST_ASSERT_EQUAL_HEX8(0, step(0));
+
+  // a new press after release is a trigger, not a bounce
+  step(0x08);
+  TEST_ASSERT_EQUAL_UINT16(2, proximity->triggers[3]);
+  TEST_ASSERT_EQUAL_UINT16(1, proximity->bounces[3]);
+}
+
+void test_sensors_count_independently() {
+  step(0x01);
+  step(0x03); // fl in one sample after fr
+  step(0x02);
+  step(0x02);
+  step(0x02);
+  // fr had its 3 clear samples, fl still held
+  TEST_ASSERT_EQUAL_HEX8(0x03, proximity->state());
+  TEST_ASSERT_EQUAL_HEX8(0x02, step(0x02));
+  TEST_ASSERT_EQUAL_HEX8(0x02, step(0));
+}
+
+void test_matches_a_counter_per_sensor() {
+  uint8_t active = 0;
+  uint8_t clearRun[4] = {};
+  uint16_t triggers[4] = {};
+  uint16_t bounces[4] = {};
+  uint8_t last = 0;
+
+  for (uint16_t n = 0; n < 5000; n++) {
+    // sensors mostly staying as they are, sometimes flipping
+    uint8_t raw = last;
+    for (uint8_t i = 0; i < 4; i++) {
+      if (rnd(4) == 0) {
+        raw ^= _BV(i);
+      }
+    }
+
+    for (uint8_t i = 0; i < 4; i++) {
+      bool on = raw & _BV(i);
+      if (active & _BV(i)) {
+        if (on) {
+          if (!(last & _BV(i))) {
+            bounces[i]++;
+          }
+          clearRun[i] = 0;
+        } else if (++clearRun[i] == PROX_RELEASE_SAMPLES) {
+          active &= ~_BV(i);
+          clearRun[i] = 0;
+        }
+      } else if (on) {
+        active |= _BV(i);
+        triggers[i]++;
+        clearRun[i] = 0;
+      }
+    }
+    last = raw;
+
+    TEST_ASSERT_EQUAL_HEX8(active, step(raw));
+  }
+
+  for (uint8_t i = 0; i < 4; i++) {
+    TEST_ASSERT_EQUAL_UINT16(triggers[i], proximity->triggers[i]);
+    TEST_ASSERT_EQUAL_UINT16(bounces[i], proximity->bounces[i]);
+    TEST_ASSERT_TRUE(triggers[i] > 50);
+  }
+}
+
+void test_overlay_is_the_leds_of_every_sensor_set() {
+  TEST_ASSERT_EQUAL_UINT16(16, overlay::size);
+  for (uint8_t mask = 0; mask < 16; mask++) {
+    uint16_t leds = 0;
+    for (uint8_t i = 0; i < 4; i++) {
+      if (mask & _BV(i)) {
+        leds |= testLeds::at(i);
+      }
+    }
+    TEST_ASSERT_EQUAL_HEX16(leds, overlay::read(mask));
+  }
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_press_shows_on_the_first_sample);
+  RUN_TEST(test_release_after_four_clear_samples);
+  RUN_TEST(test_bounce_holds_and_restarts_the_count);
+  RUN_TEST(test_sensors_count_independently);
+  RUN_TEST(test_matches_a_counter_per_sensor);
+  RUN_TEST(test_overlay_is_the_leds_of_every_sensor_set);
+  return UNITY_END();
+}
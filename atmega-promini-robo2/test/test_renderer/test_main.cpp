@@ -0,0 +1,142 @@
+// FrameRenderer: dirty frame detection, fps cap under tick jitter and the
+// dithering refresh, counted against FastLED.show() calls.
+
+#include <unity.h>
+
+#include <FastLED.h>
+#include <FrameRenderer.h>
+
+#define LEDS 16
+#define FPS 30
+#define PERIOD (1000000UL / FPS)
+
+static CRGB leds[LEDS];
+
+void setUp() {
+  FastLED.shows = 0;
+  fill_solid(leds, LEDS, CRGB::Black);
+}
+
+void tearDown() {
+}
+
+void test_unchanged_frames_are_skipped() {
+  FrameRenderer<LEDS> renderer(leds, FPS);
+  leds[3] = CRGB::Red;
+  TEST_ASSERT_TRUE(renderer.show(0));
+
+  uint32_t now = 0;
+  for (uint8_t i = 0; i < 30; i++) {
+    now += PERIOD;
+    TEST_ASSERT_FALSE(renderer.show(now));
+  }
+  TEST_ASSERT_EQUAL_UINT16(30, renderer.skipped);
+  TEST_ASSERT_EQUAL_UINT16(1, renderer.shows);
+  TEST_ASSERT_EQUAL_UINT32(1, FastLED.shows);
+
+  // one changed led is enough
+  leds[3].g = 1;
+  TEST_ASSERT_TRUE(renderer.show(now + PERIOD));
+  TEST_ASSERT_EQUAL_UINT32(2, FastLED.shows);
+}
+
+void test_jittery_ticks_at_the_cap_all_show() {
+  FrameRenderer<LEDS> renderer(leds, FPS);
+  uint32_t due = 1000;
+
+  // task ticks run up to 2ms late, each one with a new frame
+  for (uint8_t i = 0; i < 60; i++) {
+    uint32_t late = (i * 7919UL) % 2000;
+    leds[0] = CRGB(i + 1, 0, 0);
+    TEST_ASSERT_TRUE(renderer.show(due + late));
+    due += PERIOD;
+  }
+  TEST_ASSERT_EQUAL_UINT16(0, renderer.limited);
+  TEST_ASSERT_EQUAL_UINT16(60, renderer.shows);
+}
+
+void test_faster_calls_are_capped_and_frame_goes_out_later() {
+  FrameRenderer<LEDS> renderer(leds, FPS);
+  leds[0] = CRGB::Red;
+  TEST_ASSERT_TRUE(renderer.show(0));
+
+  // 100Hz with a new frame every call
+  uint32_t now = 0;
+  uint16_t shown = 0;
+  for (uint8_t i = 1; i <= 100; i++) {
+    now += 10000;
+    leds[0] = CRGB(i, 0, 0);
+    shown += renderer.show(now);
+  }
+  // a second at 100Hz calls, not more than the cap (plus its slack)
+  TEST_ASSERT_GREATER_OR_EQUAL(FPS - 1, shown);
+  TEST_ASSERT_LESS_OR_EQUAL(FPS + FPS / 7, shown);
+  TEST_ASSERT_EQUAL_UINT16(100 - shown, renderer.limited);
+
+  // the last frame was held back, the next call sends it without a change
+  if (renderer.show(now + 10000) == false) {
+    TEST_ASSERT_TRUE(renderer.show(now + 20000) || renderer.show(now + 30000));
+  }
+  TEST_ASSERT_EQUAL_UINT8(100, leds[0].r);
+  uint32_t shows = FastLED.shows;
+  TEST_ASSERT_FALSE(renderer.show(now + 100000));
+  TEST_ASSERT_EQUAL_UINT32(shows, FastLED.shows);
+}
+
+void test_refresh_keeps_lit_frames_going_for_dithering() {
+  FrameRenderer<LEDS> renderer(leds, FPS, FPS);
+  leds[5] = CRGB(1, 2, 3);
+  TEST_ASSERT_TRUE(renderer.show(0));
+
+  uint32_t now = 0;
+  for (uint8_t i = 0; i < 30; i++) {
+    now += PERIOD;
+    TEST_ASSERT_TRUE(renderer.show(now));
+  }
+  TEST_ASSERT_EQUAL_UINT16(30, renderer.refreshed);
+  TEST_ASSERT_EQUAL_UINT16(0, renderer.skipped);
+
+  // all black, nothing to dither: skipped again
+  fill_solid(leds, LEDS, CRGB::Black);
+  now += PERIOD;
+  TEST_ASSERT_TRUE(renderer.show(now));
+  for (uint8_t i = 0; i < 10; i++) {
+    now += PERIOD;
+    TEST_ASSERT_FALSE(renderer.show(now));
+  }
+  TEST_ASSERT_EQUAL_UINT16(10, renderer.skipped);
+}
+
+void test_refresh_rate_below_the_cap() {
+  FrameRenderer<LEDS> renderer(leds, FPS, 10);
+  leds[0] = CRGB::Blue;
+  renderer.show(0);
+
+  uint32_t now = 0;
+  for (uint8_t i = 0; i < 30; i++) {
+    now += PERIOD;
+    renderer.show(now);
+  }
+  // a second of unchanged frames, refreshed at 10Hz
+  TEST_ASSERT_EQUAL_UINT16(10, renderer.refreshed);
+  TEST_ASSERT_EQUAL_UINT16(20, renderer.skipped);
+}
+
+void test_show_color_fills_and_skips_repeat() {
+  FrameRenderer<LEDS> renderer(leds, FPS);
+  TEST_ASSERT_TRUE(renderer.showColor(0, CRGB::Green));
+  TEST_ASSERT_TRUE(leds[LEDS - 1] == CRGB(CRGB::Green));
+  TEST_ASSERT_FALSE(renderer.showColor(PERIOD, CRGB::Green));
+  TEST_ASSERT_EQUAL_UINT16(1, renderer.skipped);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_unchanged_frames_are_skipped);
+  RUN_TEST(test_jittery_ticks_at_the_cap_all_show);
+  RUN_TEST(test_faster_calls_are_capped_and_frame_goes_out_later);
+  RUN_TEST(test_refresh_keeps_lit_frames_going_for_dithering);
+  RUN_TEST(test_refresh_rate_below_the_cap);
+  RUN_TEST(test_show_color_fills_and_skips_repeat);
+  return UNITY_END();
+}
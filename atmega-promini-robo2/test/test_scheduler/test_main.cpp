@@ -0,0 +1,196 @@
+// Scheduler against replayed task run times on the virtual clock.
+
+#include <unity.h>
+
+#include <HalNative.h>
+#include <Scheduler.h>
+
+// run time of each call of a task (us), replayed in order, last one repeats
+struct replay_t {
+  const uint32_t *costs;
+  uint8_t count;
+  uint8_t next;
+  uint16_t runs;
+  uint32_t lastTs;
+  uint32_t ts[64];
+};
+
+static replay_t replays[2];
+
+static void replayRun(replay_t &r, const uint32_t now) {
+  if (r.runs < 64) {
+    r.ts[r.runs] = now;
+  }
+  r.runs++;
+  r.lastTs = now;
+  halAdvance(r.costs[r.next]);
+  if (r.next + 1 < r.count) {
+    r.next++;
+  }
+}
+
+static void task0(const uint32_t now) {
+  replayRun(replays[0], now);
+}
+
+static void task1(const uint32_t now) {
+  replayRun(replays[1], now);
+}
+
+static void replay(const uint8_t i, const uint32_t *costs, const uint8_t count) {
+  replays[i] = replay_t();
+  replays[i].costs = costs;
+  replays[i].count = count;
+}
+
+// loop() passes with nothing else in them for us of time
+static void runFor(Scheduler<2> &scheduler, const uint32_t us) {
+  uint32_t end = micros() + us;
+  while ((int32_t)(micros() - end) < 0) {
+    scheduler.run();
+    halAdvance(halLoopStep);
+  }
+}
+
+void setUp() {
+  halReset();
+  halAdvance(1000);
+}
+
+void tearDown() {
+}
+
+void test_tasks_run_at_their_rate_without_drift() {
+  static const uint32_t costs[] = {300};
+  replay(0, costs, 1);
+  replay(1, costs, 1);
+
+  Scheduler<2> scheduler;
+  scheduler.add(task0, 5000);
+  scheduler.add(task1, 20000);
+  scheduler.begin();
+  runFor(scheduler, 1000000UL);
+
+  // due times are start + n * period, whatever the runs cost
+  TEST_ASSERT_EQUAL_UINT16(200, replays[0].runs);
+  TEST_ASSERT_EQUAL_UINT16(50, replays[1].runs);
+  for (uint8_t i = 1; i < 64; i++) {
+    TEST_ASSERT_UINT32_WITHIN(halLoopStep + 300, 1000 + i * 5000UL, replays[0].ts[i]);
+  }
+  TEST_ASSERT_EQUAL_UINT16(0, scheduler.task(0).overruns);
+  TEST_ASSERT_EQUAL_UINT16(0, scheduler.task(1).overruns);
+}
+
+void test_wcet_is_the_longest_run() {
+  static const uint32_t costs[] = {200, 900, 150, 400, 100};
+  replay(0, costs, 5);
+  replay(1, costs, 1);
+
+  Scheduler<2> scheduler;
+  scheduler.add(task0, 5000);
+  scheduler.add(task1, 10000);
+  scheduler.begin();
+  runFor(scheduler, 100000UL);
+
+  TEST_ASSERT_EQUAL_UINT16(900, scheduler.task(0).wcet);
+  TEST_ASSERT_EQUAL_UINT16(200, scheduler.task(1).wcet);
+}
+
+void test_overrun_skips_ahead_keeping_phase() {
+  // 4th run takes 3.5 periods
+  static const uint32_t costs[] = {100, 100, 100, 3500, 100};
+  static const uint32_t other[] = {50};
+  replay(0, costs, 5);
+  replay(1, other, 1);
+
+  Scheduler<2> scheduler;
+  scheduler.add(task0, 1000);
+  scheduler.add(task1, 1000);
+  scheduler.begin();
+  runFor(scheduler, 20000UL);
+
+  // run 3 went from 4000 to 7500: the 5000 run goes late, 6000 and 7000 are skipped
+  TEST_ASSERT_UINT32_WITHIN(halLoopStep, 4000, replays[0].ts[3]);
+  // as soon as the loop comes round after it and the other task
+  TEST_ASSERT_GREATER_OR_EQUAL(7550, replays[0].ts[4]);
+  TEST_ASSERT_LESS_THAN(8000, replays[0].ts[4]);
+  TEST_ASSERT_EQUAL_UINT16(2, scheduler.task(0).overruns);
+  // then back on the old grid, not a period after the late run
+  TEST_ASSERT_UINT32_WITHIN(halLoopStep, 8000, replays[0].ts[5]);
+  TEST_ASSERT_UINT32_WITHIN(halLoopStep, 9000, replays[0].ts[6]);
+  // the other task, kept waiting from 4000 to 7500, runs once and skips 3
+  TEST_ASSERT_EQUAL_UINT16(3, scheduler.task(1).overruns);
+  TEST_ASSERT_EQUAL_UINT16(3500, scheduler.task(0).wcet);
+  // 1000..21000 less the skipped two
+  TEST_ASSERT_EQUAL_UINT16(18, replays[0].runs);
+}
+
+void test_wcet_saturates() {
+  static const uint32_t costs[] = {70000};
+  static const uint32_t other[] = {100};
+  replay(0, costs, 1);
+  replay(1, other, 1);
+
+  Scheduler<2> scheduler;
+  scheduler.add(task0, 1000);
+  scheduler.add(task1, 1000);
+  scheduler.begin();
+  scheduler.run();
+
+  TEST_ASSERT_EQUAL_UINT16(0xffff, scheduler.task(0).wcet);
+  // the other task started 70ms late: one run, 70 periods skipped
+  TEST_ASSERT_EQUAL_UINT16(1, replays[1].runs);
+  TEST_ASSERT_EQUAL_UINT16(70, scheduler.task(1).overruns);
+}
+
+static Scheduler<2> *triggering;
+
+static void triggerTask(const uint32_t now) {
+  replayRun(replays[0], now);
+  // as if new input came in on the 3rd run
+  if (replays[0].runs == 3) {
+    triggering->trigger(1);
+  }
+}
+
+void test_trigger_runs_a_task_early_and_restarts_its_period() {
+  static const uint32_t costs[] = {100};
+  replay(0, costs, 1);
+  replay(1, costs, 1);
+
+  Scheduler<2> scheduler;
+  triggering = &scheduler;
+  scheduler.add(triggerTask, 1000);
+  scheduler.add(task1, 10000);
+  scheduler.begin();
+  runFor(scheduler, 25000UL);
+
+  // at 1000, then right after the 3rd run of the other in the same pass
+  TEST_ASSERT_EQUAL_UINT32(1100, replays[1].ts[0]);
+  TEST_ASSERT_EQUAL_UINT32(replays[0].ts[2] + 100, replays[1].ts[1]);
+  // and a period on from there, not from 1000
+  TEST_ASSERT_UINT32_WITHIN(halLoopStep, replays[0].ts[2] + 10000, replays[1].ts[2]);
+  TEST_ASSERT_EQUAL_UINT16(0, scheduler.task(1).overruns);
+}
+
+void test_full_table_ignores_more_tasks() {
+  static const uint32_t costs[] = {10};
+  replay(0, costs, 1);
+
+  Scheduler<2> scheduler;
+  TEST_ASSERT_EQUAL_UINT8(0, scheduler.add(task0, 1000));
+  TEST_ASSERT_EQUAL_UINT8(1, scheduler.add(task0, 1000));
+  TEST_ASSERT_EQUAL_UINT8(2, scheduler.add(task1, 1000));
+  TEST_ASSERT_EQUAL_UINT8(2, scheduler.size());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_tasks_run_at_their_rate_without_drift);
+  RUN_TEST(test_wcet_is_the_longest_run);
+  RUN_TEST(test_overrun_skips_ahead_keeping_phase);
+  RUN_TEST(test_wcet_saturates);
+  RUN_TEST(test_trigger_runs_a_task_early_and_restarts_its_period);
+  RUN_TEST(test_full_table_ignores_more_tasks);
+  return UNITY_END();
+}
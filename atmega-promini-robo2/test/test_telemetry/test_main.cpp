@@ -0,0 +1,285 @@
+// Telemetry framing decoded back from the serial capture: COBS and crc
+// round trip, drops, throughput at 115200 baud, and robo2 built with DEBUG
+// keeping its stats text inside records.
+
+#include <unity.h>
+
+#define DEBUG
+#include "../../src/main.cpp"
+
+#include <HalNative.h>
+
+#define BAUD 115200
+// 8N1, whole us per byte like HalNative
+#define BYTES_PER_S (1000000UL / (10000000UL / BAUD))
+// uart tx buffer, the capture sees bytes as they go in there
+#define TX_BUFFER 63
+
+static uint8_t serialOut[65536];
+static size_t decodePos;
+
+struct frame_t {
+  uint8_t type;
+  uint8_t seq;
+  uint8_t len;
+  uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+};
+
+static uint8_t crc8(const uint8_t *data, const size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (uint8_t b = 0; b < 8; b++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// skip to the first delimiter, anything before is boot text
+static void decodeBegin() {
+  decodePos = 0;
+  while (decodePos < halSerialCaptured() && serialOut[decodePos] != 0) {
+    decodePos++;
+  }
+}
+
+// next frame in the capture, false at the end, fails on a bad one
+static bool nextFrame(frame_t &frame) {
+  size_t end = halSerialCaptured();
+
+  // empty frames between delimiters
+  while (decodePos < end && serialOut[decodePos] == 0) {
+    decodePos++;
+  }
+  size_t start = decodePos;
+  while (decodePos < end && serialOut[decodePos] != 0) {
+    decodePos++;
+  }
+  if (decodePos == end) {
+    // none, or one still going out
+    return false;
+  }
+
+  uint8_t data[TELEMETRY_MAX_PAYLOAD + 3];
+  size_t n = 0;
+  size_t i = start;
+  while (i < decodePos) {
+    uint8_t code = serialOut[i++];
+    TEST_ASSERT_NOT_EQUAL(0, code);
+    for (uint8_t k = 1; k < code; k++) {
+      TEST_ASSERT_TRUE(i < decodePos);
+      data[n++] = serialOut[i++];
+    }
+    if (code < 0xff && i < decodePos) {
+      data[n++] = 0;
+    }
+  }
+
+  TEST_ASSERT_TRUE(n >= 3);
+  TEST_ASSERT_EQUAL_HEX8_MESSAGE(crc8(data, n - 1), data[n - 1], "crc");
+  frame.type = data[0];
+  frame.seq = data[1];
+  frame.len = n - 3;
+  memcpy(frame.payload, data + 2, frame.len);
+  return true;
+}
+
+// loop() passes for us of time, like the native main()
+static void run(uint32_t us) {
+  while (us >= halLoopStep) {
+    loop();
+    halAdvance(halLoopStep);
+    us -= halLoopStep;
+  }
+  halAdvance(us);
+}
+
+void setUp() {
+  halReset();
+  halSerialCapture(serialOut, sizeof(serialOut));
+  Serial.begin(BAUD);
+}
+
+void tearDown() {
+}
+
+void test_payloads_round_trip() {
+  Telemetry<1024> out;
+  uint8_t payload[TELEMETRY_MAX_PAYLOAD];
+  // lengths around the COBS block, all zeros, no zeros at all, mixed
+  static const uint8_t lengths[] = {0, 1, 2, 16, 200, 249, 250};
+  uint32_t seed = 7;
+
+  decodeBegin();
+  for (uint8_t pass = 0; pass < 3; pass++) {
+    for (uint8_t l = 0; l < sizeof(lengths); l++) {
+      for (uint8_t i = 0; i < lengths[l]; i++) {
+        seed = seed * 1103515245UL + 12345UL;
+        payload[i] = pass == 0 ? 0 : pass == 1 ? 0xff : (seed >> 16) % 3 == 0 ? 0 : seed >> 8;
+      }
+      TEST_ASSERT_TRUE(out.send(10 + l, payload, lengths[l]));
+      // until it's all out
+      for (uint8_t t = 0; t < 30; t++) {
+        out.flush();
+        halAdvance(1000);
+      }
+
+      frame_t frame;
+      TEST_ASSERT_TRUE(nextFrame(frame));
+      TEST_ASSERT_EQUAL_UINT8(10 + l, frame.type);
+      TEST_ASSERT_EQUAL_UINT8(pass * sizeof(lengths) + l, frame.seq);
+      TEST_ASSERT_EQUAL_UINT8(lengths[l], frame.len);
+      if (lengths[l]) {
+        TEST_ASSERT_EQUAL_HEX8_ARRAY(payload, frame.payload, lengths[l]);
+      }
+      TEST_ASSERT_FALSE(nextFrame(frame));
+    }
+  }
+  TEST_ASSERT_EQUAL_UINT16(0, out.dropped);
+}
+
+void test_full_ring_drops_and_seq_shows_it() {
+  Telemetry<64> out;
+  uint8_t payload[16] = {};
+  // 21 bytes a frame, 3 fit next to the start delimiter
+  uint8_t accepted = 0;
+  for (uint8_t i = 0; i < 5; i++) {
+    accepted += out.send(TELEMETRY_ROBO, payload, sizeof(payload));
+  }
+  TEST_ASSERT_EQUAL_UINT8(3, accepted);
+  TEST_ASSERT_EQUAL_UINT16(2, out.dropped);
+
+  out.flush();
+  halAdvance(10000);
+  out.flush();
+  TEST_ASSERT_TRUE(out.send(TELEMETRY_ROBO, payload, sizeof(payload)));
+  halAdvance(10000);
+  out.flush();
+  halAdvance(10000);
+
+  decodeBegin();
+  frame_t frame;
+  // the dropped ones are a gap in seq
+  static const uint8_t seqs[] = {0, 1, 2, 5};
+  for (uint8_t i = 0; i < 4; i++) {
+    TEST_ASSERT_TRUE(nextFrame(frame));
+    TEST_ASSERT_EQUAL_UINT8(seqs[i], frame.seq);
+  }
+  TEST_ASSERT_FALSE(nextFrame(frame));
+}
+
+void test_throughput_at_115200() {
+  Telemetry<96> out;
+  telemetryRobo_t record = {};
+  // a robo record on the wire, code byte, type, seq, crc and delimiter
+  const uint16_t frameBytes = sizeof(record) + 5;
+  TEST_ASSERT_EQUAL_UINT16(21, frameBytes);
+
+  // as fast as the uart takes them for a second, flushed every 100us
+  uint16_t sent = 0;
+  for (uint32_t t = 0; t < 1000000UL; t += 100) {
+    record.ts = t;
+    if (out.send(TELEMETRY_ROBO, &record, sizeof(record))) {
+      sent++;
+    }
+    out.flush();
+    halAdvance(100);
+  }
+  TEST_ASSERT_EQUAL_UINT32(0, halSerialBlockedUs);
+
+  decodeBegin();
+  frame_t frame;
+  uint16_t decoded = 0;
+  while (nextFrame(frame)) {
+    TEST_ASSERT_EQUAL_UINT8(TELEMETRY_ROBO, frame.type);
+    decoded++;
+  }
+  // the line is the limit, not the encoder: a second's worth went out,
+  // the rest is still in the ring
+  TEST_ASSERT_UINT16_WITHIN(2, (BYTES_PER_S + TX_BUFFER) / frameBytes, decoded);
+  TEST_ASSERT_TRUE(sent - decoded <= 96 / frameBytes + 1);
+}
+
+void test_text_lines_come_back_whole() {
+  Telemetry<256> out;
+  TelemetryText<Telemetry<256>, 16> text(out);
+
+  text.print("Task ");
+  text.print(3);
+  text.print(": wcet ");
+  text.print(65535U);
+  text.println("us");
+  text.print(-12L);
+  text.println();
+  for (uint32_t t = 0; t < 20000; t += 1000) {
+    out.flush();
+    halAdvance(1000);
+  }
+
+  decodeBegin();
+  frame_t frame;
+  char joined[64];
+  size_t len = 0;
+  uint8_t records = 0;
+  while (nextFrame(frame)) {
+    TEST_ASSERT_EQUAL_UINT8(TELEMETRY_TEXT, frame.type);
+    TEST_ASSERT_TRUE(frame.len <= 16);
+    memcpy(joined + len, frame.payload, frame.len);
+    len += frame.len;
+    records++;
+  }
+  joined[len] = 0;
+  TEST_ASSERT_EQUAL_STRING("Task 3: wcet 65535us\n-12\n", joined);
+  // 21 chars split at 16, then the short line
+  TEST_ASSERT_EQUAL_UINT8(3, records);
+}
+
+void test_debug_sketch_keeps_the_stream_decodable() {
+  setup();
+  // 3s of running, stats go out every STATS_PERIOD_S
+  run(3000000UL);
+
+  decodeBegin();
+  frame_t frame;
+  uint16_t robo = 0;
+  uint16_t missing = 0;
+  uint8_t lastSeq = 0;
+  bool first = true;
+  char text[2048];
+  size_t textLen = 0;
+  while (nextFrame(frame)) {
+    if (!first) {
+      missing += (uint8_t)(frame.seq - lastSeq - 1);
+    }
+    first = false;
+    lastSeq = frame.seq;
+
+    if (frame.type == TELEMETRY_ROBO) {
+      TEST_ASSERT_EQUAL_UINT8(sizeof(telemetryRobo_t), frame.len);
+      robo++;
+    } else if (frame.type == TELEMETRY_TEXT && textLen + frame.len < sizeof(text)) {
+      memcpy(text + textLen, frame.payload, frame.len);
+      textLen += frame.len;
+    }
+  }
+  text[textLen] = 0;
+
+  TEST_ASSERT_EQUAL_UINT16(0, telemetry.dropped);
+  TEST_ASSERT_EQUAL_UINT16(0, missing);
+  TEST_ASSERT_UINT16_WITHIN(5, 3 * TELEMETRY_TASK_RATE, robo);
+  TEST_ASSERT_NOT_NULL(strstr(text, "Task 0: overruns "));
+  TEST_ASSERT_NOT_NULL(strstr(text, "Chn 1: "));
+  TEST_ASSERT_NOT_NULL(strstr(text, "Failsafe: stops "));
+  TEST_ASSERT_NOT_NULL(strstr(text, "Leds: show time "));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_payloads_round_trip);
+  RUN_TEST(test_full_ring_drops_and_seq_shows_it);
+  RUN_TEST(test_throughput_at_115200);
+  RUN_TEST(test_text_lines_come_back_whole);
+  RUN_TEST(test_debug_sketch_keeps_the_stream_decodable);
+  return UNITY_END();
+}
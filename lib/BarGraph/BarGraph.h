@@ -0,0 +1,98 @@
+#pragma once
+
+#include <FastLED.h>
+#include <Tables.h>
+
+// Motor speed bar graph for the robo led matrix, from flash tables.
+//
+// A bar is 8 leds, lit from one end for forward and from the other for
+// reverse, length and hue (red .. green) growing with speed:
+//   hue = |percent| * 96 / 100, leds = min(|percent|, 95) / 12 + 1
+// The table holds colour and lit leds for every percent -100..100, built at
+// compile time, so drawing is a table read instead of hue/length maths and
+// a CHSV conversion per lit led.
+
+struct barFrame_t {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+  uint8_t mask; // bit i set = bar led i lit
+};
+
+// FastLED scale8()
+constexpr uint8_t barScale8(const uint8_t i, const uint8_t scale) {
+#if FASTLED_SCALE8_FIXED == 1
+  return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+#else
+  return ((uint16_t)i * (uint16_t)scale) >> 8;
+#endif
+}
+
+// FastLED hsv2rgb_rainbow() at full saturation and value, for hues 0..127
+constexpr uint8_t barThird(const uint8_t hue) {
+  return barScale8((hue & 0x1f) << 3, 256 / 3);
+}
+
+constexpr uint8_t barTwoThirds(const uint8_t hue) {
+  return barScale8((hue & 0x1f) << 3, (256 * 2) / 3);
+}
+
+constexpr uint8_t barRed(const uint8_t hue) {
+  return hue < 0x20 ? 255 - barThird(hue)          // red -> orange
+       : hue < 0x40 ? 171                          // orange -> yellow
+       : hue < 0x60 ? 171 - barTwoThirds(hue)      // yellow -> green
+       : 0;                                        // green -> aqua
+}
+
+constexpr uint8_t barGreen(const uint8_t hue) {
+  return hue < 0x20 ? barThird(hue)
+       : hue < 0x40 ? 85 + barThird(hue)
+       : hue < 0x60 ? 170 + barThird(hue)
+       : 255 - barThird(hue);
+}
+
+constexpr uint8_t barBlue(const uint8_t hue) {
+  return hue < 0x60 ? 0 : barThird(hue);
+}
+
+constexpr uint8_t barHue(const uint8_t speed) {
+  return speed * 96U / 100U;
+}
+
+constexpr uint8_t barLength(const uint8_t speed) {
+  return (speed < 95U ? speed : 95U) / 12U + 1;
+}
+
+constexpr uint8_t barMask(const int16_t percent) {
+  return percent > 0 ? (1 << barLength(percent)) - 1
+       : percent < 0 ? (0xff00 >> barLength(-percent)) & 0xff
+       : 0;
+}
+
+constexpr uint8_t barSpeed(const int16_t percent) {
+  return percent < 0 ? -percent : percent;
+}
+
+// entry i is for percent i - 100
+struct barFrameGen {
+  static constexpr barFrame_t at(const uint16_t i) {
+    return barFrame_t{
+      barRed(barHue(barSpeed(i - 100))),
+      barGreen(barHue(barSpeed(i - 100))),
+      barBlue(barHue(barSpeed(i - 100))),
+      barMask(i - 100)
+    };
+  }
+};
+
+typedef ProgmemTable<barFrame_t, barFrameGen, 201> barFrameTable;
+
+// draw percent -100..100 on the 8 leds listed in bar
+inline void drawBarGraph(CRGB *leds, const uint8_t *bar, const int8_t percent) {
+  barFrame_t frame = barFrameTable::read(percent + 100);
+  CRGB color(frame.r, frame.g, frame.b);
+
+  for (uint8_t i = 0; i < 8; i++) {
+    leds[bar[i]] = (frame.mask & (1 << i)) ? color : CRGB(CRGB::Black);
+  }
+}
@@ -0,0 +1,345 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <util/crc16.h>
+#include <RcCapture.h>
+
+// Rc stick calibration, endpoints, centre (trim) and deadband per channel,
+// learned with a stick sweep and kept in eeprom.
+//
+// normalize() maps a pulse onto the nominal 1000..1500..2000us the rest of
+// the code is written for: 1500 inside the deadband around the centre,
+// each side scaled from there to its endpoint by a Q14 factor worked out
+// at load, so per pulse it is a compare, a multiply and a shift. 0 (no
+// pulse yet) stays 0. Without a saved record it is the identity over
+// 1000..2000.
+//
+// Sweep: entry() starts it when the entry channel is past CAL_ENTRY_WIDTH
+// within CAL_ENTRY_TIME of begin(), i.e. full stick at power up. Move
+// every stick to both ends, then let go. Once all channels rest within
+// CAL_REST_BAND for CAL_REST_TIME, and the rest point is at least
+// CAL_MIN_SIDE from both ends, the centre is the middle of the rest band,
+// the deadband its half width plus CAL_DEADBAND_MARGIN, and it is saved.
+//
+// Eeprom: a ring of SLOTS records from eepromAddr, each
+//   calibrationHeader_t, calChannel_t per channel, crc16 of all before it
+// A save goes to the slot after the newest valid one with seq + 1, so
+// writes spread over the ring and a cut write only loses itself: its crc
+// fails and load() finds the record before it. saveStep() writes a byte
+// at a time while the eeprom is ready, like Recorder::dumpStep().
+
+#define CAL_MAGIC 0xca
+#define CAL_VERSION 1
+
+// pulses outside this are ignored while sweeping (us)
+#define CAL_MIN_PULSE 800U
+#define CAL_MAX_PULSE 2200U
+
+#define CAL_ENTRY_WIDTH 1900U
+#define CAL_ENTRY_TIME 3000000UL
+#define CAL_REST_BAND 16U
+#define CAL_REST_TIME 1000000UL
+#define CAL_DEADBAND_MARGIN 4U
+// smallest travel from the deadband edge to an endpoint (us)
+#define CAL_MIN_SIDE 150U
+
+struct calChannel_t {
+  uint16_t min; // endpoints and centre (us)
+  uint16_t center;
+  uint16_t max;
+  uint8_t deadband; // each side of center (us)
+} __attribute__((packed));
+
+struct calibrationHeader_t {
+  uint8_t magic;
+  uint8_t version;
+  uint8_t seq;      // newest wins, compared mod 256
+  uint8_t channels;
+} __attribute__((packed));
+
+template <uint8_t N, uint8_t SLOTS = 8>
+class Calibration {
+public:
+  Calibration(const uint16_t eepromAddr) : eepromAddr(eepromAddr) {}
+
+  // loads the newest valid record, opens the sweep entry window
+  void begin(const uint32_t now) {
+    beginTs = now;
+    entryOpen = true;
+    load();
+  }
+
+  // true if a record was found, else the defaults are in use
+  bool load() {
+    static const calChannel_t defaults = {1000, 1500, 2000, 0};
+    for (uint8_t i = 0; i < N; i++) {
+      apply(i, defaults);
+    }
+
+    bool found = false;
+    badSlots = 0;
+    slot = SLOTS - 1;
+    seq = 0xff;
+
+    for (uint8_t s = 0; s < SLOTS; s++) {
+      eeprom_read_block(&record, (const void *)(uintptr_t)slotAddr(s), sizeof(record));
+      if (record.header.magic == 0xff) {
+        // never written
+        continue;
+      }
+      if (!check(record)) {
+        badSlots++;
+        continue;
+      }
+      if (!found || (int8_t)(record.header.seq - seq) > 0) {
+        found = true;
+        slot = s;
+        seq = record.header.seq;
+        for (uint8_t i = 0; i < N; i++) {
+          apply(i, record.chn[i]);
+        }
+      }
+    }
+
+    loaded = found;
+    return found;
+  }
+
+  // pulse of channel i mapped onto 1000..2000us
+  uint16_t normalize(const uint8_t i, const uint16_t width) const {
+    if (width == 0) {
+      return 0;
+    }
+
+    const calChannel_t &c = cal[i];
+    if (width > c.center + c.deadband) {
+      uint32_t x = ((uint32_t)(width - c.center - c.deadband) * mulHigh[i]) >> 14;
+      return x >= 500 ? 2000 : 1500 + x;
+    }
+    if (width + c.deadband < c.center) {
+      uint32_t x = ((uint32_t)(c.center - c.deadband - width) * mulLow[i]) >> 14;
+      return x >= 500 ? 1000 : 1500 - x;
+    }
+    return 1500;
+  }
+
+  const calChannel_t &channel(const uint8_t i) const {
+    return cal[i];
+  }
+
+  // starts the sweep on full stick shortly after begin()
+  void entry(const uint32_t now, const uint16_t width) {
+    if (!entryOpen) {
+      return;
+    }
+    if (now - beginTs >= CAL_ENTRY_TIME) {
+      entryOpen = false;
+      return;
+    }
+    if (width >= CAL_ENTRY_WIDTH && width <= CAL_MAX_PULSE) {
+      entryOpen = false;
+      active = true;
+      for (uint8_t i = 0; i < N; i++) {
+        sweepState[i].min = 0xffff;
+        sweepState[i].max = 0;
+        sweepState[i].rest = 0;
+      }
+    }
+  }
+
+  bool sweeping() const {
+    return active;
+  }
+
+  // feed good pulses of all N channels while sweeping, true when done
+  bool sweep(const uint32_t now, const rcPulse_t *pulses) {
+    if (!active) {
+      return false;
+    }
+
+    bool moved = false;
+    for (uint8_t i = 0; i < N; i++) {
+      uint16_t w = pulses[i].width;
+      if (w < CAL_MIN_PULSE || w > CAL_MAX_PULSE) {
+        return false;
+      }
+
+      sweep_t &s = sweepState[i];
+      if (w < s.min) s.min = w;
+      if (w > s.max) s.max = w;
+      if (w > s.rest + CAL_REST_BAND || w + CAL_REST_BAND < s.rest) {
+        moved = true;
+      }
+    }
+
+    // any stick out of its band starts the rest over
+    if (moved) {
+      for (uint8_t i = 0; i < N; i++) {
+        sweepState[i].rest = sweepState[i].restLow = sweepState[i].restHigh = pulses[i].width;
+      }
+      restTs = now;
+      return false;
+    }
+
+    for (uint8_t i = 0; i < N; i++) {
+      sweep_t &s = sweepState[i];
+      if (pulses[i].width < s.restLow) s.restLow = pulses[i].width;
+      if (pulses[i].width > s.restHigh) s.restHigh = pulses[i].width;
+    }
+    if (now - restTs < CAL_REST_TIME) {
+      return false;
+    }
+
+    calChannel_t chn[N];
+    for (uint8_t i = 0; i < N; i++) {
+      const sweep_t &s = sweepState[i];
+      chn[i].min = s.min;
+      chn[i].max = s.max;
+      chn[i].center = (s.restLow + s.restHigh) / 2;
+      chn[i].deadband = (s.restHigh - s.restLow) / 2 + CAL_DEADBAND_MARGIN;
+      if (!valid(chn[i])) {
+        // resting at an end, e.g. still on the entry stick
+        return false;
+      }
+    }
+
+    active = false;
+    save(chn);
+    return true;
+  }
+
+  // applies chn and starts writing it to the next slot, false if a
+  // channel's geometry is off
+  bool save(const calChannel_t *chn) {
+    for (uint8_t i = 0; i < N; i++) {
+      if (!valid(chn[i])) {
+        return false;
+      }
+    }
+
+    slot = slot + 1 == SLOTS ? 0 : slot + 1;
+    seq++;
+
+    record.header.magic = CAL_MAGIC;
+    record.header.version = CAL_VERSION;
+    record.header.seq = seq;
+    record.header.channels = N;
+    for (uint8_t i = 0; i < N; i++) {
+      record.chn[i] = chn[i];
+      apply(i, chn[i]);
+    }
+    record.crc = crc(record);
+
+    loaded = true;
+    savePos = 0;
+    return true;
+  }
+
+  // call often, writes while the eeprom is ready, returns true when done
+  bool saveStep() {
+    while (saving() && eeprom_is_ready()) {
+      uint16_t addr = slotAddr(slot) + savePos;
+      eeprom_update_byte((uint8_t *)(uintptr_t)addr, ((const uint8_t *)&record)[savePos]);
+      if (++savePos == sizeof(record)) {
+        savePos = NOT_SAVING;
+        saves++;
+      }
+    }
+    return !saving();
+  }
+
+  bool saving() const {
+    return savePos != NOT_SAVING;
+  }
+
+  // record in use came from eeprom (or was saved)
+  bool loaded = false;
+  // slot and seq of it, SLOTS - 1 and 0xff if none
+  uint8_t slot = SLOTS - 1;
+  uint8_t seq = 0xff;
+  // written slots that failed the checks at the last load()
+  uint8_t badSlots = 0;
+  // counters since start
+  uint16_t saves = 0;
+
+  // eeprom bytes used from eepromAddr
+  static const uint16_t EEPROM_SIZE = SLOTS * (sizeof(calibrationHeader_t) + N * sizeof(calChannel_t) + 2);
+
+private:
+  static const uint8_t NOT_SAVING = 0xff;
+
+  struct record_t {
+    calibrationHeader_t header;
+    calChannel_t chn[N];
+    uint16_t crc;
+  } __attribute__((packed));
+
+  struct sweep_t {
+    uint16_t min;
+    uint16_t max;
+    uint16_t rest; // where the current rest started
+    uint16_t restLow;
+    uint16_t restHigh;
+  };
+
+  const uint16_t eepromAddr;
+
+  calChannel_t cal[N];
+  // Q14 output us per input us, each side
+  uint16_t mulLow[N];
+  uint16_t mulHigh[N];
+
+  record_t record;
+  uint8_t savePos = NOT_SAVING;
+
+  uint32_t beginTs = 0;
+  bool entryOpen = false;
+  bool active = false;
+  sweep_t sweepState[N];
+  uint32_t restTs = 0;
+
+  uint16_t slotAddr(const uint8_t s) const {
+    return eepromAddr + s * sizeof(record_t);
+  }
+
+  static bool valid(const calChannel_t &c) {
+    return c.min >= CAL_MIN_PULSE && c.max <= CAL_MAX_PULSE &&
+           c.center >= c.min + c.deadband + CAL_MIN_SIDE &&
+           c.center + c.deadband + CAL_MIN_SIDE <= c.max;
+  }
+
+  static uint16_t crc(const record_t &r) {
+    uint16_t value = 0xffff;
+    for (uint8_t i = 0; i < sizeof(r) - sizeof(r.crc); i++) {
+      value = _crc16_update(value, ((const uint8_t *)&r)[i]);
+    }
+    return value;
+  }
+
+  static bool check(const record_t &r) {
+    if (r.header.magic != CAL_MAGIC || r.header.version != CAL_VERSION || r.header.channels != N) {
+      return false;
+    }
+    if (crc(r) != r.crc) {
+      return false;
+    }
+    for (uint8_t i = 0; i < N; i++) {
+      if (!valid(r.chn[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // rounded up, so the endpoints reach 1000 and 2000
+  static uint16_t scale(const uint16_t side) {
+    return ((500UL << 14) + side - 1) / side;
+  }
+
+  void apply(const uint8_t i, const calChannel_t &c) {
+    cal[i] = c;
+    mulLow[i] = scale(c.center - c.deadband - c.min);
+    mulHigh[i] = scale(c.max - c.center - c.deadband);
+  }
+};
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Filters.h>
+#include <RcCapture.h>
+
+// Rc signal quality and failsafe for N channels.
+//
+// update() gets the latest pulse of every channel once per control cycle.
+// Per channel it counts frames and glitches (width outside 1000..2000us),
+// averages frame interval and jitter, and keeps a histogram of frame gaps
+// so dropouts can be read back as numbers. The signal as a whole is
+//   OK     all channels fresh and valid
+//   STALE  something bad for less than badWindow, keep last outputs
+//   lost   a channel older than freshWindow or bad for badWindow
+// and once lost the configured action runs: STOP right away, HOLD last
+// outputs for actionTime then stop, or RAMP them down over actionTime.
+// Time from the last good frame to STOP is at most
+//   max(freshWindow, badWindow + one frame) + actionTime + one update period
+// and the worst seen is kept in maxReactionTime.
+
+enum failsafeAction_t {
+  FAILSAFE_ACTION_STOP,
+  FAILSAFE_ACTION_HOLD,
+  FAILSAFE_ACTION_RAMP
+};
+
+enum failsafeState_t {
+  FAILSAFE_OK,
+  FAILSAFE_STALE,
+  FAILSAFE_HOLD,
+  FAILSAFE_RAMP,
+  FAILSAFE_STOP
+};
+
+// frame gap histogram, upper bucket edges (us), last bucket is anything longer
+#define FAILSAFE_GAP_BUCKETS 6
+
+struct failsafeChannel_t {
+  uint32_t lastTs = 0;
+  uint16_t frames = 0;
+  uint16_t glitches = 0;
+  uint16_t gaps[FAILSAFE_GAP_BUCKETS] = {}; // <=25, 50, 100, 250, 1000, >1000 ms
+  ExpFilter<uint16_t, uint32_t, 3> interval; // us between frames
+  ExpFilter<uint16_t, uint32_t, 3> jitter;   // us, mean deviation from interval
+  bool valid = false;
+  bool fresh = false;
+};
+
+template <uint8_t N>
+class Failsafe {
+public:
+  Failsafe(const uint32_t freshWindow, const uint32_t badWindow, const failsafeAction_t action, const uint32_t actionTime)
+    : freshWindow(freshWindow), badWindow(badWindow), action(action), actionTime(actionTime),
+      rampStep(actionTime ? (256UL << 23) / actionTime : 0) {}
+
+  // pulses of all N channels, now not older than any of them
+  failsafeState_t update(const uint32_t now, const rcPulse_t *pulses) {
+    bool good = true;
+    bool fresh = true;
+    uint32_t oldestTs = now;
+
+    for (uint8_t i = 0; i < N; i++) {
+      failsafeChannel_t &chn = channels[i];
+      const rcPulse_t &pulse = pulses[i];
+
+      chn.valid = pulse.width >= 1000U && pulse.width <= 2000U;
+      chn.fresh = pulse.ts != 0 && now - pulse.ts <= freshWindow;
+      if (pulse.ts != chn.lastTs) {
+        addFrame(chn, pulse.ts);
+        if (!chn.valid) {
+          chn.glitches++;
+        }
+      }
+
+      good = good && chn.valid && chn.fresh;
+      fresh = fresh && chn.fresh;
+      if (now - pulse.ts > now - oldestTs) {
+        oldestTs = pulse.ts;
+      }
+    }
+
+    if (good) {
+      lastGoodTs = oldestTs;
+      state = FAILSAFE_OK;
+      return state;
+    }
+
+    if (state == FAILSAFE_OK) {
+      badSince = now;
+      state = FAILSAFE_STALE;
+    }
+
+    if (state == FAILSAFE_STALE && (!fresh || now - badSince >= badWindow)) {
+      lostTs = now;
+      if (action == FAILSAFE_ACTION_HOLD) {
+        state = FAILSAFE_HOLD;
+      } else if (action == FAILSAFE_ACTION_RAMP) {
+        state = FAILSAFE_RAMP;
+      } else {
+        stop(now);
+      }
+    }
+
+    if ((state == FAILSAFE_HOLD || state == FAILSAFE_RAMP) && now - lostTs >= actionTime) {
+      stop(now);
+    }
+
+    // elapsed < actionTime here, so the product stays under 256 << 23
+    if (state == FAILSAFE_RAMP) {
+      rampScale = 256 - (uint16_t)(((now - lostTs) * rampStep) >> 23);
+    }
+
+    return state;
+  }
+
+  failsafeState_t getState() const {
+    return state;
+  }
+
+  // true when outputs follow the sticks
+  bool ok() const {
+    return state == FAILSAFE_OK;
+  }
+
+  // output scale 0..256, use as (value * scale) >> 8
+  uint16_t scale() const {
+    switch (state) {
+      case FAILSAFE_RAMP:
+        return rampScale;
+      case FAILSAFE_STOP:
+        return 0;
+      default:
+        return 256;
+    }
+  }
+
+  const failsafeChannel_t &channel(const uint8_t i) const {
+    return channels[i];
+  }
+
+  // frames per second of channel i, 0 before two frames
+  uint16_t frameRate(const uint8_t i) const {
+    uint16_t interval = channels[i].interval.value();
+    return interval ? 1000000UL / interval : 0;
+  }
+
+  // counters since start
+  uint16_t stops = 0;
+  uint32_t lastReactionTime = 0; // us from last good frame to stop
+  uint32_t maxReactionTime = 0;
+
+private:
+  const uint32_t freshWindow;
+  const uint32_t badWindow;
+  const failsafeAction_t action;
+  const uint32_t actionTime;
+  // ramp scale per us, 9.23 fixed point, within one step of exact for
+  // action times up to ~8s
+  const uint32_t rampStep;
+
+  // nothing good seen yet counts as stopped
+  failsafeState_t state = FAILSAFE_STOP;
+  uint32_t lastGoodTs = 0;
+  uint32_t badSince = 0;
+  uint32_t lostTs = 0;
+  uint16_t rampScale = 256;
+
+  failsafeChannel_t channels[N];
+
+  void stop(const uint32_t now) {
+    state = FAILSAFE_STOP;
+    stops++;
+    lastReactionTime = now - lastGoodTs;
+    if (lastReactionTime > maxReactionTime) {
+      maxReactionTime = lastReactionTime;
+    }
+  }
+
+  static uint8_t gapBucket(const uint32_t gap) {
+    if (gap <= 25000UL) return 0;
+    if (gap <= 50000UL) return 1;
+    if (gap <= 100000UL) return 2;
+    if (gap <= 250000UL) return 3;
+    if (gap <= 1000000UL) return 4;
+    return 5;
+  }
+
+  static void addFrame(failsafeChannel_t &chn, const uint32_t ts) {
+    if (chn.lastTs != 0) {
+      uint32_t gap = ts - chn.lastTs;
+      chn.gaps[gapBucket(gap)]++;
+
+      // only normal frames go into rate and jitter, dropouts are in the histogram
+      if (gap <= 50000UL) {
+        if (chn.frames == 1) {
+          chn.interval.reset(gap);
+        }
+        uint16_t avg = chn.interval.update(gap);
+        chn.jitter.update(gap > avg ? gap - avg : avg - gap);
+      }
+    }
+
+    chn.lastTs = ts;
+    chn.frames++;
+  }
+};
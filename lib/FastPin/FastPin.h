@@ -0,0 +1,233 @@
+#pragma once
+
+#include <Arduino.h>
+#include <util/atomic.h>
+
+// Pin access with the pin number as a template parameter.
+//
+// On the ATmega328P the port and bit are known at compile time, so high(),
+// low() and toggle() are a single sbi/cbi/out and read() a single in (or
+// sbic/sbis when tested), no pin table lookups and no timer checks like
+// digitalWrite(). Arduino pins 0..7 are PORTD, 8..13 PORTB, 14..19 (A0..A5)
+// PORTC. sbi/cbi only touch the one bit, so writing from an isr and loop()
+// to different pins of a port is safe without turning interrupts off.
+//
+// PinGroup<P0, P1, ...>::read() samples several pins into a bitmask, bit i
+// is pin Pi. Each port used is read once and the bits are picked out of
+// that, so all pins are sampled at the same instant and a port read isn't
+// repeated per pin. Up to 8 pins.
+//
+// PwmPin writes the timer compare register of a pwm pin directly, 0
+// disconnects the output so the pin sits at its port value (low) instead
+// of a narrow spike. The timer keeps the mode the core (or motorPwmBegin())
+// set up. The pin must be an output, analogWrite() did that on every call.
+// TCCRnA is out of sbi/cbi reach, the output is (dis)connected with
+// interrupts off so an isr writing the timer's other output can't lose it.
+//
+// The native build goes through the core calls, unless FASTPIN_REGISTERS
+// is defined with the port and timer registers modelled (host tests).
+
+#if defined(__AVR__) || defined(FASTPIN_REGISTERS)
+
+enum fastPinPort_t {
+  FASTPIN_PORTB,
+  FASTPIN_PORTC,
+  FASTPIN_PORTD
+};
+
+template <uint8_t PIN>
+struct FastPin {
+  static_assert(PIN < 20, "FastPin: not a pin of the atmega328p");
+
+  static const uint8_t portIndex = PIN < 8 ? FASTPIN_PORTD : (PIN < 14 ? FASTPIN_PORTB : FASTPIN_PORTC);
+  static const uint8_t bitIndex = PIN < 8 ? PIN : (PIN < 14 ? PIN - 8 : PIN - 14);
+
+  static void output() {
+    ddr() |= mask();
+  }
+
+  static void input() {
+    ddr() &= ~mask();
+    port() &= ~mask();
+  }
+
+  static void inputPullup() {
+    ddr() &= ~mask();
+    port() |= mask();
+  }
+
+  static void high() {
+    port() |= mask();
+  }
+
+  static void low() {
+    port() &= ~mask();
+  }
+
+  static void write(const uint8_t value) {
+    if (value) {
+      high();
+    } else {
+      low();
+    }
+  }
+
+  // writing 1 to the PINx bit flips the output
+  static void toggle() {
+    pin() = mask();
+  }
+
+  static uint8_t read() {
+    return (pin() & mask()) ? 1 : 0;
+  }
+
+private:
+  static uint8_t mask() {
+    return _BV(bitIndex);
+  }
+
+  static volatile uint8_t &port() {
+    return PIN < 8 ? PORTD : (PIN < 14 ? PORTB : PORTC);
+  }
+
+  static volatile uint8_t &ddr() {
+    return PIN < 8 ? DDRD : (PIN < 14 ? DDRB : DDRC);
+  }
+
+  static volatile uint8_t &pin() {
+    return PIN < 8 ? PIND : (PIN < 14 ? PINB : PINC);
+  }
+};
+
+template <uint8_t... PINS>
+struct PinGroup;
+
+template <>
+struct PinGroup<> {
+  static const uint8_t count = 0;
+  static const uint8_t ports = 0;
+
+  static uint8_t gather(const uint8_t, const uint8_t, const uint8_t) {
+    return 0;
+  }
+};
+
+template <uint8_t PIN, uint8_t... REST>
+struct PinGroup<PIN, REST...> {
+  static_assert(sizeof...(REST) < 8, "PinGroup: at most 8 pins");
+
+  static const uint8_t count = 1 + sizeof...(REST);
+
+  static const uint8_t ports = _BV(FastPin<PIN>::portIndex) | PinGroup<REST...>::ports;
+
+  static uint8_t read() {
+    // ports not in the group are not read at all
+    uint8_t b = (ports & _BV(FASTPIN_PORTB)) ? PINB : 0;
+    uint8_t c = (ports & _BV(FASTPIN_PORTC)) ? PINC : 0;
+    uint8_t d = (ports & _BV(FASTPIN_PORTD)) ? PIND : 0;
+    return gather(b, c, d);
+  }
+
+  static uint8_t gather(const uint8_t b, const uint8_t c, const uint8_t d) {
+    uint8_t port = FastPin<PIN>::portIndex == FASTPIN_PORTB ? b : (FastPin<PIN>::portIndex == FASTPIN_PORTC ? c : d);
+    return ((port >> FastPin<PIN>::bitIndex) & 1) | (PinGroup<REST...>::gather(b, c, d) << 1);
+  }
+};
+
+template <uint8_t PIN>
+struct PwmPin;
+
+#define FAST_PWM_PIN(pin, ocr, tccr, com) \
+  template <> \
+  struct PwmPin<pin> { \
+    static void write(const uint8_t value) { \
+      if (value) { \
+        ocr = value; \
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { \
+          tccr |= _BV(com); \
+        } \
+      } else { \
+        ATOMIC_BLOCK(ATOMIC_RESTORESTATE) { \
+          tccr &= ~_BV(com); \
+        } \
+      } \
+    } \
+  };
+
+FAST_PWM_PIN(3, OCR2B, TCCR2A, COM2B1)
+FAST_PWM_PIN(5, OCR0B, TCCR0A, COM0B1)
+FAST_PWM_PIN(6, OCR0A, TCCR0A, COM0A1)
+FAST_PWM_PIN(9, OCR1A, TCCR1A, COM1A1)
+FAST_PWM_PIN(10, OCR1B, TCCR1A, COM1B1)
+FAST_PWM_PIN(11, OCR2A, TCCR2A, COM2A1)
+
+#undef FAST_PWM_PIN
+
+#else
+
+template <uint8_t PIN>
+struct FastPin {
+  static void output() {
+    pinMode(PIN, OUTPUT);
+  }
+
+  static void input() {
+    pinMode(PIN, INPUT);
+  }
+
+  static void inputPullup() {
+    pinMode(PIN, INPUT_PULLUP);
+  }
+
+  static void high() {
+    digitalWrite(PIN, HIGH);
+  }
+
+  static void low() {
+    digitalWrite(PIN, LOW);
+  }
+
+  static void write(const uint8_t value) {
+    digitalWrite(PIN, value ? HIGH : LOW);
+  }
+
+  static void toggle() {
+    digitalWrite(PIN, !digitalRead(PIN));
+  }
+
+  static uint8_t read() {
+    return digitalRead(PIN);
+  }
+};
+
+template <uint8_t... PINS>
+struct PinGroup;
+
+template <>
+struct PinGroup<> {
+  static const uint8_t count = 0;
+
+  static uint8_t read() {
+    return 0;
+  }
+};
+
+template <uint8_t PIN, uint8_t... REST>
+struct PinGroup<PIN, REST...> {
+  static_assert(sizeof...(REST) < 8, "PinGroup: at most 8 pins");
+
+  static const uint8_t count = 1 + sizeof...(REST);
+
+  static uint8_t read() {
+    return FastPin<PIN>::read() | (PinGroup<REST...>::read() << 1);
+  }
+};
+
+template <uint8_t PIN>
+struct PwmPin {
+  static void write(const uint8_t value) {
+    analogWrite(PIN, value);
+  }
+};
+
+#endif
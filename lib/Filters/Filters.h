@@ -0,0 +1,109 @@
+#pragma once
+
+#include <stdint.h>
+
+// Small fixed size filters for sensor streams, all O(1) or O(N) with tiny N
+// per sample and no floating point. Pick T as narrow as the data allows,
+// e.g. uint16_t for pulse widths in us or distances in mm.
+
+// Moving average over N samples, keeps a running sum.
+// SumT must hold N * max(T); N a power of two makes the divide a shift.
+template <typename T, typename SumT, uint8_t N>
+class MovingAverage {
+public:
+  // start from a known value instead of zeros
+  void reset(const T value) {
+    for (uint8_t i = 0; i < N; i++) {
+      samples[i] = value;
+    }
+    sum = (SumT)value * N;
+    pos = 0;
+  }
+
+  T update(const T sample) {
+    sum -= samples[pos];
+    sum += sample;
+    samples[pos] = sample;
+    if (++pos == N) {
+      pos = 0;
+    }
+    return value();
+  }
+
+  T value() const {
+    return sum / N;
+  }
+
+private:
+  T samples[N] = {};
+  SumT sum = 0;
+  uint8_t pos = 0;
+};
+
+// Exponential filter, y += (x - y) / 2^SHIFT in fixed point.
+// State keeps SHIFT fraction bits, StateT must hold max(T) << SHIFT.
+template <typename T, typename StateT, uint8_t SHIFT>
+class ExpFilter {
+public:
+  void reset(const T value) {
+    state = (StateT)value << SHIFT;
+  }
+
+  T update(const T sample) {
+    state -= state >> SHIFT;
+    state += sample;
+    return value();
+  }
+
+  T value() const {
+    return state >> SHIFT;
+  }
+
+private:
+  StateT state = 0;
+};
+
+// Median of the last N samples (N odd), kept in a small sorted window.
+// Drops single sample glitches without the lag of an average.
+template <typename T, uint8_t N>
+class MedianFilter {
+public:
+  T update(const T sample) {
+    uint8_t i;
+
+    if (count < N) {
+      // still filling, just insert
+      i = count++;
+    } else {
+      // find and drop the oldest sample, leaving a hole at i
+      T oldest = samples[pos];
+      for (i = 0; sorted[i] != oldest; i++) {
+      }
+      for (; i + 1 < N; i++) {
+        sorted[i] = sorted[i + 1];
+      }
+    }
+    samples[pos] = sample;
+    if (++pos == N) {
+      pos = 0;
+    }
+
+    // insert new sample keeping order, hole is at i
+    for (; i > 0 && sorted[i - 1] > sample; i--) {
+      sorted[i] = sorted[i - 1];
+    }
+    sorted[i] = sample;
+
+    return value();
+  }
+
+  T value() const {
+    return count > 0 ? sorted[count / 2] : 0;
+  }
+
+private:
+  T samples[N] = {}; // in arrival order
+  T sorted[N] = {};
+  uint8_t pos = 0;
+  uint8_t count = 0;
+};
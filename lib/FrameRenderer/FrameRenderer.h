@@ -0,0 +1,89 @@
+#pragma once
+
+#include <FastLED.h>
+
+// Pushes a led strip to the leds only when the frame changed.
+//
+// FastLED.show() blocks for ~30us per WS2812 led with interrupts delayed,
+// so a frame equal to the one on the leds is skipped, and refresh is capped
+// at maxFps. The last shown frame is kept to compare against; a frame
+// held back by the cap goes out on a later call.
+//
+// The cap allows an eighth of an interval early: called from a task at
+// maxFps, a tick that runs a little late must not hold back the next one
+// a whole period.
+//
+// FastLED's temporal dithering (setDither) only works while frames keep
+// going out, so with refreshFps an unchanged frame is shown again at that
+// rate, unless it is all black and there is nothing to dither.
+
+template <uint8_t N>
+class FrameRenderer {
+public:
+  FrameRenderer(CRGB *leds, const uint8_t maxFps, const uint8_t refreshFps = 0)
+      : leds(leds), minInterval(early(1000000UL / maxFps)),
+        refreshInterval(refreshFps ? early(1000000UL / refreshFps) : 0) {}
+
+  // show leds if changed (or due a refresh) and not too soon, returns true if shown
+  bool show(const uint32_t now) {
+    bool changed = memcmp(leds, shown, sizeof(shown)) != 0;
+    bool refresh = !changed && refreshInterval && lit && now - lastShowTs >= refreshInterval;
+    if (!changed && !refresh) {
+      skipped++;
+      return false;
+    }
+    if (everShown && now - lastShowTs < minInterval) {
+      limited++;
+      return false;
+    }
+
+    uint32_t start = micros();
+    FastLED.show();
+    uint32_t elapsed = micros() - start;
+
+    if (changed) {
+      memcpy(shown, leds, sizeof(shown));
+      lit = false;
+      for (uint8_t i = 0; i < N && !lit; i++) {
+        lit = shown[i].r || shown[i].g || shown[i].b;
+      }
+    } else {
+      refreshed++;
+    }
+    lastShowTs = now;
+    everShown = true;
+
+    shows++;
+    showTime += elapsed;
+    if (elapsed > maxShowTime) {
+      maxShowTime = elapsed;
+    }
+    return true;
+  }
+
+  bool showColor(const uint32_t now, const CRGB &color) {
+    fill_solid(leds, N, color);
+    return show(now);
+  }
+
+  // counters since start
+  uint16_t shows = 0;
+  uint16_t skipped = 0;     // frame unchanged
+  uint16_t limited = 0;     // held back by fps cap
+  uint16_t refreshed = 0;   // unchanged but shown again for dithering
+  uint32_t showTime = 0;    // us spent in FastLED.show()
+  uint16_t maxShowTime = 0; // us
+
+private:
+  CRGB *leds;
+  CRGB shown[N];
+  const uint32_t minInterval;
+  const uint32_t refreshInterval;
+  uint32_t lastShowTs = 0;
+  bool everShown = false;
+  bool lit = false; // shown frame has a led on
+
+  static uint32_t early(const uint32_t interval) {
+    return interval - interval / 8;
+  }
+};
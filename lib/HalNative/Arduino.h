@@ -0,0 +1,105 @@
+#pragma once
+
+// Native (Linux) stand-in for the Arduino core, see HalNative.h.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "HalNative.h"
+
+#ifndef F_CPU
+#define F_CPU 8000000UL
+#endif
+
+#define HIGH 1
+#define LOW 0
+
+#define INPUT 0
+#define OUTPUT 1
+#define INPUT_PULLUP 2
+
+#define CHANGE 1
+#define FALLING 2
+#define RISING 3
+
+#define LED_BUILTIN 13
+
+#define NUM_DIGITAL_PINS 20
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+#define PROGMEM
+#define PSTR(s) (s)
+#define F(s) (s)
+#define memcpy_P memcpy
+#define pgm_read_byte(addr) (*(const uint8_t *)(addr))
+#define pgm_read_word(addr) (*(const uint16_t *)(addr))
+#define pgm_read_dword(addr) (*(const uint32_t *)(addr))
+
+#define _BV(bit) (1 << (bit))
+#define bit(b) (1UL << (b))
+
+typedef uint8_t byte;
+typedef bool boolean;
+
+uint32_t micros();
+uint32_t millis();
+void delay(uint32_t ms);
+void delayMicroseconds(uint16_t us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+void analogWrite(uint8_t pin, int value);
+
+// INT0 / INT1 like the atmega328
+#define digitalPinToInterrupt(pin) ((pin) == 2 ? 0 : ((pin) == 3 ? 1 : -1))
+void attachInterrupt(uint8_t interruptNum, void (*handler)(), int mode);
+void detachInterrupt(uint8_t interruptNum);
+void noInterrupts();
+void interrupts();
+
+// frame formats, only timed as 8N1
+#define SERIAL_8N1 0x06
+#define SERIAL_8E2 0x2e
+
+// Serial port, output goes to stdout
+class HardwareSerial {
+public:
+  void begin(unsigned long baud);
+  void begin(unsigned long baud, uint8_t) {
+    begin(baud);
+  }
+  void end() {}
+  int available();
+  int read();
+  int availableForWrite();
+  void flush() {}
+
+  size_t write(uint8_t c);
+  size_t write(const char *str);
+  size_t write(const uint8_t *buffer, size_t size);
+
+  size_t print(const char *str);
+  size_t print(char c);
+  size_t print(long n);
+  size_t print(unsigned long n);
+  size_t print(int n) { return print((long)n); }
+  size_t print(unsigned int n) { return print((unsigned long)n); }
+
+  size_t println() { return write('\n'); }
+  template <typename T>
+  size_t println(T value) {
+    return print(value) + println();
+  }
+};
+
+extern HardwareSerial Serial;
+
+// provided by the sketch
+void setup();
+void loop();
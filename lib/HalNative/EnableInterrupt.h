@@ -0,0 +1,6 @@
+#pragma once
+
+#include <Arduino.h>
+
+// native EnableInterrupt, any pin
+void enableInterrupt(uint8_t pin, void (*handler)(), uint8_t mode);
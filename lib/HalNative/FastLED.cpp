@@ -0,0 +1,72 @@
+#ifndef __AVR__
+
+#include <FastLED.h>
+
+CFastLED FastLED;
+
+static uint8_t scale8(uint8_t i, uint8_t scale) {
+  return ((uint16_t)i * (1 + (uint16_t)scale)) >> 8;
+}
+
+static uint8_t scale8_video(uint8_t i, uint8_t scale) {
+  return (((uint16_t)i * scale) >> 8) + ((i && scale) ? 1 : 0);
+}
+
+// same "rainbow" hue map as FastLED
+void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb) {
+  uint8_t hue = hsv.hue;
+  uint8_t sat = hsv.sat;
+  uint8_t val = hsv.val;
+
+  uint8_t offset8 = (hue & 0x1f) << 3;
+  uint8_t third = scale8(offset8, 256 / 3);
+  uint8_t twothirds = scale8(offset8, (256 * 2) / 3);
+  uint8_t r, g, b;
+
+  switch (hue >> 5) {
+    case 0: r = 255 - third; g = third; b = 0; break;             // red -> orange
+    case 1: r = 171; g = 85 + third; b = 0; break;                // orange -> yellow
+    case 2: r = 171 - twothirds; g = 170 + third; b = 0; break;   // yellow -> green
+    case 3: r = 0; g = 255 - third; b = third; break;             // green -> aqua
+    case 4: r = 0; g = 171 - twothirds; b = 85 + twothirds; break; // aqua -> blue
+    case 5: r = third; g = 0; b = 255 - third; break;             // blue -> purple
+    case 6: r = 85 + third; g = 0; b = 171 - third; break;        // purple -> pink
+    default: r = 170 + third; g = 0; b = 85 - third; break;       // pink -> red
+  }
+
+  if (sat != 255) {
+    if (sat == 0) {
+      r = g = b = 255;
+    } else {
+      uint8_t desat = 255 - sat;
+      desat = scale8_video(desat, desat);
+      uint8_t satscale = 255 - desat;
+      r = scale8(r, satscale) + desat;
+      g = scale8(g, satscale) + desat;
+      b = scale8(b, satscale) + desat;
+    }
+  }
+
+  if (val != 255) {
+    val = scale8_video(val, val);
+    if (val == 0) {
+      r = g = b = 0;
+    } else {
+      r = scale8(r, val);
+      g = scale8(g, val);
+      b = scale8(b, val);
+    }
+  }
+
+  rgb.r = r;
+  rgb.g = g;
+  rgb.b = b;
+}
+
+void fill_solid(CRGB *leds, int count, const CRGB &color) {
+  for (int i = 0; i < count; i++) {
+    leds[i] = color;
+  }
+}
+
+#endif
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Native FastLED, just the parts the sketches use. show() only counts,
+// the frame stays in the sketch's led array for inspection.
+
+#define FASTLED_SCALE8_FIXED 1
+
+struct CHSV {
+  uint8_t hue;
+  uint8_t sat;
+  uint8_t val;
+
+  CHSV() {}
+  CHSV(uint8_t hue, uint8_t sat, uint8_t val) : hue(hue), sat(sat), val(val) {}
+};
+
+struct CRGB;
+void hsv2rgb_rainbow(const CHSV &hsv, CRGB &rgb);
+
+struct CRGB {
+  uint8_t r;
+  uint8_t g;
+  uint8_t b;
+
+  typedef enum {
+    Black = 0x000000,
+    White = 0xffffff,
+    Red = 0xff0000,
+    Green = 0x008000,
+    Blue = 0x0000ff,
+  } HTMLColorCode;
+
+  CRGB() {}
+  CRGB(uint8_t r, uint8_t g, uint8_t b) : r(r), g(g), b(b) {}
+  CRGB(uint32_t colorcode) : r(colorcode >> 16), g(colorcode >> 8), b(colorcode) {}
+  CRGB(HTMLColorCode colorcode) : CRGB((uint32_t)colorcode) {}
+  CRGB(const CHSV &hsv) {
+    hsv2rgb_rainbow(hsv, *this);
+  }
+
+  bool operator==(const CRGB &rhs) const {
+    return r == rhs.r && g == rhs.g && b == rhs.b;
+  }
+
+  bool operator!=(const CRGB &rhs) const {
+    return !(*this == rhs);
+  }
+};
+
+enum EOrder { RGB = 0012, GRB = 0102 };
+
+enum LEDColorCorrection { TypicalLEDStrip = 0xffb0f0, UncorrectedColor = 0xffffff };
+
+template <uint8_t DATA_PIN, EOrder RGB_ORDER>
+class WS2812 {};
+
+class CFastLED {
+public:
+  template <template <uint8_t, EOrder> class CHIPSET, uint8_t DATA_PIN, EOrder RGB_ORDER>
+  void addLeds(CRGB *data, int count) {
+    leds = data;
+    ledCount = count;
+  }
+
+  void setBrightness(uint8_t scale) {
+    brightness = scale;
+  }
+
+  void setCorrection(LEDColorCorrection) {}
+  void setDither(bool) {}
+
+  void show() {
+    shows++;
+  }
+
+  void showColor(const CRGB &color) {
+    (void)color;
+    shows++;
+  }
+
+  CRGB *leds = nullptr;
+  int ledCount = 0;
+  uint8_t brightness = 255;
+  uint32_t shows = 0;
+};
+
+extern CFastLED FastLED;
+
+void fill_solid(CRGB *leds, int count, const CRGB &color);
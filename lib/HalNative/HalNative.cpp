@@ -0,0 +1,395 @@
+#ifndef __AVR__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <Arduino.h>
+#include <EnableInterrupt.h>
+#include <avr/eeprom.h>
+
+HardwareSerial Serial;
+
+uint32_t halLoopStep = 100;
+
+static uint32_t clockUs = 0;
+
+struct pinState_t {
+  uint8_t mode;
+  int value;
+  void (*handler)();
+  int handlerMode;
+  void (*watch)(uint8_t pin, int value);
+  bool pending;
+};
+
+static pinState_t pins[NUM_DIGITAL_PINS];
+static bool interruptsEnabled = true;
+
+static void runHandler(pinState_t &pin) {
+  if (!interruptsEnabled) {
+    // runs when interrupts are enabled again, like a latched flag
+    pin.pending = true;
+    return;
+  }
+  interruptsEnabled = false;
+  pin.handler();
+  interruptsEnabled = true;
+}
+
+void halAdvance(uint32_t us) {
+  clockUs += us;
+}
+
+void halSetPin(uint8_t pin, uint8_t level) {
+  if (pin >= NUM_DIGITAL_PINS) {
+    return;
+  }
+  pinState_t &state = pins[pin];
+  int last = state.value;
+  state.value = level ? HIGH : LOW;
+
+  if (state.handler == nullptr || last == state.value) {
+    return;
+  }
+  if (state.handlerMode == CHANGE ||
+      (state.handlerMode == RISING && state.value == HIGH) ||
+      (state.handlerMode == FALLING && state.value == LOW)) {
+    runHandler(state);
+  }
+}
+
+int halGetPin(uint8_t pin) {
+  return pin < NUM_DIGITAL_PINS ? pins[pin].value : 0;
+}
+
+void halWatchPin(uint8_t pin, void (*handler)(uint8_t pin, int value)) {
+  if (pin < NUM_DIGITAL_PINS) {
+    pins[pin].watch = handler;
+  }
+}
+
+static void written(uint8_t pin) {
+  if (pins[pin].watch != nullptr) {
+    pins[pin].watch(pin, pins[pin].value);
+  }
+}
+
+// time
+
+uint32_t micros() {
+  return clockUs;
+}
+
+uint32_t millis() {
+  return clockUs / 1000;
+}
+
+void delay(uint32_t ms) {
+  clockUs += ms * 1000;
+}
+
+void delayMicroseconds(uint16_t us) {
+  clockUs += us;
+}
+
+// pins
+
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (pin < NUM_DIGITAL_PINS) {
+    pins[pin].mode = mode;
+    if (mode == INPUT_PULLUP) {
+      pins[pin].value = HIGH;
+    }
+  }
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+  if (pin < NUM_DIGITAL_PINS) {
+    pins[pin].value = value ? HIGH : LOW;
+    written(pin);
+  }
+}
+
+int digitalRead(uint8_t pin) {
+  return pin < NUM_DIGITAL_PINS && pins[pin].value != 0 ? HIGH : LOW;
+}
+
+void analogWrite(uint8_t pin, int value) {
+  if (pin < NUM_DIGITAL_PINS) {
+    pins[pin].value = value;
+    written(pin);
+  }
+}
+
+// interrupts
+
+static const uint8_t interruptPins[] = {2, 3};
+
+void attachInterrupt(uint8_t interruptNum, void (*handler)(), int mode) {
+  if (interruptNum < sizeof(interruptPins)) {
+    enableInterrupt(interruptPins[interruptNum], handler, mode);
+  }
+}
+
+void detachInterrupt(uint8_t interruptNum) {
+  if (interruptNum < sizeof(interruptPins)) {
+    pins[interruptPins[interruptNum]].handler = nullptr;
+  }
+}
+
+void enableInterrupt(uint8_t pin, void (*handler)(), uint8_t mode) {
+  if (pin < NUM_DIGITAL_PINS) {
+    pins[pin].handler = handler;
+    pins[pin].handlerMode = mode;
+  }
+}
+
+void noInterrupts() {
+  interruptsEnabled = false;
+}
+
+void interrupts() {
+  interruptsEnabled = true;
+  for (uint8_t i = 0; i < NUM_DIGITAL_PINS; i++) {
+    if (pins[i].pending) {
+      pins[i].pending = false;
+      runHandler(pins[i]);
+    }
+  }
+}
+
+// serial
+
+#define SERIAL_TX_BUFFER 63
+
+uint32_t halSerialBlockedUs = 0;
+
+static unsigned long txBaud = 0;
+static uint32_t txQueued = 0;
+static uint32_t txTs = 0;
+
+// us per byte, 8N1
+static uint32_t txByteTime() {
+  return 10000000UL / txBaud;
+}
+
+// take out what the uart sent since last time
+static void txDrain() {
+  if (txBaud == 0 || txQueued == 0) {
+    txQueued = 0;
+    txTs = clockUs;
+    return;
+  }
+
+  uint32_t sent = (clockUs - txTs) / txByteTime();
+  if (sent >= txQueued) {
+    txQueued = 0;
+    txTs = clockUs;
+  } else {
+    txQueued -= sent;
+    txTs += sent * txByteTime();
+  }
+}
+
+static void txQueue(size_t count) {
+  if (txBaud == 0) {
+    return;
+  }
+
+  for (size_t i = 0; i < count; i++) {
+    txDrain();
+    if (txQueued == SERIAL_TX_BUFFER) {
+      // wait for the oldest byte to go out
+      uint32_t wait = txTs + txByteTime() - clockUs;
+      halAdvance(wait);
+      halSerialBlockedUs += wait;
+      txDrain();
+    }
+    txQueued++;
+  }
+}
+
+void HardwareSerial::begin(unsigned long baud) {
+  txBaud = baud;
+  txQueued = 0;
+  txTs = clockUs;
+}
+
+#define SERIAL_RX_BUFFER 64
+
+static uint8_t rxBuffer[SERIAL_RX_BUFFER];
+static uint8_t rxHead = 0;
+static uint8_t rxTail = 0;
+
+void halSerialInput(const uint8_t *data, size_t size) {
+  for (size_t i = 0; i < size; i++) {
+    uint8_t next = (rxHead + 1) % SERIAL_RX_BUFFER;
+    if (next == rxTail) {
+      // full, dropped like on overrun
+      return;
+    }
+    rxBuffer[rxHead] = data[i];
+    rxHead = next;
+  }
+}
+
+void halSerialInput(const char *data) {
+  halSerialInput((const uint8_t *)data, strlen(data));
+}
+
+int HardwareSerial::available() {
+  return (rxHead + SERIAL_RX_BUFFER - rxTail) % SERIAL_RX_BUFFER;
+}
+
+int HardwareSerial::read() {
+  if (rxHead == rxTail) {
+    return -1;
+  }
+  uint8_t c = rxBuffer[rxTail];
+  rxTail = (rxTail + 1) % SERIAL_RX_BUFFER;
+  return c;
+}
+
+int HardwareSerial::availableForWrite() {
+  txDrain();
+  return SERIAL_TX_BUFFER - txQueued;
+}
+
+static uint8_t *captureBuffer = nullptr;
+static size_t captureSize = 0;
+static size_t captured = 0;
+
+void halSerialCapture(uint8_t *buffer, size_t size) {
+  captureBuffer = buffer;
+  captureSize = size;
+  captured = 0;
+}
+
+size_t halSerialCaptured() {
+  return captured;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+size_t HardwareSerial::write(const char *str) {
+  return write((const uint8_t *)str, strlen(str));
+}
+
+size_t HardwareSerial::write(const uint8_t *buffer, size_t size) {
+  txQueue(size);
+  if (captureBuffer == nullptr) {
+    return fwrite(buffer, 1, size, stdout);
+  }
+  for (size_t i = 0; i < size && captured < captureSize; i++) {
+    captureBuffer[captured++] = buffer[i];
+  }
+  return size;
+}
+
+size_t HardwareSerial::print(const char *str) {
+  return write(str);
+}
+
+size_t HardwareSerial::print(char c) {
+  return write((uint8_t)c);
+}
+
+size_t HardwareSerial::print(long n) {
+  char buffer[12];
+  snprintf(buffer, sizeof(buffer), "%ld", n);
+  return write(buffer);
+}
+
+size_t HardwareSerial::print(unsigned long n) {
+  char buffer[12];
+  snprintf(buffer, sizeof(buffer), "%lu", n);
+  return write(buffer);
+}
+
+// eeprom
+
+uint32_t halEepromWrites = 0;
+uint32_t halEepromWriteUs = 0;
+
+static uint8_t eeprom[E2END + 1];
+static bool eepromErased = false;
+static uint32_t eepromBusyTs = 0;
+
+static uint8_t *eepromAt(const void *addr) {
+  if (!eepromErased) {
+    memset(eeprom, 0xff, sizeof(eeprom));
+    eepromErased = true;
+  }
+  return &eeprom[(uintptr_t)addr & E2END];
+}
+
+uint8_t eeprom_read_byte(const uint8_t *addr) {
+  return *eepromAt(addr);
+}
+
+void eeprom_write_byte(uint8_t *addr, uint8_t value) {
+  *eepromAt(addr) = value;
+  halEepromWrites++;
+  eepromBusyTs = clockUs;
+}
+
+bool eeprom_is_ready() {
+  return halEepromWrites == 0 || clockUs - eepromBusyTs >= halEepromWriteUs;
+}
+
+void eeprom_update_byte(uint8_t *addr, uint8_t value) {
+  if (*eepromAt(addr) != value) {
+    eeprom_write_byte(addr, value);
+  }
+}
+
+void eeprom_read_block(void *dst, const void *src, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    ((uint8_t *)dst)[i] = eeprom_read_byte((const uint8_t *)src + i);
+  }
+}
+
+void eeprom_update_block(const void *src, void *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    eeprom_update_byte((uint8_t *)dst + i, ((const uint8_t *)src)[i]);
+  }
+}
+
+void halReset() {
+  clockUs = 0;
+  memset(pins, 0, sizeof(pins));
+  interruptsEnabled = true;
+
+  txBaud = 0;
+  txQueued = 0;
+  txTs = 0;
+  rxHead = rxTail = 0;
+  halSerialBlockedUs = 0;
+  halSerialCapture(nullptr, 0);
+
+  eepromErased = false;
+  halEepromWrites = 0;
+  halEepromWriteUs = 0;
+  eepromBusyTs = 0;
+}
+
+// runs the sketch, optionally for a number of loop() passes given as
+// argument, test builds (pio test) bring their own main()
+#if !defined(HAL_NATIVE_NO_MAIN) && !defined(PIO_UNIT_TESTING)
+int main(int argc, char **argv) {
+  unsigned long loops = argc > 1 ? strtoul(argv[1], nullptr, 10) : 0;
+
+  setup();
+  for (unsigned long i = 0; loops == 0 || i < loops; i++) {
+    loop();
+    halAdvance(halLoopStep);
+  }
+
+  return 0;
+}
+#endif
+
+#endif
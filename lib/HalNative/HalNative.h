@@ -0,0 +1,56 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Native (Linux) backend for the Arduino API the sketches use.
+//
+// The Arduino core calls (pins, pwm, micros(), interrupts, serial) plus the
+// FastLED and EnableInterrupt headers are the hardware abstraction:
+// on the atmega they come from the real core and libraries, here from this
+// library, so every main.cpp builds unchanged as the [env:native] target
+// and the control logic can run, be tested and profiled on a PC.
+//
+// Time is virtual: it only moves on delay(), halAdvance() and one step per
+// loop() pass, so runs are repeatable and as fast as the host allows.
+// Inputs are driven with halSetPin(), which runs attached pin interrupts.
+//
+// Tests: `pio test -e native` builds each project's test/test_* suites
+// (Unity) against this library. There is no main() then, a suite can
+// #include "../../src/main.cpp" and call setup() and loop() itself, see
+// robo1's test_sketch. Defining HAL_NATIVE_NO_MAIN does the same outside
+// pio.
+
+// move the virtual clock forward
+void halAdvance(uint32_t us);
+
+// drive an input pin, runs its interrupt handler on a matching edge
+void halSetPin(uint8_t pin, uint8_t level);
+
+// last value written to an output pin, digital (0/1) or pwm (0..255)
+int halGetPin(uint8_t pin);
+
+// called on every write to an output pin, e.g. to answer a sonar trigger
+// with an echo, nullptr to stop
+void halWatchPin(uint8_t pin, void (*handler)(uint8_t pin, int value));
+
+// virtual time each loop() pass takes in the native main() (us)
+extern uint32_t halLoopStep;
+
+// Serial drains at the baud rate given to begin() out of a 63 byte tx
+// buffer like the atmega one, a write to a full buffer blocks: the clock
+// moves on and the time is added here (us)
+extern uint32_t halSerialBlockedUs;
+
+// bytes for Serial.read(), as if received
+void halSerialInput(const char *data);
+void halSerialInput(const uint8_t *data, size_t size);
+
+// Serial output goes into buffer (up to size bytes) instead of stdout, e.g.
+// to decode telemetry in a test, nullptr goes back to stdout
+void halSerialCapture(uint8_t *buffer, size_t size);
+// bytes written to it since
+size_t halSerialCaptured();
+
+// clock, pins, interrupt handlers, serial and eeprom back to power up
+void halReset();
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// avr-libc eeprom api on a 1KB array, erased (0xff) at start. Writes are
+// done right away, halEepromWrites counts the bytes actually changed, for
+// wear checks. It is always ready unless halEepromWriteUs is set, then it
+// is busy that long after each write like the real one (~3300us).
+
+#define E2END 0x3ff
+
+extern uint32_t halEepromWrites;
+extern uint32_t halEepromWriteUs;
+
+uint8_t eeprom_read_byte(const uint8_t *addr);
+void eeprom_write_byte(uint8_t *addr, uint8_t value);
+void eeprom_update_byte(uint8_t *addr, uint8_t value);
+void eeprom_read_block(void *dst, const void *src, size_t n);
+void eeprom_update_block(const void *src, void *dst, size_t n);
+
+bool eeprom_is_ready();
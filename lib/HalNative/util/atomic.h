@@ -0,0 +1,11 @@
+#pragma once
+
+#include <stdint.h>
+
+// avr-libc's ATOMIC_BLOCK. The native isrs run from halSetPin() and
+// halAdvance(), never inside a block, so the block just runs once.
+
+#define ATOMIC_RESTORESTATE 0
+#define ATOMIC_FORCEON 1
+
+#define ATOMIC_BLOCK(type) for (uint8_t atomicOnce_ = ((void)(type), 1); atomicOnce_; atomicOnce_ = 0)
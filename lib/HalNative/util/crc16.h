@@ -0,0 +1,14 @@
+#pragma once
+
+#include <stdint.h>
+
+// avr-libc crc16 helpers, the plain C versions from its documentation.
+
+// CRC-16/ARC, polynomial 0x8005 reflected (0xa001)
+static inline uint16_t _crc16_update(uint16_t crc, uint8_t a) {
+  crc ^= a;
+  for (uint8_t i = 0; i < 8; i++) {
+    crc = (crc & 1) ? (crc >> 1) ^ 0xa001 : crc >> 1;
+  }
+  return crc;
+}
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Tables.h>
+
+// Differential drive mixer, rc steering + throttle pulses to two motors.
+//
+// Pulse to percent scaling is
+//   x = width - 1500, |x| <= DEADBAND -> 0
+//   percent = sign(x) * min((|x| - OFFSET) / DIVISOR, 100)
+// with the divide done as a multiply-shift, exact for |x| up to 1000.
+// Then optional expo (lookup table) and rate limiting are applied, and
+// thrust is split between motors as
+//   forward: thr1 = thr + str, thr2 = thr - str
+//   reverse: thr1 = thr - str, thr2 = thr + str
+// With expo and rate limit off the result is the same as the original
+// robo1 (100, 0, 5) and robo2 (100, 100, 3) code.
+
+struct motorOutputs_t {
+  uint8_t motor1a = 0;
+  uint8_t motor1b = 0;
+  uint8_t motor2a = 0;
+  uint8_t motor2b = 0;
+};
+
+// p^3 / 10000 for p = 0..100, same range as p
+struct mixerCubeCurve {
+  static constexpr uint8_t at(const uint16_t p) {
+    return (uint32_t)p * p * p / 10000;
+  }
+};
+
+typedef ProgmemTable<uint8_t, mixerCubeCurve, 101> mixerCubeTable;
+
+template <uint16_t DEADBAND, uint16_t OFFSET, uint8_t DIVISOR>
+class Mixer {
+  static_assert(OFFSET <= DEADBAND, "offset must be inside deadband");
+
+public:
+  // 0 = linear .. 255 = almost fully cubic
+  uint8_t expo = 0;
+  // max percent change per update, 0 = no limit
+  uint8_t rateLimit = 0;
+
+  // outputs, -100..100
+  int8_t thr1Percent = 0;
+  int8_t thr2Percent = 0;
+
+  void update(const uint16_t strWidth, const uint16_t thrWidth) {
+    int16_t thrPercent = applyExpo(pulseToPercent(thrWidth));
+    int16_t strPercent = applyExpo(pulseToPercent(strWidth));
+
+    int16_t newThr1Percent;
+    int16_t newThr2Percent;
+    if (thrPercent >= 0) {
+      newThr1Percent = thrPercent + strPercent;
+      newThr2Percent = thrPercent - strPercent;
+    } else {
+      newThr1Percent = thrPercent - strPercent;
+      newThr2Percent = thrPercent + strPercent;
+    }
+
+    thr1Percent = limitRate(thr1Percent, clampPercent(newThr1Percent));
+    thr2Percent = limitRate(thr2Percent, clampPercent(newThr2Percent));
+  }
+
+  // stop right away, e.g. on signal loss
+  void reset() {
+    thr1Percent = 0;
+    thr2Percent = 0;
+  }
+
+  static int8_t pulseToPercent(const uint16_t width) {
+    bool negative = width < 1500;
+    uint16_t x = negative ? 1500 - width : width - 1500;
+    if (x <= DEADBAND) {
+      return 0;
+    }
+
+    uint16_t percent = ((uint32_t)(x - OFFSET) * DIVISOR_MUL) >> 16;
+    if (percent > 100) {
+      percent = 100;
+    }
+    return negative ? -(int8_t)percent : percent;
+  }
+
+  // -100..100 percent to pwm values for the two h-bridge inputs of each motor
+  static motorOutputs_t motorOutputs(const int16_t thr1Percent, const int16_t thr2Percent) {
+    motorOutputs_t out;
+
+    if (thr1Percent > 0) {
+      out.motor1a = thr1Percent << 1;
+    } else if (thr1Percent < 0) {
+      out.motor1b = -thr1Percent << 1;
+    }
+
+    if (thr2Percent > 0) {
+      out.motor2a = thr2Percent << 1;
+    } else if (thr2Percent < 0) {
+      out.motor2b = -thr2Percent << 1;
+    }
+
+    return out;
+  }
+
+private:
+  // 2^16 / DIVISOR rounded up
+  static const uint32_t DIVISOR_MUL = (65536UL + DIVISOR - 1) / DIVISOR;
+
+  static int8_t clampPercent(const int16_t percent) {
+    if (percent > 100) return 100;
+    if (percent < -100) return -100;
+    return percent;
+  }
+
+  int8_t applyExpo(const int8_t percent) const {
+    if (expo == 0) {
+      return percent;
+    }
+
+    uint8_t p = percent < 0 ? -percent : percent;
+    uint8_t curved = ((uint16_t)p * (256 - expo) + (uint16_t)mixerCubeTable::read(p) * expo) >> 8;
+    return percent < 0 ? -(int8_t)curved : curved;
+  }
+
+  int8_t limitRate(const int8_t last, const int8_t target) const {
+    if (rateLimit == 0) {
+      return target;
+    }
+    if (target > last + rateLimit) {
+      return last + rateLimit;
+    }
+    if (target < last - rateLimit) {
+      return last - rateLimit;
+    }
+    return target;
+  }
+};
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastPin.h>
+
+// Two input h-bridge motors on hardware pwm, written straight to the timer
+// compare registers through PwmPin instead of analogWrite().
+//
+// motorPwmBegin() moves Timer1 and Timer2 to 8 bit fast pwm at
+// F_CPU / MOTOR_PWM_PRESCALER / 256, 31250Hz on 8MHz boards, out of hearing
+// range. Timer0 keeps the core's 8MHz / 64 / 256 = 488Hz since micros()
+// runs on it, so motors on pins 5 and 6 (motor 2 on robo1/robo2) still
+// whine. With RC_CAPTURE_TIMER1 Timer1
+// belongs to the rc capture and is left alone.
+//
+// Each update() moves the output at most slew pwm steps towards the
+// target, so speed steps don't turn into current spikes. stop() skips the
+// slew for failsafe. At speed 0 the bridge coasts (both inputs low) or
+// brakes (both high).
+
+// 1 (31250Hz) or 8 (3906Hz) at 8MHz
+#ifndef MOTOR_PWM_PRESCALER
+#define MOTOR_PWM_PRESCALER 1
+#endif
+
+enum motorStopMode_t {
+  MOTOR_COAST,
+  MOTOR_BRAKE
+};
+
+#ifdef __AVR__
+
+inline void motorPwmBegin() {
+#if MOTOR_PWM_PRESCALER == 1
+  const uint8_t cs = _BV(CS10);
+  const uint8_t cs2 = _BV(CS20);
+#elif MOTOR_PWM_PRESCALER == 8
+  const uint8_t cs = _BV(CS11);
+  const uint8_t cs2 = _BV(CS21);
+#else
+#error "MOTOR_PWM_PRESCALER must be 1 or 8"
+#endif
+
+#ifndef RC_CAPTURE_TIMER1
+  // 8 bit fast pwm
+  TCCR1A = (TCCR1A & (_BV(COM1A1) | _BV(COM1B1))) | _BV(WGM10);
+  TCCR1B = _BV(WGM12) | cs;
+#endif
+  TCCR2A = (TCCR2A & (_BV(COM2A1) | _BV(COM2B1))) | _BV(WGM21) | _BV(WGM20);
+  TCCR2B = cs2;
+}
+
+#else
+
+// no timers on the native build, pwm goes through the core
+inline void motorPwmBegin() {
+}
+
+#endif
+
+template <uint8_t PIN_A, uint8_t PIN_B>
+class Motor {
+public:
+  // max pwm change per update(), 0 = no limit
+  uint8_t slew = 0;
+  motorStopMode_t stopMode = MOTOR_COAST;
+
+  // last written pwm of the two bridge inputs
+  uint8_t outA = 0;
+  uint8_t outB = 0;
+
+  void begin() {
+    FastPin<PIN_A>::low();
+    FastPin<PIN_B>::low();
+    FastPin<PIN_A>::output();
+    FastPin<PIN_B>::output();
+    stop();
+  }
+
+  // target -255..255, positive drives input A
+  void update(const int16_t target) {
+    int16_t clamped = target > 255 ? 255 : (target < -255 ? -255 : target);
+
+    if (slew && clamped > speed + slew) {
+      speed += slew;
+    } else if (slew && clamped < speed - slew) {
+      speed -= slew;
+    } else {
+      speed = clamped;
+    }
+    apply();
+  }
+
+  // right away, no slew
+  void stop() {
+    speed = 0;
+    apply();
+  }
+
+  int16_t getSpeed() const {
+    return speed;
+  }
+
+private:
+  int16_t speed = 0;
+
+  void apply() {
+    if (speed > 0) {
+      write(speed, 0);
+    } else if (speed < 0) {
+      write(0, -speed);
+    } else if (stopMode == MOTOR_BRAKE) {
+      write(255, 255);
+    } else {
+      write(0, 0);
+    }
+  }
+
+  void write(const uint8_t a, const uint8_t b) {
+    // only touch registers that change
+    if (a != outA) {
+      PwmPin<PIN_A>::write(a);
+      outA = a;
+    }
+    if (b != outB) {
+      PwmPin<PIN_B>::write(b);
+      outB = b;
+    }
+  }
+};
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Timing probes for cycle counting under simavr, see tools/simbench.
+//
+// Built with -D BENCH_PROBES (the simbench env), PROBE_BEGIN(id) and
+// PROBE_END(id) set and clear bit id (0..7) of the GPIOR0 register, a
+// single sbi/cbi each, so they cost 2 cycles and no pins. simbench hooks
+// writes to GPIOR0 and times every bit. Otherwise they compile to nothing.
+
+#if defined(BENCH_PROBES) && defined(__AVR__)
+#define PROBE_BEGIN(id) (GPIOR0 |= _BV(id))
+#define PROBE_END(id) (GPIOR0 &= ~_BV(id))
+#else
+#define PROBE_BEGIN(id) ((void)0)
+#define PROBE_END(id) ((void)0)
+#endif
+
+// probe ids shared by the sketches
+#define PROBE_LOOP 0
+#define PROBE_ISR_1 1
+#define PROBE_ISR_2 2
+#define PROBE_RECORDER 3
+#define PROBE_MOTORS 4
+#define PROBE_DECODE 5
+#define PROBE_LIGHTS 6
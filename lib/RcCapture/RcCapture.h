@@ -0,0 +1,61 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include <Snapshot.h>
+
+#include "RcTimer.h"
+
+// Interrupt driven capture of RC receiver pulses, N channels.
+//
+// Each channel pin gets a CHANGE interrupt that calls handleEdge(). Completed
+// pulses are published into a Snapshot per channel, loop() reads the last
+// one with read() - no pulseIn() busy waiting and no interrupts off.
+// Edge times come from the RcTimer time base, see RcTimer.h. Up to 8
+// channels, the started flags share a byte.
+
+struct rcPulse_t {
+  uint32_t ts = 0;     // micros() at pulse end, 0 if no pulse seen yet
+  uint16_t width = 0;  // pulse width (us)
+};
+
+template <uint8_t N>
+class RcCapture {
+  static_assert(N >= 1 && N <= 8, "RcCapture: 1 to 8 channels");
+
+public:
+  // call from channel pin change interrupt, now from rcTimerNow()
+  void handleEdge(const uint8_t chnIndex, const uint8_t state, const uint16_t now) {
+    uint8_t mask = _BV(chnIndex);
+
+    if (state == 1) {
+      // up transition, record start
+      pulseStart[chnIndex] = now;
+      started |= mask;
+      return;
+    }
+
+    if (!(started & mask)) {
+      // no up transition yet
+      return;
+    }
+
+    // down transition, publish
+    rcPulse_t pulse;
+    pulse.ts = micros();
+    pulse.width = rcTimerToMicros(now - pulseStart[chnIndex]);
+    pulses[chnIndex].publish(pulse);
+    started &= ~mask;
+  }
+
+  // last completed pulse of channel, safe to call with interrupts enabled
+  rcPulse_t read(const uint8_t chnIndex) const {
+    return pulses[chnIndex].read();
+  }
+
+private:
+  // edge state, only touched by the isrs, which don't nest
+  volatile uint16_t pulseStart[N] = {};
+  volatile uint8_t started = 0;
+  Snapshot<rcPulse_t> pulses[N];
+};
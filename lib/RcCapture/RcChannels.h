@@ -0,0 +1,113 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastPin.h>
+#include <Probe.h>
+#include <Tables.h>
+
+#include "RcCapture.h"
+
+// Compile time table of rc pwm inputs, one pin per channel in channel
+// order:
+//
+//   typedef RcChannels<PIN_STR, PIN_THR> rcChannels;
+//   rcChannels::begin(INPUT);
+//   rcPulse_t str = rcChannels::read(CHN_STR);
+//
+// Each channel gets its own generated isr with the pin and index built in,
+// a FastPin read and RcCapture::handleEdge() on a constant channel, so
+// adding channels adds isrs but doesn't make any of them slower. begin()
+// sets the pins up and attaches the isrs with attachInterrupt() (INT0 and
+// INT1 pins) or a given attach function, e.g. one calling enableInterrupt()
+// for pin change interrupts on any pin.
+//
+// With RC_CAPTURE_TIMER1 a channel on the ICP1 pin is captured by Timer1
+// instead, the sketch calls handleCapture() from ISR(TIMER1_CAPT_vect).
+//
+// The edge state and pulses are the RcCapture ones: 2 bytes per channel
+// for the start time, one byte of started flags and a Snapshot per channel.
+// Channel 0 is timed by PROBE_ISR_1, the others by PROBE_ISR_2.
+
+template <uint8_t... PINS>
+class RcChannels {
+public:
+  static const uint8_t count = sizeof...(PINS);
+  static constexpr uint8_t pins[count] = {PINS...};
+
+  // starts the time base, sets the pins to mode and attaches the isrs
+  static void begin(const uint8_t mode = INPUT) {
+    begin(mode, attachInt);
+  }
+
+  // same, isrs attached with attach(pin, isr, CHANGE)
+  template <typename F>
+  static void begin(const uint8_t mode, F attach) {
+    rcTimerBegin();
+    beginEach(mode, attach, typename makeIndexSeq<count>::type());
+  }
+
+  // last completed pulse of channel, safe to call with interrupts enabled
+  static rcPulse_t read(const uint8_t chnIndex) {
+    return capture.read(chnIndex);
+  }
+
+  static void readAll(rcPulse_t *pulses) {
+    for (uint8_t i = 0; i < count; i++) {
+      pulses[i] = capture.read(i);
+    }
+  }
+
+  // channel index of a pin, count if none
+  static constexpr uint8_t indexOf(const uint8_t pin, const uint8_t i = 0) {
+    return i == count ? count : (pins[i] == pin ? i : indexOf(pin, i + 1));
+  }
+
+#ifdef RC_CAPTURE_TIMER1
+  // call from ISR(TIMER1_CAPT_vect)
+  static void handleCapture() {
+    static_assert(indexOf(RC_TIMER_ICP_PIN) < count, "RcChannels: no channel on the ICP1 pin");
+
+    uint16_t now;
+    uint8_t state = rcTimerCapture(now);
+    capture.handleEdge(indexOf(RC_TIMER_ICP_PIN), state, now);
+  }
+#endif
+
+private:
+  static RcCapture<sizeof...(PINS)> capture;
+
+  template <uint16_t I>
+  static void isr() {
+    PROBE_BEGIN(I == 0 ? PROBE_ISR_1 : PROBE_ISR_2);
+    capture.handleEdge(I, FastPin<pins[I]>::read(), rcTimerNow());
+    PROBE_END(I == 0 ? PROBE_ISR_1 : PROBE_ISR_2);
+  }
+
+  static void attachInt(const uint8_t pin, void (*handler)(), const uint8_t mode) {
+    attachInterrupt(digitalPinToInterrupt(pin), handler, mode);
+  }
+
+  template <typename F, uint16_t... Is>
+  static void beginEach(const uint8_t mode, F attach, indexSeq<Is...>) {
+    int unused[] = {0, (beginOne<Is>(mode, attach), 0)...};
+    (void)unused;
+  }
+
+  template <uint16_t I, typename F>
+  static void beginOne(const uint8_t mode, F attach) {
+    pinMode(pins[I], mode);
+#ifdef RC_CAPTURE_TIMER1
+    if (pins[I] == RC_TIMER_ICP_PIN) {
+      rcTimerBeginCapture();
+      return;
+    }
+#endif
+    attach(pins[I], isr<I>, CHANGE);
+  }
+};
+
+template <uint8_t... PINS>
+constexpr uint8_t RcChannels<PINS...>::pins[];
+
+template <uint8_t... PINS>
+RcCapture<sizeof...(PINS)> RcChannels<PINS...>::capture;
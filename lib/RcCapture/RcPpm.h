@@ -0,0 +1,102 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "RcCapture.h"
+
+// PPM sum decoder, the first N channels of a frame on one pin.
+//
+// A PPM frame is one edge per channel, each channel the time from its edge
+// to the next (~1000..2000us), then a sync gap of 3ms or more before the
+// next frame. Attach an interrupt on one edge only (RISING, or FALLING for
+// receivers with inverted output) that calls handleEdge(), intervals are
+// the same either way. Channel values are published into a Snapshot per
+// channel like RcCapture, read() gives the same rcPulse_t.
+//
+// Intervals come from the RcTimer time base. With RC_CAPTURE_TIMER1 the
+// 16 bit count wraps every 8.2ms, shorter than a sync gap can be, so gaps
+// are told apart on micros() instead and the ticks only time channels.
+// A frame with an interval out of range is dropped from that channel on
+// and counted as an error, decoding picks up again at the next sync.
+
+// channel interval range (us)
+#define RC_PPM_MIN_INTERVAL 700U
+#define RC_PPM_MAX_INTERVAL 2300U
+// anything longer is a sync gap (us)
+#define RC_PPM_SYNC_GAP 2700U
+
+struct rcPpmStats_t {
+  uint16_t frames = 0; // complete frames
+  uint16_t errors = 0; // frames cut short by an interval out of range
+  uint8_t channels = 0; // channels in the last complete frame
+};
+
+template <uint8_t N>
+class RcPpm {
+public:
+  // call from the pin interrupt, now from rcTimerNow()
+  void handleEdge(const uint16_t now) {
+    uint32_t ts = micros();
+    uint16_t interval = rcTimerToMicros(now - lastEdge);
+    bool gap = ts - lastTs > RC_PPM_SYNC_GAP;
+    lastEdge = now;
+    lastTs = ts;
+
+    if (gap) {
+      if (chnIndex != NOT_SYNCED && chnIndex > 0) {
+        stats.frames++;
+        stats.channels = chnIndex;
+      }
+      chnIndex = 0;
+      return;
+    }
+
+    if (chnIndex == NOT_SYNCED) {
+      return;
+    }
+
+    if (interval < RC_PPM_MIN_INTERVAL || interval > RC_PPM_MAX_INTERVAL) {
+      stats.errors++;
+      chnIndex = NOT_SYNCED;
+      return;
+    }
+
+    // channels past N are counted but not kept
+    if (chnIndex < N) {
+      rcPulse_t pulse;
+      pulse.ts = ts;
+      pulse.width = interval;
+      pulses[chnIndex].publish(pulse);
+    }
+    if (chnIndex < NOT_SYNCED - 1) {
+      chnIndex++;
+    }
+  }
+
+  // last value of channel, safe to call with interrupts enabled
+  rcPulse_t read(const uint8_t chnIndex) const {
+    return pulses[chnIndex].read();
+  }
+
+  // counters, copied with interrupts off
+  rcPpmStats_t getStats() const {
+    noInterrupts();
+    rcPpmStats_t copy;
+    copy.frames = stats.frames;
+    copy.errors = stats.errors;
+    copy.channels = stats.channels;
+    interrupts();
+    return copy;
+  }
+
+private:
+  static const uint8_t NOT_SYNCED = 0xff;
+
+  // edge state, only touched by the isr
+  uint16_t lastEdge = 0;
+  uint32_t lastTs = 0;
+  uint8_t chnIndex = NOT_SYNCED;
+  volatile rcPpmStats_t stats;
+
+  Snapshot<rcPulse_t> pulses[N];
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <Arduino.h>
+
+#include "RcCapture.h"
+
+// SBUS decoder, 16 channels from one serial input.
+//
+// SBUS is 100000 baud 8E2 with inverted levels, the atmega uart needs an
+// inverter (one transistor) in front of RX. A frame is 25 bytes every 7ms
+// or 14ms:
+//   0x0f, 16 channels of 11 bits packed lsb first in 22 bytes, flags, 0x00
+// handleByte() runs a fixed buffer state machine on the bytes read from
+// Serial and decodes when a frame is complete. A frame starts only on a
+// start byte after the line was quiet for RC_SBUS_GAP, as 0x0f turns up
+// inside frames too, and must end with the end byte. A frame with a wrong
+// end byte or a gap inside is dropped and the next gap waited for. Values
+// 172..1811 become 988..2012us pulse widths in the same rcPulse_t as
+// RcCapture. Frames with the receiver failsafe flag leave the channels
+// alone, so they go stale for Failsafe like a lost signal on pwm inputs.
+//
+// The gaps are timed on when the bytes are handled, so feed them from the
+// uart rx isr or a loop that reads Serial at least every 1ms. Read less
+// often, the bytes come in bursts: the quiet before a start byte looks
+// shorter than RC_SBUS_GAP and frames are never synced to, or a frame
+// split over two reads looks cut by a gap and is dropped.
+
+#define RC_SBUS_BAUD 100000
+#define RC_SBUS_CHANNELS 16
+#define RC_SBUS_FRAME 25
+#define RC_SBUS_START 0x0f
+#define RC_SBUS_END 0x00
+// quiet before a frame (us): a frame takes 3ms, the line is quiet 4ms at
+// the 7ms rate, and bytes read by polling every 1ms can look up to 1ms
+// closer; bytes of one frame are never this far apart
+#define RC_SBUS_GAP 2500U
+
+// flags byte
+#define RC_SBUS_CH17 0x01
+#define RC_SBUS_CH18 0x02
+#define RC_SBUS_LOST 0x04     // receiver missed a frame from the transmitter
+#define RC_SBUS_FAILSAFE 0x08 // receiver is in failsafe
+
+struct rcSbusStats_t {
+  uint16_t frames = 0;   // decoded
+  uint16_t errors = 0;   // dropped, bad end byte or cut short
+  uint16_t lost = 0;     // frames flagged lost by the receiver
+  uint16_t failsafes = 0; // frames flagged failsafe
+};
+
+class RcSbus {
+public:
+  // call for every received byte, now is micros(), true when a frame was decoded
+  bool handleByte(const uint8_t b, const uint32_t now) {
+    bool gap = now - lastTs >= RC_SBUS_GAP;
+    lastTs = now;
+
+    if (gap && pos > 0) {
+      stats.errors++;
+      pos = 0;
+    }
+    if (pos == 0 && !(gap && b == RC_SBUS_START)) {
+      return false;
+    }
+
+    frame[pos++] = b;
+    if (pos < RC_SBUS_FRAME) {
+      return false;
+    }
+    pos = 0;
+
+    if (b != RC_SBUS_END) {
+      stats.errors++;
+      return false;
+    }
+
+    decode(now);
+    return true;
+  }
+
+  // last value of channel 0..15
+  rcPulse_t read(const uint8_t chnIndex) const {
+    return channels[chnIndex];
+  }
+
+  // flags byte of the last frame
+  uint8_t flags() const {
+    return lastFlags;
+  }
+
+  rcSbusStats_t stats;
+
+  static uint16_t toMicros(const uint16_t value) {
+    // 5/8 us per step, 992 is center
+    return ((value * 5) >> 3) + 880;
+  }
+
+private:
+  uint8_t frame[RC_SBUS_FRAME];
+  uint8_t pos = 0;
+  uint32_t lastTs = 0; // last byte
+  uint8_t lastFlags = 0;
+
+  rcPulse_t channels[RC_SBUS_CHANNELS];
+
+  void decode(const uint32_t now) {
+    lastFlags = frame[RC_SBUS_FRAME - 2];
+    stats.frames++;
+    if (lastFlags & RC_SBUS_LOST) {
+      stats.lost++;
+    }
+    if (lastFlags & RC_SBUS_FAILSAFE) {
+      stats.failsafes++;
+      return;
+    }
+
+    const uint8_t *data = &frame[1];
+    uint32_t bits = 0;
+    uint8_t bitCount = 0;
+    for (uint8_t i = 0; i < RC_SBUS_CHANNELS; i++) {
+      while (bitCount < 11) {
+        bits |= (uint32_t)*data++ << bitCount;
+        bitCount += 8;
+      }
+      channels[i].ts = now;
+      channels[i].width = toMicros(bits & 0x7ff);
+      bits >>= 11;
+      bitCount -= 11;
+    }
+  }
+};
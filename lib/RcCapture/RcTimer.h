@@ -0,0 +1,72 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Time base used to measure RC pulse widths, selected at compile time.
+//
+// Default is micros(): portable, but it moves in 8us steps on 8MHz boards
+// (4us on 16MHz) and adds ISR entry jitter, about 1% of a pulse.
+//
+// Build with -D RC_CAPTURE_TIMER1 to run Timer1 free at F_CPU instead, which
+// measures in 0.125us steps on 8MHz boards. The 16 bit counter wraps every
+// 8.2ms (4.1ms at 16MHz), longer than any valid pulse, so a plain 16 bit
+// difference gives the width. Timer1 is taken over: no analogWrite() on
+// pins 9 and 10 and no Servo library or ServoDriver. One channel can also
+// use the ICP1 pin (8), where the hardware latches the counter so ISR
+// latency does not matter at all.
+
+#ifdef RC_CAPTURE_TIMER1
+
+#define RC_TIMER_TICKS_PER_US (F_CPU / 1000000UL)
+
+// pin latched by the input capture unit
+#define RC_TIMER_ICP_PIN 8
+
+inline void rcTimerBegin() {
+  // normal mode, no prescaler
+  TCCR1A = 0;
+  TCCR1B = _BV(CS10);
+  TIMSK1 = 0;
+}
+
+inline uint16_t rcTimerNow() {
+  return TCNT1;
+}
+
+// start capturing edges on ICP1, handled by TIMER1_CAPT_vect
+inline void rcTimerBeginCapture() {
+  // noise canceler delays capture by 4 clocks, same for both edges
+  TCCR1B |= _BV(ICNC1) | _BV(ICES1);
+  TIFR1 = _BV(ICF1);
+  TIMSK1 |= _BV(ICIE1);
+}
+
+// call from TIMER1_CAPT_vect, returns the captured pin state and sets up the other edge
+inline uint8_t rcTimerCapture(uint16_t &ticks) {
+  ticks = ICR1;
+  uint8_t state = (TCCR1B & _BV(ICES1)) ? 1 : 0;
+  TCCR1B ^= _BV(ICES1);
+  // changing edge may raise a bogus capture flag
+  TIFR1 = _BV(ICF1);
+  return state;
+}
+
+#else
+
+#define RC_TIMER_TICKS_PER_US 1
+
+inline void rcTimerBegin() {
+}
+
+inline uint16_t rcTimerNow() {
+  return micros();
+}
+
+#endif
+
+// rounded to the nearest us, ticks up to 0xffff
+inline uint16_t rcTimerToMicros(const uint16_t ticks) {
+  // constant power of two divisor, compiles to shifts; adding the half
+  // before dividing would wrap the 16 bit int of the avr near 0xffff
+  return ticks / RC_TIMER_TICKS_PER_US + ((ticks & (RC_TIMER_TICKS_PER_US / 2)) ? 1 : 0);
+}
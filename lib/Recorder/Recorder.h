@@ -0,0 +1,342 @@
+#pragma once
+
+#include <Arduino.h>
+#include <avr/eeprom.h>
+#include <Telemetry.h>
+
+// Flight recorder, the last few seconds of robo state in a RAM ring.
+//
+// record() takes one sample per fixed period and stores what changed since
+// the previous one: a flags byte, then an 8 bit delta or full 16 bit value
+// per pulse width, the 4 motor pwms and the prox/signal bits, each only if
+// changed. Runs of unchanged samples are one repeat byte. The oldest
+// records are dropped to make room, folding them into a full base sample,
+// so the ring always decodes from the base forward.
+//
+// dump() copies the ring to eeprom a byte at a time from dumpStep(), only
+// while the eeprom is ready so it never waits the ~3.3ms a write takes.
+// Recording is paused until the copy is done. The image is
+//   recorderHeader_t, then the records
+// with the magic byte written last, so a cut dump doesn't read as valid.
+// RecorderReader sends it back as telemetry records, tools/telemetry
+// rebuilds the timeline.
+
+struct recorderSample_t {
+  uint16_t str; // pulse widths (us)
+  uint16_t thr;
+  uint8_t motor1a; // pwm outputs
+  uint8_t motor1b;
+  uint8_t motor2a;
+  uint8_t motor2b;
+  uint8_t bits; // prox bits 0..3 (fr, fl, rr, rl), failsafe state in 4..7
+} __attribute__((packed));
+
+#define RECORDER_MAGIC 0xb1
+#define RECORDER_VERSION 1
+
+struct recorderHeader_t {
+  uint8_t magic;
+  uint8_t version;
+  uint16_t period;   // ms between samples
+  uint16_t samples;  // in the image, base included
+  uint16_t length;   // record bytes after the header
+  uint32_t endTs;    // millis() of the newest sample
+  recorderSample_t base; // oldest sample
+} __attribute__((packed));
+
+// record flags
+#define RECORDER_STR_DELTA 0x01 // int8 delta follows
+#define RECORDER_STR_FULL 0x02  // uint16 follows
+#define RECORDER_THR_DELTA 0x04
+#define RECORDER_THR_FULL 0x08
+#define RECORDER_MOTORS 0x10    // 4 pwm bytes follow
+#define RECORDER_BITS 0x20      // bits byte follows
+#define RECORDER_REPEAT 0x80    // low 7 bits: previous sample repeated n times
+
+// flags byte and all fields
+#define RECORDER_RECORD_MAX 10
+
+template <uint16_t BUDGET>
+class Recorder {
+public:
+  Recorder(const uint16_t period, const uint16_t eepromAddr) : period(period), eepromAddr(eepromAddr) {}
+
+  // call every period ms
+  void record(const uint32_t nowMs, const recorderSample_t &sample) {
+    if (dumping()) {
+      return;
+    }
+
+    if (samples == 0) {
+      base = sample;
+      last = sample;
+      samples = 1;
+      endTs = nowMs;
+      return;
+    }
+
+    uint8_t rec[RECORDER_RECORD_MAX];
+    uint8_t len = encode(rec, sample);
+
+    if (len == 0) {
+      // unchanged, count it on the last repeat byte if there is one
+      if (repeatPos != NO_REPEAT && (ring[repeatPos] & 0x7f) < 0x7f) {
+        ring[repeatPos]++;
+      } else {
+        makeRoom(1);
+        repeatPos = head;
+        put(RECORDER_REPEAT | 1);
+      }
+    } else {
+      makeRoom(len);
+      for (uint8_t i = 0; i < len; i++) {
+        put(rec[i]);
+      }
+      repeatPos = NO_REPEAT;
+    }
+
+    last = sample;
+    samples++;
+    endTs = nowMs;
+  }
+
+  // start copying to eeprom, ignored while a copy is running
+  void dump() {
+    if (dumping() || samples == 0) {
+      return;
+    }
+
+    header.magic = RECORDER_MAGIC;
+    header.version = RECORDER_VERSION;
+    header.period = period;
+    header.samples = samples;
+    header.length = used;
+    header.endTs = endTs;
+    header.base = base;
+
+    dumpPos = 0;
+    dumpSize = sizeof(header) + used;
+  }
+
+  // call often, writes while the eeprom is ready, returns true when done
+  bool dumpStep() {
+    while (dumping() && eeprom_is_ready()) {
+      // magic cleared first and set last
+      uint16_t addr = dumpPos == dumpSize ? 0 : dumpPos;
+      uint8_t value = dumpPos == 0 ? 0xff : imageByte(addr);
+      eeprom_update_byte((uint8_t *)(uintptr_t)(eepromAddr + addr), value);
+
+      if (dumpPos++ == dumpSize) {
+        dumpPos = NOT_DUMPING;
+        dumps++;
+      }
+    }
+    return !dumping();
+  }
+
+  bool dumping() const {
+    return dumpPos != NOT_DUMPING;
+  }
+
+  // samples and bytes held now
+  uint16_t size() const {
+    return samples;
+  }
+
+  uint16_t bytes() const {
+    return used;
+  }
+
+  // counters since start
+  uint16_t dumps = 0;
+
+  // eeprom bytes used from eepromAddr at most, a full ring
+  static const uint16_t EEPROM_SIZE = sizeof(recorderHeader_t) + BUDGET;
+
+private:
+  static const uint16_t NO_REPEAT = 0xffff;
+  static const uint16_t NOT_DUMPING = 0xffff;
+
+  const uint16_t period;
+  const uint16_t eepromAddr;
+
+  uint8_t ring[BUDGET];
+  uint16_t head = 0;
+  uint16_t tail = 0;
+  uint16_t used = 0;
+  // last record if it is a repeat that can still count up
+  uint16_t repeatPos = NO_REPEAT;
+
+  recorderSample_t base;
+  recorderSample_t last;
+  uint16_t samples = 0;
+  uint32_t endTs = 0;
+
+  recorderHeader_t header;
+  uint16_t dumpPos = NOT_DUMPING;
+  uint16_t dumpSize = 0;
+
+  uint16_t wrap(const uint16_t pos) const {
+    return pos >= BUDGET ? pos - BUDGET : pos;
+  }
+
+  void put(const uint8_t b) {
+    ring[head] = b;
+    head = wrap(head + 1);
+    used++;
+  }
+
+  uint8_t imageByte(const uint16_t i) const {
+    if (i < sizeof(header)) {
+      return ((const uint8_t *)&header)[i];
+    }
+    return ring[wrap(tail + i - sizeof(header))];
+  }
+
+  // record for sample against last, 0 if unchanged
+  uint8_t encode(uint8_t *rec, const recorderSample_t &sample) const {
+    uint8_t len = 1;
+    uint8_t flags = 0;
+
+    int16_t strDelta = sample.str - last.str;
+    if (strDelta != 0) {
+      if (strDelta >= -128 && strDelta <= 127) {
+        flags |= RECORDER_STR_DELTA;
+        rec[len++] = strDelta;
+      } else {
+        flags |= RECORDER_STR_FULL;
+        rec[len++] = sample.str;
+        rec[len++] = sample.str >> 8;
+      }
+    }
+
+    int16_t thrDelta = sample.thr - last.thr;
+    if (thrDelta != 0) {
+      if (thrDelta >= -128 && thrDelta <= 127) {
+        flags |= RECORDER_THR_DELTA;
+        rec[len++] = thrDelta;
+      } else {
+        flags |= RECORDER_THR_FULL;
+        rec[len++] = sample.thr;
+        rec[len++] = sample.thr >> 8;
+      }
+    }
+
+    if (sample.motor1a != last.motor1a || sample.motor1b != last.motor1b ||
+        sample.motor2a != last.motor2a || sample.motor2b != last.motor2b) {
+      flags |= RECORDER_MOTORS;
+      rec[len++] = sample.motor1a;
+      rec[len++] = sample.motor1b;
+      rec[len++] = sample.motor2a;
+      rec[len++] = sample.motor2b;
+    }
+
+    if (sample.bits != last.bits) {
+      flags |= RECORDER_BITS;
+      rec[len++] = sample.bits;
+    }
+
+    if (flags == 0) {
+      return 0;
+    }
+    rec[0] = flags;
+    return len;
+  }
+
+  // drop oldest records into base until len bytes are free
+  void makeRoom(const uint8_t len) {
+    while (BUDGET - used < len) {
+      evict();
+    }
+  }
+
+  void evict() {
+    uint8_t flags = ring[tail];
+    uint8_t len = 1;
+
+    if (flags & RECORDER_REPEAT) {
+      samples -= flags & 0x7f;
+    } else {
+      if (flags & RECORDER_STR_DELTA) {
+        base.str += (int8_t)at(len++);
+      } else if (flags & RECORDER_STR_FULL) {
+        base.str = at(len) | (at(len + 1) << 8);
+        len += 2;
+      }
+      if (flags & RECORDER_THR_DELTA) {
+        base.thr += (int8_t)at(len++);
+      } else if (flags & RECORDER_THR_FULL) {
+        base.thr = at(len) | (at(len + 1) << 8);
+        len += 2;
+      }
+      if (flags & RECORDER_MOTORS) {
+        base.motor1a = at(len++);
+        base.motor1b = at(len++);
+        base.motor2a = at(len++);
+        base.motor2b = at(len++);
+      }
+      if (flags & RECORDER_BITS) {
+        base.bits = at(len++);
+      }
+      samples--;
+    }
+
+    tail = wrap(tail + len);
+    used -= len;
+    if (used == 0) {
+      repeatPos = NO_REPEAT;
+    }
+  }
+
+  // byte i of the oldest record
+  uint8_t at(const uint8_t i) const {
+    return ring[wrap(tail + i)];
+  }
+};
+
+// Sends the eeprom image back as telemetry records, a chunk per step().
+class RecorderReader {
+public:
+  RecorderReader(const uint16_t eepromAddr) : eepromAddr(eepromAddr) {}
+
+  // start reading, false if there is no valid image
+  bool begin() {
+    recorderHeader_t header;
+    eeprom_read_block(&header, (const void *)(uintptr_t)eepromAddr, sizeof(header));
+    if (header.magic != RECORDER_MAGIC || header.version != RECORDER_VERSION) {
+      return false;
+    }
+
+    size = sizeof(header) + header.length;
+    offset = 0;
+    return true;
+  }
+
+  // queue the next chunk if there is room, returns true while more to send
+  template <typename TelemetryT>
+  bool step(TelemetryT &telemetry) {
+    if (offset >= size) {
+      return false;
+    }
+
+    telemetryRecorder_t chunk;
+    chunk.offset = offset;
+    chunk.size = size;
+    uint16_t count = size - offset;
+    if (count > TELEMETRY_RECORDER_CHUNK) {
+      count = TELEMETRY_RECORDER_CHUNK;
+    }
+    memset(chunk.data, 0, sizeof(chunk.data));
+    eeprom_read_block(chunk.data, (const void *)(uintptr_t)(eepromAddr + offset), count);
+
+    if (telemetry.send(TELEMETRY_RECORDER, &chunk, sizeof(chunk))) {
+      offset += count;
+    }
+    return offset < size;
+  }
+
+private:
+  const uint16_t eepromAddr;
+  uint16_t offset = 0;
+  uint16_t size = 0;
+};
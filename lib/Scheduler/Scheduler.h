@@ -0,0 +1,92 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Fixed rate cooperative task scheduler.
+//
+// Call run() from loop(), each task runs at its own period. Deadlines advance
+// by exactly one period, so rates don't drift with the time a pass takes. A
+// task that falls a whole period behind counts an overrun and skips ahead,
+// keeping its phase. trigger() runs a task early when its input changed.
+//
+// Time base is micros(), i.e. the Timer0 overflow interrupt, so no other
+// timer is taken away from pwm.
+
+typedef void (*taskFn_t)(const uint32_t now);
+
+struct task_t {
+  taskFn_t fn = nullptr;
+  uint32_t period = 0;   // us
+  uint32_t due = 0;
+  uint16_t overruns = 0; // missed periods
+  uint16_t wcet = 0;     // worst case execution time (us)
+};
+
+template <uint8_t N>
+class Scheduler {
+public:
+  // tasks run in the order they were added, returns the index, N if full
+  uint8_t add(const taskFn_t fn, const uint32_t period) {
+    if (count >= N) {
+      return N;
+    }
+    tasks[count].fn = fn;
+    tasks[count].period = period;
+    return count++;
+  }
+
+  // task i is due now, later in this pass if called from a task before it,
+  // and its period starts over from here: fresh input needn't wait a period
+  void trigger(const uint8_t i) {
+    tasks[i].due = micros();
+  }
+
+  // all tasks are due right away
+  void begin() {
+    uint32_t now = micros();
+    for (uint8_t i = 0; i < count; i++) {
+      tasks[i].due = now;
+    }
+  }
+
+  void run() {
+    for (uint8_t i = 0; i < count; i++) {
+      task_t &task = tasks[i];
+
+      uint32_t now = micros();
+      if ((int32_t)(now - task.due) < 0) {
+        continue;
+      }
+
+      task.fn(now);
+
+      uint32_t elapsed = micros() - now;
+      if (elapsed > task.wcet) {
+        task.wcet = elapsed > 0xffff ? 0xffff : elapsed;
+      }
+
+      task.due += task.period;
+      while ((int32_t)(now - task.due) >= 0) {
+        task.due += task.period;
+        if (task.overruns < 0xffff) {
+          task.overruns++;
+        }
+      }
+    }
+  }
+
+  uint8_t size() const {
+    return count;
+  }
+
+  const task_t &task(const uint8_t i) const {
+    return tasks[i];
+  }
+
+private:
+  task_t tasks[N];
+  uint8_t count = 0;
+};
+
+// us between runs for a rate in Hz
+#define TASK_HZ(hz) (1000000UL / (hz))
@@ -0,0 +1,181 @@
+#pragma once
+
+#include <Arduino.h>
+#include <FastPin.h>
+
+// Servos on the Timer1 compare outputs, the pulses made by the timer.
+//
+// servoTimerBegin() puts Timer1 in fast pwm with TOP in ICR1 (mode 14), a
+// 20ms frame in 1us steps at 8MHz (prescaler 8). OC1A (pin 9) and OC1B
+// (pin 10) then give the pulses on their own with no interrupts, where the
+// Servo library takes a Timer1 compare interrupt on every servo edge plus
+// one per frame, each one delaying other isrs like the sonar echo. OCR1x
+// are double buffered in this mode, a new width starts at the next frame.
+//
+// Those two pins are all Timer1 has, so 1 or 2 servos. Timer0 and Timer2
+// are 8 bit: a 20ms frame needs prescaler 1024 there, 128us steps, about
+// 8 across a 1..2ms pulse, too coarse to aim a servo. More would need an
+// isr to multiplex them, the thing this avoids; proximity drives one.
+// Timer1 is taken, no analogWrite() on pins 9/10 and no RC_CAPTURE_TIMER1
+// next to it.
+//
+// write() sets a target, update() at a fixed rate moves towards it at most
+// slew us per call and writes the compare register only when the width
+// changes. play() runs a PROGMEM list of angles one after another at its
+// own step, e.g. a power up sweep.
+//
+// On the native build the pulse width (us) is the pin value, compare()
+// holds what OCR1x would.
+
+#ifdef RC_CAPTURE_TIMER1
+#error "ServoDriver needs Timer1, RC_CAPTURE_TIMER1 has it"
+#endif
+
+// angle to pulse mapping of the Servo library, so angles stay the same (us)
+#define SERVO_MIN_PULSE 544U
+#define SERVO_MAX_PULSE 2400U
+
+#define SERVO_FRAME_US 20000U
+
+// timer steps per us at prescaler 8
+#define SERVO_TICKS_PER_US (F_CPU / 8000000UL)
+
+// ICR1: the counter runs 0..TOP, TOP + 1 ticks a frame (19999 at 8MHz)
+constexpr uint16_t servoTop(const uint8_t ticksPerUs = SERVO_TICKS_PER_US) {
+  return SERVO_FRAME_US * ticksPerUs - 1;
+}
+
+// OCR1x for a pulse: the pin is set at BOTTOM and cleared on the compare
+// match, high for OCR1x + 1 ticks
+constexpr uint16_t servoCompare(const uint16_t us, const uint8_t ticksPerUs = SERVO_TICKS_PER_US) {
+  return us * ticksPerUs - 1;
+}
+
+#ifdef __AVR__
+
+inline void servoTimerBegin() {
+  // keep enabled outputs, fast pwm TOP = ICR1, prescaler 8
+  TCCR1B = 0;
+  TCCR1A = (TCCR1A & (_BV(COM1A1) | _BV(COM1B1))) | _BV(WGM11);
+  TCNT1 = 0;
+  ICR1 = servoTop();
+  TCCR1B = _BV(WGM13) | _BV(WGM12) | _BV(CS11);
+}
+
+#else
+
+inline void servoTimerBegin() {
+}
+
+#endif
+
+template <uint8_t PIN>
+class TimerServo {
+  static_assert(PIN == 9 || PIN == 10, "TimerServo: only OC1A (9) and OC1B (10)");
+
+public:
+  // max pulse change per update() (us), 0 = no limit
+  uint16_t slew = 0;
+
+  // register writes since start
+  uint16_t writes = 0;
+
+  void begin(const uint8_t angle) {
+    target = current = angleToPulse(angle);
+    apply();
+    FastPin<PIN>::output();
+#ifdef __AVR__
+    TCCR1A |= PIN == 9 ? _BV(COM1A1) : _BV(COM1B1);
+#endif
+  }
+
+  // stops a running play()
+  void write(const uint8_t angle) {
+    writeMicroseconds(angleToPulse(angle));
+  }
+
+  void writeMicroseconds(const uint16_t us) {
+    target = us < SERVO_MIN_PULSE ? SERVO_MIN_PULSE : (us > SERVO_MAX_PULSE ? SERVO_MAX_PULSE : us);
+    remaining = 0;
+    profileStep = 0;
+  }
+
+  // go through count angles from flash, step us per update()
+  void play(const uint8_t *angles, const uint8_t count, const uint16_t step) {
+    profile = angles;
+    remaining = count;
+    profileStep = step;
+    target = current;
+  }
+
+  bool playing() const {
+    return remaining || (profileStep && current != target);
+  }
+
+  // call at a fixed rate, e.g. once per frame
+  void update() {
+    if (current == target && remaining) {
+      target = angleToPulse(pgm_read_byte(profile++));
+      remaining--;
+    }
+    if (current == target && !remaining) {
+      profileStep = 0;
+    }
+
+    uint16_t step = profileStep ? profileStep : slew;
+    if (step && target > current + step) {
+      current += step;
+    } else if (step && target + step < current) {
+      current -= step;
+    } else {
+      current = target;
+    }
+    apply();
+  }
+
+  // pulse width being sent (us)
+  uint16_t read() const {
+    return current;
+  }
+
+  // OCR1x value written for it
+  uint16_t compare() const {
+    return written;
+  }
+
+  static uint16_t angleToPulse(const uint8_t angle) {
+    uint8_t a = angle > 180 ? 180 : angle;
+    return SERVO_MIN_PULSE + (uint32_t)a * (SERVO_MAX_PULSE - SERVO_MIN_PULSE) / 180;
+  }
+
+private:
+  uint16_t target = 0;
+  uint16_t current = 0;
+  // OCR1x, none yet
+  uint16_t written = 0xffff;
+
+  const uint8_t *profile = nullptr;
+  uint8_t remaining = 0;
+  uint16_t profileStep = 0;
+
+  void apply() {
+    uint16_t value = servoCompare(current);
+    if (value == written) {
+      return;
+    }
+    written = value;
+    writes++;
+#ifdef __AVR__
+    // 16 bit register, no isr may touch Timer1 in between
+    noInterrupts();
+    if (PIN == 9) {
+      OCR1A = value;
+    } else {
+      OCR1B = value;
+    }
+    interrupts();
+#else
+    analogWrite(PIN, current);
+#endif
+  }
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <stdint.h>
+
+// Value shared between one interrupt writer and loop() readers, no
+// interrupts off on either side.
+//
+// publish() (isr) writes the slot not last published, flips to it and bumps
+// a sequence counter. read() (loop) copies the current slot and retries if
+// the counter moved while copying. A single publish during the copy lands in
+// the other slot, a second one could tear it - both show up as a new
+// sequence, so a returned copy is always one whole published value. The
+// counter is 8 bit, fine as long as fewer than 256 publishes can land during
+// one read, i.e. the isr doesn't starve loop().
+//
+// T should be a small plain struct or integer, it is copied byte by byte.
+
+template <typename T>
+class Snapshot {
+  static_assert(sizeof(T) < 256, "Snapshot: copies are indexed with a byte");
+
+public:
+  // call with interrupts off, i.e. from the isr
+  void publish(const T &value) {
+    uint8_t next = slot ^ 1;
+    copyIn(values[next], value);
+    slot = next;
+    seq++;
+  }
+
+  // last published value, T() until the first publish
+  T read() const {
+    T value;
+    uint8_t before;
+
+    // retries only if publish() ran while copying, isrs are far shorter than loop()
+    do {
+      before = seq;
+      copyOut(value, values[slot]);
+    } while (before != seq);
+
+    return value;
+  }
+
+  // changes on every publish, wraps at 256
+  uint8_t version() const {
+    return seq;
+  }
+
+private:
+  volatile T values[2] = {};
+  volatile uint8_t slot = 0;
+  volatile uint8_t seq = 0;
+
+  static void copyIn(volatile T &to, const T &from) {
+    volatile uint8_t *dst = (volatile uint8_t *)&to;
+    const uint8_t *src = (const uint8_t *)&from;
+    for (uint8_t i = 0; i < sizeof(T); i++) {
+      dst[i] = src[i];
+    }
+  }
+
+  static void copyOut(T &to, const volatile T &from) {
+    uint8_t *dst = (uint8_t *)&to;
+    const volatile uint8_t *src = (const volatile uint8_t *)&from;
+    for (uint8_t i = 0; i < sizeof(T); i++) {
+      dst[i] = src[i];
+    }
+  }
+};
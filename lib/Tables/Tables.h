@@ -0,0 +1,46 @@
+#pragma once
+
+#include <Arduino.h>
+
+// Lookup tables generated at compile time straight into flash.
+//
+// G is a struct with a constexpr static at(i) giving entry i, e.g.
+//
+//   struct squares { static constexpr uint16_t at(uint16_t i) { return i * i; } };
+//   typedef ProgmemTable<uint16_t, squares, 16> squareTable;
+//   uint16_t nine = squareTable::read(3);
+//
+// Tables are built with template recursion, keep them to a few hundred entries.
+
+template <uint16_t... Is>
+struct indexSeq {};
+
+template <uint16_t N, uint16_t... Is>
+struct makeIndexSeq : makeIndexSeq<N - 1, N - 1, Is...> {};
+
+template <uint16_t... Is>
+struct makeIndexSeq<0, Is...> {
+  typedef indexSeq<Is...> type;
+};
+
+template <typename T, typename G, typename Seq>
+struct progmemTableData;
+
+template <typename T, typename G, uint16_t... Is>
+struct progmemTableData<T, G, indexSeq<Is...>> {
+  static const T values[sizeof...(Is)];
+};
+
+template <typename T, typename G, uint16_t... Is>
+const T progmemTableData<T, G, indexSeq<Is...>>::values[sizeof...(Is)] PROGMEM = {G::at(Is)...};
+
+template <typename T, typename G, uint16_t N>
+struct ProgmemTable : progmemTableData<T, G, typename makeIndexSeq<N>::type> {
+  static const uint16_t size = N;
+
+  static T read(const uint16_t i) {
+    T value;
+    memcpy_P(&value, &ProgmemTable::values[i], sizeof(T));
+    return value;
+  }
+};
@@ -0,0 +1,253 @@
+#pragma once
+
+#include <Arduino.h>
+#include <Tables.h>
+
+// Binary telemetry records over Serial, COBS framed with a CRC8.
+//
+// On the wire a record is COBS(type, seq, payload..., crc) and a 0 byte, the
+// crc (poly 0x07) covers type, seq and payload. seq counts every record,
+// dropped ones too, so the decoder sees what's missing. send() encodes into
+// a ring buffer and flush() only writes what fits in the serial tx buffer,
+// so nothing here waits for the uart - with the ring full the record is
+// dropped and counted instead. tools/telemetry decodes a capture to csv.
+//
+// Payloads are fixed layout little endian structs, see the records below.
+// Text printed straight to Serial would land inside half sent frames, with
+// records going out use TelemetryText, it sends text as records too.
+
+// longest payload, keeps a frame within one COBS block
+#define TELEMETRY_MAX_PAYLOAD 250
+
+// crc8 poly 0x07 of a single byte
+constexpr uint8_t crc8Shift(const uint8_t crc, const uint8_t bits) {
+  return bits == 0 ? crc : crc8Shift((crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1), bits - 1);
+}
+
+struct crc8Gen {
+  static constexpr uint8_t at(const uint16_t i) {
+    return crc8Shift(i, 8);
+  }
+};
+
+typedef ProgmemTable<uint8_t, crc8Gen, 256> crc8Table;
+
+inline uint8_t crc8Update(const uint8_t crc, const uint8_t data) {
+  return crc8Table::read(crc ^ data);
+}
+
+// SIZE bytes of ring, a frame takes payload + 5
+template <uint16_t SIZE>
+class Telemetry {
+public:
+  // starts with a delimiter, ends whatever text went out before
+  Telemetry() {
+    put(0);
+  }
+
+  // queue a record, false if dropped for lack of room
+  bool send(const uint8_t type, const void *payload, const uint8_t len) {
+    uint8_t recordSeq = seq++;
+
+    // code byte, type, seq, payload, crc, delimiter - no zero run is longer than a block
+    if (len > TELEMETRY_MAX_PAYLOAD || SIZE - used < (uint16_t)len + 5) {
+      dropped++;
+      return false;
+    }
+
+    codePos = head;
+    put(0);
+    code = 1;
+
+    uint8_t crc = 0;
+    encode(type);
+    crc = crc8Update(crc, type);
+    encode(recordSeq);
+    crc = crc8Update(crc, recordSeq);
+    const uint8_t *data = (const uint8_t *)payload;
+    for (uint8_t i = 0; i < len; i++) {
+      encode(data[i]);
+      crc = crc8Update(crc, data[i]);
+    }
+    encode(crc);
+
+    ring[codePos] = code;
+    put(0);
+
+    sent++;
+    return true;
+  }
+
+  // write queued bytes without blocking, call often
+  void flush() {
+    uint16_t room = Serial.availableForWrite();
+
+    while (room > 0 && used > 0) {
+      // contiguous part up to the end of the ring
+      uint16_t count = SIZE - tail;
+      if (count > used) count = used;
+      if (count > room) count = room;
+
+      Serial.write(&ring[tail], count);
+      tail += count;
+      if (tail == SIZE) {
+        tail = 0;
+      }
+      used -= count;
+      room -= count;
+    }
+  }
+
+  // counters since start
+  uint16_t sent = 0;
+  uint16_t dropped = 0;
+
+private:
+  uint8_t ring[SIZE];
+  uint16_t head = 0;
+  uint16_t tail = 0;
+  uint16_t used = 0;
+  uint8_t seq = 0;
+
+  // COBS state of the frame being encoded
+  uint16_t codePos = 0;
+  uint8_t code = 1;
+
+  void put(const uint8_t b) {
+    ring[head] = b;
+    if (++head == SIZE) {
+      head = 0;
+    }
+    used++;
+  }
+
+  void encode(const uint8_t b) {
+    if (b == 0) {
+      ring[codePos] = code;
+      codePos = head;
+      put(0);
+      code = 1;
+    } else {
+      put(b);
+      code++;
+    }
+  }
+};
+
+// Serial.print() like text in TELEMETRY_TEXT records, a record per line or
+// per LINE chars of a longer one. Records carry the bytes as printed, the
+// newline too, so the decoder puts them back together by just writing them
+// out. Keep a burst of lines within what the ring can hold.
+#define TELEMETRY_TEXT 4
+
+template <class TELEMETRY, uint8_t LINE = 48>
+class TelemetryText {
+public:
+  TelemetryText(TELEMETRY &telemetry) : telemetry(telemetry) {}
+
+  void print(const char *str) {
+    while (*str) {
+      put(*str++);
+    }
+  }
+
+  void print(unsigned long n) {
+    char digits[10];
+    uint8_t count = 0;
+    do {
+      digits[count++] = '0' + n % 10;
+      n /= 10;
+    } while (n);
+    while (count) {
+      put(digits[--count]);
+    }
+  }
+
+  void print(long n) {
+    if (n < 0) {
+      put('-');
+      n = -n;
+    }
+    print((unsigned long)n);
+  }
+
+  void print(unsigned int n) {
+    print((unsigned long)n);
+  }
+
+  void print(int n) {
+    print((long)n);
+  }
+
+  void print(unsigned char n) {
+    print((unsigned long)n);
+  }
+
+  void println() {
+    put('\n');
+    send();
+  }
+
+  template <typename T>
+  void println(T value) {
+    print(value);
+    println();
+  }
+
+private:
+  TELEMETRY &telemetry;
+  char line[LINE];
+  uint8_t len = 0;
+
+  void put(const char c) {
+    if (len == LINE) {
+      send();
+    }
+    line[len++] = c;
+  }
+
+  void send() {
+    telemetry.send(TELEMETRY_TEXT, line, len);
+    len = 0;
+  }
+};
+
+// records
+
+// robo1/robo2 state, one per control cycle
+#define TELEMETRY_ROBO 1
+
+struct telemetryRobo_t {
+  uint32_t ts;       // micros()
+  uint16_t str;      // filtered pulse widths (us)
+  uint16_t thr;
+  uint8_t motor1a;   // pwm outputs
+  uint8_t motor1b;
+  uint8_t motor2a;
+  uint8_t motor2b;
+  uint8_t prox;      // bit 0 fr, 1 fl, 2 rr, 3 rl
+  uint8_t signal;    // failsafeState_t
+  uint16_t loopTime; // longest loop() since last record (us)
+} __attribute__((packed));
+
+// piece of a flight recorder image read back from eeprom, see Recorder.h
+#define TELEMETRY_RECORDER 2
+#define TELEMETRY_RECORDER_CHUNK 32
+
+struct telemetryRecorder_t {
+  uint16_t offset;   // in the image
+  uint16_t size;     // of the whole image
+  uint8_t data[TELEMETRY_RECORDER_CHUNK]; // only up to size is valid
+} __attribute__((packed));
+
+// proximity sonar map, one per sweep pass, see ScanMap.h
+#define TELEMETRY_SCAN 3
+#define TELEMETRY_SCAN_BINS 32
+
+struct telemetryScan_t {
+  uint32_t ts;        // micros() at the end of the pass
+  uint16_t passTime;  // of the last full pass (ms)
+  uint8_t nearestBin; // 0xff none
+  uint8_t nearest;    // cm, 0xff none
+  uint8_t cm[TELEMETRY_SCAN_BINS]; // bin i centred on (2i + 1) * 90 / 32 degrees, 0xff no echo
+} __attribute__((packed));
@@ -0,0 +1,80 @@
+#!/bin/sh
+# Builds every project with probes on (simbench env), runs each under
+# simbench with its input waveforms and prints a JSON array of the results.
+# With -c the results are also checked against a baseline from an earlier
+# run, any probe whose max cycles grew more than 10% fails the run.
+#
+#   tools/simbench/run.sh [seconds] > tools/simbench/baseline.json
+#   tools/simbench/run.sh -c tools/simbench/baseline.json [seconds] > now.json
+
+set -e
+
+ROOT=$(cd "$(dirname "$0")/../.." && pwd)
+SIMBENCH="$ROOT/tools/simbench/simbench"
+
+BASELINE=
+if [ "$1" = "-c" ]; then
+  BASELINE=$2
+  shift 2
+fi
+SECONDS_RUN=${1:-5}
+RESULTS=$(mktemp)
+trap 'rm -f "$RESULTS"' EXIT
+
+if [ ! -x "$SIMBENCH" ]; then
+  cc -O2 -o "$SIMBENCH" "$ROOT/tools/simbench/simbench.c" -lsimavr -lelf
+fi
+
+# project and simbench waveform options, pins as in each sketch
+PROJECTS="
+atmega-promini-blinky|
+atmega-promini-proximity|-e 7:8:1200
+atmega-promini-rc|-r 2 -r 3
+atmega-promini-rc-lights|-r 2 -r 3:1900
+atmega-promini-robo1|-r 2 -r 3
+atmega-promini-robo2|-r 2 -r 3
+"
+
+{
+  echo "["
+  first=1
+  echo "$PROJECTS" | while IFS='|' read -r project waveforms; do
+    [ -n "$project" ] || continue
+
+    pio run -s -d "$ROOT/$project" -e simbench >&2
+    [ $first = 1 ] || echo ","
+    first=0
+    # shellcheck disable=SC2086
+    "$SIMBENCH" -s "$SECONDS_RUN" $waveforms "$ROOT/$project/.pio/build/simbench/firmware.elf"
+  done
+  echo "]"
+} > "$RESULTS"
+cat "$RESULTS"
+
+[ -n "$BASELINE" ] || exit 0
+
+# per firmware and probe: max cycles against the baseline
+python3 - "$BASELINE" "$RESULTS" <<'EOF'
+import json, os, sys
+
+def load(path):
+  runs = {}
+  for run in json.load(open(path)):
+    name = os.path.basename(os.path.dirname(os.path.dirname(os.path.dirname(os.path.dirname(run["firmware"])))))
+    runs[name] = {p["name"]: p for p in run["probes"]}
+  return runs
+
+base, now = load(sys.argv[1]), load(sys.argv[2])
+failed = False
+for project in sorted(now):
+  for probe, p in sorted(now[project].items()):
+    b = base.get(project, {}).get(probe)
+    if not b:
+      print("%s %s: new, max %d" % (project, probe, p["max"]), file=sys.stderr)
+      continue
+    grew = p["max"] > b["max"] * 1.1
+    failed |= grew
+    print("%s %s: max %d -> %d, avg %d -> %d%s" % (project, probe, b["max"], p["max"], b["avg"], p["avg"],
+                                                   "  REGRESSION" if grew else ""), file=sys.stderr)
+sys.exit(1 if failed else 0)
+EOF
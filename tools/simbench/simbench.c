@@ -0,0 +1,321 @@
+// Cycle counts for the sketches under simavr, no hardware needed.
+//
+// Runs a firmware built with -D BENCH_PROBES (pio run -e simbench) on a
+// simulated 8 MHz atmega328p, feeds scripted waveforms to the input pins
+// and times the PROBE_BEGIN/PROBE_END pairs from lib/Probe, which toggle
+// bits of GPIOR0. Prints one JSON object with count/min/avg/max cycles per
+// probe, the latency from an injected edge to the isr probe firing, and
+// the worst loop time.
+//
+// Only the isr probes (ISR_1, ISR_2) pick up an edge. An edge no isr
+// answers within EDGE_TIMEOUT_US (a falling edge with the interrupt on
+// RISING, a pin without an interrupt) is dropped and counted as
+// edges_unmatched instead of being credited to whatever probe runs next.
+//
+// Build (needs libsimavr and libelf):
+//   cc -O2 -o simbench simbench.c -lsimavr -lelf
+//
+// Usage:
+//   simbench [-s seconds] [-r pin[:us]]... [-e trigger:echo:us] firmware.elf
+//
+//   -s  simulated run time, default 5
+//   -r  50Hz rc pulses on arduino pin, fixed width in us or sweeping 1000..2000
+//   -e  answer each falling edge on trigger pin with an echo pulse on echo pin
+//
+// See run.sh for the waveforms used for each project.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/sim_io.h>
+#include <simavr/sim_cycle_timers.h>
+#include <simavr/avr_ioport.h>
+
+#define MCU "atmega328p"
+#define FREQUENCY 8000000
+
+// GPIOR0 in data space, same address as in lib/Probe
+#define GPIOR0_ADDR 0x3e
+
+#define PROBE_COUNT 8
+// probe ids of the isrs, as in lib/Probe
+#define PROBE_ISR_1 1
+#define PROBE_ISR_2 2
+
+// longest edge to isr time still taken as that isr answering the edge
+#define EDGE_TIMEOUT_US 200
+#define RC_MAX 4
+
+static const char *probeNames[PROBE_COUNT] = {
+  "loop", "isr1", "isr2", "recorder", "motors", "decode", "lights", "probe7",
+};
+
+typedef struct {
+  avr_cycle_count_t start;
+  uint32_t count;
+  avr_cycle_count_t min;
+  avr_cycle_count_t max;
+  uint64_t total;
+  // isr probes, injected edge to probe begin
+  uint32_t latencyCount;
+  avr_cycle_count_t latencyMin;
+  avr_cycle_count_t latencyMax;
+} probe_t;
+
+typedef struct {
+  avr_irq_t *irq;
+  uint16_t width; // us, 0 = sweep
+  uint16_t sweep;
+  uint8_t level;
+} rcChannel_t;
+
+static avr_t *avr;
+static probe_t probes[PROBE_COUNT];
+
+static rcChannel_t rcChannels[RC_MAX];
+static uint8_t rcCount = 0;
+
+static avr_irq_t *echoIrq = NULL;
+static uint16_t echoWidth = 0; // us
+
+// last injected edge not yet picked up by an isr probe
+static avr_cycle_count_t edgeCycle;
+static int edgePending = 0;
+static uint32_t edgesUnmatched = 0;
+
+// arduino pin number to ioport irq
+static avr_irq_t *pinIrq(const int pin) {
+  char port;
+  int bit;
+
+  if (pin >= 0 && pin <= 7) {
+    port = 'D';
+    bit = pin;
+  } else if (pin >= 8 && pin <= 13) {
+    port = 'B';
+    bit = pin - 8;
+  } else if (pin >= 14 && pin <= 19) {
+    port = 'C';
+    bit = pin - 14;
+  } else {
+    fprintf(stderr, "simbench: bad pin %d\n", pin);
+    exit(2);
+  }
+
+  return avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ(port), bit);
+}
+
+static int edgeExpired(void) {
+  return avr->cycle - edgeCycle > avr_usec_to_cycles(avr, EDGE_TIMEOUT_US);
+}
+
+static void injectEdge(avr_irq_t *irq, const uint8_t level) {
+  // the previous one never got an isr
+  if (edgePending) {
+    edgesUnmatched++;
+  }
+  edgeCycle = avr->cycle;
+  edgePending = 1;
+  avr_raise_irq(irq, level);
+}
+
+static void probeWrite(avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param) {
+  uint8_t old = avr->data[addr];
+  uint8_t changed = old ^ v;
+  avr->data[addr] = v;
+
+  for (int i = 0; i < PROBE_COUNT; i++) {
+    if (!(changed & (1 << i))) {
+      continue;
+    }
+    probe_t *p = &probes[i];
+
+    if (v & (1 << i)) {
+      p->start = avr->cycle;
+
+      if ((i == PROBE_ISR_1 || i == PROBE_ISR_2) && edgePending && edgeExpired()) {
+        edgePending = 0;
+        edgesUnmatched++;
+      }
+      if ((i == PROBE_ISR_1 || i == PROBE_ISR_2) && edgePending) {
+        avr_cycle_count_t latency = avr->cycle - edgeCycle;
+        edgePending = 0;
+        if (p->latencyCount == 0 || latency < p->latencyMin) {
+          p->latencyMin = latency;
+        }
+        if (latency > p->latencyMax) {
+          p->latencyMax = latency;
+        }
+        p->latencyCount++;
+      }
+    } else {
+      avr_cycle_count_t elapsed = avr->cycle - p->start;
+      if (p->count == 0 || elapsed < p->min) {
+        p->min = elapsed;
+      }
+      if (elapsed > p->max) {
+        p->max = elapsed;
+      }
+      p->total += elapsed;
+      p->count++;
+    }
+  }
+}
+
+// rc pulse edges, high for the pulse width then low until the next frame
+static avr_cycle_count_t rcEdge(avr_t *avr, avr_cycle_count_t when, void *param) {
+  rcChannel_t *chn = param;
+  uint16_t width = chn->width ? chn->width : 1000 + chn->sweep;
+
+  chn->level = !chn->level;
+  injectEdge(chn->irq, chn->level);
+
+  if (chn->level) {
+    return when + avr_usec_to_cycles(avr, width);
+  }
+
+  if (!chn->width) {
+    chn->sweep = (chn->sweep + 10) % 1010;
+  }
+  return when + avr_usec_to_cycles(avr, 20000 - width);
+}
+
+static avr_cycle_count_t echoEnd(avr_t *avr, avr_cycle_count_t when, void *param) {
+  injectEdge(echoIrq, 0);
+  return 0;
+}
+
+static avr_cycle_count_t echoStart(avr_t *avr, avr_cycle_count_t when, void *param) {
+  injectEdge(echoIrq, 1);
+  avr_cycle_timer_register_usec(avr, echoWidth, echoEnd, NULL);
+  return 0;
+}
+
+// sensor answers the end of the trigger pulse after ~450us
+static void triggerChanged(avr_irq_t *irq, uint32_t value, void *param) {
+  if (value == 0) {
+    avr_cycle_timer_register_usec(avr, 450, echoStart, NULL);
+  }
+}
+
+static void printJson(const char *firmware) {
+  printf("{\"firmware\": \"%s\", \"mcu\": \"%s\", \"frequency\": %d, \"cycles\": %llu, \"probes\": [",
+         firmware, MCU, FREQUENCY, (unsigned long long)avr->cycle);
+
+  int first = 1;
+  for (int i = 0; i < PROBE_COUNT; i++) {
+    probe_t *p = &probes[i];
+    if (p->count == 0) {
+      continue;
+    }
+
+    printf("%s\n  {\"id\": %d, \"name\": \"%s\", \"count\": %u, \"min\": %llu, \"avg\": %llu, \"max\": %llu",
+           first ? "" : ",", i, probeNames[i], p->count,
+           (unsigned long long)p->min, (unsigned long long)(p->total / p->count), (unsigned long long)p->max);
+    if (p->latencyCount) {
+      printf(", \"latency_min\": %llu, \"latency_max\": %llu",
+             (unsigned long long)p->latencyMin, (unsigned long long)p->latencyMax);
+    }
+    printf("}");
+    first = 0;
+  }
+
+  if (edgePending && edgeExpired()) {
+    edgesUnmatched++;
+  }
+  printf("\n], \"edges_unmatched\": %u, \"worst_loop_us\": %.1f}\n", edgesUnmatched,
+         probes[0].count ? probes[0].max * 1e6 / FREQUENCY : 0.0);
+}
+
+static void usage(void) {
+  fprintf(stderr, "usage: simbench [-s seconds] [-r pin[:us]]... [-e trigger:echo:us] firmware.elf\n");
+  exit(2);
+}
+
+int main(int argc, char *argv[]) {
+  int seconds = 5;
+  int rcPins[RC_MAX], rcWidths[RC_MAX];
+  int trigPin = -1, echoPin = -1;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "s:r:e:")) != -1) {
+    switch (opt) {
+      case 's':
+        seconds = atoi(optarg);
+        break;
+      case 'r':
+        if (rcCount == RC_MAX) {
+          usage();
+        }
+        rcWidths[rcCount] = 0;
+        if (sscanf(optarg, "%d:%d", &rcPins[rcCount], &rcWidths[rcCount]) < 1) {
+          usage();
+        }
+        rcCount++;
+        break;
+      case 'e': {
+        int width;
+        if (sscanf(optarg, "%d:%d:%d", &trigPin, &echoPin, &width) != 3) {
+          usage();
+        }
+        echoWidth = width;
+        break;
+      }
+      default:
+        usage();
+    }
+  }
+  if (optind != argc - 1) {
+    usage();
+  }
+  const char *firmware = argv[optind];
+
+  elf_firmware_t f;
+  memset(&f, 0, sizeof(f));
+  if (elf_read_firmware(firmware, &f) != 0) {
+    fprintf(stderr, "simbench: can't read %s\n", firmware);
+    return 1;
+  }
+
+  avr = avr_make_mcu_by_name(MCU);
+  if (!avr) {
+    fprintf(stderr, "simbench: no %s core in simavr\n", MCU);
+    return 1;
+  }
+  avr_init(avr);
+  avr_load_firmware(avr, &f);
+  avr->frequency = FREQUENCY;
+
+  avr_register_io_write(avr, GPIOR0_ADDR, probeWrite, NULL);
+
+  // stagger channels like a receiver sending them one after the other
+  for (int i = 0; i < rcCount; i++) {
+    rcChannels[i].irq = pinIrq(rcPins[i]);
+    rcChannels[i].width = rcWidths[i];
+    avr_raise_irq(rcChannels[i].irq, 0);
+    avr_cycle_timer_register_usec(avr, 100000 + i * 2500, rcEdge, &rcChannels[i]);
+  }
+
+  if (echoPin >= 0) {
+    echoIrq = pinIrq(echoPin);
+    avr_raise_irq(echoIrq, 0);
+    avr_irq_register_notify(pinIrq(trigPin), triggerChanged, NULL);
+  }
+
+  avr_cycle_count_t end = (avr_cycle_count_t)seconds * FREQUENCY;
+  int state = cpu_Running;
+  while (avr->cycle < end && state != cpu_Done && state != cpu_Crashed) {
+    state = avr_run(avr);
+  }
+  if (state == cpu_Crashed) {
+    fprintf(stderr, "simbench: %s crashed at pc 0x%04x\n", firmware, avr->pc);
+    return 1;
+  }
+
+  printJson(firmware);
+  return 0;
+}
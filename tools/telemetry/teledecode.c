@@ -0,0 +1,316 @@
+// Decodes a serial capture of lib/Telemetry records to csv.
+//
+// Frames are split on 0 bytes, COBS decoded and crc checked, anything else
+// on the line (boot messages) just fails the check and is skipped. Records
+// missing from the seq count are reported on stderr, text records (robo2
+// DEBUG stats) are written out there as they come.
+//
+// Flight recorder images (lib/Recorder, read out by sending 'r' to the
+// robo) are put back together from their chunks and, with -r, written as
+// a csv timeline of the recorded samples.
+//
+// Proximity sonar maps (SONAR_SCAN) go, with -s, one row per sweep pass
+// with the range of every bin.
+//
+// Build:
+//   cc -O2 -o teledecode teledecode.c
+//
+// Usage:
+//   stty -F /dev/ttyUSB0 115200 raw && cat /dev/ttyUSB0 > capture.bin
+//   teledecode [-r recorder.csv] [-s scan.csv] capture.bin > robo.csv    (or from stdin)
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TELEMETRY_ROBO 1
+#define TELEMETRY_ROBO_SIZE 16
+
+#define TELEMETRY_RECORDER 2
+#define TELEMETRY_RECORDER_CHUNK 32
+
+#define TELEMETRY_SCAN 3
+#define TELEMETRY_SCAN_BINS 32
+
+#define TELEMETRY_TEXT 4
+
+// lib/Recorder image
+#define RECORDER_MAGIC 0xb1
+#define RECORDER_VERSION 1
+#define RECORDER_HEADER_SIZE 21
+#define RECORDER_STR_DELTA 0x01
+#define RECORDER_STR_FULL 0x02
+#define RECORDER_THR_DELTA 0x04
+#define RECORDER_THR_FULL 0x08
+#define RECORDER_MOTORS 0x10
+#define RECORDER_BITS 0x20
+#define RECORDER_REPEAT 0x80
+
+#define FRAME_MAX 256
+
+static unsigned long frames = 0;
+static unsigned long badFrames = 0;
+static unsigned long missing = 0;
+
+static FILE *recorderOut = NULL;
+static uint8_t image[65536];
+static uint32_t imageFilled = 0;
+static unsigned long images = 0;
+
+static FILE *scanOut = NULL;
+static unsigned long scans = 0;
+
+// same as crc8Update() in Telemetry.h
+static uint8_t crc8(const uint8_t *data, size_t len) {
+  uint8_t crc = 0;
+  for (size_t i = 0; i < len; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+  }
+  return crc;
+}
+
+// returns decoded length, 0 if malformed
+static size_t cobsDecode(const uint8_t *in, size_t len, uint8_t *out) {
+  size_t i = 0, o = 0;
+
+  while (i < len) {
+    uint8_t code = in[i++];
+    if (code == 0 || i + code - 1 > len) {
+      return 0;
+    }
+    for (uint8_t k = 1; k < code; k++) {
+      out[o++] = in[i++];
+    }
+    if (code != 0xff && i < len) {
+      out[o++] = 0;
+    }
+  }
+
+  return o;
+}
+
+static uint16_t le16(const uint8_t *p) {
+  return p[0] | (p[1] << 8);
+}
+
+static uint32_t le32(const uint8_t *p) {
+  return p[0] | (p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void printRobo(uint8_t seq, const uint8_t *p) {
+  printf("%u,%lu,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+         seq, (unsigned long)le32(p), le16(p + 4), le16(p + 6),
+         p[8], p[9], p[10], p[11],
+         p[12] & 1, (p[12] >> 1) & 1, (p[12] >> 2) & 1, (p[12] >> 3) & 1,
+         p[13], le16(p + 14));
+}
+
+static void printScan(uint8_t seq, const uint8_t *p) {
+  // bin centre angles, 0xff (no echo) left empty
+  fprintf(scanOut, "%u,%lu,%u,", seq, (unsigned long)le32(p), le16(p + 4));
+  if (p[6] == 0xff) {
+    fprintf(scanOut, ",,");
+  } else {
+    fprintf(scanOut, "%u,%u,", (2 * p[6] + 1) * 90 / TELEMETRY_SCAN_BINS, p[7]);
+  }
+  for (int i = 0; i < TELEMETRY_SCAN_BINS; i++) {
+    if (p[8 + i] != 0xff) {
+      fprintf(scanOut, "%u", p[8 + i]);
+    }
+    fputc(i + 1 < TELEMETRY_SCAN_BINS ? ',' : '\n', scanOut);
+  }
+  scans++;
+}
+
+typedef struct {
+  uint16_t str, thr;
+  uint8_t motor[4];
+  uint8_t bits;
+} sample_t;
+
+static void printSample(uint32_t ts, const sample_t *s) {
+  fprintf(recorderOut, "%lu,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u,%u\n",
+          (unsigned long)ts, s->str, s->thr, s->motor[0], s->motor[1], s->motor[2], s->motor[3],
+          s->bits & 1, (s->bits >> 1) & 1, (s->bits >> 2) & 1, (s->bits >> 3) & 1, s->bits >> 4);
+}
+
+// replays the records from the base sample, same encoding as Recorder.h
+static void decodeImage(const uint8_t *img, uint32_t size) {
+  if (size < RECORDER_HEADER_SIZE || img[0] != RECORDER_MAGIC || img[1] != RECORDER_VERSION) {
+    fprintf(stderr, "teledecode: bad recorder image\n");
+    return;
+  }
+
+  uint16_t period = le16(img + 2);
+  uint16_t samples = le16(img + 4);
+  uint16_t length = le16(img + 6);
+  uint32_t endTs = le32(img + 8);
+  const uint8_t *p = img + 12;
+  sample_t s = {le16(p), le16(p + 2), {p[4], p[5], p[6], p[7]}, p[8]};
+
+  if (RECORDER_HEADER_SIZE + (uint32_t)length > size) {
+    fprintf(stderr, "teledecode: short recorder image\n");
+    return;
+  }
+
+  images++;
+  fprintf(recorderOut, "# image %lu, %u samples every %ums\n", images, samples, period);
+  fprintf(recorderOut, "ts,str,thr,motor1a,motor1b,motor2a,motor2b,prox_fr,prox_fl,prox_rr,prox_rl,signal\n");
+
+  uint32_t ts = endTs - (uint32_t)(samples - 1) * period;
+  printSample(ts, &s);
+
+  const uint8_t *rec = img + RECORDER_HEADER_SIZE;
+  const uint8_t *end = rec + length;
+  while (rec < end) {
+    uint8_t flags = *rec++;
+
+    if (flags & RECORDER_REPEAT) {
+      for (int i = 0; i < (flags & 0x7f); i++) {
+        ts += period;
+        printSample(ts, &s);
+      }
+      continue;
+    }
+
+    if (flags & RECORDER_STR_DELTA) {
+      s.str += (int8_t)*rec++;
+    } else if (flags & RECORDER_STR_FULL) {
+      s.str = le16(rec);
+      rec += 2;
+    }
+    if (flags & RECORDER_THR_DELTA) {
+      s.thr += (int8_t)*rec++;
+    } else if (flags & RECORDER_THR_FULL) {
+      s.thr = le16(rec);
+      rec += 2;
+    }
+    if (flags & RECORDER_MOTORS) {
+      memcpy(s.motor, rec, 4);
+      rec += 4;
+    }
+    if (flags & RECORDER_BITS) {
+      s.bits = *rec++;
+    }
+
+    ts += period;
+    printSample(ts, &s);
+  }
+}
+
+// chunks come in order, a new image starts at offset 0
+static void handleRecorderChunk(const uint8_t *p) {
+  uint16_t offset = le16(p);
+  uint16_t size = le16(p + 2);
+
+  if (offset == 0) {
+    imageFilled = 0;
+  }
+  if (offset != imageFilled) {
+    // a chunk went missing, wait for the next image
+    return;
+  }
+
+  uint16_t count = size - offset < TELEMETRY_RECORDER_CHUNK ? size - offset : TELEMETRY_RECORDER_CHUNK;
+  memcpy(image + offset, p + 4, count);
+  imageFilled += count;
+
+  if (imageFilled == size && recorderOut) {
+    decodeImage(image, size);
+  }
+}
+
+static void handleFrame(const uint8_t *frame, size_t len) {
+  static int haveSeq = 0;
+  static uint8_t lastSeq;
+  uint8_t data[FRAME_MAX];
+
+  if (len == 0) {
+    return;
+  }
+
+  size_t n = cobsDecode(frame, len, data);
+  // type, seq, crc at least
+  if (n < 3 || crc8(data, n - 1) != data[n - 1]) {
+    badFrames++;
+    return;
+  }
+  frames++;
+
+  uint8_t type = data[0];
+  uint8_t seq = data[1];
+  if (haveSeq) {
+    missing += (uint8_t)(seq - lastSeq - 1);
+  }
+  haveSeq = 1;
+  lastSeq = seq;
+
+  if (type == TELEMETRY_ROBO && n - 3 == TELEMETRY_ROBO_SIZE) {
+    printRobo(seq, data + 2);
+  } else if (type == TELEMETRY_RECORDER && n - 3 == 4 + TELEMETRY_RECORDER_CHUNK) {
+    handleRecorderChunk(data + 2);
+  } else if (type == TELEMETRY_SCAN && n - 3 == 8 + TELEMETRY_SCAN_BINS) {
+    if (scanOut) {
+      printScan(seq, data + 2);
+    }
+  } else if (type == TELEMETRY_TEXT) {
+    fwrite(data + 2, 1, n - 3, stderr);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  FILE *in = stdin;
+  uint8_t frame[FRAME_MAX];
+  size_t len = 0;
+  int c;
+
+  while ((c = getopt(argc, argv, "r:s:")) != -1) {
+    FILE **out = c == 'r' ? &recorderOut : (c == 's' ? &scanOut : NULL);
+    if (!out) {
+      fprintf(stderr, "usage: teledecode [-r recorder.csv] [-s scan.csv] [capture]\n");
+      return 2;
+    }
+    if (!(*out = fopen(optarg, "w"))) {
+      perror(optarg);
+      return 1;
+    }
+  }
+  if (argc - optind > 1) {
+    fprintf(stderr, "usage: teledecode [-r recorder.csv] [-s scan.csv] [capture]\n");
+    return 2;
+  }
+  if (argc - optind == 1 && !(in = fopen(argv[optind], "rb"))) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  if (scanOut) {
+    fprintf(scanOut, "seq,ts,pass_ms,nearest_deg,nearest_cm");
+    for (int i = 0; i < TELEMETRY_SCAN_BINS; i++) {
+      fprintf(scanOut, ",cm_%u", (2 * i + 1) * 90 / TELEMETRY_SCAN_BINS);
+    }
+    fputc('\n', scanOut);
+  }
+
+  printf("seq,ts,str,thr,motor1a,motor1b,motor2a,motor2b,prox_fr,prox_fl,prox_rr,prox_rl,signal,loop_time\n");
+
+  while ((c = fgetc(in)) != EOF) {
+    if (c == 0) {
+      handleFrame(frame, len);
+      len = 0;
+    } else if (len < sizeof(frame)) {
+      frame[len++] = c;
+    } else {
+      // too long for a record, drop until the next delimiter
+      len = sizeof(frame);
+    }
+  }
+
+  fprintf(stderr, "teledecode: %lu records, %lu bad frames, %lu missing, %lu recorder images, %lu scans\n",
+          frames, badFrames, missing, images, scans);
+  return 0;
+}